@@ -0,0 +1,78 @@
+/*
+ * cyccnt.h
+ *
+ * description:
+ *   cycle counter for benchmarks.
+ *   target: DWT CYCCNT, counts core clock cycles, wraps at 2^32
+ *           (25 s at 168 MHz)
+ *   host:   time stamp counter on x86, nanoseconds elsewhere.
+ *           the TSC runs at a fixed rate, not at the core clock,
+ *           so host numbers only compare with each other
+ *
+ *   measure short sections only, take differences as uint32_t:
+ *     uint32_t t0 = cyccnt_read();
+ *     ...
+ *     uint32_t cycles = cyccnt_read() - t0;
+ */
+
+#ifndef __CYCCNT_H
+#define __CYCCNT_H
+
+#include <stdint.h>
+
+#ifdef HOST_BUILD
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+#define CYCCNT_UNIT "TSC ticks"
+
+static inline void cyccnt_init(void)
+{
+}
+
+static inline uint32_t cyccnt_read(void)
+{
+	return (uint32_t)__rdtsc();
+}
+
+#else
+#include <time.h>
+
+#define CYCCNT_UNIT "ns"
+
+static inline void cyccnt_init(void)
+{
+}
+
+static inline uint32_t cyccnt_read(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+#endif
+
+#else
+
+#include "stm32f4xx.h"
+
+#define CYCCNT_UNIT "cycles"
+
+static inline void cyccnt_init(void)
+{
+	// trace enable - TRCENA bit 24 on DEMCR
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	// counter enable - CYCCNTENA bit 0 on DWT_CTRL
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cyccnt_read(void)
+{
+	return DWT->CYCCNT;
+}
+
+#endif
+
+#endif
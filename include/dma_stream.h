@@ -0,0 +1,62 @@
+/*
+ * dma_stream.h
+ *
+ * description:
+ *   helpers for a DMA stream given by its register block (DMA1_Stream3,
+ *   DMA2_Stream0 ...), shared by the drivers that take a stream as a
+ *   parameter.
+ *
+ *   the controller and the stream number follow from the address:
+ *   the streams start at offset 0x10 of their controller and are 0x18
+ *   apart. the event flags of stream n are 6 bits (FEIF, DMEIF, TEIF,
+ *   HTIF, TCIF, bit 1 unused) in LISR/LIFCR for streams 0-3 and in
+ *   HISR/HIFCR for streams 4-7, at DMA_STREAM_SHIFT(n).
+ *
+ * usage:
+ *   DMA_TypeDef *dma = dma_stream_dma(DMA2_Stream0);
+ *   uint8_t n = dma_stream_number(DMA2_Stream0);
+ *   if (dma_stream_flags(dma, n) & DMA_STREAM_TCIF)
+ *     dma_stream_clear(dma, n, DMA_STREAM_TCIF);
+ */
+
+#ifndef __DMA_STREAM_H
+#define __DMA_STREAM_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#define DMA_STREAM_FLAGS     0x3Du       /* all flags of a stream   */
+#define DMA_STREAM_TCIF      (1u << 5)
+#define DMA_STREAM_HTIF      (1u << 4)
+#define DMA_STREAM_TEIF      (1u << 3)
+
+/* flag bit position of stream n in LISR/HISR (LIFCR/HIFCR), 0 6 16 22 */
+#define DMA_STREAM_SHIFT(n)  ((uint32_t)(((n) & 1) * 6 + ((n) & 2) * 8))
+
+static inline uint8_t dma_stream_number(const DMA_Stream_TypeDef *s)
+{
+	return (uint8_t)((((uintptr_t)s & 0xFF) - 0x10) / 0x18);
+}
+
+static inline DMA_TypeDef *dma_stream_dma(const DMA_Stream_TypeDef *s)
+{
+	return (DMA_TypeDef *)((uintptr_t)s & ~(uintptr_t)0xFF);
+}
+
+/* event flags of stream n, shifted down to bits 5:0 */
+static inline uint32_t dma_stream_flags(const DMA_TypeDef *dma, uint8_t n)
+{
+	uint32_t isr = (n < 4) ? dma->LISR : dma->HISR;
+	return (isr >> DMA_STREAM_SHIFT(n)) & DMA_STREAM_FLAGS;
+}
+
+/* clear flags (bits 5:0, DMA_STREAM_x) of stream n */
+static inline void dma_stream_clear(DMA_TypeDef *dma, uint8_t n, uint32_t flags)
+{
+	if (n < 4)
+		dma->LIFCR = flags << DMA_STREAM_SHIFT(n);
+	else
+		dma->HIFCR = flags << DMA_STREAM_SHIFT(n);
+}
+
+#endif
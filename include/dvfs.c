@@ -0,0 +1,288 @@
+/*
+ * dvfs.c
+ *
+ * description:
+ *   frequency governor with peripheral re-timing, see dvfs.h
+ */
+
+#include "dvfs.h"
+#include "system_stm32f4xx.h"
+#include "cyccnt.h"
+#include "idle.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#if defined (STM32F429xx)
+#define APB1_MAX      45000000
+#else
+#define APB1_MAX      42000000
+#endif
+#define APB2_MAX      (2 * APB1_MAX)
+
+// CFGR fields: SW bits 1:0, HPRE 7:4, PPRE1 12:10, PPRE2 15:13
+#define SW_MASK       (0x3U << 0)
+#define HPRE_MASK     (0xFU << 4)
+#define PPRE1_MASK    (0x7U << 10)
+#define PPRE2_MASK    (0x7U << 13)
+#define DIV_MASK      (HPRE_MASK | PPRE1_MASK | PPRE2_MASK)
+
+typedef struct {
+	uint32_t cfgr;               // SW and the prescalers
+	uint32_t latency;            // flash wait states
+	dvfs_clocks_t clk;
+} level_t;
+
+/*************************************************
+* variables
+*************************************************/
+dvfs_stats_t dvfs_stats;
+
+static level_t levels[DVFS_NLEVELS];
+static volatile uint32_t cur;
+
+static dvfs_hook_t hooks[DVFS_MAX_HOOKS];
+static uint32_t nhooks;
+
+static uint32_t up_x100, down_x100;
+static uint64_t last_asleep, last_total;
+
+/*************************************************
+* helpers
+*************************************************/
+// the smallest APB divider that keeps the bus within max, as field
+static uint32_t apb(uint32_t hclk, uint32_t max, uint32_t *pclk, uint32_t *timclk)
+{
+	uint32_t field = 0, div = 1;
+
+	while (hclk / div > max) {
+		div *= 2;
+		field = field ? field + 1 : 4;
+	}
+	*pclk = hclk / div;
+	// timers run at twice the bus clock when the bus is divided
+	*timclk = div == 1 ? *pclk : *pclk * 2;
+	return field;
+}
+
+// sw: 0 HSI, 2 PLL. half: AHB /2 (HPRE 0b1000)
+static void make_level(level_t *l, uint32_t sysclk, uint32_t sw, uint32_t half)
+{
+	uint32_t hpre = half ? 0x8 : 0x0;
+	uint32_t hclk = half ? sysclk / 2 : sysclk;
+	uint32_t p1, p2;
+
+	l->clk.hclk = hclk;
+	p1 = apb(hclk, APB1_MAX, &l->clk.pclk1, &l->clk.timclk1);
+	p2 = apb(hclk, APB2_MAX, &l->clk.pclk2, &l->clk.timclk2);
+	l->cfgr = sw | (hpre << 4) | (p1 << 10) | (p2 << 13);
+	// one wait state per 30 MHz at 2.7 - 3.6 V
+	l->latency = (hclk - 1) / 30000000;
+}
+
+static void set_latency(uint32_t ws)
+{
+	FLASH->ACR = (FLASH->ACR & ~0x7U) | ws;
+	// the new latency has to be in effect before the clock changes
+	while ((FLASH->ACR & 0x7U) != ws);
+}
+
+// per field the larger divider of a and b, the field values grow
+//   with the divider (0 is /1)
+static uint32_t larger_div(uint32_t a, uint32_t b)
+{
+	static const uint32_t masks[3] = { HPRE_MASK, PPRE1_MASK, PPRE2_MASK };
+	uint32_t i, r = 0;
+
+	for (i = 0; i < 3; i++)
+		r |= (a & masks[i]) > (b & masks[i]) ? (a & masks[i]) : (b & masks[i]);
+	return r;
+}
+
+/*************************************************
+* api
+*************************************************/
+/*
+ * after set_sysclk_to_168, with the PLL as the system clock. starts
+ * at DVFS_HIGH. up and down: governor thresholds, busy percent
+ */
+void dvfs_init(uint32_t up, uint32_t down)
+{
+	uint32_t pll = get_sysclk();
+
+	make_level(&levels[DVFS_LOW], HSI_VALUE, 0x0, 0);
+	make_level(&levels[DVFS_MID], pll, 0x2, 1);
+	make_level(&levels[DVFS_HIGH], pll, 0x2, 0);
+
+	// DVFS_HIGH with the prescalers of the table
+	RCC->CFGR = (RCC->CFGR & ~DIV_MASK) | (levels[DVFS_HIGH].cfgr & DIV_MASK);
+	cur = DVFS_HIGH;
+
+	nhooks = 0;
+	up_x100 = up * 100;
+	down_x100 = down * 100;
+	dvfs_stats_reset();
+}
+
+/*
+ * hook(now, before) after every switch, with interrupts masked.
+ * returns 0 when there is no room
+ */
+int dvfs_add_hook(dvfs_hook_t hook)
+{
+	if (nhooks == DVFS_MAX_HOOKS)
+		return 0;
+	hooks[nhooks++] = hook;
+	return 1;
+}
+
+/*
+ * switch to level and re-time, from thread or interrupt context
+ */
+void dvfs_set(uint32_t level)
+{
+	const level_t *to, *from;
+	uint32_t primask, t0, i, sw;
+
+	if (level >= DVFS_NLEVELS)
+		return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (level == cur) {
+		__set_PRIMASK(primask);
+		return;
+	}
+	t0 = cyccnt_read();
+	from = &levels[cur];
+	to = &levels[level];
+
+	// more wait states before the clock goes up (ACR: bits 2:0)
+	if (to->latency > from->latency)
+		set_latency(to->latency);
+
+	// the larger dividers of both levels, then the switch, then the
+	//   dividers of the new level. no bus goes over its limit and the
+	//   core over the wait states on the way
+	RCC->CFGR = (RCC->CFGR & ~DIV_MASK) | larger_div(from->cfgr, to->cfgr);
+	sw = to->cfgr & SW_MASK;
+	RCC->CFGR = (RCC->CFGR & ~SW_MASK) | sw;
+	// wait for the switch status (CFGR: bits 3:2)
+	while (((RCC->CFGR >> 2) & 0x3) != sw);
+	RCC->CFGR = (RCC->CFGR & ~DIV_MASK) | (to->cfgr & DIV_MASK);
+
+	// fewer wait states once the clock is down
+	if (to->latency < from->latency)
+		set_latency(to->latency);
+
+	cur = level;
+	for (i = 0; i < nhooks; i++)
+		hooks[i](&to->clk, &from->clk);
+
+	dvfs_stats.switches++;
+	dvfs_stats.switch_last = cyccnt_read() - t0;
+	if (dvfs_stats.switch_last > dvfs_stats.switch_max)
+		dvfs_stats.switch_max = dvfs_stats.switch_last;
+
+	__set_PRIMASK(primask);
+}
+
+/*
+ * to DVFS_HIGH now, for the interrupt that brings work
+ */
+void dvfs_boost(void)
+{
+	if (cur == DVFS_HIGH)
+		return;
+	dvfs_stats.boosts++;
+	dvfs_set(DVFS_HIGH);
+}
+
+uint32_t dvfs_level(void)
+{
+	return cur;
+}
+
+const dvfs_clocks_t *dvfs_clocks(void)
+{
+	return &levels[cur].clk;
+}
+
+/*
+ * end of a load window, from the main loop. the load is the time not
+ * asleep in idle_once since the last call. returns the level
+ */
+uint32_t dvfs_govern(void)
+{
+	uint64_t asleep, total;
+	uint32_t busy;
+
+	// idle_stats_reset in between, start over
+	if (idle_stats.total < last_total) {
+		last_total = 0;
+		last_asleep = 0;
+	}
+	asleep = idle_stats.asleep - last_asleep;
+	total = idle_stats.total - last_total;
+	last_asleep = idle_stats.asleep;
+	last_total = idle_stats.total;
+	if (total == 0)
+		return cur;
+
+	busy = 10000 - (uint32_t)((asleep * 10000) / total);
+	dvfs_stats.busy_x100 = busy;
+	dvfs_stats.windows[cur]++;
+
+	if (busy >= up_x100)
+		dvfs_set(DVFS_HIGH);
+	else if (busy < down_x100 && cur > DVFS_LOW)
+		dvfs_set(cur - 1);
+	return cur;
+}
+
+void dvfs_stats_reset(void)
+{
+	uint32_t i;
+
+	dvfs_stats.switches = 0;
+	dvfs_stats.boosts = 0;
+	dvfs_stats.switch_last = 0;
+	dvfs_stats.switch_max = 0;
+	dvfs_stats.busy_x100 = 0;
+	for (i = 0; i < DVFS_NLEVELS; i++)
+		dvfs_stats.windows[i] = 0;
+	last_asleep = idle_stats.asleep;
+	last_total = idle_stats.total;
+}
+
+/*************************************************
+* re-timing helpers for hooks
+*************************************************/
+/*
+ * BRR for baud from the bus clock, 16x oversampling (OVER8 = 0).
+ * USARTDIV in 1/16 steps is pclk / baud, rounded
+ */
+uint32_t dvfs_uart_brr(uint32_t pclk, uint32_t baud)
+{
+	return (pclk + baud / 2) / baud;
+}
+
+/*
+ * timer counting at hz from timclk, at once. PSC is preloaded and
+ * only taken at an update event, which would be the next overflow of
+ * a free running counter. UG forces the update with URS set so there
+ * is no update interrupt, and the count is put back: a free running
+ * timer used as a clock loses the ticks of these few instructions
+ */
+void dvfs_tim_retime(TIM_TypeDef *tim, uint32_t timclk, uint32_t hz)
+{
+	uint32_t cr1 = tim->CR1;
+	uint32_t cnt = tim->CNT;
+
+	tim->PSC = timclk / hz - 1;
+	// URS (CR1: bit 2) then UG (EGR: bit 0), the update clears CNT
+	tim->CR1 = cr1 | (1 << 2);
+	tim->EGR = (1 << 0);
+	tim->CNT = cnt;
+	tim->CR1 = cr1;
+}
@@ -0,0 +1,111 @@
+/*
+ * dvfs.h
+ *
+ * description:
+ *   frequency governor: runs the core fast while there is work and
+ *   slow while the main loop sleeps, and re-times the peripherals on
+ *   every switch.
+ *
+ *   three levels, from the PLL that set_sysclk_to_168 started:
+ *     DVFS_LOW   HSI, 16 MHz
+ *     DVFS_MID   PLL with the AHB prescaler at /2 (84 MHz on F407)
+ *     DVFS_HIGH  PLL, 168 MHz (84 on F401, 180 on F429)
+ *   the PLL keeps running at every level, so a switch is a write to
+ *   CFGR and a wait for SWS, a few cycles. going up to DVFS_HIGH
+ *   takes microseconds, hooks included. no PLL lock, no regulator
+ *   change. the price is the PLL current at DVFS_LOW.
+ *   the APB prescalers are picked per level for the fastest bus
+ *   within the limits, PCLK1 and PCLK2 stay the same at DVFS_MID.
+ *
+ *   a switch is one operation with interrupts masked:
+ *     flash wait states up (going faster), APB prescalers that
+ *     divide more, the clock switch, APB prescalers that divide
+ *     less, wait states down (going slower), then every hook.
+ *   a hook gets the new and the old clocks and reprograms what
+ *   depends on them: USART BRR (dvfs_uart_brr), timer prescalers
+ *   (dvfs_tim_retime), SysTick LOAD. no interrupt sees a clock with
+ *   half of its peripherals re-timed. keep hooks short, they add
+ *   to the switch time.
+ *
+ *   the governor measures the load from idle_stats (include/idle.c):
+ *   call dvfs_govern() once per window (e.g. 100 ms) from the main
+ *   loop. busy = 100 % - time asleep over the window.
+ *     busy >= up     straight to DVFS_HIGH
+ *     busy <  down   one level down
+ *   dvfs_boost() goes to DVFS_HIGH from an interrupt that brings work,
+ *   the work then does not wait for the next window.
+ *
+ *   the time asleep needs an idle clock that keeps its rate: a timer
+ *   re-timed by a hook (dvfs_tim_retime), not the DWT cycle counter.
+ *   DWT CYCCNT and include/timebase.c count core cycles and change
+ *   their rate with every switch.
+ *
+ *   get_hclk(), get_pclk1() and get_pclk2() in system_stm32f4xx.c read
+ *   the clocks back from RCC at any time.
+ *
+ * usage:
+ *   set_sysclk_to_168();
+ *   dvfs_init(50, 10);                        // up at 50 %, down below 10 %
+ *   dvfs_add_hook(uart_retime);
+ *   idle_init(tim5_now, IDLE_WFI);
+ *   every 100 ms from the main loop:
+ *       dvfs_govern();
+ *   in the interrupt handler that brings work:
+ *       dvfs_boost();
+ */
+
+#ifndef __DVFS_H
+#define __DVFS_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define DVFS_LOW         0
+#define DVFS_MID         1
+#define DVFS_HIGH        2
+#define DVFS_NLEVELS     3
+
+#define DVFS_MAX_HOOKS   8
+
+typedef struct {
+	uint32_t hclk;               /* core, AHB, SysTick                   */
+	uint32_t pclk1;              /* APB1: USART2-5, I2C, SPI2/3          */
+	uint32_t pclk2;              /* APB2: USART1/6, SPI1, ADC            */
+	uint32_t timclk1;            /* TIM2-7, 12-14: PCLK1, x2 if divided  */
+	uint32_t timclk2;            /* TIM1, 8-11: PCLK2, x2 if divided     */
+} dvfs_clocks_t;
+
+typedef void (*dvfs_hook_t)(const dvfs_clocks_t *now, const dvfs_clocks_t *before);
+
+typedef struct {
+	uint32_t switches;
+	uint32_t boosts;             /* dvfs_boost calls that switched       */
+	uint32_t switch_last;        /* core cycles of the last switch,      */
+	uint32_t switch_max;         /*   hooks included (DWT, if enabled)   */
+	uint32_t busy_x100;          /* last window, percent times 100       */
+	uint32_t windows[DVFS_NLEVELS]; /* windows ended at each level       */
+} dvfs_stats_t;
+
+extern dvfs_stats_t dvfs_stats;
+
+void     dvfs_init(uint32_t up, uint32_t down);
+int      dvfs_add_hook(dvfs_hook_t hook);
+void     dvfs_set(uint32_t level);
+void     dvfs_boost(void);
+uint32_t dvfs_level(void);
+const dvfs_clocks_t *dvfs_clocks(void);
+uint32_t dvfs_govern(void);
+void     dvfs_stats_reset(void);
+
+uint32_t dvfs_uart_brr(uint32_t pclk, uint32_t baud);
+void     dvfs_tim_retime(TIM_TypeDef *tim, uint32_t timclk, uint32_t hz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * fast_trig.c
+ *
+ * description:
+ *   sine and cosine kernels, see fast_trig.h
+ */
+
+#include "fast_trig.h"
+
+/*************************************************
+* definitions
+*************************************************/
+// pi/2 in three parts, the first two have few enough bits that
+//   q * part is exact for |q| < 2^15
+#define PIO2_1     1.5703125f
+#define PIO2_2     4.837512969970703125e-4f
+#define PIO2_3     7.549790126404332e-8f
+#define TWO_OVER_PI  0.636619772f
+
+// cordic gain 1/prod(sqrt(1 + 2^-2i)) in Q30
+#define CORDIC_K_Q30  652032874
+
+/*************************************************
+* tables
+*************************************************/
+// one period of sin(2 pi i / TRIG_LUT_N) and the first entry again
+static const float lut[TRIG_LUT_N + 1] = {
+	 0.000000000f,  0.024541229f,  0.049067676f,  0.073564567f,  0.098017141f,  0.122410677f,
+	 0.146730468f,  0.170961887f,  0.195090324f,  0.219101235f,  0.242980182f,  0.266712755f,
+	 0.290284663f,  0.313681751f,  0.336889863f,  0.359895051f,  0.382683426f,  0.405241311f,
+	 0.427555084f,  0.449611336f,  0.471396744f,  0.492898196f,  0.514102757f,  0.534997642f,
+	 0.555570245f,  0.575808167f,  0.595699310f,  0.615231574f,  0.634393275f,  0.653172851f,
+	 0.671558976f,  0.689540565f,  0.707106769f,  0.724247098f,  0.740951121f,  0.757208824f,
+	 0.773010433f,  0.788346410f,  0.803207517f,  0.817584813f,  0.831469595f,  0.844853580f,
+	 0.857728601f,  0.870086968f,  0.881921291f,  0.893224299f,  0.903989315f,  0.914209783f,
+	 0.923879504f,  0.932992816f,  0.941544056f,  0.949528158f,  0.956940353f,  0.963776052f,
+	 0.970031261f,  0.975702107f,  0.980785251f,  0.985277653f,  0.989176512f,  0.992479563f,
+	 0.995184720f,  0.997290432f,  0.998795450f,  0.999698818f,  1.000000000f,  0.999698818f,
+	 0.998795450f,  0.997290432f,  0.995184720f,  0.992479563f,  0.989176512f,  0.985277653f,
+	 0.980785251f,  0.975702107f,  0.970031261f,  0.963776052f,  0.956940353f,  0.949528158f,
+	 0.941544056f,  0.932992816f,  0.923879504f,  0.914209783f,  0.903989315f,  0.893224299f,
+	 0.881921291f,  0.870086968f,  0.857728601f,  0.844853580f,  0.831469595f,  0.817584813f,
+	 0.803207517f,  0.788346410f,  0.773010433f,  0.757208824f,  0.740951121f,  0.724247098f,
+	 0.707106769f,  0.689540565f,  0.671558976f,  0.653172851f,  0.634393275f,  0.615231574f,
+	 0.595699310f,  0.575808167f,  0.555570245f,  0.534997642f,  0.514102757f,  0.492898196f,
+	 0.471396744f,  0.449611336f,  0.427555084f,  0.405241311f,  0.382683426f,  0.359895051f,
+	 0.336889863f,  0.313681751f,  0.290284663f,  0.266712755f,  0.242980182f,  0.219101235f,
+	 0.195090324f,  0.170961887f,  0.146730468f,  0.122410677f,  0.098017141f,  0.073564567f,
+	 0.049067676f,  0.024541229f,  0.000000000f, -0.024541229f, -0.049067676f, -0.073564567f,
+	-0.098017141f, -0.122410677f, -0.146730468f, -0.170961887f, -0.195090324f, -0.219101235f,
+	-0.242980182f, -0.266712755f, -0.290284663f, -0.313681751f, -0.336889863f, -0.359895051f,
+	-0.382683426f, -0.405241311f, -0.427555084f, -0.449611336f, -0.471396744f, -0.492898196f,
+	-0.514102757f, -0.534997642f, -0.555570245f, -0.575808167f, -0.595699310f, -0.615231574f,
+	-0.634393275f, -0.653172851f, -0.671558976f, -0.689540565f, -0.707106769f, -0.724247098f,
+	-0.740951121f, -0.757208824f, -0.773010433f, -0.788346410f, -0.803207517f, -0.817584813f,
+	-0.831469595f, -0.844853580f, -0.857728601f, -0.870086968f, -0.881921291f, -0.893224299f,
+	-0.903989315f, -0.914209783f, -0.923879504f, -0.932992816f, -0.941544056f, -0.949528158f,
+	-0.956940353f, -0.963776052f, -0.970031261f, -0.975702107f, -0.980785251f, -0.985277653f,
+	-0.989176512f, -0.992479563f, -0.995184720f, -0.997290432f, -0.998795450f, -0.999698818f,
+	-1.000000000f, -0.999698818f, -0.998795450f, -0.997290432f, -0.995184720f, -0.992479563f,
+	-0.989176512f, -0.985277653f, -0.980785251f, -0.975702107f, -0.970031261f, -0.963776052f,
+	-0.956940353f, -0.949528158f, -0.941544056f, -0.932992816f, -0.923879504f, -0.914209783f,
+	-0.903989315f, -0.893224299f, -0.881921291f, -0.870086968f, -0.857728601f, -0.844853580f,
+	-0.831469595f, -0.817584813f, -0.803207517f, -0.788346410f, -0.773010433f, -0.757208824f,
+	-0.740951121f, -0.724247098f, -0.707106769f, -0.689540565f, -0.671558976f, -0.653172851f,
+	-0.634393275f, -0.615231574f, -0.595699310f, -0.575808167f, -0.555570245f, -0.534997642f,
+	-0.514102757f, -0.492898196f, -0.471396744f, -0.449611336f, -0.427555084f, -0.405241311f,
+	-0.382683426f, -0.359895051f, -0.336889863f, -0.313681751f, -0.290284663f, -0.266712755f,
+	-0.242980182f, -0.219101235f, -0.195090324f, -0.170961887f, -0.146730468f, -0.122410677f,
+	-0.098017141f, -0.073564567f, -0.049067676f, -0.024541229f,  0.000000000f
+};
+
+// atan(2^-i), 2^31 = pi
+static const int32_t cordic_atan[TRIG_CORDIC_ITER] = {
+	536870912, 316933406, 167458907, 85004756, 42667331, 21354465,
+	10679838, 5340245, 2670163, 1335087, 667544, 333772,
+	166886, 83443, 41722, 20861, 10430, 5215,
+	2608, 1304, 652, 326, 163, 81,
+	41, 20, 10, 5, 3, 1
+};
+
+/*************************************************
+* table and linear interpolation
+*************************************************/
+// x in table steps, wrapped to one period
+static float lut_at(float p)
+{
+	int32_t i = (int32_t)p;
+	float f;
+
+	// floor, the cast rounds towards zero
+	if (p < (float)i)
+		i--;
+	f = p - (float)i;
+	i &= TRIG_LUT_N - 1;
+
+	return lut[i] + f * (lut[i + 1] - lut[i]);
+}
+
+float trig_sin_lut(float x)
+{
+	return lut_at(x * (TRIG_LUT_N / TRIG_2PI));
+}
+
+float trig_cos_lut(float x)
+{
+	return lut_at(x * (TRIG_LUT_N / TRIG_2PI) + (TRIG_LUT_N / 4));
+}
+
+/*************************************************
+* polynomial
+*************************************************/
+// minimax polynomials on -pi/4 .. pi/4 (Cephes sinf/cosf)
+static float poly_sin(float r)
+{
+	float r2 = r * r;
+	return r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+}
+
+static float poly_cos(float r)
+{
+	float r2 = r * r;
+	return 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568e-2f + r2 * (-1.388731625e-3f + r2 * 2.443315712e-5f));
+}
+
+// x = q pi/2 + r, |r| <= pi/4
+static int32_t reduce(float x, float *r)
+{
+	float t = x * TWO_OVER_PI;
+	int32_t q = (int32_t)(t >= 0 ? t + 0.5f : t - 0.5f);
+	float fq = (float)q;
+
+	*r = ((x - fq * PIO2_1) - fq * PIO2_2) - fq * PIO2_3;
+	return q;
+}
+
+void trig_sincos_poly(float x, float *s, float *c)
+{
+	float r, ps, pc;
+	int32_t q = reduce(x, &r);
+
+	ps = poly_sin(r);
+	pc = poly_cos(r);
+
+	switch (q & 3) {
+	case 0: *s =  ps; *c =  pc; break;
+	case 1: *s =  pc; *c = -ps; break;
+	case 2: *s = -ps; *c = -pc; break;
+	default: *s = -pc; *c =  ps; break;
+	}
+}
+
+float trig_sin_poly(float x)
+{
+	float r;
+	int32_t q = reduce(x, &r);
+	float v = (q & 1) ? poly_cos(r) : poly_sin(r);
+
+	return (q & 2) ? -v : v;
+}
+
+float trig_cos_poly(float x)
+{
+	float r;
+	int32_t q = reduce(x, &r);
+	float v = (q & 1) ? poly_sin(r) : poly_cos(r);
+
+	return ((q + 1) & 2) ? -v : v;
+}
+
+/*************************************************
+* Q31 cordic
+*************************************************/
+static int32_t sat_q30_to_q31(int32_t v)
+{
+	if (v >= (1 << 30))
+		return 0x7FFFFFFF;
+	if (v < -(1 << 30))
+		return (int32_t)0x80000000;
+	return (int32_t)((uint32_t)v << 1);
+}
+
+void trig_sincos_q31(q31_t angle, q31_t *s, q31_t *c)
+{
+	int32_t x = CORDIC_K_Q30;
+	int32_t y = 0;
+	int32_t z = angle;
+	int32_t neg = 0;
+	int32_t i;
+
+	// rotations only converge within +-pi/2, turn half a period
+	//   and negate the result for the rest
+	if (z > (1 << 30) || z < -(1 << 30)) {
+		z = (int32_t)((uint32_t)z + 0x80000000u);
+		neg = 1;
+	}
+
+	for (i = 0; i < TRIG_CORDIC_ITER; i++) {
+		int32_t xs = x >> i;
+		int32_t ys = y >> i;
+
+		if (z >= 0) {
+			x -= ys;
+			y += xs;
+			z -= cordic_atan[i];
+		} else {
+			x += ys;
+			y -= xs;
+			z += cordic_atan[i];
+		}
+	}
+
+	if (neg) {
+		x = -x;
+		y = -y;
+	}
+	*s = sat_q30_to_q31(y);
+	*c = sat_q30_to_q31(x);
+}
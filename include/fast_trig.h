@@ -0,0 +1,61 @@
+/*
+ * fast_trig.h
+ *
+ * description:
+ *   sine and cosine without libm. the Cortex-M4 FPU only does single
+ *   precision, sin() on a double goes through the soft-float library
+ *   and takes thousands of cycles. three kernels, pick by accuracy
+ *   and by the number format of the caller:
+ *
+ *   trig_sin_lut / trig_cos_lut
+ *     256 entry float table (1 KB flash) with linear interpolation.
+ *     max error 7.6e-5 (about 13 bits)
+ *
+ *   trig_sin_poly / trig_cos_poly / trig_sincos_poly
+ *     reduction to -pi/4 .. pi/4 with a three part pi/2, then minimax
+ *     polynomials of degree 7 (sin) and 8 (cos) on the FPU.
+ *     max error 1.2e-7, about one float ulp near 1.0
+ *
+ *   trig_sincos_q31
+ *     fixed point CORDIC, 30 rotations of shifts and adds, no FPU and
+ *     no multiplier. the angle is Q31 with 2^31 = pi, so the int32
+ *     range is one period and wraps on its own (a phase accumulator
+ *     can be passed as is). results in Q31.
+ *     max error 2.0e-8 (about 26 bits), rounding of the Q30 steps
+ *
+ *   the float errors hold for |x| <= 8 pi, larger arguments slowly
+ *   lose accuracy in the reduction. the figures are measured by
+ *   projects/trig_bench against double precision sin() and cos().
+ *
+ * usage:
+ *   float s = trig_sin_poly(theta);
+ *   trig_sincos_q31(phase, &s31, &c31);
+ */
+
+#ifndef __FAST_TRIG_H
+#define __FAST_TRIG_H
+
+#include <stdint.h>
+
+typedef int32_t q31_t;
+
+#define TRIG_PI            3.14159265f
+#define TRIG_2PI           6.28318531f
+
+/* table size, a power of two */
+#define TRIG_LUT_N         256
+#define TRIG_CORDIC_ITER   30
+
+/* radians to the cordic angle format, |x| < pi */
+#define TRIG_RAD_TO_Q31(x) ((q31_t)((x) * (2147483648.0f / TRIG_PI)))
+
+float trig_sin_lut(float x);
+float trig_cos_lut(float x);
+
+float trig_sin_poly(float x);
+float trig_cos_poly(float x);
+void  trig_sincos_poly(float x, float *s, float *c);
+
+void  trig_sincos_q31(q31_t angle, q31_t *s, q31_t *c);
+
+#endif
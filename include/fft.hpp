@@ -0,0 +1,381 @@
+/*
+ * fft.hpp
+ *
+ * description:
+ *   in-place complex FFT, float32, Q31 and Q15, for N = 2^k points
+ *   (4 .. 4096). header only, C++14.
+ *
+ *   decimation in time: the input is put in bit reversed order, then
+ *   a radix-2 stage when k is odd and radix-4 stages for the rest.
+ *   a radix-4 stage does the work of two radix-2 stages with 3 instead
+ *   of 4 twiddle multiplies per 4 points and half the passes over the
+ *   buffer.
+ *
+ *   twiddle tables (3N/4 entries, e^-j2pi i/N) are built at compile
+ *   time by constexpr functions and placed in flash, one per type and
+ *   size that is used. nothing is computed at start up.
+ *
+ *   scaling:
+ *     float  no scaling, the plain DFT
+ *     Q31    every stage divides by its radix, the result is DFT / N.
+ *     Q15    the same, with the halving SIMD adds. inputs need a
+ *            magnitude |x| <= 1.0, always true for real data.
+ *
+ *   on Cortex-M4 the Q15 butterflies work on packed (re, im) pairs
+ *   with the DSP instructions: SHADD16/SHSUB16 for the halving sums,
+ *   SHASX/SHSAX for the +-j rotations, SMUSD/SMUADX for the complex
+ *   multiply. host builds (HOST_BUILD) run the same integer steps in
+ *   portable C++, both give the same bits.
+ *
+ *   memory layout:
+ *     re and im are interleaved, one complex value is a single 32-bit
+ *     (Q15) or 64-bit (LDRD) access. the stage loops keep the twiddle
+ *     index outer, so each twiddle is read from flash once per stage
+ *     and the butterflies walk the buffer with a fixed stride.
+ *     the work buffer is best in CCM (0x10000000, 64 KB): zero wait
+ *     states on the D-bus and no DMA traffic to share the bus with.
+ *     buffers that DMA fills (ADC, SPI) have to stay in SRAM1/SRAM2,
+ *     keep them 8 byte aligned.
+ *
+ * usage:
+ *   static fft::cf32 buf[256];
+ *   fft::forward<256>(buf);
+ *   static fft::cq15 pkt[64];                // fft::q15_pack(re, im)
+ *   fft::forward<64>(pkt);
+ */
+
+#ifndef __FFT_HPP
+#define __FFT_HPP
+
+#include <stdint.h>
+
+#ifndef HOST_BUILD
+#include "stm32f4xx.h"
+#endif
+
+namespace fft {
+
+struct cf32 {
+	float re, im;
+};
+
+struct cq31 {
+	int32_t re, im;
+};
+
+// Q15 pair packed in a word, re in the low half
+typedef uint32_t cq15;
+
+constexpr cq15 q15_pack(int16_t re, int16_t im)
+{
+	return (uint32_t)(uint16_t)re | ((uint32_t)(uint16_t)im << 16);
+}
+
+constexpr int16_t q15_re(cq15 x) { return (int16_t)(x & 0xFFFF); }
+constexpr int16_t q15_im(cq15 x) { return (int16_t)(x >> 16); }
+
+/*************************************************
+* compile time twiddles
+*************************************************/
+namespace detail {
+
+constexpr double pi = 3.14159265358979323846;
+
+// sin and cos of 2 pi i / n, Taylor series after reduction to +-pi/4
+constexpr double taylor_sin(double x)
+{
+	double term = x, sum = x;
+	for (int n = 1; n < 10; n++) {
+		term = -term * x * x / (double)((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double taylor_cos(double x)
+{
+	double term = 1.0, sum = 1.0;
+	for (int n = 1; n < 10; n++) {
+		term = -term * x * x / (double)((2 * n - 1) * (2 * n));
+		sum += term;
+	}
+	return sum;
+}
+
+// octant symmetry keeps the argument small, the values exact to ~1e-17
+constexpr double sin_turn(uint32_t i, uint32_t n)
+{
+	uint32_t q = (uint32_t)((8 * (uint64_t)i + n) / (2 * n)) & 3;  // nearest quarter
+	double r = 2.0 * pi * ((double)i / n - 0.25 * (double)((8 * (uint64_t)i + n) / (2 * n)));
+	return (q == 0) ? taylor_sin(r) : (q == 1) ? taylor_cos(r) :
+	       (q == 2) ? -taylor_sin(r) : -taylor_cos(r);
+}
+
+constexpr double cos_turn(uint32_t i, uint32_t n)
+{
+	return sin_turn(i + n / 4, n);
+}
+
+constexpr int32_t round_q(double v, double scale)
+{
+	return (int32_t)((v >= 0) ? v * scale + 0.5 : v * scale - 0.5);
+}
+
+template <class T, uint32_t N>
+struct table {
+	T w[3 * N / 4];
+};
+
+template <class T> struct make;
+
+template <> struct make<cf32> {
+	static constexpr cf32 at(uint32_t i, uint32_t n)
+	{
+		return cf32{ (float)cos_turn(i, n), (float)-sin_turn(i, n) };
+	}
+};
+
+template <> struct make<cq31> {
+	static constexpr cq31 at(uint32_t i, uint32_t n)
+	{
+		return cq31{ round_q(cos_turn(i, n), 2147483647.0),
+		             round_q(-sin_turn(i, n), 2147483647.0) };
+	}
+};
+
+template <> struct make<cq15> {
+	static constexpr cq15 at(uint32_t i, uint32_t n)
+	{
+		return q15_pack((int16_t)round_q(cos_turn(i, n), 32767.0),
+		                (int16_t)round_q(-sin_turn(i, n), 32767.0));
+	}
+};
+
+template <class T, uint32_t N>
+constexpr table<T, N> make_table()
+{
+	table<T, N> t{};
+	for (uint32_t i = 0; i < 3 * N / 4; i++)
+		t.w[i] = make<T>::at(i, N);
+	return t;
+}
+
+template <class T, uint32_t N>
+struct twiddles {
+	static constexpr table<T, N> value = make_table<T, N>();
+};
+
+template <class T, uint32_t N>
+constexpr table<T, N> twiddles<T, N>::value;
+
+constexpr unsigned log2u(uint32_t n) { return (n <= 1) ? 0 : 1 + log2u(n >> 1); }
+
+/*************************************************
+* butterflies
+*************************************************/
+// x * w, DIT radix-4 on a, b, c, d in place:
+//   X0 = a + b + c + d      X1 = a - jb - c + jd
+//   X2 = a - b + c - d      X3 = a + jb - c - jd
+// b, c, d have their twiddles applied already
+
+struct ops_f32 {
+	typedef cf32 type;
+
+	static inline cf32 mul(cf32 x, cf32 w)
+	{
+		return cf32{ x.re * w.re - x.im * w.im, x.re * w.im + x.im * w.re };
+	}
+
+	static inline void bfly2(cf32 &a, cf32 &b)
+	{
+		cf32 t = a;
+		a = cf32{ t.re + b.re, t.im + b.im };
+		b = cf32{ t.re - b.re, t.im - b.im };
+	}
+
+	static inline void bfly4(cf32 &a, cf32 &b, cf32 &c, cf32 &d)
+	{
+		cf32 t0 = { a.re + c.re, a.im + c.im };
+		cf32 t1 = { a.re - c.re, a.im - c.im };
+		cf32 t2 = { b.re + d.re, b.im + d.im };
+		cf32 t3 = { b.re - d.re, b.im - d.im };
+
+		a = cf32{ t0.re + t2.re, t0.im + t2.im };
+		c = cf32{ t0.re - t2.re, t0.im - t2.im };
+		// X1 = t1 - j t3, X3 = t1 + j t3
+		b = cf32{ t1.re + t3.im, t1.im - t3.re };
+		d = cf32{ t1.re - t3.im, t1.im + t3.re };
+	}
+};
+
+struct ops_q31 {
+	typedef cq31 type;
+
+	static inline cq31 mul(cq31 x, cq31 w)
+	{
+		return cq31{
+			(int32_t)(((int64_t)x.re * w.re - (int64_t)x.im * w.im) >> 31),
+			(int32_t)(((int64_t)x.re * w.im + (int64_t)x.im * w.re) >> 31) };
+	}
+
+	static inline void bfly2(cq31 &a, cq31 &b)
+	{
+		cq31 t = { a.re >> 1, a.im >> 1 };
+		cq31 u = { b.re >> 1, b.im >> 1 };
+		a = cq31{ t.re + u.re, t.im + u.im };
+		b = cq31{ t.re - u.re, t.im - u.im };
+	}
+
+	// every input / 4 first, the sums of quarters stay in range
+	static inline void bfly4(cq31 &a, cq31 &b, cq31 &c, cq31 &d)
+	{
+		cq31 qa = { a.re >> 2, a.im >> 2 }, qb = { b.re >> 2, b.im >> 2 };
+		cq31 qc = { c.re >> 2, c.im >> 2 }, qd = { d.re >> 2, d.im >> 2 };
+		cq31 t0 = { qa.re + qc.re, qa.im + qc.im };
+		cq31 t1 = { qa.re - qc.re, qa.im - qc.im };
+		cq31 t2 = { qb.re + qd.re, qb.im + qd.im };
+		cq31 t3 = { qb.re - qd.re, qb.im - qd.im };
+
+		a = cq31{ t0.re + t2.re, t0.im + t2.im };
+		c = cq31{ t0.re - t2.re, t0.im - t2.im };
+		b = cq31{ t1.re + t3.im, t1.im - t3.re };
+		d = cq31{ t1.re - t3.im, t1.im + t3.re };
+	}
+};
+
+#ifdef HOST_BUILD
+// the Cortex-M4 SIMD instructions used below, lane by lane
+static inline int32_t lo(uint32_t x) { return (int16_t)(x & 0xFFFF); }
+static inline int32_t hi(uint32_t x) { return (int16_t)(x >> 16); }
+
+static inline uint32_t pack(int32_t l, int32_t h)
+{
+	return ((uint32_t)l & 0xFFFF) | ((uint32_t)h << 16);
+}
+
+static inline uint32_t shadd16(uint32_t x, uint32_t y) { return pack((lo(x) + lo(y)) >> 1, (hi(x) + hi(y)) >> 1); }
+static inline uint32_t shsub16(uint32_t x, uint32_t y) { return pack((lo(x) - lo(y)) >> 1, (hi(x) - hi(y)) >> 1); }
+static inline uint32_t shasx(uint32_t x, uint32_t y) { return pack((lo(x) - hi(y)) >> 1, (hi(x) + lo(y)) >> 1); }
+static inline uint32_t shsax(uint32_t x, uint32_t y) { return pack((lo(x) + hi(y)) >> 1, (hi(x) - lo(y)) >> 1); }
+static inline int32_t smusd(uint32_t x, uint32_t y) { return lo(x) * lo(y) - hi(x) * hi(y); }
+static inline int32_t smuadx(uint32_t x, uint32_t y) { return lo(x) * hi(y) + hi(x) * lo(y); }
+static inline uint32_t pkhbt16(int32_t l, int32_t h) { return pack(l, h); }
+#else
+static inline uint32_t shadd16(uint32_t x, uint32_t y) { return __SHADD16(x, y); }
+static inline uint32_t shsub16(uint32_t x, uint32_t y) { return __SHSUB16(x, y); }
+static inline uint32_t shasx(uint32_t x, uint32_t y) { return __SHASX(x, y); }
+static inline uint32_t shsax(uint32_t x, uint32_t y) { return __SHSAX(x, y); }
+static inline int32_t smusd(uint32_t x, uint32_t y) { return (int32_t)__SMUSD(x, y); }
+static inline int32_t smuadx(uint32_t x, uint32_t y) { return (int32_t)__SMUADX(x, y); }
+static inline uint32_t pkhbt16(int32_t l, int32_t h) { return __PKHBT((uint32_t)l, (uint32_t)h, 16); }
+#endif
+
+struct ops_q15 {
+	typedef cq15 type;
+
+	// SMUSD gives re, SMUADX gives im, both Q30
+	static inline cq15 mul(cq15 x, cq15 w)
+	{
+		return pkhbt16(smusd(x, w) >> 15, smuadx(x, w) >> 15);
+	}
+
+	static inline void bfly2(cq15 &a, cq15 &b)
+	{
+		cq15 t = a;
+		a = shadd16(t, b);
+		b = shsub16(t, b);
+	}
+
+	// each halving step divides by 2, the stage by 4
+	static inline void bfly4(cq15 &a, cq15 &b, cq15 &c, cq15 &d)
+	{
+		cq15 t0 = shadd16(a, c);
+		cq15 t1 = shsub16(a, c);
+		cq15 t2 = shadd16(b, d);
+		cq15 t3 = shsub16(b, d);
+
+		a = shadd16(t0, t2);
+		c = shsub16(t0, t2);
+		// X1 = t1 - j t3, X3 = t1 + j t3
+		b = shsax(t1, t3);
+		d = shasx(t1, t3);
+	}
+};
+
+template <class T> struct ops;
+template <> struct ops<cf32> : ops_f32 {};
+template <> struct ops<cq31> : ops_q31 {};
+template <> struct ops<cq15> : ops_q15 {};
+
+template <uint32_t N, class T>
+inline void bit_reverse(T *x)
+{
+	uint32_t j = 0;
+
+	for (uint32_t i = 0; i < N - 1; i++) {
+		if (i < j) {
+			T t = x[i];
+			x[i] = x[j];
+			x[j] = t;
+		}
+		// add one to j from the top bit down
+		uint32_t m = N >> 1;
+		while (j & m) {
+			j ^= m;
+			m >>= 1;
+		}
+		j |= m;
+	}
+}
+
+} // namespace detail
+
+/*************************************************
+* transform
+*************************************************/
+template <uint32_t N, class T>
+void forward(T *x)
+{
+	typedef detail::ops<T> op;
+	static_assert(N >= 4 && N <= 4096 && !(N & (N - 1)), "N must be a power of two, 4 .. 4096");
+	const T *tw = detail::twiddles<T, N>::value.w;
+	uint32_t len = 1;
+
+	detail::bit_reverse<N>(x);
+
+	if (detail::log2u(N) & 1) {
+		for (uint32_t i = 0; i < N; i += 2)
+			op::bfly2(x[i], x[i + 1]);
+		len = 2;
+	}
+
+	// combine four DFTs of len points into one of 4 len. in bit reversed
+	//   order the quarters hold the inputs with index 0, 2, 1, 3 mod 4
+	for (; len < N; len *= 4) {
+		const uint32_t stride = N / (4 * len);
+
+		for (uint32_t k = 0; k < len; k++) {
+			const T w1 = tw[k * stride];
+			const T w2 = tw[2 * k * stride];
+			const T w3 = tw[3 * k * stride];
+
+			for (uint32_t base = k; base < N; base += 4 * len) {
+				T *p = x + base;
+				T a = p[0];
+				T b = op::mul(p[2 * len], w1);
+				T c = op::mul(p[len], w2);
+				T d = op::mul(p[3 * len], w3);
+
+				op::bfly4(a, b, c, d);
+				p[0] = a;
+				p[len] = b;
+				p[2 * len] = c;
+				p[3 * len] = d;
+			}
+		}
+	}
+}
+
+} // namespace fft
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * idle.c
+ *
+ * description:
+ *   event driven main loop with sleep statistics, see idle.h
+ */
+
+#include "idle.h"
+#include "stm32f4xx.h"
+
+/*************************************************
+* variables
+*************************************************/
+idle_stats_t idle_stats;
+
+typedef struct {
+	idle_fn_t fn;
+	void *arg;
+} idle_call_t;
+
+static idle_call_t queue[IDLE_QUEUE];
+static volatile uint32_t q_head;   // next to run
+static volatile uint32_t q_tail;   // next free
+
+static idle_poll_t polls[IDLE_MAX_POLL];
+static idle_pending_t pendings[IDLE_MAX_POLL];
+static uint32_t npolls;
+
+static idle_clock_t clk;
+static uint32_t clk_last;
+static uint8_t use_wfe;
+
+/*************************************************
+* helpers
+*************************************************/
+// elapsed clock ticks into the total, returns the clock
+static uint32_t account(void)
+{
+	uint32_t now;
+
+	if (clk == 0)
+		return 0;
+	now = clk();
+	idle_stats.total += (uint32_t)(now - clk_last);
+	clk_last = now;
+	return now;
+}
+
+static uint32_t run_queue(void)
+{
+	uint32_t n = 0;
+
+	// only the main loop moves the head, the slot is read before
+	//   it is handed back to idle_post
+	while (q_head != q_tail) {
+		idle_call_t c = queue[q_head % IDLE_QUEUE];
+		q_head++;
+		c.fn(c.arg);
+		n++;
+	}
+	return n;
+}
+
+// anything to do, called with interrupts masked
+static int pending(void)
+{
+	uint32_t i;
+
+	if (q_head != q_tail)
+		return 1;
+	for (i = 0; i < npolls; i++)
+		if (pendings[i] && pendings[i]())
+			return 1;
+	return 0;
+}
+
+// done(arg) is checked again with interrupts masked, so a wait does
+//   not sleep through the interrupt that ended it
+static void sleep_once(idle_done_t done, void *arg)
+{
+	uint32_t t0, t1, vec;
+
+	__disable_irq();
+	if (pending() || (done && done(arg))) {
+		__enable_irq();
+		return;
+	}
+
+	t0 = account();
+	__DSB();
+	if (use_wfe)
+		__WFE();
+	else
+		__WFI();
+	t1 = account();
+
+	// who woke us, still pending - VECTPENDING bits 20:12 on ICSR
+	vec = (SCB->ICSR >> 12) & 0x1FF;
+	if (vec >= IDLE_NVEC)
+		vec = 0;
+	idle_stats.wakes[vec]++;
+	idle_stats.sleeps++;
+	idle_stats.asleep += (uint32_t)(t1 - t0);
+
+	__enable_irq();
+}
+
+/*************************************************
+* api
+*************************************************/
+
+/*
+ * clock: free running counter for the time asleep, 0 for none.
+ * mode: IDLE_WFI or IDLE_WFE
+ */
+void idle_init(idle_clock_t c, uint8_t mode)
+{
+	clk = c;
+	q_head = 0;
+	q_tail = 0;
+	npolls = 0;
+	use_wfe = mode;
+
+	// SEVONPEND bit 4 on SCR, wake WFE on any pending interrupt
+	if (mode == IDLE_WFE)
+		SCB->SCR |= (1 << 4);
+	else
+		SCB->SCR &= ~(1U << 4);
+	// plain sleep, not deep sleep - SLEEPDEEP bit 2 on SCR
+	SCB->SCR &= ~(1U << 2);
+
+	idle_stats_reset();
+}
+
+/*
+ * queue fn(arg) for the main loop, from interrupt or thread context.
+ * returns 0 when the queue is full
+ */
+int idle_post(idle_fn_t fn, void *arg)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (q_tail - q_head >= IDLE_QUEUE) {
+		idle_stats.dropped++;
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	queue[q_tail % IDLE_QUEUE].fn = fn;
+	queue[q_tail % IDLE_QUEUE].arg = arg;
+	q_tail++;
+
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+/*
+ * poll returns the amount of work it did, pending tells if it has
+ * some without doing it (interrupts are masked then). pending may be
+ * 0, the poller then only runs when something else woke the core
+ */
+int idle_add_poll(idle_poll_t poll, idle_pending_t pend)
+{
+	if (npolls == IDLE_MAX_POLL)
+		return 0;
+	polls[npolls] = poll;
+	pendings[npolls] = pend;
+	npolls++;
+	return 1;
+}
+
+static uint32_t pass(idle_done_t done, void *arg)
+{
+	uint32_t n = run_queue();
+	uint32_t i;
+
+	for (i = 0; i < npolls; i++)
+		n += polls[i]();
+
+	if (n)
+		idle_stats.work += n;
+	else
+		sleep_once(done, arg);
+	account();
+	return n;
+}
+
+/*
+ * one pass of the main loop: run the work there is, sleep when there
+ * was none. returns the work done
+ */
+uint32_t idle_once(void)
+{
+	return pass(0, 0);
+}
+
+/*
+ * keep the main loop going, asleep in between, until done(arg).
+ * not for interrupt context
+ */
+void idle_wait(idle_done_t done, void *arg)
+{
+	while (!done(arg))
+		pass(done, arg);
+}
+
+void idle_stats_reset(void)
+{
+	uint32_t i;
+
+	idle_stats.sleeps = 0;
+	idle_stats.work = 0;
+	idle_stats.dropped = 0;
+	idle_stats.asleep = 0;
+	idle_stats.total = 0;
+	for (i = 0; i < IDLE_NVEC; i++)
+		idle_stats.wakes[i] = 0;
+	if (clk)
+		clk_last = clk();
+}
+
+/*
+ * percent of the time asleep times 100 (9950 is 99.50 %)
+ */
+uint32_t idle_asleep_x100(void)
+{
+	account();
+	if (idle_stats.total == 0)
+		return 0;
+	return (uint32_t)((idle_stats.asleep * 10000) / idle_stats.total);
+}
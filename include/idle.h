@@ -0,0 +1,94 @@
+/*
+ * idle.h
+ *
+ * description:
+ *   event driven main loop that sleeps when there is nothing to do.
+ *
+ *   work reaches the main loop two ways:
+ *     - idle_post(fn, arg) from an interrupt handler (or anywhere),
+ *       a small queue of calls run in order by the main loop
+ *     - pollers added with idle_add_poll, e.g. swtimer_poll with
+ *       swtimer_pending, asked every pass
+ *
+ *   idle_once() runs the queue and the pollers. when neither had
+ *   anything it masks interrupts, checks once more and sleeps with
+ *   WFI (or WFE). a pending interrupt wakes the core even with
+ *   PRIMASK set, so work posted between the check and the sleep is
+ *   never slept through. before interrupts are unmasked again
+ *   VECTPENDING in SCB_ICSR names the exception that woke the core,
+ *   counted in idle_stats.wakes[] by exception number (IRQn + 16).
+ *
+ *   idle_wait(done, arg) sleeps in the same loop until done(arg) is
+ *   true, delays built on it sleep instead of spinning as long as an
+ *   interrupt comes when the wait is over (SysTick, a timer compare).
+ *
+ *   time asleep is taken from a free running counter given to
+ *   idle_init, a timer that keeps running in sleep mode (TIM2/TIM5,
+ *   swtimer_now). the DWT cycle counter is no good here: it stops
+ *   with the core clock unless DBG_SLEEP keeps HCLK on, which costs
+ *   the power the sleep is meant to save. without a clock only the
+ *   sleep and wakeup counts are kept.
+ *
+ *   IDLE_WFE sets SEVONPEND, so also interrupts that are disabled in
+ *   the NVIC wake the core as events. WFE returns right away when the
+ *   event register was set (by SEV, or an earlier interrupt), such
+ *   wakeups count as wakes[0].
+ *
+ * usage:
+ *   idle_init(swtimer_now, IDLE_WFI);
+ *   idle_add_poll(swtimer_poll, swtimer_pending);
+ *   while(1)
+ *       idle_once();
+ *   ...
+ *   in an interrupt handler:
+ *   idle_post(handle_rx, &rx_buf);
+ */
+
+#ifndef __IDLE_H
+#define __IDLE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define IDLE_QUEUE       16
+#define IDLE_MAX_POLL    4
+/* exception numbers, 16 core + 82 interrupts on STM32F407 */
+#define IDLE_NVEC        98
+
+/* sleep instruction */
+#define IDLE_WFI         0
+#define IDLE_WFE         1
+
+typedef void (*idle_fn_t)(void *arg);
+typedef uint32_t (*idle_clock_t)(void);
+typedef uint32_t (*idle_poll_t)(void);
+typedef int (*idle_pending_t)(void);
+typedef int (*idle_done_t)(void *arg);
+
+typedef struct {
+	uint32_t sleeps;             /* WFI/WFE executed                     */
+	uint32_t work;               /* posted calls and poller work run     */
+	uint32_t dropped;            /* idle_post with a full queue          */
+	uint64_t asleep;             /* clock ticks spent in WFI/WFE         */
+	uint64_t total;              /* clock ticks since idle_stats_reset   */
+	uint32_t wakes[IDLE_NVEC];   /* by exception number, 0: event        */
+} idle_stats_t;
+
+extern idle_stats_t idle_stats;
+
+void     idle_init(idle_clock_t clock, uint8_t mode);
+int      idle_post(idle_fn_t fn, void *arg);
+int      idle_add_poll(idle_poll_t poll, idle_pending_t pending);
+uint32_t idle_once(void);
+void     idle_wait(idle_done_t done, void *arg);
+void     idle_stats_reset(void);
+uint32_t idle_asleep_x100(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * memwatch.c
+ *
+ * description:
+ *   stack and heap high-water marks from a paint pattern, see
+ *   memwatch.h
+ */
+
+#include "memwatch.h"
+#include "stm32f4xx.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define SCAN_STACK    0
+#define SCAN_HEAP     1
+
+// from the linker script
+extern uint32_t __end__, __HeapLimit, __StackTop;
+
+/*************************************************
+* variables
+*************************************************/
+mem_stats_t mem_stats;
+
+static uint32_t *stack_lo;           // stack bottom, above the guard
+static uint32_t *stack_mark;         // lowest word written so far
+static uint32_t *heap_mark;          // above the highest word written
+static uint32_t *cursor;
+static uint32_t scan;
+
+static uint32_t limit;
+static mem_alarm_t alarm;
+
+/*************************************************
+* helpers
+*************************************************/
+static uint32_t bytes(const uint32_t *lo, const uint32_t *hi)
+{
+	return (uint32_t)(hi - lo) * 4;
+}
+
+/*************************************************
+* api
+*************************************************/
+/*
+ * paint the heap and the main stack below the caller. interrupts are
+ * masked, they would stack right where the paint goes. before
+ * mem_guard, the guard can not be written
+ */
+void mem_paint(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t *p, *sp;
+
+	__disable_irq();
+	for (p = &__end__; p < &__HeapLimit; p++)
+		*p = MEM_PAINT;
+	sp = (uint32_t *)__get_MSP();
+	for (p = &__HeapLimit; p < sp; p++)
+		*p = MEM_PAINT;
+	__set_PRIMASK(primask);
+}
+
+/*
+ * marks back to nothing used, after mem_paint
+ */
+void mem_init(void)
+{
+	stack_lo = &__HeapLimit;
+	stack_mark = &__StackTop;
+	heap_mark = &__end__;
+
+	mem_stats.stack_size = bytes(stack_lo, &__StackTop);
+	mem_stats.stack_used = 0;
+	mem_stats.heap_size = bytes(&__end__, &__HeapLimit);
+	mem_stats.heap_used = 0;
+	mem_stats.passes = 0;
+	mem_stats.guard = 0;
+
+	scan = SCAN_STACK;
+	cursor = stack_lo;
+}
+
+/*
+ * up to MEM_CHUNK words of the scan. returns 0, for the idle loop this
+ * is no work and the core still sleeps
+ */
+uint32_t mem_step(void)
+{
+	uint32_t n = MEM_CHUNK;
+
+	if (scan == SCAN_STACK) {
+		// up from the bottom to the first word that is not paint
+		while (n-- && cursor < stack_mark) {
+			if (*cursor != MEM_PAINT) {
+				stack_mark = cursor;
+				break;
+			}
+			cursor++;
+		}
+		if (cursor < stack_mark)
+			return 0;
+
+		mem_stats.stack_used = bytes(stack_mark, &__StackTop);
+		if (alarm && bytes(stack_lo, stack_mark) < limit) {
+			mem_alarm_t a = alarm;
+
+			alarm = 0;
+			a(bytes(stack_lo, stack_mark));
+		}
+		scan = SCAN_HEAP;
+		cursor = &__HeapLimit;
+	} else {
+		// down from the end to the first word that is not paint
+		while (n-- && cursor > heap_mark) {
+			if (cursor[-1] != MEM_PAINT) {
+				heap_mark = cursor;
+				break;
+			}
+			cursor--;
+		}
+		if (cursor > heap_mark)
+			return 0;
+
+		mem_stats.heap_used = bytes(&__end__, heap_mark);
+		mem_stats.passes++;
+		scan = SCAN_STACK;
+		cursor = stack_lo;
+	}
+	return 0;
+}
+
+/*
+ * the rest of the current pass and one more for both, now
+ */
+void mem_scan(void)
+{
+	uint32_t passes = mem_stats.passes;
+
+	while (mem_stats.passes < passes + 2)
+		mem_step();
+}
+
+/*
+ * 32 bytes at the stack bottom that nothing may touch, MPU region 7.
+ * privileged code keeps the default memory map everywhere else
+ * (PRIVDEFENA), unprivileged code would need regions of its own.
+ * returns the guard address
+ */
+uint32_t mem_guard(void)
+{
+	uint32_t base = ((uint32_t)stack_lo + 31) & ~31U;
+
+	// the highest region number wins where regions overlap
+	MPU->RNR = 7;
+	MPU->RBAR = base;
+	// XN bit 28, AP no access (bits 26:24 = 0), 2^(SIZE+1) bytes with
+	//   SIZE 4 (bits 5:1), ENABLE bit 0
+	MPU->RASR = (1U << 28) | (4U << 1) | (1U << 0);
+	// MemManage fault instead of a hard fault, MEMFAULTENA bit 16 on SHCSR
+	SCB->SHCSR |= (1U << 16);
+	// PRIVDEFENA bit 2, ENABLE bit 0 on MPU CTRL
+	MPU->CTRL = (1U << 2) | (1U << 0);
+	__DSB();
+	__ISB();
+
+	stack_lo = (uint32_t *)(base + 32);
+	mem_stats.stack_size = bytes(stack_lo, &__StackTop);
+	mem_stats.guard = base;
+	if (scan == SCAN_STACK && cursor < stack_lo)
+		cursor = stack_lo;
+	return base;
+}
+
+/*
+ * alarm(free bytes) once, from the mem_step that finds less than bytes
+ * of main stack left
+ */
+void mem_limit(uint32_t bytes_free, mem_alarm_t fn)
+{
+	limit = bytes_free;
+	alarm = fn;
+}
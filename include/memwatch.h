@@ -0,0 +1,89 @@
+/*
+ * memwatch.h
+ *
+ * description:
+ *   high-water marks of the main stack and of the heap, read back
+ *   from a paint pattern.
+ *
+ *   mem_paint() fills the heap (__end__ to __HeapLimit) and the main
+ *   stack below the stack pointer (down to __HeapLimit) with
+ *   MEM_PAINT, "FREE". the C++ startup code does it at boot with
+ *   STARTUP_FILL_HEAP, C projects first thing in main. what the
+ *   program writes there is not paint any more, and paint never
+ *   comes back:
+ *     stack  grows down from __StackTop, the lowest word that is not
+ *            paint is the deepest the stack has been
+ *     heap   grows up from __end__, the highest word that is not
+ *            paint is the top of the heap used so far. .heap input
+ *            sections size it in the linker script, there are none
+ *            in this repo and the heap is empty
+ *   a stack or heap word that holds MEM_PAINT reads as unused.
+ *
+ *   the scan is incremental. mem_step() looks at MEM_CHUNK words and
+ *   returns, call it from the idle loop, a chunk per pass:
+ *     idle_add_poll(mem_step, 0);             include/idle.c
+ *     kernel::idle_hook = ...mem_step...;     bare_metal_cpp
+ *   a stack pass scans up from the stack bottom to the last mark, a
+ *   heap pass down from the heap end to its last mark, the marks only
+ *   move outwards. mem_stats has the results for the debugger or a
+ *   report, mem_scan() does whole passes at once.
+ *
+ *   checks, both optional:
+ *     mem_guard()      an MPU region of 32 bytes with no access at the
+ *                      stack bottom. an overflow faults right where it
+ *                      happens (MemManage, enabled here) instead of
+ *                      writing over the heap and .bss. the exception
+ *                      frame itself goes to the stack, with the stack
+ *                      in the guard it escalates to a hard fault.
+ *     mem_limit()      alarm(free bytes) from mem_step when a pass finds
+ *                      the free stack under a limit, once. the
+ *                      Cortex-M4 has no stack limit register, this is
+ *                      the software version: late, but no MPU.
+ *
+ * usage:
+ *   mem_paint();                  // or STARTUP_FILL_HEAP in startup.cpp
+ *   mem_init();
+ *   mem_guard();                  // optional
+ *   mem_limit(256, stack_low);    // optional
+ *   idle_add_poll(mem_step, 0);
+ *   ...
+ *   mem_stats.stack_used, mem_stats.heap_used
+ */
+
+#ifndef __MEMWATCH_H
+#define __MEMWATCH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define MEM_PAINT        0x45455246   /* "FREE" */
+#define MEM_CHUNK        64           /* words per mem_step */
+
+typedef void (*mem_alarm_t)(uint32_t stack_free);
+
+typedef struct {
+	uint32_t stack_size;         /* bytes, __StackTop to the stack bottom */
+	uint32_t stack_used;         /*   deepest so far                      */
+	uint32_t heap_size;          /* bytes, __end__ to __HeapLimit         */
+	uint32_t heap_used;          /*   highest so far                      */
+	uint32_t passes;             /* stack and heap scans done             */
+	uint32_t guard;              /* MPU guard address, 0 without          */
+} mem_stats_t;
+
+extern mem_stats_t mem_stats;
+
+void     mem_paint(void);
+void     mem_init(void);
+uint32_t mem_step(void);
+void     mem_scan(void);
+uint32_t mem_guard(void);
+void     mem_limit(uint32_t bytes, mem_alarm_t alarm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
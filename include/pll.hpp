@@ -0,0 +1,314 @@
+/*
+ * pll.hpp
+ *
+ * description:
+ *   compile time solver for the main PLL of the STM32F4 parts in this
+ *   directory. header only, C++14.
+ *
+ *   from the HSE crystal, the SYSCLK wanted and whether USB needs an
+ *   exact 48 MHz it picks M, N, P and Q and everything that goes with
+ *   the clock: voltage scale, over-drive, flash wait states and the APB
+ *   prescalers. a combination the part cannot do is a compile error
+ *   with the reason, not a board that hangs in the PLL wait loop.
+ *
+ *   limits, from the reference manuals and datasheets:
+ *                      F401       F405/F407   F429
+ *     SYSCLK max       84 MHz     168 MHz     180 MHz (over-drive > 168)
+ *     VCO output       192..432   100..432    100..432 MHz
+ *     APB1 / APB2 max  42 / 84    42 / 84     45 / 90 MHz
+ *   for all of them the VCO input is 1..2 MHz, M 2..63, N 50..432,
+ *   P 2, 4, 6 or 8, Q 2..15, the PLL48CLK at most 48 MHz, one flash
+ *   wait state per 30 MHz at 2.7..3.6 V.
+ *
+ *   the search takes the smallest M, so the VCO input is as close to
+ *   2 MHz as the crystal allows (less jitter), then the smallest P.
+ *   SYSCLK and USB have to come out exact, in Hz.
+ *
+ *     8 MHz   M 4,  2 MHz in     12 MHz   M 6, 2 MHz in
+ *     25 MHz  M 25, 1 MHz in (no M in 13..24 divides it evenly)
+ *
+ *   USB at 48 MHz needs a VCO that is a multiple of 48 MHz, so a F429
+ *   at 180 MHz cannot have it. fastest<> finds the highest SYSCLK that
+ *   works, 168 MHz in that case.
+ *
+ *   apply() programs the clock tree from a config the same way
+ *   set_sysclk_to_168 in system_stm32f4xx.c does. host builds
+ *   (HOST_BUILD) only get the solver.
+ *
+ * usage:
+ *   typedef pll::clock<pll::chip::f407, 25000000, 168000000> clk;
+ *   pll::apply(clk::value);             // clk::value.pclk1 == 42000000
+ *   typedef pll::fastest<pll::chip::f429, 8000000, false> top;  // 180 MHz
+ *   pll::clock<pll::chip::f429, 8000000, 180000000> bad;  // error: USB
+ */
+
+#ifndef __PLL_HPP
+#define __PLL_HPP
+
+#include <stdint.h>
+
+#ifndef HOST_BUILD
+#include "stm32f4xx.h"
+#endif
+
+namespace pll {
+
+enum class chip { f401, f405, f407, f429 };
+
+enum class error {
+	none,
+	hse_range,       // HSE has to be 4..26 MHz
+	too_fast,        // over the SYSCLK of the part
+	vco_input,       // no M gives 1..2 MHz
+	sysclk,          // no N and P give the SYSCLK exactly
+	usb              // no Q gives 48 MHz with the SYSCLK
+};
+
+struct limits {
+	uint32_t sys_max;
+	uint32_t vco_min;
+	uint32_t apb1_max;
+	uint32_t apb2_max;
+};
+
+struct config {
+	error err;
+	chip part;
+	uint32_t hse;
+	uint32_t sysclk;       // = hclk, the AHB runs undivided
+	uint32_t pclk1;
+	uint32_t pclk2;
+	uint32_t pll48;        // USB, SDIO and RNG clock
+	uint32_t m, n, p, q;
+	uint32_t vos;          // voltage scale 1, 2 or 3
+	uint32_t vos_bits;     // for PWR_CR, bits 15:14 (bit 14 on F405/F407)
+	bool overdrive;
+	uint32_t latency;      // flash wait states
+	uint32_t ppre1;        // CFGR bits 12:10
+	uint32_t ppre2;        // CFGR bits 15:13
+
+	// PLLCFGR with HSE as the source (bit 22)
+	constexpr uint32_t pllcfgr() const
+	{
+		return m | (n << 6) | (((p >> 1) - 1) << 16) | (1u << 22) | (q << 24);
+	}
+	constexpr bool ok() const { return err == error::none; }
+};
+
+// the part the code is built for
+#if defined (STM32F401xC) || defined (STM32F401xE)
+constexpr chip this_chip = chip::f401;
+#elif defined (STM32F405xx)
+constexpr chip this_chip = chip::f405;
+#elif defined (STM32F429xx)
+constexpr chip this_chip = chip::f429;
+#else
+constexpr chip this_chip = chip::f407;
+#endif
+
+constexpr uint32_t MHZ = 1000000;
+constexpr uint32_t usb_hz = 48 * MHZ;
+
+/*************************************************
+* solver
+*************************************************/
+namespace detail {
+
+constexpr limits limits_of(chip c)
+{
+	return c == chip::f401 ? limits{ 84 * MHZ, 192 * MHZ, 42 * MHZ, 84 * MHZ } :
+	       c == chip::f429 ? limits{ 180 * MHZ, 100 * MHZ, 45 * MHZ, 90 * MHZ } :
+	                         limits{ 168 * MHZ, 100 * MHZ, 42 * MHZ, 84 * MHZ };
+}
+
+constexpr config fail(chip c, uint32_t hse, uint32_t sysclk, error e)
+{
+	return config{ e, c, hse, sysclk, 0, 0, 0, 0, 0, 0, 0, 0, 0, false, 0, 0, 0 };
+}
+
+// smallest APB divider that keeps the bus in its limit, as CFGR field
+constexpr uint32_t ppre(uint32_t hclk, uint32_t max, uint32_t *pclk)
+{
+	uint32_t field = 0, div = 1;
+
+	while (hclk / div > max) {
+		div *= 2;
+		field = field ? field + 1 : 4;
+	}
+	*pclk = hclk / div;
+	return field;
+}
+
+// voltage scale, over-drive, wait states and buses for a PLL setting
+constexpr config finish(config c)
+{
+	if (c.part == chip::f401) {
+		c.vos = c.sysclk <= 60 * MHZ ? 3 : 2;
+		c.vos_bits = (c.vos == 3 ? 0x1u : 0x2u) << 14;
+	} else if (c.part == chip::f429) {
+		c.vos = c.sysclk <= 120 * MHZ ? 3 : c.sysclk <= 144 * MHZ ? 2 : 1;
+		c.vos_bits = (4 - c.vos) << 14;
+		c.overdrive = c.sysclk > 168 * MHZ;
+	} else {
+		c.vos = c.sysclk <= 144 * MHZ ? 2 : 1;
+		c.vos_bits = c.vos == 1 ? (1u << 14) : 0;
+	}
+	c.latency = (c.sysclk - 1) / (30 * MHZ);
+
+	limits l = limits_of(c.part);
+	c.ppre1 = ppre(c.sysclk, l.apb1_max, &c.pclk1);
+	c.ppre2 = ppre(c.sysclk, l.apb2_max, &c.pclk2);
+	return c;
+}
+
+} // namespace detail
+
+/*
+ * M, N, P and Q for exactly sysclk Hz from an hse Hz crystal, with
+ * PLL48CLK at exactly 48 MHz if usb is set (at most 48 MHz if not).
+ * the reason is in err when there is none
+ */
+constexpr config solve(chip part, uint32_t hse, uint32_t sysclk, bool usb = true)
+{
+	limits l = detail::limits_of(part);
+	error why = error::vco_input;
+
+	if (hse < 4 * MHZ || hse > 26 * MHZ)
+		return detail::fail(part, hse, sysclk, error::hse_range);
+	if (sysclk > l.sys_max || sysclk == 0)
+		return detail::fail(part, hse, sysclk, error::too_fast);
+
+	for (uint32_t m = 2; m <= 63; m++) {
+		// 1 MHz <= hse / m <= 2 MHz
+		if (hse > 2 * MHZ * m || hse < MHZ * m)
+			continue;
+		if (why == error::vco_input)
+			why = error::sysclk;
+
+		for (uint32_t p = 2; p <= 8; p += 2) {
+			uint64_t vco = (uint64_t)sysclk * p;
+			uint64_t nm = vco * m;
+
+			if (vco < l.vco_min || vco > 432 * MHZ || nm % hse)
+				continue;
+			uint32_t n = (uint32_t)(nm / hse);
+			if (n < 50 || n > 432)
+				continue;
+
+			uint32_t q = 0;
+			if (usb) {
+				if (vco % usb_hz || vco / usb_hz < 2 || vco / usb_hz > 15) {
+					why = error::usb;
+					continue;
+				}
+				q = (uint32_t)(vco / usb_hz);
+			} else {
+				q = (uint32_t)((vco + usb_hz - 1) / usb_hz);
+				q = q < 2 ? 2 : q;
+			}
+
+			config c = detail::fail(part, hse, sysclk, error::none);
+			c.m = m;
+			c.n = n;
+			c.p = p;
+			c.q = q;
+			c.pll48 = (uint32_t)(vco / q);
+			return detail::finish(c);
+		}
+	}
+	return detail::fail(part, hse, sysclk, why);
+}
+
+/*
+ * the highest SYSCLK in whole MHz the part reaches from the crystal
+ */
+constexpr config solve_max(chip part, uint32_t hse, bool usb = true)
+{
+	config c = detail::fail(part, hse, 0, error::sysclk);
+
+	for (uint32_t f = detail::limits_of(part).sys_max; f >= 16 * MHZ; f -= MHZ) {
+		c = solve(part, hse, f, usb);
+		if (c.ok() || c.err == error::hse_range)
+			return c;
+	}
+	return c;
+}
+
+/*************************************************
+* compile time checked configurations
+*************************************************/
+template <chip C, uint32_t HSE, uint32_t SYSCLK, bool USB = true>
+struct clock {
+	static constexpr config value = solve(C, HSE, SYSCLK, USB);
+
+	static_assert(value.err != error::hse_range, "pll: HSE has to be 4 to 26 MHz");
+	static_assert(value.err != error::too_fast, "pll: SYSCLK over the maximum of the part");
+	static_assert(value.err != error::vco_input, "pll: no M gives a 1 to 2 MHz VCO input");
+	static_assert(value.err != error::sysclk, "pll: SYSCLK not reachable from this HSE");
+	static_assert(value.err != error::usb, "pll: no 48 MHz USB clock with this SYSCLK");
+};
+
+template <chip C, uint32_t HSE, uint32_t SYSCLK, bool USB>
+constexpr config clock<C, HSE, SYSCLK, USB>::value;
+
+template <chip C, uint32_t HSE, bool USB = true>
+struct fastest {
+	static constexpr config value = solve_max(C, HSE, USB);
+
+	static_assert(value.err != error::hse_range, "pll: HSE has to be 4 to 26 MHz");
+	static_assert(value.ok(), "pll: no SYSCLK reachable from this HSE");
+};
+
+template <chip C, uint32_t HSE, bool USB>
+constexpr config fastest<C, HSE, USB>::value;
+
+#ifndef HOST_BUILD
+/*************************************************
+* program the clock tree
+*************************************************/
+/*
+ * from reset (HSI) to the PLL of c. the order follows the reference
+ * manual: regulator scale before the PLL, over-drive after it locks,
+ * wait states before the switch
+ */
+inline void apply(const config &c)
+{
+	// HSE on (CR: bit 16), wait for HSERDY (CR: bit 17)
+	RCC->CR |= (1u << 16);
+	while (!(RCC->CR & (1u << 17)));
+
+	// power interface clock (APB1ENR: bit 28), then the voltage scale
+	RCC->APB1ENR |= (1u << 28);
+	PWR->CR = (PWR->CR & ~(0x3u << 14)) | c.vos_bits;
+
+	// AHB /1, APB1 (CFGR: bits 12:10), APB2 (CFGR: bits 15:13)
+	RCC->CFGR = (RCC->CFGR & ~((0xFu << 4) | (0x7u << 10) | (0x7u << 13))) |
+	            (c.ppre1 << 10) | (c.ppre2 << 13);
+
+	// PLL on (CR: bit 24), wait for PLLRDY (CR: bit 25)
+	RCC->PLLCFGR = c.pllcfgr();
+	RCC->CR |= (1u << 24);
+	while (!(RCC->CR & (1u << 25)));
+
+	if (c.overdrive) {
+		// ODEN (PWR_CR: bit 16) then ODSWEN (bit 17), ready flags at
+		//   the same bits in PWR_CSR
+		PWR->CR |= (1u << 16);
+		while (!(PWR->CSR & (1u << 16)));
+		PWR->CR |= (1u << 17);
+		while (!(PWR->CSR & (1u << 17)));
+	}
+
+	// prefetch, instruction and data cache (ACR: bits 8, 9, 10), latency
+	FLASH->ACR = (1u << 8) | (1u << 9) | (1u << 10) | c.latency;
+	while ((FLASH->ACR & 0x7u) != c.latency);
+
+	// PLL as SYSCLK (CFGR: bits 1:0), wait for SWS (CFGR: bits 3:2)
+	RCC->CFGR = (RCC->CFGR & ~0x3u) | 0x2u;
+	while ((RCC->CFGR & (0x3u << 2)) != (0x2u << 2));
+}
+#endif
+
+} // namespace pll
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * sched.c
+ *
+ * description:
+ *   cooperative run-to-completion scheduler, see sched.h
+ */
+
+#include "sched.h"
+#include "stm32f4xx.h"
+
+/*************************************************
+* variables
+*************************************************/
+sched_stats_t sched_stats;
+
+static sched_task_t tasks[SCHED_MAX_TASKS];
+static uint32_t active;            // registered tasks, by priority
+static volatile uint32_t ready;    // released, not started
+static volatile uint32_t running;  // priority + 1 of the task in fn, 0 none
+
+static sched_clock_t clk;
+static uint32_t per_tick;
+
+/*************************************************
+* helpers
+*************************************************/
+static uint32_t clock_read(void)
+{
+	return clk ? clk() : 0;
+}
+
+static void clear_stats(sched_task_t *t)
+{
+	t->runs = 0;
+	t->overruns = 0;
+	t->misses = 0;
+	t->exec_last = 0;
+	t->exec_max = 0;
+	t->exec_total = 0;
+	t->late_max = 0;
+}
+
+/*************************************************
+* api
+*************************************************/
+/*
+ * clock: free running counter for the statistics (0 for none),
+ * clocks_per_tick: its counts between two sched_tick calls
+ */
+void sched_init(sched_clock_t clock, uint32_t clocks_per_tick)
+{
+	clk = clock;
+	per_tick = clocks_per_tick;
+	active = 0;
+	ready = 0;
+	running = 0;
+	sched_stats_reset();
+}
+
+/*
+ * run fn(arg) every period ticks, the first time offset ticks from now
+ * (0 is the next tick). offsets spread tasks with the same period over
+ * different ticks. returns 0 if prio is taken or out of range
+ */
+sched_task_t *sched_add(uint8_t prio, uint32_t period, uint32_t offset,
+                        sched_fn_t fn, void *arg, const char *name)
+{
+	sched_task_t *t;
+	uint32_t primask;
+
+	if (prio >= SCHED_MAX_TASKS || period == 0 || (active & (1u << prio)))
+		return 0;
+
+	t = &tasks[prio];
+	t->fn = fn;
+	t->arg = arg;
+	t->name = name;
+	t->period = period;
+	t->countdown = offset + 1;
+	t->released = 0;
+	t->prio = prio;
+	clear_stats(t);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	active |= (1u << prio);
+	__set_PRIMASK(primask);
+	return t;
+}
+
+/*
+ * no more releases, a pending one is dropped. from the task itself too
+ */
+void sched_remove(uint8_t prio)
+{
+	uint32_t primask;
+
+	if (prio >= SCHED_MAX_TASKS)
+		return;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	active &= ~(1u << prio);
+	ready &= ~(1u << prio);
+	__set_PRIMASK(primask);
+}
+
+sched_task_t *sched_task(uint8_t prio)
+{
+	if (prio >= SCHED_MAX_TASKS || !(active & (1u << prio)))
+		return 0;
+	return &tasks[prio];
+}
+
+/*
+ * one tick, call from the SysTick handler
+ */
+void sched_tick(void)
+{
+	uint32_t now = clock_read();
+	uint32_t a = active;
+	uint32_t r = ready;
+
+	sched_stats.ticks++;
+	while (a) {
+		uint32_t p = 31 - __CLZ(a);
+		sched_task_t *t = &tasks[p];
+
+		a &= ~(1u << p);
+		if (--t->countdown)
+			continue;
+		t->countdown = t->period;
+
+		if ((r & (1u << p)) || running == p + 1) {
+			// still waiting or still running, this release is lost.
+			//   a waiting one keeps its older release time, a running
+			//   one waits for the next release
+			t->overruns++;
+			continue;
+		}
+		t->released = now;
+		r |= (1u << p);
+	}
+	ready = r;
+}
+
+/*
+ * run the highest priority ready task to completion. one task per
+ * call, so an overloaded set of tasks still lets the rest of the main
+ * loop run. returns 1 if a task ran, 0 if none was ready
+ */
+uint32_t sched_poll(void)
+{
+	uint32_t primask, r, p, rel, entry, start, end, exec, late;
+	sched_task_t *t;
+
+	if (!ready)
+		return 0;
+	entry = clock_read();
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	r = ready;
+	p = 31 - __CLZ(r);
+	ready = r & ~(1u << p);
+	running = p + 1;
+	t = &tasks[p];
+	rel = t->released;
+	__set_PRIMASK(primask);
+
+	start = clock_read();
+	t->fn(t->arg);
+	end = clock_read();
+	running = 0;
+
+	// picking the task and a clock read
+	if (start - entry > sched_stats.overhead_max)
+		sched_stats.overhead_max = start - entry;
+
+	exec = end - start;
+	late = start - rel;
+	t->runs++;
+	t->exec_last = exec;
+	t->exec_total += exec;
+	if (exec > t->exec_max)
+		t->exec_max = exec;
+	if (late > t->late_max)
+		t->late_max = late;
+	if (end - rel > t->period * per_tick)
+		t->misses++;
+
+	sched_stats.dispatches++;
+	return 1;
+}
+
+/*
+ * a task is ready, for idle_add_poll
+ */
+int sched_pending(void)
+{
+	return ready != 0;
+}
+
+void sched_stats_reset(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < SCHED_MAX_TASKS; i++)
+		clear_stats(&tasks[i]);
+	sched_stats.ticks = 0;
+	sched_stats.dispatches = 0;
+	sched_stats.overhead_max = 0;
+}
+
+/*
+ * average execution time, clock units
+ */
+uint32_t sched_exec_avg(const sched_task_t *t)
+{
+	if (t->runs == 0)
+		return 0;
+	return (uint32_t)(t->exec_total / t->runs);
+}
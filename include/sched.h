@@ -0,0 +1,104 @@
+/*
+ * sched.h
+ *
+ * description:
+ *   cooperative run-to-completion scheduler for periodic jobs, for
+ *   boards where a preemptive kernel is more than needed.
+ *
+ *   a task is a function with a period and an offset in ticks and a
+ *   priority from 0 to 31, one task per priority, higher runs first.
+ *   sched_tick() from the SysTick handler counts the tasks down and
+ *   marks the due ones ready in a 32-bit mask. each sched_poll() in
+ *   the main loop runs the highest ready task (CLZ on the mask) to
+ *   completion: there are no stacks to switch and no locking between
+ *   tasks. a long task delays every other one, that is what the
+ *   statistics are for.
+ *
+ *   per task, in clock units (the clock given to sched_init, e.g. the
+ *   DWT cycle counter):
+ *     runs        times it ran
+ *     exec_last   execution time of the last run, exec_max the worst,
+ *     exec_total  the sum for the average
+ *     late_max    worst time from the release (the tick it became due)
+ *                 to the start
+ *     overruns    releases while the previous one had not run or not
+ *                 finished yet, each one dropped: the job runs once
+ *                 for the older release, or next at the release after
+ *     misses      runs that finished more than a period after their
+ *                 release, the deadline is the next release
+ *   a dispatch is a CLZ and a few instructions under a short interrupt
+ *   lock plus three clock reads, tens of cycles per task run. the
+ *   worst one is kept in sched_stats.overhead_max.
+ *
+ *   sched_poll and sched_pending fit idle_add_poll (include/idle.h),
+ *   the main loop then sleeps until the next tick when nothing is
+ *   ready. host builds (HOST_BUILD) run the same code against the core
+ *   header of the simulators, the tick comes from the simulation.
+ *
+ * usage:
+ *   sched_init(cyccnt_read, 168000);           // 1 ms tick at 168 MHz
+ *   sched_add(3, 10, 0, poll_buttons, 0, "buttons");
+ *   sched_add(1, 500, 5, blink, 0, "blink");
+ *   call sched_tick() from SysTick_Handler
+ *   idle_add_poll(sched_poll, sched_pending);
+ *   while(1)
+ *       idle_once();
+ */
+
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* priorities 0 .. SCHED_MAX_TASKS - 1 */
+#define SCHED_MAX_TASKS  32
+
+typedef void (*sched_fn_t)(void *arg);
+typedef uint32_t (*sched_clock_t)(void);
+
+typedef struct {
+	sched_fn_t fn;
+	void *arg;
+	const char *name;
+	uint32_t period;             /* ticks                              */
+	uint32_t countdown;          /* ticks to the next release          */
+	uint32_t released;           /* clock at the oldest release not run */
+	uint8_t prio;
+	/* statistics, clock units */
+	uint32_t runs;
+	uint32_t overruns;
+	uint32_t misses;
+	uint32_t exec_last;
+	uint32_t exec_max;
+	uint64_t exec_total;
+	uint32_t late_max;
+} sched_task_t;
+
+typedef struct {
+	uint32_t ticks;
+	uint32_t dispatches;         /* task runs, all tasks               */
+	uint32_t overhead_max;       /* worst dispatch cost, clock units   */
+} sched_stats_t;
+
+extern sched_stats_t sched_stats;
+
+void          sched_init(sched_clock_t clock, uint32_t clocks_per_tick);
+sched_task_t *sched_add(uint8_t prio, uint32_t period, uint32_t offset,
+                        sched_fn_t fn, void *arg, const char *name);
+void          sched_remove(uint8_t prio);
+sched_task_t *sched_task(uint8_t prio);
+void          sched_tick(void);
+uint32_t      sched_poll(void);
+int           sched_pending(void);
+void          sched_stats_reset(void);
+uint32_t      sched_exec_avg(const sched_task_t *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
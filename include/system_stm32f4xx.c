@@ -8,23 +8,219 @@
 
 #include "system_stm32f4xx.h"
 
+uint32_t boot_cycles;
+
+/*************************************************
+* boot time, DWT cycle counter from the first
+* instruction of the reset handler
+*************************************************/
+void boot_timer_start(void)
+{
+	/* trace enable (DEMCR:bit 24), counter from 0 (DWT_CTRL:bit 0) */
+	CoreDebug->DEMCR |= (1UL << 24);
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= (1UL << 0);
+}
+
+/*************************************************
+* word copy and zero for the startup code
+* the loops are in assembly so they are just as
+* fast in the debug profile (-O0). 32 bytes per
+* pass with LDM/STM of 4 registers, then single
+* words for the rest. dst, src and end are word
+* aligned, the linker script keeps them so
+*************************************************/
+void boot_copy(uint32_t *dst, const uint32_t *src, const uint32_t *end)
+{
+	__asm volatile (
+		"	b	2f\n"
+		"1:	ldmia	%[s]!, {r2, r3, r4, r5}\n"
+		"	stmia	%[d]!, {r2, r3, r4, r5}\n"
+		"	ldmia	%[s]!, {r2, r3, r4, r5}\n"
+		"	stmia	%[d]!, {r2, r3, r4, r5}\n"
+		"2:	sub	r12, %[e], %[d]\n"
+		"	cmp	r12, #32\n"
+		"	bhs	1b\n"
+		"	b	4f\n"
+		"3:	ldr	r2, [%[s]], #4\n"
+		"	str	r2, [%[d]], #4\n"
+		"4:	cmp	%[d], %[e]\n"
+		"	blo	3b\n"
+		: [d] "+r" (dst), [s] "+r" (src)
+		: [e] "r" (end)
+		: "r2", "r3", "r4", "r5", "r12", "cc", "memory");
+}
+
+void boot_zero(uint32_t *dst, const uint32_t *end)
+{
+	__asm volatile (
+		"	movs	r2, #0\n"
+		"	movs	r3, #0\n"
+		"	movs	r4, #0\n"
+		"	movs	r5, #0\n"
+		"	b	2f\n"
+		"1:	stmia	%[d]!, {r2, r3, r4, r5}\n"
+		"	stmia	%[d]!, {r2, r3, r4, r5}\n"
+		"2:	sub	r12, %[e], %[d]\n"
+		"	cmp	r12, #32\n"
+		"	bhs	1b\n"
+		"	b	4f\n"
+		"3:	str	r2, [%[d]], #4\n"
+		"4:	cmp	%[d], %[e]\n"
+		"	blo	3b\n"
+		: [d] "+r" (dst)
+		: [e] "r" (end)
+		: "r2", "r3", "r4", "r5", "r12", "cc", "memory");
+}
+
+/*************************************************
+* zero with DMA2 stream 0 in memory to memory mode
+* (only DMA2 can), a zero word in flash as the
+* fixed source. returns 0 and does nothing when
+* the block is under BOOT_DMA_MIN bytes or over
+* the 65535 words of one transfer
+*************************************************/
+static const uint32_t boot_zero_word = 0;
+
+static void zero_dma_start(uint32_t *dst, uint32_t words)
+{
+	/* enable DMA2 clock (AHB1ENR:bit 22) */
+	RCC->AHB1ENR |= (1 << 22);
+	DMA2_Stream0->CR = 0;
+	while (DMA2_Stream0->CR & (1 << 0));
+
+	/* memory to memory: PAR is the source, M0AR the destination */
+	DMA2_Stream0->PAR = (uint32_t)&boot_zero_word;
+	DMA2_Stream0->M0AR = (uint32_t)dst;
+	DMA2_Stream0->NDTR = words;
+	/* no direct mode in memory to memory, FIFO (FCR:bit 2) full (1:0) */
+	DMA2_Stream0->FCR = (1 << 2) | (0x3 << 0);
+	/* DIR memory to memory (CR:bits 7:6), MINC (bit 10),
+	 * PSIZE and MSIZE word (bits 12:11, 14:13), EN (bit 0) */
+	DMA2_Stream0->CR = (0x2 << 6) | (1 << 10) | (0x2 << 11) | (0x2 << 13) | (1 << 0);
+}
+
+int boot_zero_dma(uint32_t *dst, const uint32_t *end)
+{
+	uint32_t words = (uint32_t)(end - dst);
+
+	if (BOOT_DMA_MIN == 0 || words * 4 < BOOT_DMA_MIN || words > 0xFFFF)
+		return 0;
+
+	zero_dma_start(dst, words);
+	return 1;
+}
+
+void boot_dma_wait(void)
+{
+	/* transfer complete TCIF0 (LISR:bit 5) */
+	while (!(DMA2->LISR & (1 << 5)));
+	/* clear the stream 0 flags (LIFCR:bits 5:0), back to reset */
+	DMA2->LIFCR = 0x3D;
+	DMA2_Stream0->CR = 0;
+	RCC->AHB1ENR &= ~(1U << 22);
+}
+
+/*************************************************
+* .lazy_bss, zeroed by the same DMA stream from
+* the start of main, or by the core if it is too
+* large for one transfer. from thread code only.
+* the DMA2 clock stays on, other streams may be
+* running by the time it is done
+*************************************************/
+#define LAZY_IDLE     0
+#define LAZY_DMA      1
+#define LAZY_DONE     2
+
+extern uint32_t __lazy_bss_start__, __lazy_bss_end__;
+static volatile uint32_t lazy_state;
+
+/* from the reset handler, right before main */
+void lazy_zero_start(void)
+{
+	uint32_t words = (uint32_t)(&__lazy_bss_end__ - &__lazy_bss_start__);
+
+	if (lazy_state != LAZY_IDLE)
+		return;
+	if (words == 0) {
+		lazy_state = LAZY_DONE;
+		return;
+	}
+	/* too large, lazy_zero_wait does it */
+	if (words > 0xFFFF)
+		return;
+	zero_dma_start(&__lazy_bss_start__, words);
+	lazy_state = LAZY_DMA;
+}
+
+/* 1 once .lazy_bss is zero, does not wait */
+int lazy_zero_done(void)
+{
+	/* transfer complete TCIF0 (LISR:bit 5), clear the stream 0
+	 * flags (LIFCR:bits 5:0) and give the stream back */
+	if (lazy_state == LAZY_DMA && (DMA2->LISR & (1 << 5))) {
+		DMA2->LIFCR = 0x3D;
+		DMA2_Stream0->CR = 0;
+		lazy_state = LAZY_DONE;
+	}
+	return lazy_state == LAZY_DONE;
+}
+
+/* before the first use of a LAZY_BSS variable */
+void lazy_zero_wait(void)
+{
+	if (lazy_state == LAZY_IDLE) {
+		boot_zero(&__lazy_bss_start__, &__lazy_bss_end__);
+		lazy_state = LAZY_DONE;
+	}
+	while (!lazy_zero_done());
+}
+
+/*************************************************
+* CCM sections, by the core as DMA can not reach
+* CCM. the CCM clock is on from reset, set again
+* in case a bootloader turned it off
+*************************************************/
+void boot_ccm(void)
+{
+#if defined (CCMDATARAM_BASE)
+	extern uint32_t __ccm_data_load__, __ccm_data_start__, __ccm_data_end__;
+	extern uint32_t __ccm_bss_start__, __ccm_bss_end__;
+
+	/* enable CCM data RAM clock, bit 20 on AHB1ENR */
+	RCC->AHB1ENR |= (1 << 20);
+	boot_copy(&__ccm_data_start__, &__ccm_data_load__, &__ccm_data_end__);
+	boot_zero(&__ccm_bss_start__, &__ccm_bss_end__);
+#endif
+}
+
 /*************************************************
 * Copy the data contents from LMA to VMA
 * Initializes data and bss sections
 *************************************************/
 void _init_data(void)
 {
-	extern unsigned long __etext, __data_start__, __data_end__, __bss_start__, __bss_end__;
-	unsigned long *src = &__etext;
-	unsigned long *dst = &__data_start__;
+	extern uint32_t __etext, __data_start__, __data_end__, __bss_start__, __bss_end__;
+	extern uint32_t __ramfunc_load__, __ramfunc_start__, __ramfunc_end__;
+	int dma;
+
+	/* a large bss is zeroed by DMA in the background */
+	dma = boot_zero_dma(&__bss_start__, &__bss_end__);
 
 	/* ROM has data at end of text; copy it.  */
-	while (dst < &__data_end__)
-		*dst++ = *src++;
+	boot_copy(&__data_start__, &__etext, &__data_end__);
+
+	/* RAMFUNC code, it follows the data */
+	boot_copy(&__ramfunc_start__, &__ramfunc_load__, &__ramfunc_end__);
 
-	/* zero bss.  */
-	for (dst = &__bss_start__; dst< &__bss_end__; dst++)
-		*dst = 0;
+	/* CCM, while the DMA is still busy on SRAM */
+	boot_ccm();
+
+	/* zero bss, or wait for the DMA to finish it */
+	if (dma)
+		boot_dma_wait();
+	else
+		boot_zero(&__bss_start__, &__bss_end__);
 }
 
 
@@ -32,19 +228,36 @@ void _init_data(void)
 * entry point for the program
 * initializes data and bss sections and calls main program
 *************************************************/
+/* hard float code would fault on its first FPU instruction */
+#if defined(__ARM_PCS_VFP) && !(__FPU_USED == 1)
+#error "hard float ABI without __FPU_USED, the FPU would stay off"
+#endif
+
 void Reset_Handler(void)
 {
-	/* initialize data and bss sections */
-	_init_data();
+	/* count cycles to main, boot_cycles */
+	boot_timer_start();
 
-	/* FPU settings, can be enabled from project makefile */
+	/* FPU settings, set by CMSIS from the float ABI (PROFILE in armf4.mk)
+	 * first, optimized code may use FPU registers anywhere after this */
 	#if (__FPU_PRESENT == 1) && (__FPU_USED == 1)
 	SCB->CPACR |= ((3UL << 10*2)|(3UL << 11*2));  /* set CP10 and CP11 Full Access */
+	__DSB();
+	__ISB();
 	#endif
 
+	/* initialize data and bss sections */
+	_init_data();
+
 	/* reset clock */
 	reset_clock();
 
+	/* cycles from here to main, the counter keeps running */
+	boot_cycles = DWT->CYCCNT;
+
+	/* .lazy_bss in the background from here */
+	lazy_zero_start();
+
 	/* call main function */
 	main();
 
@@ -80,7 +293,7 @@ void reset_clock(void)
 
 
 /*************************************************
-* configure system clock to 168 Mhz
+* configure system clock to 168 Mhz (84 Mhz on F401, 180 Mhz on F429)
 * this is only tested on stm32f4 discovery board
 *************************************************/
 void set_sysclk_to_168(void)
@@ -95,18 +308,21 @@ void set_sysclk_to_168(void)
 	/* Enable power interface clock (APB1ENR:bit 28) */
 	RCC->APB1ENR |= (1 << 28);
 
-	/* set voltage scale to 1 for max frequency (PWR_CR:bit 14)
-	 * (0b0) scale 2 for fCLK <= 144 Mhz
-	 * (0b1) scale 1 for 144 Mhz < fCLK <= 168 Mhz
+	/* set voltage scale for max frequency (PWR_CR:bits 15:14)
+	 * F405/407 (bit 14): 0b0 scale 2 for fCLK <= 144 Mhz
+	 *                    0b1 scale 1 for 144 Mhz < fCLK <= 168 Mhz
+	 * F401: 0b01 scale 3 <= 60 Mhz, 0b10 scale 2 <= 84 Mhz
+	 * F429: 0b01 scale 3 <= 120 Mhz, 0b10 scale 2 <= 144 Mhz,
+	 *       0b11 scale 1 <= 168 Mhz, 180 Mhz with over-drive
 	 */
-	PWR->CR |= (1 << 14);
+	PWR->CR = (PWR->CR & ~(0x3U << 14)) | PLL_VOS;
 
 	/* set AHB prescaler to /1 (CFGR:bits 7:4) */
 	RCC->CFGR |= (0 << 4);
-	/* set ABP low speed prescaler to /4 (APB1) (CFGR:bits 12:10) */
-	RCC->CFGR |= (0x5 << 10);
-	/* set ABP high speed prescaper to /2 (ABP2) (CFGR:bits 15:13) */
-	RCC->CFGR |= (0x4 << 13);
+	/* set ABP low speed prescaler (APB1) (CFGR:bits 12:10) */
+	RCC->CFGR |= (PLL_PPRE1 << 10);
+	/* set ABP high speed prescaper (ABP2) (CFGR:bits 15:13) */
+	RCC->CFGR |= (PLL_PPRE2 << 13);
 
 	/* Set M, N, P and Q PLL dividers
 	 * PLLCFGR: bits 5:0 (M), 14:6 (N), 17:16 (P), 27:24 (Q)
@@ -118,14 +334,26 @@ void set_sysclk_to_168(void)
 	RCC->CR |= (1 << 24);
 	/* Wait till the main PLL is ready (CR: bit 25) */
 	while(!(RCC->CR & (1 << 25)));
+
+	/* over-drive for 180 Mhz once the PLL runs
+	 * ODEN (PWR_CR:bit 16), wait for ODRDY (PWR_CSR:bit 16)
+	 * ODSWEN (PWR_CR:bit 17), wait for ODSWRDY (PWR_CSR:bit 17)
+	 */
+	#if PLL_OD
+	PWR->CR |= (1 << 16);
+	while(!(PWR->CSR & (1 << 16)));
+	PWR->CR |= (1 << 17);
+	while(!(PWR->CSR & (1 << 17)));
+	#endif
+
 	/* Configure Flash
 	 * prefetch enable (ACR:bit 8)
 	 * instruction cache enable (ACR:bit 9)
 	 * data cache enable (ACR:bit 10)
-	 * set latency to 5 wait states (ARC:bits 2:0)
+	 * set latency to PLL_LATENCY wait states (ARC:bits 2:0)
 	 *   see Table 10 on page 80 in RM0090
 	 */
-	FLASH->ACR = (1 << 8) | (1 << 9) | (1 << 10 ) | (0x5 << 0);
+	FLASH->ACR = (1 << 8) | (1 << 9) | (1 << 10 ) | (PLL_LATENCY << 0);
 
 	/* Select the main PLL as system clock source, (CFGR:bits 1:0)
 	 * 0b00 - HSI
@@ -137,3 +365,57 @@ void set_sysclk_to_168(void)
 	/* Wait till the main PLL is used as system clock source (CFGR:bits 3:2) */
 	while (!(RCC->CFGR & (uint32_t)(0x2 << 2)));
 }
+
+
+/*************************************************
+* current clocks, from the RCC registers
+* right after any of the set_sysclk functions or a
+* switch at run time (include/dvfs.c)
+*************************************************/
+uint32_t get_sysclk(void)
+{
+	uint32_t pll = RCC->PLLCFGR;
+	uint32_t src, m, n, p;
+
+	/* system clock switch status (CFGR:bits 3:2) */
+	switch ((RCC->CFGR >> 2) & 0x3) {
+	case 0x1:
+		return HSE_VALUE;
+	case 0x2:
+		/* source (PLLCFGR:bit 22), M (5:0), N (14:6), P (17:16) */
+		src = (pll & (1 << 22)) ? HSE_VALUE : HSI_VALUE;
+		m = pll & 0x3F;
+		n = (pll >> 6) & 0x1FF;
+		p = (((pll >> 16) & 0x3) + 1) * 2;
+		return (uint32_t)((uint64_t)src * n / m / p);
+	default:
+		return HSI_VALUE;
+	}
+}
+
+uint32_t get_hclk(void)
+{
+	/* AHB prescaler (CFGR:bits 7:4), 0xxx: /1, 1000: /2 .. 1111: /512 */
+	static const uint8_t shift[8] = { 1, 2, 3, 4, 6, 7, 8, 9 };
+	uint32_t hpre = (RCC->CFGR >> 4) & 0xF;
+
+	return get_sysclk() >> ((hpre & 0x8) ? shift[hpre & 0x7] : 0);
+}
+
+/* APB prescalers 0xx: /1, 100: /2 .. 111: /16 */
+static uint32_t apb_clock(uint32_t ppre)
+{
+	return get_hclk() >> ((ppre & 0x4) ? (ppre & 0x3) + 1 : 0);
+}
+
+uint32_t get_pclk1(void)
+{
+	/* APB1 prescaler (CFGR:bits 12:10) */
+	return apb_clock((RCC->CFGR >> 10) & 0x7);
+}
+
+uint32_t get_pclk2(void)
+{
+	/* APB2 prescaler (CFGR:bits 15:13) */
+	return apb_clock((RCC->CFGR >> 13) & 0x7);
+}
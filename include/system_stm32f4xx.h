@@ -7,32 +7,153 @@
 
 #include "stm32f4xx.h"
 
-/* Clock PLLs for 407 chip */
-#if defined (STM32F407xx) || defined (STM32F429xx)
-// Main PLL = N * (source_clock / M) / P
-// HSE = 8 Mhz
-// fCLK =   N * (8Mhz / M) / P
-#define PLL_M	8
-#define PLL_Q 	7
-#define PLL_P 	2
+/* Main PLL = N * (HSE / M) / P, PLL48CLK = N * (HSE / M) / Q
+ * VCO input at 2 Mhz for less jitter, 1 Mhz when HSE is not a multiple
+ * of 2 Mhz (25 Mhz crystals). pass -DHSE_VALUE=... for other boards.
+ * these are the settings pll::solve in pll.hpp picks, projects/pll
+ * checks that they stay the same
+ */
+#ifndef HSE_VALUE
+#define HSE_VALUE   8000000   /* discovery boards */
 #endif
+#define HSI_VALUE   16000000
 
-/* stm32f407 runs at 168Mhz max */
-#if defined (STM32F407xx)
-#define PLL_N 	336
+#if (HSE_VALUE < 4000000) || (HSE_VALUE > 26000000)
+#error "HSE_VALUE has to be 4 to 26 Mhz"
+#elif (HSE_VALUE % 2000000) == 0
+#define PLL_VCO_IN  2000000
+#elif (HSE_VALUE % 1000000) == 0
+#define PLL_VCO_IN  1000000
+#else
+#error "HSE_VALUE has to be a multiple of 1 Mhz"
 #endif
 
-/* stm32f429 runs at 180Mhz max */
-#if defined (STM32F429xx)
-#define PLL_N   360
+#define PLL_M       (HSE_VALUE / PLL_VCO_IN)
+#define PLL_N       (PLL_VCO / PLL_VCO_IN)
+
+/* stm32f401 runs at 84Mhz max, regulator scale 2, 2 wait states
+ * APB1 /2 (42 Mhz), APB2 /1 (84 Mhz), USB at 48 Mhz */
+#if defined (STM32F401xC) || defined (STM32F401xE)
+#define PLL_VCO     336000000
+#define PLL_P       4
+#define PLL_Q       7
+#define PLL_VOS     (0x2 << 14)
+#define PLL_OD      0
+#define PLL_LATENCY 2
+#define PLL_PPRE1   0x4
+#define PLL_PPRE2   0x0
+
+/* stm32f429 runs at 180Mhz max with over-drive, scale 1, 5 wait states
+ * APB1 /4 (45 Mhz), APB2 /2 (90 Mhz). a 360 Mhz VCO has no 48 Mhz
+ * for USB, Q keeps PLL48CLK under it (45 Mhz) */
+#elif defined (STM32F429xx)
+#define PLL_VCO     360000000
+#define PLL_P       2
+#define PLL_Q       8
+#define PLL_VOS     (0x3 << 14)
+#define PLL_OD      1
+#define PLL_LATENCY 5
+#define PLL_PPRE1   0x5
+#define PLL_PPRE2   0x4
+
+/* stm32f405/407 run at 168Mhz max, scale 1, 5 wait states
+ * APB1 /4 (42 Mhz), APB2 /2 (84 Mhz), USB at 48 Mhz */
+#else
+#define PLL_VCO     336000000
+#define PLL_P       2
+#define PLL_Q       7
+#define PLL_VOS     (0x1 << 14)
+#define PLL_OD      0
+#define PLL_LATENCY 5
+#define PLL_PPRE1   0x5
+#define PLL_PPRE2   0x4
+#endif
+
+/* startup
+ * .bss of at least BOOT_DMA_MIN bytes is zeroed by DMA2 while the core
+ * copies .data, 0 leaves it all to the core
+ */
+#ifndef BOOT_DMA_MIN
+#define BOOT_DMA_MIN  8192
+#endif
+
+/* core coupled memory on F405/F407/F429, 64K at 0x10000000 that only
+ * the core reaches: no wait states and no bus matrix contention with
+ * DMA on SRAM. for CPU-only hot data, task stacks, state machine state,
+ * DSP work buffers. not for DMA buffers, DMA can not reach CCM, and not
+ * for code.
+ *   static float work[1024] CCM_BSS;       zeroed at boot
+ *   static uint32_t state CCM_DATA = 1;    copied from flash at boot
+ * plain .bss and .data on parts without CCM and on the host
+ */
+#if defined (CCMDATARAM_BASE) && !defined (HOST_BUILD)
+#define CCM_DATA    __attribute__ ((section(".ccm_data")))
+#define CCM_BSS     __attribute__ ((section(".ccm_bss")))
+#else
+#define CCM_DATA
+#define CCM_BSS
 #endif
 
+/* functions that run from SRAM, copied there at boot: no flash wait
+ * states and no ART accelerator misses, the same timing every time.
+ * for short interrupt paths that need deterministic timing.
+ *   RAMFUNC void USART2_IRQHandler(void) { ... }
+ * long_call, SRAM is out of reach of a BL from flash. what a RAMFUNC
+ * calls runs from flash unless it is a RAMFUNC too or inlined, the
+ * debug profile (-O0) inlines nothing. fetches from SRAM share the
+ * S-bus with the data and with DMA. not in CCM, the core can not
+ * execute from it
+ */
+#if !defined (HOST_BUILD)
+#define RAMFUNC     __attribute__ ((section(".ramfunc"), long_call, noinline))
+#else
+#define RAMFUNC
+#endif
+
+/* SRAM the startup code leaves alone
+ *   NOINIT    never written: buffers that are filled before they are
+ *             read, logs that have to survive a warm reset. random
+ *             after power on, check a magic number
+ *   LAZY_BSS  zero, but not before main: DMA2 stream 0 zeroes it in
+ *             the background from the start of main. call
+ *             lazy_zero_wait() before the first use, and before DMA2
+ *             stream 0 is set up for anything else
+ *   static uint8_t frame[32768] LAZY_BSS;
+ * plain .bss on the host
+ */
+#if !defined (HOST_BUILD)
+#define NOINIT      __attribute__ ((section(".noinit")))
+#define LAZY_BSS    __attribute__ ((section(".lazy_bss")))
+#else
+#define NOINIT
+#define LAZY_BSS
+#endif
+
+/* core cycles from reset to main, at the 16 Mhz HSI of the reset */
+extern uint32_t boot_cycles;
+
+void boot_timer_start(void);
+void boot_copy(uint32_t *dst, const uint32_t *src, const uint32_t *end);
+void boot_zero(uint32_t *dst, const uint32_t *end);
+int  boot_zero_dma(uint32_t *dst, const uint32_t *end);
+void boot_dma_wait(void);
+void boot_ccm(void);
+void lazy_zero_start(void);
+int  lazy_zero_done(void);
+void lazy_zero_wait(void);
+
 void _init_data(void);
 void Reset_Handler(void);
 void reset_clock(void);
 void set_sysclk_to_168(void);
-/* bring main */
+uint32_t get_sysclk(void);
+uint32_t get_hclk(void);
+uint32_t get_pclk1(void);
+uint32_t get_pclk2(void);
+/* bring main, host builds have their own */
+#ifndef HOST_BUILD
 extern int main(void);
+#endif
 
 #ifdef __cplusplus
 }
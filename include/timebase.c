@@ -0,0 +1,202 @@
+/*
+ * timebase.c
+ *
+ * description:
+ *   64-bit time and delays on the DWT cycle counter, see timebase.h
+ */
+
+#include "timebase.h"
+
+#ifdef HOST_BUILD
+#include <time.h>
+#else
+#include "stm32f4xx.h"
+#endif
+
+/*************************************************
+* variables
+*************************************************/
+// half periods (2^31 cycles) of the counter since timebase_init
+static volatile uint32_t tb_half;
+
+static uint32_t tb_per_us;
+// floor((2^64 - 1) / tb_per_us)
+static uint64_t tb_recip;
+// cycles a delay_cycles call takes on top of what it waits
+static uint32_t tb_overhead;
+
+/*************************************************
+* counter
+*************************************************/
+#ifdef HOST_BUILD
+static inline uint32_t counter(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+static inline void counter_start(void)
+{
+}
+
+// move the half period count from old to old + 1 unless someone did
+static inline void half_advance(uint32_t old)
+{
+	__atomic_compare_exchange_n(&tb_half, &old, old + 1, 0,
+	                            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+#else
+static inline uint32_t counter(void)
+{
+	return DWT->CYCCNT;
+}
+
+static inline void counter_start(void)
+{
+	// keep HCLK running in sleep mode - DBG_SLEEP bit 0 on DBGMCU_CR
+	DBGMCU->CR |= (1 << 0);
+	// trace enable - TRCENA bit 24 on DEMCR
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	// counter enable - CYCCNTENA bit 0 on DWT_CTRL
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// exclusive monitor: the store fails when an interrupt came in
+//   between, then the value is read again
+static inline void half_advance(uint32_t old)
+{
+	do {
+		if (__LDREXW(&tb_half) != old) {
+			__CLREX();
+			return;
+		}
+	} while (__STREXW(old + 1, &tb_half));
+}
+#endif
+
+/*************************************************
+* arithmetic
+*************************************************/
+// upper 64 bits of a 64 x 64 multiply, four UMULL on Cortex-M4
+static uint64_t mul_hi(uint64_t a, uint64_t b)
+{
+	uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+	uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+	uint64_t p00 = a0 * b0, p01 = a0 * b1;
+	uint64_t p10 = a1 * b0, p11 = a1 * b1;
+	uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+
+	return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+
+/*
+ * cycles / cycles per us. the reciprocal is rounded down, so the
+ * quotient is exact or one short, the remainder tells which
+ */
+uint64_t timebase_cycles_to_us(uint64_t cycles)
+{
+	uint64_t q = mul_hi(cycles, tb_recip);
+
+	if (cycles - q * tb_per_us >= tb_per_us)
+		q++;
+	return q;
+}
+
+/*************************************************
+* api
+*************************************************/
+
+/*
+ * start the counter from 0. core_hz is the core clock, a whole
+ * number of MHz
+ */
+void timebase_init(uint32_t core_hz)
+{
+	uint32_t t0, t1, best = 0xFFFFFFFF;
+	int i;
+
+#ifdef HOST_BUILD
+	(void)core_hz;
+	tb_per_us = 1000;
+#else
+	tb_per_us = core_hz / 1000000;
+#endif
+	tb_recip = 0xFFFFFFFFFFFFFFFFULL / tb_per_us;
+
+	counter_start();
+	tb_half = counter() >> 31;
+
+	// what a call costs beyond the cycles it waits for, best of a few
+	tb_overhead = 0;
+	for (i = 0; i < 4; i++) {
+		t0 = counter();
+		delay_cycles(1000);
+		t1 = counter();
+		if (t1 - t0 - 1000 < best)
+			best = t1 - t0 - 1000;
+	}
+	tb_overhead = best;
+}
+
+uint64_t now_cycles(void)
+{
+	// the count first, then the counter. volatile keeps the order
+	uint32_t h = tb_half;
+	uint32_t c = counter();
+
+	if ((c >> 31) != (h & 1)) {
+		// a half period went by since the count was last moved
+		half_advance(h);
+		h++;
+	}
+	return ((uint64_t)h << 31) + (c & 0x7FFFFFFF);
+}
+
+uint64_t now_us(void)
+{
+	return timebase_cycles_to_us(now_cycles());
+}
+
+uint32_t timebase_cycles_per_us(void)
+{
+	return tb_per_us;
+}
+
+uint32_t timebase_overhead(void)
+{
+	return tb_overhead;
+}
+
+/*
+ * busy wait for n core cycles, up to 2^32 - 1
+ */
+void delay_cycles(uint32_t n)
+{
+	uint32_t t0 = counter();
+
+	if (n <= tb_overhead)
+		return;
+	n -= tb_overhead;
+	while ((uint32_t)(counter() - t0) < n);
+}
+
+void delay_us(uint32_t us)
+{
+	// one second at a time keeps the cycle count in 32 bits
+	while (us > 1000000) {
+		delay_cycles(tb_per_us * 1000000);
+		us -= 1000000;
+	}
+	delay_cycles(tb_per_us * us);
+}
+
+void delay_ms(uint32_t ms)
+{
+	while (ms > 1000) {
+		delay_us(1000000);
+		ms -= 1000;
+	}
+	delay_us(ms * 1000);
+}
@@ -0,0 +1,66 @@
+/*
+ * timebase.h
+ *
+ * description:
+ *   64-bit monotonic time from the DWT cycle counter and delays that
+ *   do not depend on the optimization level.
+ *
+ *   CYCCNT counts core clock cycles and wraps at 2^32 (25.6 s at
+ *   168 MHz). now_cycles() extends it to 64 bits with a count of half
+ *   periods (2^31 cycles) kept in one word. a reader takes the word,
+ *   then the counter: if the top bit of the counter no longer matches
+ *   the parity of the count, a half period has passed and the reader
+ *   moves the count on with LDREX/STREX. no interrupt masking, no
+ *   lock, callable from thread and interrupt context at any priority.
+ *   the only rule: something has to call now_cycles() or now_us()
+ *   at least once per half period (12.7 s at 168 MHz).
+ *
+ *   now_us() divides by the cycles per microsecond with a 64-bit
+ *   reciprocal multiply and one correction step, exact and without
+ *   the 64-bit division of libgcc.
+ *
+ *   delay_cycles() / delay_us() / delay_ms() spin on the counter
+ *   itself. the call overhead is measured once in timebase_init()
+ *   and taken off, short delays are accurate to a few cycles.
+ *
+ *   the core clock and with it CYCCNT stop in sleep mode (WFI/WFE).
+ *   timebase_init() sets DBG_SLEEP in DBGMCU_CR, which keeps HCLK
+ *   running in sleep so the time stays right across WFI, at the cost
+ *   of some sleep current. stop and standby still stop the counter.
+ *
+ *   host builds (HOST_BUILD) count nanoseconds from CLOCK_MONOTONIC
+ *   truncated to 32 bits, 1 "cycle" per ns, so the extension wraps
+ *   every 4.3 s there and can be checked on the development machine.
+ *
+ * usage:
+ *   timebase_init(168000000);
+ *   uint64_t t0 = now_us();
+ *   delay_us(25);
+ *   uint32_t took = (uint32_t)(now_us() - t0);
+ */
+
+#ifndef __TIMEBASE_H
+#define __TIMEBASE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+void     timebase_init(uint32_t core_hz);
+uint64_t now_cycles(void);
+uint64_t now_us(void);
+uint64_t timebase_cycles_to_us(uint64_t cycles);
+uint32_t timebase_cycles_per_us(void);
+uint32_t timebase_overhead(void);
+
+void     delay_cycles(uint32_t n);
+void     delay_us(uint32_t us);
+void     delay_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * vectors.c
+ *
+ * description:
+ *   the shared vector table and its copy in SRAM, see vectors.h
+ */
+
+#include "vectors.h"
+#include "system_stm32f4xx.h"
+
+/*************************************************
+* exceptions and interrupts of the device
+* X(name, slot) for the core name_Handler, the
+* hard fault has no IRQn in the device header
+* X(name) for name_IRQHandler at 16 + name_IRQn
+*************************************************/
+#define CORE_EXCEPTIONS(X) \
+	X(NMI, 2) X(HardFault, 3) X(MemManage, 4) X(BusFault, 5) \
+	X(UsageFault, 6) X(SVC, 11) X(DebugMon, 12) X(PendSV, 14) X(SysTick, 15)
+
+/* on every part */
+#define IRQS_COMMON(X) \
+	X(WWDG) X(PVD) X(TAMP_STAMP) X(RTC_WKUP) X(FLASH) X(RCC) \
+	X(EXTI0) X(EXTI1) X(EXTI2) X(EXTI3) X(EXTI4) \
+	X(DMA1_Stream0) X(DMA1_Stream1) X(DMA1_Stream2) X(DMA1_Stream3) \
+	X(DMA1_Stream4) X(DMA1_Stream5) X(DMA1_Stream6) X(ADC) X(EXTI9_5) \
+	X(TIM1_BRK_TIM9) X(TIM1_UP_TIM10) X(TIM1_TRG_COM_TIM11) X(TIM1_CC) \
+	X(TIM2) X(TIM3) X(TIM4) X(I2C1_EV) X(I2C1_ER) X(I2C2_EV) X(I2C2_ER) \
+	X(SPI1) X(SPI2) X(USART1) X(USART2) X(EXTI15_10) X(RTC_Alarm) \
+	X(OTG_FS_WKUP) X(DMA1_Stream7) X(SDIO) X(TIM5) X(SPI3) \
+	X(DMA2_Stream0) X(DMA2_Stream1) X(DMA2_Stream2) X(DMA2_Stream3) \
+	X(DMA2_Stream4) X(OTG_FS) X(DMA2_Stream5) X(DMA2_Stream6) \
+	X(DMA2_Stream7) X(USART6) X(I2C3_EV) X(I2C3_ER) X(FPU)
+
+/* F405, F407 and F429 */
+#define IRQS_F40X(X) \
+	X(CAN1_TX) X(CAN1_RX0) X(CAN1_RX1) X(CAN1_SCE) X(USART3) \
+	X(TIM8_BRK_TIM12) X(TIM8_UP_TIM13) X(TIM8_TRG_COM_TIM14) X(TIM8_CC) \
+	X(UART4) X(UART5) X(TIM6_DAC) X(TIM7) \
+	X(CAN2_TX) X(CAN2_RX0) X(CAN2_RX1) X(CAN2_SCE) \
+	X(OTG_HS_EP1_OUT) X(OTG_HS_EP1_IN) X(OTG_HS_WKUP) X(OTG_HS)
+
+#if defined (STM32F429xx)
+#define IRQS(X) IRQS_COMMON(X) IRQS_F40X(X) \
+	X(ETH) X(ETH_WKUP) X(DCMI) X(FMC) X(HASH_RNG) X(UART7) X(UART8) \
+	X(SPI4) X(SPI5) X(SPI6) X(SAI1) X(LTDC) X(LTDC_ER) X(DMA2D)
+#elif defined (STM32F401xC) || defined (STM32F401xE)
+#define IRQS(X) IRQS_COMMON(X) X(SPI4)
+#elif defined (STM32F405xx)
+#define IRQS(X) IRQS_COMMON(X) IRQS_F40X(X) X(FSMC) X(RNG)
+#else
+#define IRQS(X) IRQS_COMMON(X) IRQS_F40X(X) X(FSMC) X(RNG) \
+	X(ETH) X(ETH_WKUP) X(DCMI)
+#endif
+
+/*************************************************
+* weak handlers, a project function of the same
+* name replaces them
+*************************************************/
+#define CORE_WEAK(name, slot) \
+	void name##_Handler(void) __attribute__ ((weak, alias("Default_Handler")));
+#define IRQ_WEAK(name) \
+	void name##_IRQHandler(void) __attribute__ ((weak, alias("Default_Handler")));
+
+CORE_EXCEPTIONS(CORE_WEAK)
+IRQS(IRQ_WEAK)
+
+/*************************************************
+* Vector Table
+*************************************************/
+// get the stack pointer location from linker
+typedef void (* const intfunc)(void);
+extern unsigned long __stack;
+
+#define CORE_SLOT(name, slot)  [slot] = name##_Handler,
+#define IRQ_SLOT(name)         [16 + name##_IRQn] = name##_IRQHandler,
+
+// every slot Default_Handler first, the reserved ones as well, then
+//   the handlers over it by number. the range is a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+__extension__ __attribute__ ((section(".vectors"), used))
+void (* const vector_table[VECTORS_N])(void) = {
+	[0] = (intfunc)((unsigned long)&__stack),
+	[1] = Reset_Handler,
+	[2 ... VECTORS_N - 1] = Default_Handler,
+	CORE_EXCEPTIONS(CORE_SLOT)
+	IRQS(IRQ_SLOT)
+};
+#pragma GCC diagnostic pop
+
+/*************************************************
+* default interrupt handler
+*************************************************/
+volatile uint32_t vectors_unexpected;
+
+void Default_Handler(void)
+{
+	// the exception number, VECTACTIVE bits 8:0 on ICSR
+	vectors_unexpected = SCB->ICSR & 0x1FF;
+	for (;;);  // Wait forever
+}
+
+/*************************************************
+* vector table in SRAM
+*************************************************/
+_Static_assert(VECTORS_N * 4 <= VECTORS_ALIGN, "VECTORS_ALIGN too small for the table");
+
+static vector_t ram_table[VECTORS_N] __attribute__ ((aligned(VECTORS_ALIGN)));
+
+static int in_ram(void)
+{
+	return SCB->VTOR == (uint32_t)ram_table;
+}
+
+/*
+ * copy the table to SRAM and move VTOR there, once
+ */
+void vectors_to_ram(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t i;
+
+	__disable_irq();
+	if (!in_ram()) {
+		for (i = 0; i < VECTORS_N; i++)
+			ram_table[i] = vector_table[i];
+		__DSB();
+		SCB->VTOR = (uint32_t)ram_table;
+		__DSB();
+		__ISB();
+	}
+	__set_PRIMASK(primask);
+}
+
+/*
+ * handler into the slot of irq (CMSIS number, the core exceptions are
+ * negative), 0 puts the one of the flash table back. the next
+ * interrupt goes to it. returns the handler that was there, 0 for a
+ * number out of range
+ */
+vector_t vectors_set(IRQn_Type irq, vector_t handler)
+{
+	int32_t n = 16 + (int32_t)irq;
+	vector_t old;
+
+	if (n < 2 || n >= VECTORS_N)
+		return 0;
+	vectors_to_ram();
+	old = ram_table[n];
+	ram_table[n] = handler ? handler : vector_table[n];
+	__DSB();
+	return old;
+}
+
+/*
+ * the handler the next interrupt of irq goes to, from where VTOR is
+ */
+vector_t vectors_get(IRQn_Type irq)
+{
+	int32_t n = 16 + (int32_t)irq;
+
+	if (n < 2 || n >= VECTORS_N)
+		return 0;
+	return ((const vector_t *)SCB->VTOR)[n];
+}
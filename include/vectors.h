@@ -0,0 +1,76 @@
+/*
+ * vectors.h
+ *
+ * description:
+ *   one vector table for every project, complete for the device of
+ *   the build (STM32F401, F405/F407 or F429), and a copy of it in
+ *   SRAM where handlers can be attached at run time.
+ *
+ *   vector_table in vectors.c has a slot for every exception and
+ *   interrupt of the device. each one is a weak alias of
+ *   Default_Handler under the CMSIS name (USART2_IRQHandler,
+ *   SysTick_Handler, HardFault_Handler ...), a function of the same
+ *   name in the project takes its place at link time. the table is
+ *   built from the IRQn numbers of the device header, a slot can not
+ *   end up at the wrong offset and none is left 0: an interrupt
+ *   nobody handles lands in Default_Handler, which keeps its
+ *   exception number in vectors_unexpected for the debugger, instead
+ *   of jumping to address 0.
+ *
+ *   vectors_to_ram() copies the table to SRAM and points VTOR at the
+ *   copy. vectors_set(irq, fn) then writes fn into the slot, the
+ *   hardware calls it straight from there on the next interrupt.
+ *   there is no dispatch in between, the latency is that of the flash
+ *   table or better (no flash wait states on the vector fetch, see
+ *   projects/ramfunc). vectors_set copies the table on first use.
+ *
+ *   a project uses it instead of its own table:
+ *     SRCS += ../../include/vectors.c         in the makefile
+ *   and names its handlers after CMSIS, C linkage from C++
+ *   (extern "C").
+ *
+ * usage:
+ *   void USART2_IRQHandler(void) { ... }     fixed at link time
+ *   ...
+ *   vectors_set(TIM2_IRQn, tim2_ticks);      attached at run time
+ *   NVIC_EnableIRQ(TIM2_IRQn);
+ */
+
+#ifndef __VECTORS_H
+#define __VECTORS_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* interrupts of the device, after the 16 core exceptions */
+#if defined (STM32F429xx)
+#define VECTORS_NIRQ     91
+#elif defined (STM32F401xC) || defined (STM32F401xE)
+#define VECTORS_NIRQ     85
+#else
+#define VECTORS_NIRQ     82
+#endif
+#define VECTORS_N        (16 + VECTORS_NIRQ)
+
+/* VTOR needs the table aligned to its size rounded up to a power of 2 */
+#define VECTORS_ALIGN    512
+
+typedef void (*vector_t)(void);
+
+extern void (* const vector_table[VECTORS_N])(void);
+extern volatile uint32_t vectors_unexpected;
+
+void     Default_Handler(void);
+void     vectors_to_ram(void);
+vector_t vectors_set(IRQn_Type irq, vector_t handler);
+vector_t vectors_get(IRQn_Type irq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,7 +18,30 @@ INCLUDES += -I$(CMSIS)/CMSIS/Core/Include
 CFLAGS += $(CDEFS)
 
 CFLAGS += -mcpu=cortex-m4 -mthumb # processor setup
-CFLAGS += -O0 # optimization is off
+
+# Build profile, set PROFILE in the project makefile or on the command line
+#   make PROFILE=debug
+#   debug - -O0, soft float calling convention, steps line by line
+#   speed - -O2, hard float ABI, the FPU is turned on in Reset_Handler
+#   size  - -Os, hard float ABI, link time optimization
+# the libraries follow the float ABI through the multilib flags on the
+# link line. make profiles builds all three and prints their sizes.
+PROFILE ?= speed
+
+ifeq ($(PROFILE), debug)
+PERFORMANCE_FLAGS = -O0 # optimization is off
+FLOAT_ABI = softfp
+else ifeq ($(PROFILE), speed)
+PERFORMANCE_FLAGS = -O2
+FLOAT_ABI = hard
+else ifeq ($(PROFILE), size)
+PERFORMANCE_FLAGS = -Os -flto
+FLOAT_ABI = hard
+# only the linker keeps the vector table, tell link time optimization
+LDFLAGS += -Wl,--undefined=vector_table
+else
+$(error PROFILE has to be debug, speed or size)
+endif
 
 ifeq ($(DEBUG), 1)
 CFLAGS += -ggdb -gdwarf-2 # generate debug info
@@ -37,18 +60,19 @@ CFLAGS += -fomit-frame-pointer # do not use fp if not needed
 CFLAGS += -ffunction-sections -fdata-sections
 #CFLAGS += --std=c99
 
-# Chooses the relevant FPU option
+# Chooses the relevant FPU option, from the profile
+#   softfp: FPU instructions, floats passed in core registers
+#   hard:   floats passed in FPU registers, __FPU_USED is set by CMSIS
+#           so Reset_Handler enables CP10/CP11
 #CFLAGS += -mfloat-abi=soft # No FP
-CFLAGS += -mfloat-abi=softfp -mfpu=fpv4-sp-d16 -lang-c-c++-comments # Soft FP
-#CFLAGS += -mfloat-abi=hard -mfpu=fpv4-sp-d16 # Hard FP
+CFLAGS += -mfloat-abi=$(FLOAT_ABI) -mfpu=fpv4-sp-d16 -lang-c-c++-comments
 
 # C++ size optimizations
 CPPFLAGS += -fno-rtti -fno-exceptions 
 
-LDFLAGS += -mfloat-abi=softfp -mfpu=fpv4-sp-d16 # Soft FP
-#LDFLAGS += -mfloat-abi=hard -mfpu=fpv4-sp-d16 # Hard FP
+LDFLAGS += -mfloat-abi=$(FLOAT_ABI) -mfpu=fpv4-sp-d16 # picks the libc/libm variant
 
-LDFLAGS += -march=armv7e-m # processor setup
+LDFLAGS += -march=armv7e-m -mthumb # processor setup
 LDFLAGS += -nostartfiles # no start files are used
 
 ifeq ($(DEBUG), 1)
@@ -114,6 +138,14 @@ $(TARGET).elf: $(OBJS) $(CPP_OBJS)
 size: $(TARGET).elf
 	@$(SIZE) $(TARGET).elf
 
+# every profile from scratch, keeps $(TARGET)-<profile>.elf to compare
+profiles:
+	@for p in debug speed size; do \
+		$(MAKE) --no-print-directory -s clean build PROFILE=$$p > /dev/null || exit 1; \
+		cp $(TARGET).elf $(TARGET)-$$p.elf; \
+		echo "$$p:"; $(SIZE) $(TARGET)-$$p.elf; \
+	done
+
 disass: $(TARGET).elf
 	@$(OBJDUMP) -d $(TARGET).elf
 
@@ -145,7 +177,8 @@ clean:
 	@rm -f $(TARGET).map
 	@rm -f $(TARGET).hex
 	@rm -f $(TARGET).lst
+	@rm -f $(TARGET)-debug.elf $(TARGET)-speed.elf $(TARGET)-size.elf
 	@rm -f *.o
 	@rm -f *.d
 
-.PHONY: all build size clean burn disass disass-all
+.PHONY: all build size profiles clean burn disass disass-all
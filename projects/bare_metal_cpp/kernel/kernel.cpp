@@ -0,0 +1,470 @@
+/**
+ * Small preemptive kernel for Cortex-M4, see kernel.hpp
+ *
+ * Stack of a task that is not running, from its saved sp up:
+ *   r4-r11, EXC_RETURN          saved by PendSV
+ *   s16-s31                     saved by PendSV, FPU frame only
+ *   r0-r3, r12, lr, pc, xPSR    stacked by the hardware
+ *   s0-s15, FPSCR, reserved     stacked by the hardware, FPU frame only
+ */
+
+#include <string.h>
+
+#include "stm32f407xx.h"
+#include "kernel.hpp"
+
+namespace kernel {
+
+// running task and the pick of the next one, used from the PendSV
+// assembly so they are C
+extern "C" {
+task *volatile k_current;
+void k_switch();
+}
+
+void (*tick_hook)();
+void (*idle_hook)();
+volatile uint32_t switches;
+
+static task *tasks[max_prio + 1];
+static volatile uint32_t ready;
+static volatile uint32_t ticks;
+
+static task idle_task;
+alignas(8) static uint32_t idle_stack[min_stack];
+
+/** Priority mask helpers, the highest set bit with CLZ
+ */
+static inline uint32_t bit(uint32_t prio) {
+    return 1u << prio;
+}
+
+static inline uint32_t highest(uint32_t mask) {
+    return 31u - __CLZ(mask);
+}
+
+/** Kernel lock, PRIMASK so it works from any interrupt
+ */
+static inline uint32_t lock() {
+    uint32_t pm = __get_PRIMASK();
+    __disable_irq();
+    return pm;
+}
+
+static inline void unlock(uint32_t pm) {
+    __set_PRIMASK(pm);
+}
+
+/** Pend a switch if the running task is not the best ready one anymore,
+ * PendSV runs once the lock and every other interrupt is gone
+ */
+static void schedule() {
+    task *cur = k_current;
+    if (cur && tasks[highest(ready)] != cur) {
+        // PENDSVSET, bit 28 on ICSR
+        SCB->ICSR = (1u << 28);
+    }
+}
+
+/** Make a blocked task ready, result is what its wait returns
+ */
+static void wake(task *t, uint32_t result) {
+    if (t->waitlist) {
+        *t->waitlist &= ~bit(t->prio);
+    }
+    t->waitlist = nullptr;
+    t->timeout = forever;
+    t->result = result;
+    t->st = state::ready;
+    ready |= bit(t->prio);
+}
+
+/** Block a task on an object (or on nothing for sleep), with the lock.
+ * the switch happens when the caller unlocks
+ */
+static void block(task *t, uint32_t *waitlist, uint32_t timeout) {
+    ready &= ~bit(t->prio);
+    t->st = state::blocked;
+    t->waitlist = waitlist;
+    if (waitlist) {
+        *waitlist |= bit(t->prio);
+    }
+    t->timeout = timeout;
+    t->result = 0;
+    schedule();
+}
+
+/** A task function returned, its priority is free again
+ */
+static void task_exit() {
+    task *t = k_current;
+    lock();
+    ready &= ~bit(t->prio);
+    t->st = state::done;
+    tasks[t->prio] = nullptr;
+    schedule();
+    unlock(0);
+    while (true);
+}
+
+static void idle(void *) {
+    while (true) {
+        if (idle_hook) {
+            idle_hook();
+        }
+        __WFI();
+    }
+}
+
+/** Called from PendSV with interrupts off
+ */
+extern "C" __attribute__((used)) void k_switch() {
+    task *next = tasks[highest(ready)];
+    if (next != k_current) {
+        next->switches++;
+        switches++;
+    }
+    k_current = next;
+}
+
+/*************************************************
+* tasks
+*************************************************/
+/** Add a task at priority prio (1 .. max_prio, unique), it runs fn(arg)
+ * on stack, words long and 8 byte aligned. Returns false for a bad or
+ * taken priority or a too small stack
+ */
+bool create(task &t, task_fn fn, void *arg, uint8_t prio,
+            uint32_t *stack, uint32_t words, const char *name) {
+    if (prio > max_prio || words < min_stack) {
+        return false;
+    }
+
+    uint32_t pm = lock();
+    if (tasks[prio]) {
+        unlock(pm);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < words; i++) {
+        stack[i] = stack_paint;
+    }
+
+    // the frame an exception would have left, from the top down. the
+    // top stays 8 byte aligned as exception entry wants it
+    uint32_t *sp = stack + (words & ~1u);
+    *--sp = 0x01000000;                                  // xPSR, Thumb bit
+    *--sp = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(fn)) & ~1u;  // pc
+    *--sp = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(task_exit)); // lr
+    for (int i = 0; i < 4; i++) {
+        *--sp = 0;                                       // r12, r3, r2, r1
+    }
+    *--sp = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(arg));       // r0
+    // EXC_RETURN: thread mode, process stack, no FPU frame
+    *--sp = 0xFFFFFFFD;
+    for (int i = 0; i < 8; i++) {
+        *--sp = 0;                                       // r11 .. r4
+    }
+
+    t.sp = sp;
+    t.stack = stack;
+    t.stack_words = words;
+    t.name = name;
+    t.prio = prio;
+    t.st = state::ready;
+    t.waitlist = nullptr;
+    t.wait_buf = nullptr;
+    t.timeout = forever;
+    t.result = 0;
+    t.switches = 0;
+
+    tasks[prio] = &t;
+    ready |= bit(prio);
+    schedule();
+    unlock(pm);
+    return true;
+}
+
+/** Start the tick and switch to the highest priority task. The stack
+ * main runs on stays the stack of the interrupt handlers
+ */
+void start(uint32_t core_hz) {
+    create(idle_task, idle, nullptr, 0, idle_stack, min_stack, "idle");
+
+    // PendSV below everything, the tick just above it
+    NVIC_SetPriority(PendSV_IRQn, 15);
+    NVIC_SetPriority(SysTick_IRQn, 14);
+
+    // core clock (bit 2), interrupt (bit 1), counter on (bit 0)
+    SysTick->LOAD = core_hz / tick_hz - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL = (1 << 2) | (1 << 1) | (1 << 0);
+
+    // no current task, the first switch saves nothing
+    __disable_irq();
+    k_current = nullptr;
+    SCB->ICSR = (1u << 28);
+    __enable_irq();
+
+    while (true);
+}
+
+/** Block the calling task for ticks ticks
+ */
+void sleep(uint32_t n) {
+    if (n == 0) {
+        return;
+    }
+    uint32_t pm = lock();
+    block(k_current, nullptr, n);
+    unlock(pm);
+}
+
+/** Block the calling task until the tick count reaches wake, for a fixed
+ * rate: wake += period; sleep_until(wake). A wake that already passed
+ * (the task fell behind, e.g. blocked on a full queue) does not sleep
+ * and moves wake to now, instead of waiting for the count to wrap
+ */
+void sleep_until(uint32_t &wake) {
+    uint32_t pm = lock();
+    int32_t d = static_cast<int32_t>(wake - ticks);
+    if (d > 0) {
+        block(k_current, nullptr, static_cast<uint32_t>(d));
+    } else {
+        wake = ticks;
+    }
+    unlock(pm);
+}
+
+uint32_t now() {
+    return ticks;
+}
+
+task *self() {
+    return k_current;
+}
+
+/** Words at the bottom of the stack that were never written
+ */
+uint32_t stack_unused(const task &t) {
+    uint32_t n = 0;
+    while (n < t.stack_words && t.stack[n] == stack_paint) {
+        n++;
+    }
+    return n;
+}
+
+/*************************************************
+* event flags
+*************************************************/
+static uint32_t flags_match(uint32_t bits, uint32_t mask, uint8_t mode) {
+    uint32_t got = bits & mask;
+    if ((mode & flags_all) && got != mask) {
+        return 0;
+    }
+    return got;
+}
+
+/** Wait until any (flags_any) or all (flags_all) bits of mask are set,
+ * with flags_consume added the bits taken are cleared. Returns the bits
+ * taken, 0 on timeout
+ */
+uint32_t flags_wait(flags &f, uint32_t mask, uint8_t mode, uint32_t timeout) {
+    task *me = k_current;
+    uint32_t pm = lock();
+    uint32_t got = flags_match(f.bits, mask, mode);
+
+    if (got) {
+        if (mode & flags_consume) {
+            f.bits &= ~got;
+        }
+    } else if (timeout) {
+        me->wait_mask = mask;
+        me->wait_mode = mode;
+        block(me, &f.waiting, timeout);
+        unlock(pm);
+        // back here when woken
+        return me->result;
+    }
+    unlock(pm);
+    return got;
+}
+
+/** Set bits and wake every waiting task that is satisfied now, higher
+ * priorities first. Interrupt safe
+ */
+void flags_set(flags &f, uint32_t bits) {
+    uint32_t pm = lock();
+    f.bits |= bits;
+
+    uint32_t w = f.waiting;
+    while (w) {
+        uint32_t p = highest(w);
+        w &= ~bit(p);
+        task *t = tasks[p];
+        uint32_t got = flags_match(f.bits, t->wait_mask, t->wait_mode);
+        if (got) {
+            if (t->wait_mode & flags_consume) {
+                f.bits &= ~got;
+            }
+            wake(t, got);
+        }
+    }
+    schedule();
+    unlock(pm);
+}
+
+void flags_clear(flags &f, uint32_t bits) {
+    uint32_t pm = lock();
+    f.bits &= ~bits;
+    unlock(pm);
+}
+
+/*************************************************
+* message queues
+*************************************************/
+/** len items of item bytes each in buf
+ */
+void queue_init(queue &q, void *buf, uint16_t item, uint16_t len) {
+    q.buf = static_cast<uint8_t *>(buf);
+    q.item = item;
+    q.len = len;
+    q.head = 0;
+    q.count = 0;
+    q.getters = 0;
+    q.putters = 0;
+}
+
+static void queue_push(queue &q, const void *item) {
+    uint32_t tail = (q.head + q.count) % q.len;
+    memcpy(q.buf + tail * q.item, item, q.item);
+    q.count++;
+}
+
+static void queue_pop(queue &q, void *item) {
+    memcpy(item, q.buf + q.head * q.item, q.item);
+    q.head = static_cast<uint16_t>((q.head + 1) % q.len);
+    q.count--;
+}
+
+/** Add an item, wait up to timeout ticks for room. Returns false if it
+ * did not fit. Interrupt safe with timeout 0
+ */
+bool queue_put(queue &q, const void *item, uint32_t timeout) {
+    task *me = k_current;
+    uint32_t pm = lock();
+
+    if (q.getters) {
+        // getters only wait on an empty queue, the item goes right to
+        // the highest one
+        task *t = tasks[highest(q.getters)];
+        memcpy(t->wait_buf, item, q.item);
+        wake(t, 1);
+        schedule();
+    } else if (q.count < q.len) {
+        queue_push(q, item);
+    } else if (timeout) {
+        me->wait_buf = const_cast<void *>(item);
+        block(me, &q.putters, timeout);
+        unlock(pm);
+        return me->result != 0;
+    } else {
+        unlock(pm);
+        return false;
+    }
+    unlock(pm);
+    return true;
+}
+
+/** Take the oldest item, wait up to timeout ticks for one. Returns false
+ * if there was none. Interrupt safe with timeout 0
+ */
+bool queue_get(queue &q, void *item, uint32_t timeout) {
+    task *me = k_current;
+    uint32_t pm = lock();
+
+    if (q.count) {
+        queue_pop(q, item);
+        if (q.putters) {
+            // room again, the item of the highest waiting putter goes in
+            task *t = tasks[highest(q.putters)];
+            queue_push(q, t->wait_buf);
+            wake(t, 1);
+            schedule();
+        }
+    } else if (timeout) {
+        me->wait_buf = item;
+        block(me, &q.getters, timeout);
+        unlock(pm);
+        return me->result != 0;
+    } else {
+        unlock(pm);
+        return false;
+    }
+    unlock(pm);
+    return true;
+}
+
+}
+
+/*************************************************
+* handlers, override the weak ones of handlers_cm.cpp
+*************************************************/
+/** Count the tick down on every blocked task, wake the ones that ran
+ * out, then the hook
+ */
+void SYSTICK_handler() {
+    using namespace kernel;
+
+    uint32_t pm = lock();
+    ticks++;
+    for (uint32_t p = 1; p <= max_prio; p++) {
+        task *t = tasks[p];
+        if (t && t->st == state::blocked && t->timeout != forever && --t->timeout == 0) {
+            wake(t, 0);
+        }
+    }
+    schedule();
+    unlock(pm);
+
+    if (tick_hook) {
+        tick_hook();
+    }
+}
+
+/** Save the running task, pick the next one, restore it
+ */
+__attribute__((naked)) void PENDSV_handler() {
+    __asm volatile(
+        "   mrs     r0, psp             \n"
+        "   ldr     r3, =k_current      \n"
+        "   ldr     r2, [r3]            \n"
+        // the first switch has nothing to save
+        "   cbz     r2, 1f              \n"
+#ifdef __ARM_FP
+        // s16-s31 only with an FPU frame (EXC_RETURN bit 4 clear), this
+        // also makes the hardware store the lazily stacked s0-s15
+        "   tst     lr, #0x10           \n"
+        "   it      eq                  \n"
+        "   vstmdbeq r0!, {s16-s31}     \n"
+#endif
+        "   stmdb   r0!, {r4-r11, lr}   \n"
+        "   str     r0, [r2]            \n"
+        "1: cpsid   i                   \n"
+        "   bl      k_switch            \n"
+        "   cpsie   i                   \n"
+        "   ldr     r3, =k_current      \n"
+        "   ldr     r2, [r3]            \n"
+        "   ldr     r0, [r2]            \n"
+        "   ldmia   r0!, {r4-r11, lr}   \n"
+#ifdef __ARM_FP
+        "   tst     lr, #0x10           \n"
+        "   it      eq                  \n"
+        "   vldmiaeq r0!, {s16-s31}     \n"
+#endif
+        "   msr     psp, r0             \n"
+        "   isb                         \n"
+        "   bx      lr                  \n"
+        "   .ltorg                      \n"
+    );
+}
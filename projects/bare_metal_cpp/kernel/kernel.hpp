@@ -0,0 +1,131 @@
+/**
+ * Small preemptive kernel for Cortex-M4
+ *
+ * Tasks have unique priorities from 0 to 31, a higher number is a higher
+ * priority, 0 is the idle task. The highest priority ready task always
+ * runs: the ready tasks are a 32-bit mask, the next one is found with a
+ * single CLZ instruction. There are no time slices between tasks.
+ *
+ * Context switches happen in PendSV at the lowest exception priority,
+ * after every other interrupt is done. Anything that makes a higher
+ * priority task ready (an event, a message, the tick) only pends it.
+ * The hardware stacks r0-r3, r12, lr, pc and xPSR on the process stack,
+ * PendSV adds r4-r11 and EXC_RETURN. FPU registers are saved lazily:
+ * only a task that used the FPU has an extended frame (EXC_RETURN bit 4
+ * clear), only then s16-s31 are saved, and the hardware saves s0-s15
+ * only when the FPU is touched again (lazy stacking, on after reset).
+ *
+ * Tasks block on:
+ *   sleep(ticks)      the SysTick runs at tick_hz, sleep_until(wake) for
+ *                     a fixed rate
+ *   flags             32 event bits, wait for any or all of a mask,
+ *                     optionally clear them when taken
+ *   queue             fixed size items in a ring buffer, a waiting
+ *                     getter gets the item straight from the putter
+ * all with a timeout in ticks, 0 to poll, forever to wait. Waiting tasks
+ * of an object are a priority mask as well, the highest one is served
+ * first. flags_set(), queue_put() and queue_get() with timeout 0 can be
+ * called from interrupts below the kernel lock (all of them, the lock is
+ * PRIMASK).
+ *
+ * Every stack is painted at create(), stack_unused() tells how much of
+ * it was never touched.
+ *
+ * Usage:
+ *   static kernel::task t;
+ *   alignas(8) static uint32_t stack[256];
+ *   kernel::create(t, fn, arg, 5, stack, 256, "name");
+ *   kernel::start(168000000);      // never returns
+ */
+
+#ifndef KERNEL_HPP
+#define KERNEL_HPP
+
+#include <stdint.h>
+
+namespace kernel {
+
+// system tick
+constexpr uint32_t tick_hz = 1000;
+// timeout for waiting without end
+constexpr uint32_t forever = 0xFFFFFFFF;
+// priorities 0 .. max_prio, 0 is taken by the idle task
+constexpr uint32_t max_prio = 31;
+// stack paint, "FREE" like MEM_PAINT of include/memwatch.h
+constexpr uint32_t stack_paint = 0x45455246;
+// smallest stack: both exception frames with FPU and a little more
+constexpr uint32_t min_stack = 64;
+
+// wait modes of flags_wait, any or all of the mask, consume clears the
+// bits taken
+constexpr uint8_t flags_any = 0;
+constexpr uint8_t flags_all = 1;
+constexpr uint8_t flags_consume = 2;
+
+typedef void (*task_fn)(void *arg);
+
+enum class state : uint8_t { ready, blocked, done };
+
+struct task {
+    uint32_t *sp;           // saved stack pointer, first for PendSV
+    uint32_t *stack;        // lowest word of the stack
+    uint32_t stack_words;
+    const char *name;
+    uint8_t prio;
+    state st;
+    uint8_t wait_mode;      // flags_wait mode
+    uint32_t wait_mask;     // flags_wait mask
+    uint32_t *waitlist;     // mask of the object waited on, 0 for sleep
+    void *wait_buf;         // queue item of a blocked getter or putter
+    uint32_t timeout;       // ticks left, forever without
+    uint32_t result;        // flags taken, 1 for a queue item, 0 timeout
+    uint32_t switches;      // times switched in
+};
+
+struct flags {
+    uint32_t bits;
+    uint32_t waiting;       // priorities of the waiting tasks
+};
+
+struct queue {
+    uint8_t *buf;
+    uint16_t item;          // bytes per item
+    uint16_t len;           // items
+    uint16_t head;
+    uint16_t count;
+    uint32_t getters;       // priorities of tasks waiting for an item
+    uint32_t putters;       // priorities of tasks waiting for space
+};
+
+// tasks
+bool create(task &t, task_fn fn, void *arg, uint8_t prio,
+            uint32_t *stack, uint32_t words, const char *name);
+[[noreturn]] void start(uint32_t core_hz);
+void sleep(uint32_t ticks);
+void sleep_until(uint32_t &wake);
+uint32_t now();
+task *self();
+uint32_t stack_unused(const task &t);
+
+// called from the SysTick handler after the timeouts, 0 for none
+extern void (*tick_hook)();
+// called by the idle task before every WFI, 0 for none. it runs when
+// nothing else is ready, keep it short, a task that becomes ready
+// waits for it to return
+extern void (*idle_hook)();
+// context switches since start
+extern volatile uint32_t switches;
+
+// event flags
+uint32_t flags_wait(flags &f, uint32_t mask, uint8_t mode, uint32_t timeout);
+void flags_set(flags &f, uint32_t bits);
+void flags_clear(flags &f, uint32_t bits);
+
+// message queues
+void queue_init(queue &q, void *buf, uint16_t item, uint16_t len);
+bool queue_put(queue &q, const void *item, uint32_t timeout);
+bool queue_get(queue &q, void *item, uint32_t timeout);
+
+}
+
+#endif
@@ -1,24 +1,215 @@
+/*
+ * main.cpp
+ *
+ * description:
+ *   four tasks on the preemptive kernel in kernel/, started from the
+ *   C++ startup code in startup/.
+ *
+ *     leds    (prio 4)  waits for LED event flags and drives the LEDs
+ *     sensor  (prio 3)  every 10 ms a new float reading, a triangle
+ *                       wave of one second, into the queue. uses the
+ *                       FPU, so its context switches save FPU registers
+ *     control (prio 2)  takes the readings and runs a state machine
+ *                       low -> rising -> high -> falling, each state
+ *                       change sets the flag of its LED
+ *     report  (prio 1)  every second the switch count, the cycles
+ *                       from reset to main_app (boot_cycles), the
+ *                       main stack and heap high-water marks
+ *                       (include/memwatch.c) and the unused stack of
+ *                       each task over USART2. it waits for TXE in a
+ *                       busy loop, it is only ever preempted and does
+ *                       not keep the others from running
+ *
+ *   idle (prio 0) scans a chunk of the main stack paint, then sleeps
+ *   with WFI when nobody is ready. the bottom of the main stack is an
+ *   MPU guard region, an overflow stops in MEMMANAGE_handler.
+ *
+ * setup:
+ *   clock at 168 MHz, 1 kHz tick
+ *   4 LEDs on PD12 (low), PD13 (rising), PD14 (high), PD15 (falling)
+ *   USART2 TX on PA2 (AF7), 115200 8N1
+ */
 
 #include "stm32f407xx.h"
 #include "system_stm32f4xx.h"
+#include "memwatch.h"
+#include "kernel/kernel.hpp"
 
-// define used registers
-static volatile unsigned &RCC_AHB1 = *reinterpret_cast<unsigned *>(0x40021014);
-static volatile unsigned &GPIOA_MODER = *reinterpret_cast<unsigned *>(0x48000000);
-static volatile unsigned &GPIOA_BSRR = *reinterpret_cast<unsigned *>(0x48000018);
+enum fsm_state : uint8_t { low, rising, high, falling };
 
-// #include <cmath>
+static kernel::task t_leds, t_sensor, t_control, t_report;
+// task stacks in CCM, only the core touches them
+alignas(8) static uint32_t s_leds[128] CCM_BSS;
+alignas(8) static uint32_t s_sensor[256] CCM_BSS;
+alignas(8) static uint32_t s_control[256] CCM_BSS;
+alignas(8) static uint32_t s_report[256] CCM_BSS;
 
-// application
-void main_app() {
-    RCC_AHB1 |= 0x00020000;  // enable clock for GPIOA
-    GPIOA_MODER |= 0x40000000;  // set output on GPIOA.P15
-    // double x = 0.0;
-    // double y = 0.0;
+static kernel::flags led_flags;
+static kernel::queue readings;
+static float reading_buf[8];
+
+static void uart_putc(char c) {
+    // wait for TXE, bit 7 on SR
+    while (!(USART2->SR & (1 << 7)));
+    USART2->DR = static_cast<uint8_t>(c);
+}
+
+static void uart_puts(const char *s) {
+    while (*s) {
+        uart_putc(*s++);
+    }
+}
+
+static void uart_putu(uint32_t v) {
+    char buf[11];
+    int n = 0;
+    do {
+        buf[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) {
+        uart_putc(buf[--n]);
+    }
+}
+
+static void uart_init() {
+    // enable GPIOA clock, bit 0 on AHB1ENR
+    RCC->AHB1ENR |= (1 << 0);
+    // enable USART2 clock, bit 17 on APB1ENR
+    RCC->APB1ENR |= (1 << 17);
+
+    // PA2 alternate function mode (0b10), AF7
+    GPIOA->MODER &= ~(0x3u << 4);
+    GPIOA->MODER |= (0x2 << 4);
+    GPIOA->AFR[0] |= (0x7 << 8);
+
+    // 42 MHz / 115200 / 16 = 22.8125, mantissa 22, fraction 13
+    USART2->BRR = (22 << 4) | 13;
+    // usart enable UE bit 13, tx enable TE bit 3
+    USART2->CR1 = (1 << 13) | (1 << 3);
+}
+
+/*************************************************
+* tasks
+*************************************************/
+static void leds(void *) {
+    while (true) {
+        uint32_t got = kernel::flags_wait(led_flags, 0xF,
+                                          kernel::flags_any | kernel::flags_consume,
+                                          kernel::forever);
+        // the newest state wins if several came in
+        uint32_t n = 31 - __CLZ(got);
+        GPIOD->ODR = (GPIOD->ODR & ~(0xFu << 12)) | (1u << (12 + n));
+    }
+}
+
+static void sensor(void *) {
+    float phase = 0.0f;
+    uint32_t wake = kernel::now();
     while (true) {
-        // y = sin(x);
-        // x += y;
-        GPIOA_BSRR = 0x00008000;  // set output on GPIOA.P15
-        GPIOA_BSRR = 0x80000000;  // clear output on GPIOA.P15
+        phase += 0.01f;
+        if (phase >= 1.0f) {
+            phase -= 1.0f;
+        }
+        float r = (phase < 0.5f) ? 2.0f * phase : 2.0f - 2.0f * phase;
+        kernel::queue_put(readings, &r, kernel::forever);
+
+        // fixed rate, no drift from the time spent here
+        wake += 10;
+        kernel::sleep_until(wake);
+    }
+}
+
+static void control(void *) {
+    fsm_state st = low;
+    float last = 0.0f;
+    float r;
+    while (true) {
+        kernel::queue_get(readings, &r, kernel::forever);
+        fsm_state next = st;
+        switch (st) {
+        case low:
+            if (r > 0.1f) next = rising;
+            break;
+        case rising:
+            if (r > 0.9f) next = high;
+            else if (r < last) next = falling;
+            break;
+        case high:
+            if (r < 0.9f) next = falling;
+            break;
+        case falling:
+            if (r < 0.1f) next = low;
+            else if (r > last) next = rising;
+            break;
+        }
+        last = r;
+        if (next != st) {
+            st = next;
+            kernel::flags_set(led_flags, 1u << st);
+        }
+    }
+}
+
+static void report(void *) {
+    kernel::task *all[] = { &t_leds, &t_sensor, &t_control, &t_report };
+    uint32_t next = kernel::now();
+    while (true) {
+        next += kernel::tick_hz;
+        kernel::sleep_until(next);
+
+        uart_puts("t=");
+        uart_putu(kernel::now());
+        uart_puts(" switches=");
+        uart_putu(kernel::switches);
+        uart_puts(" boot=");
+        uart_putu(boot_cycles);
+        uart_puts(" msp=");
+        uart_putu(mem_stats.stack_used);
+        uart_puts("/");
+        uart_putu(mem_stats.stack_size);
+        uart_puts(" heap=");
+        uart_putu(mem_stats.heap_used);
+        uart_puts("/");
+        uart_putu(mem_stats.heap_size);
+        uart_puts("\r\n");
+        for (kernel::task *t : all) {
+            uart_puts("  ");
+            uart_puts(t->name);
+            uart_puts(" in=");
+            uart_putu(t->switches);
+            uart_puts(" free=");
+            uart_putu(kernel::stack_unused(*t));
+            uart_puts("/");
+            uart_putu(t->stack_words);
+            uart_puts("\r\n");
+        }
     }
 }
+
+// application, called from RESET_handler
+void main_app() {
+    set_sysclk_to_168();
+
+    // enable GPIOD clock, bit 3 on AHB1ENR
+    RCC->AHB1ENR |= (1 << 3);
+    // PD12-15 as output
+    GPIOD->MODER &= 0x00FFFFFF;
+    GPIOD->MODER |= 0x55000000;
+
+    uart_init();
+
+    kernel::queue_init(readings, reading_buf, sizeof(float), 8);
+    kernel::create(t_leds, leds, nullptr, 4, s_leds, 128, "leds");
+    kernel::create(t_sensor, sensor, nullptr, 3, s_sensor, 256, "sensor");
+    kernel::create(t_control, control, nullptr, 2, s_control, 256, "control");
+    kernel::create(t_report, report, nullptr, 1, s_report, 256, "report");
+
+    // the startup code painted the main stack (STARTUP_FILL_HEAP), the
+    //   idle task scans it. it is the interrupt stack from here on
+    mem_init();
+    mem_guard();
+    kernel::idle_hook = [] { mem_step(); };
+
+    kernel::start(168000000);
+}
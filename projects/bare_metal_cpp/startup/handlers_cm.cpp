@@ -4,6 +4,9 @@
 
 typedef void (*ptr_func_t)();
 
+// top of stack, defined in linker script
+extern unsigned __stack;
+
 // Undefined handler is pointing to this function, this stop MCU.
 // This function name must by not mangled, so must be C,
 // because alias("..") is working only with C code
@@ -12,7 +15,8 @@ extern "C" void __stop() { while (true); }
 // Handlers for Cortex-M core.
 // These handler are with attribute 'weak' and can be overwritten
 // by non-week function, default is __stop() function
-__attribute__((weak, alias("__stop"))) void RESET_handler();
+// RESET_handler is C as well, the makefile names it as the entry point
+extern "C" __attribute__((weak, alias("__stop"))) void RESET_handler();
 __attribute__((weak, alias("__stop"))) void NMI_handler();
 __attribute__((weak, alias("__stop"))) void HARDFAULT_handler();
 __attribute__((weak, alias("__stop"))) void MEMMANAGE_handler();
@@ -28,7 +32,9 @@ __attribute__((weak, alias("__stop"))) void DUMMY_handler();
 
 // Vector table for handlers
 // This array will be placed in ".vectors" section defined in linker script.
+// The first entry is the initial stack pointer, not a handler
 __attribute__((section(".vectors"), used)) ptr_func_t __isr_vectors[] = {
+    reinterpret_cast<ptr_func_t>(&__stack),
     RESET_handler,
     NMI_handler,
     HARDFAULT_handler,
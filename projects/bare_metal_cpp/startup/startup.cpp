@@ -1,4 +1,15 @@
 // very simple startup code with definition of handlers for all cortex-m cores
+//
+// the word copy and zero loops, the DMA zeroing of a large .bss, the
+// background zeroing of .lazy_bss and the boot cycle count are the
+// ones of the C startup, in system_stm32f4xx.c. boot_cycles has the
+// cycles from reset to main_app(). define STARTUP_FILL_HEAP to paint
+// the heap and the free stack for the watermarks of include/memwatch.c
+// (mem_paint), it costs a pass over all of it at every boot.
+
+#include <stdint.h>
+#include "system_stm32f4xx.h"
+#include "memwatch.h"
 
 typedef void (*ptr_func_t)();
 
@@ -6,14 +17,19 @@ typedef void (*ptr_func_t)();
 extern void main_app();
 
 // location of these variables is defined in linker script
-extern unsigned __data_start__;
-extern unsigned __data_end__;
-extern unsigned __data_load__;
+extern "C" uint32_t __data_start__;
+extern "C" uint32_t __data_end__;
 
-extern unsigned __bss_start__;
-extern unsigned __bss_end__;
+// load address of the data section, right after the code
+extern "C" uint32_t __etext;
 
-extern unsigned __heap_start__;
+// RAMFUNC code, run and load address
+extern "C" uint32_t __ramfunc_start__;
+extern "C" uint32_t __ramfunc_end__;
+extern "C" uint32_t __ramfunc_load__;
+
+extern "C" uint32_t __bss_start__;
+extern "C" uint32_t __bss_end__;
 
 extern ptr_func_t __preinit_array_start[];
 extern ptr_func_t __preinit_array_end[];
@@ -25,35 +41,19 @@ extern ptr_func_t __fini_array_start[];
 extern ptr_func_t __fini_array_end[];
 
 
-/** Copy default data to DATA section
- */
-unsigned __data_load__;
-void copy_data() {
-    unsigned *src = &__data_load__;
-    unsigned *dst = &__data_start__;
-    while (dst < &__data_end__) {
-        *dst++ = *src++;
-    }
-}
-
-/** Erase BSS section
- */
-void zero_bss() {
-    unsigned *dst = &__bss_start__;
-    while (dst < &__bss_end__) {
-        *dst++ = 0;
-    }
-}
-
-/** Fill heap memory
+/** Copy default data to DATA section and RAMFUNC code, zero BSS
+ * a large BSS is zeroed by DMA while the data, the code and the CCM
+ * sections are done
  */
-unsigned __heap_start__;
-void fill_heap(unsigned fill=0x45455246) {
-    unsigned *dst = &__heap_start__;
-    unsigned *msp_reg;
-    __asm__("mrs %0, msp\n" : "=r" (msp_reg) );
-    while (dst < msp_reg) {
-        *dst++ = fill;
+void copy_data_zero_bss() {
+    bool dma = boot_zero_dma(&__bss_start__, &__bss_end__);
+    boot_copy(&__data_start__, &__etext, &__data_end__);
+    boot_copy(&__ramfunc_start__, &__ramfunc_load__, &__ramfunc_end__);
+    boot_ccm();
+    if (dma) {
+        boot_dma_wait();
+    } else {
+        boot_zero(&__bss_start__, &__bss_end__);
     }
 }
 
@@ -83,12 +83,29 @@ void call_fini_array() {
     }
 }
 
-// reset handler
-void RESET_handler() {
-    copy_data();
-    zero_bss();
-    fill_heap();
+/** Give full access to the FPU (CP10 and CP11 in CPACR)
+ * first thing, code built for the hard float ABI may use FPU registers
+ * anywhere, even in the copy loops
+ */
+static inline void enable_fpu() {
+#ifdef __ARM_FP
+    volatile unsigned &CPACR = *reinterpret_cast<unsigned *>(0xE000ED88);
+    CPACR |= (0xF << 20);
+    __asm__ volatile("dsb\n\tisb\n" ::: "memory");
+#endif
+}
+
+// reset handler, C linkage so the makefile can name it as entry point
+extern "C" void RESET_handler() {
+    boot_timer_start();
+    enable_fpu();
+    copy_data_zero_bss();
+#ifdef STARTUP_FILL_HEAP
+    mem_paint();
+#endif
     call_init_array();
+    boot_cycles = DWT->CYCCNT;
+    lazy_zero_start();
     // run application
     main_app();
     // call destructors for static instances
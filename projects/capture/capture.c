@@ -0,0 +1,185 @@
+/*
+ * capture.c
+ *
+ * description:
+ *   measures frequency, period and duty of a signal on PA15 with
+ *   input capture on TIM2 (incap.c). the edges go to two DMA rings,
+ *   there is no interrupt per edge, only two per ring.
+ *
+ *   TIM3 channel 1 makes the test signal on PB4: 100 kHz, 250 kHz
+ *   and 500 kHz in turn, a third high each, one second each. the
+ *   measurement of the last 100 ms is left in meas for the debugger.
+ *   green LED (PD12) when it matches the signal to 0.1 % and no edge
+ *   was lost, red LED (PD14) otherwise.
+ *
+ * setup:
+ *    connect PB4 to PA15
+ *    TIM2 on APB1, 84 MHz timer clock, no prescaler: 11.9 ns ticks
+ *    uses 2 on-board LEDs
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "incap.h"
+#include "timebase.h"
+
+/*************************************************
+* function declarations
+*************************************************/
+void DMA1_Stream5_IRQHandler(void);
+void DMA1_Stream6_IRQHandler(void);
+int main(void);
+
+/*************************************************
+* definitions
+*************************************************/
+// APB1 timer clock
+#define TIM_HZ         84000000
+#define RING_LEN       256
+#define SIGNALS        3
+
+typedef struct {
+	uint64_t freq_mhz;       // mHz
+	uint64_t period_ns;
+	uint32_t duty_x100;      // 3333 is 33.33 %
+	uint32_t min;            // ticks
+	uint32_t max;
+	uint32_t periods;
+	uint32_t lost;
+	uint32_t ok;
+} meas_t;
+
+/*************************************************
+* variables
+*************************************************/
+incap_t ic;
+volatile meas_t meas;
+
+static uint32_t rise[RING_LEN];
+static uint32_t fall[RING_LEN];
+
+// TIM3 periods for 100 kHz, 250 kHz and 500 kHz
+static const uint16_t signal_arr[SIGNALS] = { 839, 335, 167 };
+
+/*************************************************
+* DMA1 stream 5 and 6, TIM2 CH1 and CH2 captures
+*************************************************/
+void DMA1_Stream5_IRQHandler(void)
+{
+	incap_irq(&ic);
+}
+
+void DMA1_Stream6_IRQHandler(void)
+{
+	incap_irq(&ic);
+}
+
+/*************************************************
+* test signal
+*************************************************/
+static void signal_init(void)
+{
+	// enable GPIOB clock, bit 1 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 1);
+	// PB4 alternate function (0b10), AF2 TIM3_CH1
+	GPIOB->MODER &= ~(0x3U << 8);
+	GPIOB->MODER |= (0x2 << 8);
+	GPIOB->AFR[0] |= (0x2 << 16);
+
+	// enable TIM3 clock, bit 1 on APB1ENR
+	RCC->APB1ENR |= (1 << 1);
+	TIM3->PSC = 0;
+	// pwm mode 1 (0b110) with preload on channel 1, output enable
+	TIM3->CCMR1 = (0x6 << 4) | (1 << 3);
+	TIM3->CCER = (1 << 0);
+	// auto-reload preload, counter enable
+	TIM3->CR1 = (1 << 7) | (1 << 0);
+}
+
+// a third of the period high, from the next update on
+static void signal_set(uint16_t arr)
+{
+	TIM3->ARR = arr;
+	TIM3->CCR1 = (arr + 1) / 3;
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	incap_batch_t b;
+	uint32_t sig = 0, t = 0;
+	uint64_t want;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+	timebase_init(168000000);
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	// PD12 and PD14 as outputs
+	GPIOD->MODER &= 0xCCFFFFFF;
+	GPIOD->MODER |= 0x11000000;
+
+	// enable GPIOA clock, bit 0 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 0);
+	// PA15 alternate function (0b10), AF1 TIM2_CH1
+	GPIOA->MODER &= ~(0x3U << 30);
+	GPIOA->MODER |= (0x2U << 30);
+	GPIOA->AFR[1] &= ~(0xFU << 28);
+	GPIOA->AFR[1] |= (0x1U << 28);
+
+	// enable DMA1 clock, bit 21 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 21);
+	// enable TIM2 clock, bit 0 on APB1ENR
+	RCC->APB1ENR |= (1 << 0);
+
+	signal_init();
+	signal_set(signal_arr[0]);
+
+	// TIM2_CH1 on stream 5, TIM2_CH2 on stream 6, both channel 3
+	incap_init(&ic, TIM2, DMA1_Stream5, DMA1_Stream6, 3, 0, TIM_HZ);
+	NVIC_SetPriority(DMA1_Stream5_IRQn, 1);
+	NVIC_SetPriority(DMA1_Stream6_IRQn, 1);
+	NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+	NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+	incap_start(&ic, rise, fall, RING_LEN);
+
+	while(1)
+	{
+		// 500 kHz fills the ring in 512 us, poll often enough
+		delay_us(200);
+		incap_poll(&ic, &b);
+
+		meas.periods += b.periods;
+		meas.lost += b.lost;
+
+		// a measurement every 100 ms, from the edges of the last poll
+		if (++t % 500 == 0) {
+			meas.freq_mhz = incap_freq_mhz(&ic, &b);
+			meas.period_ns = incap_period_ns(&ic, &b);
+			meas.duty_x100 = incap_duty_x100(&b);
+			meas.min = b.min;
+			meas.max = b.max;
+
+			// expected mHz, within 0.1 %
+			want = (uint64_t)TIM_HZ * 1000 / (signal_arr[sig] + 1);
+			meas.ok = meas.lost == 0 &&
+			          meas.freq_mhz > want - want / 1000 &&
+			          meas.freq_mhz < want + want / 1000;
+			GPIOD->ODR = meas.ok ? (1 << 12) : (1 << 14);
+		}
+
+		// next signal every second, right after a measurement so
+		//   none of them spans the switch
+		if (t % 5000 == 0) {
+			sig = (sig + 1) % SIGNALS;
+			signal_set(signal_arr[sig]);
+			meas.lost = 0;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * incap.c
+ *
+ * description:
+ *   input capture to DMA rings, see incap.h
+ *
+ * setup:
+ *   1. timer free running over 32 bits (ARR = 0xFFFFFFFF)
+ *   2. IC1 on TI1, rising edge. IC2 on TI1 as well, falling edge
+ *   3. one circular DMA stream per channel, CCRx to the ring, word
+ *      transfers, half and full transfer interrupts
+ *   4. capture enable and capture DMA requests (CC1DE, CC2DE) on
+ */
+
+#include "incap.h"
+#include "dma_stream.h"
+
+/*************************************************
+* definitions
+*************************************************/
+// very high priority, word memory and peripheral size, memory increment,
+// circular, peripheral to memory, transfer complete, half transfer and
+// transfer error interrupts
+#define DMA_INCAP_CR   ((0x3 << 16) | (0x2 << 13) | (0x2 << 11) | (1 << 10) | \
+                        (1 << 8) | (1 << 4) | (1 << 3) | (1 << 2))
+
+// overcapture, CC1OF bit 9 and CC2OF bit 10 on SR
+#define TIM_CC1OF      (1u << 9)
+#define TIM_CC2OF      (1u << 10)
+
+/*************************************************
+* helpers
+*************************************************/
+// read and clear the flags of a stream
+static uint32_t dma_take_flags(const incap_ring_t *r)
+{
+	DMA_TypeDef *dma = dma_stream_dma(r->stream);
+	uint32_t flags = dma_stream_flags(dma, r->stream_n);
+
+	if (flags)
+		dma_stream_clear(dma, r->stream_n, flags);
+	return flags;
+}
+
+static void stream_off(incap_ring_t *r)
+{
+	r->stream->CR = 0;
+	while (r->stream->CR & (1 << 0));
+	dma_take_flags(r);
+}
+
+static void ring_run(incap_t *ic, incap_ring_t *r, volatile uint32_t *ccr)
+{
+	DMA_Stream_TypeDef *s = r->stream;
+
+	r->halves = 0;
+	r->count = 0;
+
+	s->PAR = (uint32_t)ccr;
+	s->M0AR = (uint32_t)r->buf;
+	s->NDTR = ic->len;
+	s->CR = ((uint32_t)ic->channel << 25) | DMA_INCAP_CR;
+	s->CR |= (1 << 0);
+}
+
+/*
+ * edges the DMA wrote into the ring so far, modulo 2^32. the half
+ * count and NDTR are read until they belong together, then the count
+ * is moved on if the position is already in the next half and its
+ * interrupt did not run yet
+ */
+static uint32_t produced(const incap_t *ic, const incap_ring_t *r)
+{
+	uint32_t half = ic->len / 2;
+	uint32_t h, pos;
+
+	do {
+		h = r->halves;
+		pos = ic->len - r->stream->NDTR;
+	} while (h != r->halves);
+	pos &= ic->len - 1;
+
+	if ((pos >= half) != (h & 1))
+		h++;
+	return h * half + (pos & (half - 1));
+}
+
+/*
+ * unread edges of a ring. with more than 3/4 of a ring behind, the
+ * oldest would be overwritten while they are read: they are dropped
+ * and only the newest half ring is taken
+ */
+static uint32_t ring_new(const incap_t *ic, incap_ring_t *r, incap_batch_t *b)
+{
+	uint32_t len = ic->len;
+	uint32_t n = produced(ic, r) - r->count;
+	uint32_t keep = len / 2;
+
+	if (n > len - len / 4) {
+		b->lost += n - keep;
+		r->count += n - keep;
+		n = keep;
+	}
+	return n;
+}
+
+// a * b / c without losing the fraction of a / c, exact for c * b < 2^64
+static uint64_t muldiv(uint64_t a, uint64_t b, uint64_t c)
+{
+	return (a / c) * b + (a % c) * b / c;
+}
+
+/*************************************************
+* api
+*************************************************/
+/*
+ * set the timer up to count at tim_hz / (psc + 1) over all 32 bits
+ * and both channels to capture TI1. rise and fall are the DMA1 streams
+ * of the CH1 and CH2 requests on channel. nothing is captured yet
+ */
+void incap_init(incap_t *ic, TIM_TypeDef *tim, DMA_Stream_TypeDef *rise,
+                DMA_Stream_TypeDef *fall, uint8_t channel, uint16_t psc,
+                uint32_t tim_hz)
+{
+	ic->tim = tim;
+	ic->tick_hz = tim_hz / ((uint32_t)psc + 1);
+	ic->channel = channel;
+	ic->len = 0;
+	ic->have_last = 0;
+	ic->errors = 0;
+	ic->rise.stream = rise;
+	ic->rise.stream_n = dma_stream_number(rise);
+	ic->rise.buf = 0;
+	ic->fall.stream = fall;
+	ic->fall.stream_n = dma_stream_number(fall);
+	ic->fall.buf = 0;
+
+	stream_off(&ic->rise);
+	stream_off(&ic->fall);
+
+	tim->CR1 = 0;
+	tim->DIER = 0;
+	tim->PSC = psc;
+	tim->ARR = 0xFFFFFFFF;
+
+	// IC1 on TI1 (CC1S 0b01, bits 1:0), IC2 on TI1 (CC2S 0b10, bits 9:8),
+	//   no filter, every edge captured
+	tim->CCMR1 = (0x1 << 0) | (0x2 << 8);
+	// CC1 on the rising edge, CC2 on the falling edge (CC2P bit 5),
+	//   capture enables come with incap_start
+	tim->CCER = (1 << 5);
+
+	// load the prescaler, then count
+	tim->EGR = (1 << 0);
+	tim->SR = 0;
+	tim->CR1 = (1 << 0);
+}
+
+/*
+ * capture into rise_buf and fall_buf, len timestamps each. fall_buf
+ * can be 0 to measure the frequency only. len is a power of two
+ * returns 0 if the length is not usable
+ */
+int incap_start(incap_t *ic, uint32_t *rise_buf, uint32_t *fall_buf, uint16_t len)
+{
+	TIM_TypeDef *tim = ic->tim;
+
+	if (len < 4 || (len & (len - 1)))
+		return 0;
+
+	incap_stop(ic);
+
+	ic->len = len;
+	ic->have_last = 0;
+	ic->rise.buf = rise_buf;
+	ic->fall.buf = fall_buf;
+
+	ring_run(ic, &ic->rise, &tim->CCR1);
+	if (fall_buf)
+		ring_run(ic, &ic->fall, &tim->CCR2);
+
+	// stale capture and overcapture flags
+	tim->SR = 0;
+
+	// capture enable CC1E bit 0 and CC2E bit 4 on CCER,
+	//   DMA requests CC1DE bit 9 and CC2DE bit 10 on DIER
+	tim->CCER |= (1 << 0);
+	tim->DIER |= (1 << 9);
+	if (fall_buf) {
+		tim->CCER |= (1 << 4);
+		tim->DIER |= (1 << 10);
+	}
+	return 1;
+}
+
+/*
+ * stop capturing, the counter keeps running
+ */
+void incap_stop(incap_t *ic)
+{
+	ic->tim->DIER &= ~((1u << 9) | (1u << 10));
+	ic->tim->CCER &= ~((1u << 0) | (1u << 4));
+	stream_off(&ic->rise);
+	stream_off(&ic->fall);
+}
+
+/*
+ * take the edges captured since the last call into b.
+ * returns the number of complete periods in it
+ */
+uint32_t incap_poll(incap_t *ic, incap_batch_t *b)
+{
+	TIM_TypeDef *tim = ic->tim;
+	uint32_t mask = ic->len - 1;
+	uint32_t nr, nf = 0, sr, i;
+
+	b->periods = 0;
+	b->ticks = 0;
+	b->min = 0xFFFFFFFF;
+	b->max = 0;
+	b->highs = 0;
+	b->high = 0;
+	b->hticks = 0;
+	b->lost = 0;
+
+	// an edge came before the last one was read, write 0 to clear
+	sr = tim->SR & (TIM_CC1OF | TIM_CC2OF);
+	if (sr) {
+		tim->SR = ~sr;
+		b->lost += (sr & TIM_CC1OF) ? 1 : 0;
+		b->lost += (sr & TIM_CC2OF) ? 1 : 0;
+		if (sr & TIM_CC1OF)
+			ic->have_last = 0;
+	}
+
+	// rising edges dropped, the next one starts a new period
+	i = b->lost;
+	nr = ring_new(ic, &ic->rise, b);
+	if (b->lost != i)
+		ic->have_last = 0;
+	if (ic->fall.buf)
+		nf = ring_new(ic, &ic->fall, b);
+
+	for (i = 0; i < nr; i++) {
+		uint32_t r = ic->rise.buf[ic->rise.count++ & mask];
+		uint32_t high = 0;
+		int found = 0;
+
+		// falling edges before this rising edge, the first one after
+		//   the last rising edge ends the high time. later ones stay
+		//   for the next call
+		while (nf && (int32_t)(ic->fall.buf[ic->fall.count & mask] - r) < 0) {
+			uint32_t f = ic->fall.buf[ic->fall.count++ & mask];
+			nf--;
+			if (!found && ic->have_last && (int32_t)(f - ic->last) > 0) {
+				high = f - ic->last;
+				found = 1;
+			}
+		}
+
+		if (ic->have_last) {
+			// one period, right across a counter wrap
+			uint32_t p = r - ic->last;
+
+			b->periods++;
+			b->ticks += p;
+			if (p < b->min)
+				b->min = p;
+			if (p > b->max)
+				b->max = p;
+			if (found) {
+				b->highs++;
+				b->high += high;
+				b->hticks += p;
+			}
+		}
+		ic->last = r;
+		ic->have_last = 1;
+	}
+
+	if (b->periods == 0)
+		b->min = 0;
+	return b->periods;
+}
+
+/*
+ * half or full ring, call from the interrupts of both streams
+ */
+void incap_irq(incap_t *ic)
+{
+	incap_ring_t *rings[2] = { &ic->rise, &ic->fall };
+	uint32_t i, flags;
+
+	for (i = 0; i < 2; i++) {
+		if (rings[i]->buf == 0)
+			continue;
+		flags = dma_take_flags(rings[i]);
+		if (flags & DMA_STREAM_HTIF)
+			rings[i]->halves++;
+		if (flags & DMA_STREAM_TCIF)
+			rings[i]->halves++;
+		// the stream turned itself off
+		if (flags & DMA_STREAM_TEIF)
+			ic->errors++;
+	}
+}
+
+/*
+ * frequency of a batch in mHz, 0 without a complete period
+ */
+uint64_t incap_freq_mhz(const incap_t *ic, const incap_batch_t *b)
+{
+	if (b->ticks == 0)
+		return 0;
+	return muldiv((uint64_t)b->periods * ic->tick_hz, 1000, b->ticks);
+}
+
+/*
+ * mean period of a batch in ns
+ */
+uint64_t incap_period_ns(const incap_t *ic, const incap_batch_t *b)
+{
+	// thousandths of a tick first, then ns
+	uint64_t mticks;
+
+	if (b->periods == 0)
+		return 0;
+	mticks = muldiv(b->ticks, 1000, b->periods);
+	return muldiv(mticks, 1000000, ic->tick_hz);
+}
+
+/*
+ * high time over period times 100 (3000 is 30.00 %), over the periods
+ * a falling edge was found in
+ */
+uint32_t incap_duty_x100(const incap_batch_t *b)
+{
+	if (b->hticks == 0)
+		return 0;
+	return (uint32_t)muldiv(b->high, 10000, b->hticks);
+}
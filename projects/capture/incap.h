@@ -0,0 +1,117 @@
+/*
+ * incap.h
+ *
+ * description:
+ *   frequency, period and duty measurement with input capture on a
+ *   32-bit timer (TIM2 or TIM5), without an interrupt per edge.
+ *
+ *   the input goes to TI1. channel 1 captures its rising edges,
+ *   channel 2 (IC2 mapped on TI1) its falling edges. each capture asks
+ *   the DMA for a transfer, two circular streams copy CCR1 and CCR2
+ *   into two rings of timestamps. the CPU is only involved twice per
+ *   ring (half and full transfer interrupts count the laps), so the
+ *   edge rate is bound by the DMA, not by interrupt entry and exit:
+ *   hundreds of kHz are no problem, an interrupt per edge tops out
+ *   well below that.
+ *
+ *   incap_poll() takes the edges that came in since the last call and
+ *   returns a batch: the complete periods, their total length, the
+ *   shortest and longest period and the high time. periods are the
+ *   difference of two timestamps in 32 bits, right across counter
+ *   wraps, sums are 64-bit. frequency, period and duty are computed
+ *   from a batch with 64-bit arithmetic that does not overflow for
+ *   any batch a ring can hold.
+ *
+ *   where the producer is: NDTR gives the position in the ring, the
+ *   lap count the interrupts keep gives the rest. an interrupt that
+ *   is still pending shows as the position being in the other half
+ *   than the count says, the count is corrected for it. the interrupt
+ *   latency has to stay below half a ring of edges.
+ *
+ *   lost edges:
+ *     - the consumer was too late: more than 3/4 of a ring unread.
+ *       the older edges are dropped, the newest half ring is kept
+ *     - overcapture: a capture while the previous one was not read
+ *       yet (CC1OF/CC2OF), the DMA could not keep up
+ *   both are counted in the batch, the pairing of edges starts over.
+ *   an overcapture is only seen at the next incap_poll, the batch it
+ *   shows up in may hold one period that spans the lost edge.
+ *
+ *   ring lengths are a power of two. the timer counts at tick_hz,
+ *   periods longer than 2^31 ticks (25 s at 84 MHz) do not work.
+ *   clocks and pins are up to the caller (TIMx clock, DMA1 clock,
+ *   the pin in the TIMx_CH1 alternate function).
+ *
+ *   DMA1 requests (RM0090 table 42):
+ *     TIM2_CH1  stream 5 channel 3     TIM2_CH2  stream 6 channel 3
+ *     TIM5_CH1  stream 2 channel 6     TIM5_CH2  stream 4 channel 6
+ *
+ * usage:
+ *   static uint32_t rise[256], fall[256];
+ *   incap_init(&ic, TIM2, DMA1_Stream5, DMA1_Stream6, 3, 0, 84000000);
+ *   incap_start(&ic, rise, fall, 256);
+ *   call incap_irq(&ic) from both stream interrupts
+ *   ...
+ *   incap_poll(&ic, &b);
+ *   hz_x1000 = incap_freq_mhz(&ic, &b);
+ *   duty = incap_duty_x100(&b);        // 3000 is 30.00 %
+ */
+
+#ifndef __INCAP_H
+#define __INCAP_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	DMA_Stream_TypeDef *stream;
+	uint8_t stream_n;         /* stream number 0-7                  */
+	uint32_t *buf;            /* len timestamps                     */
+	volatile uint32_t halves; /* half rings done, by the interrupt  */
+	uint32_t count;           /* edges taken by incap_poll          */
+} incap_ring_t;
+
+typedef struct {
+	TIM_TypeDef *tim;
+	uint32_t tick_hz;         /* counter clock                      */
+	uint8_t channel;          /* DMA channel of both requests       */
+	uint16_t len;             /* ring length, a power of two        */
+	incap_ring_t rise;
+	incap_ring_t fall;        /* buf 0 without duty measurement     */
+	uint32_t last;            /* last rising edge taken             */
+	uint8_t have_last;
+	volatile uint32_t errors; /* DMA transfer errors, stream stopped */
+} incap_t;
+
+typedef struct {
+	uint32_t periods;         /* complete periods                   */
+	uint64_t ticks;           /* their total length                 */
+	uint32_t min;             /* shortest period, ticks             */
+	uint32_t max;             /* longest period, ticks              */
+	uint32_t highs;           /* periods with a falling edge found  */
+	uint64_t high;            /* high time of those                 */
+	uint64_t hticks;          /* length of those                    */
+	uint32_t lost;            /* edges dropped or overcaptured      */
+} incap_batch_t;
+
+void     incap_init(incap_t *ic, TIM_TypeDef *tim, DMA_Stream_TypeDef *rise,
+                    DMA_Stream_TypeDef *fall, uint8_t channel, uint16_t psc,
+                    uint32_t tim_hz);
+int      incap_start(incap_t *ic, uint32_t *rise_buf, uint32_t *fall_buf, uint16_t len);
+void     incap_stop(incap_t *ic);
+uint32_t incap_poll(incap_t *ic, incap_batch_t *b);
+void     incap_irq(incap_t *ic);
+
+uint64_t incap_freq_mhz(const incap_t *ic, const incap_batch_t *b);
+uint64_t incap_period_ns(const incap_t *ic, const incap_batch_t *b);
+uint32_t incap_duty_x100(const incap_batch_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
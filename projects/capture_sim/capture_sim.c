@@ -0,0 +1,316 @@
+/*
+ * capture_sim.c
+ *
+ * description:
+ *   runs the input capture engine from projects/capture on the host
+ *   against a model of TIM2 and two DMA1 streams and checks the
+ *   measurements.
+ *
+ *   the timer and the DMA controller are plain memory. the DMA block
+ *   sits on a 256 byte boundary, so the driver finds the stream number
+ *   and the flag registers from the stream address as on the board.
+ *   a signal generator makes the edges in virtual time; each edge
+ *   stores the counter value (84 MHz, starts half a second before the
+ *   wrap) into the ring of its stream and counts NDTR down, the half
+ *   and full transfer flags run incap_irq, right away or a number of
+ *   edges later. the consumer polls at fixed times in between.
+ *
+ *   scenarios:
+ *     1. 243 kHz, a third high: periods that are no whole number of
+ *        ticks, across the counter wrap
+ *     2. 500 kHz with the interrupt up to 100 edges late
+ *     3. 1 MHz, rising edges only
+ *     4. 200 kHz, the consumer stalls for 5 ms: the overrun has to be
+ *        seen and counted, nothing wrong measured afterwards
+ *     5. 100 kHz with overcaptures, single edges the DMA missed
+ *     6. 10 Hz, a quarter high, polled every 100 ms
+ *
+ *   batches with lost edges are left out of the results, the way a
+ *   consumer would. exits with 1 if a frequency, period or duty is
+ *   off, a batch holds a period that does not exist in the signal, or
+ *   edges were lost (or not reported lost) unexpectedly.
+ *
+ * usage:
+ *   make run
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "stm32f4xx.h"
+#include "incap.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define TICK_HZ        84000000.0
+#define CNT_START      (0xFFFFFFFFU - 42000000U)
+#define RING_LEN       256
+
+#define DMA_HTIF       (1u << 4)
+#define DMA_TCIF       (1u << 5)
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		failures++; \
+		printf("  FAIL: " __VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while (0)
+
+typedef struct {
+	const char *name;
+	double hz;
+	double duty;
+	uint32_t ms;             // signal length
+	uint32_t poll_us;        // consumer period
+	int rise_only;
+	uint32_t irq_delay;      // edges an interrupt waits
+	uint32_t stall_at_ms;    // no polls from here ...
+	uint32_t stall_ms;       // ... for this long, 0 for none
+	uint32_t drop_every;     // a rising edge overcaptured, 0 for none
+	int expect_lost;
+} scenario_t;
+
+/*************************************************
+* variables
+*************************************************/
+static TIM_TypeDef tim;
+static uint32_t dma_mem[64] __attribute__((aligned(256)));
+static uint32_t rise[RING_LEN];
+static uint32_t fall[RING_LEN];
+static incap_t ic;
+
+static int irq_pending;
+static uint32_t irq_wait;
+static uint32_t irqs;
+static int failures;
+
+static const uint8_t flag_shift[4] = {0, 6, 16, 22};
+
+#define DMA_SIM        ((DMA_TypeDef *)dma_mem)
+#define STREAM(n)      ((DMA_Stream_TypeDef *)((uint8_t *)dma_mem + 0x10 + 0x18 * (n)))
+
+/*************************************************
+* timer and DMA model
+*************************************************/
+// the handler clears flags by writing 1s to HIFCR. a plain memory
+//   register only keeps the last write, so the handler sees the flags
+//   of one stream at a time and the clear is applied after each
+static void irq_take(void)
+{
+	static const uint32_t mask[2] = { 0x3Du << 6, 0x3Du << 16 };
+	uint32_t all = DMA_SIM->HISR;
+	uint32_t i;
+
+	for (i = 0; i < 2; i++) {
+		if (!(all & mask[i]))
+			continue;
+		DMA_SIM->HISR = all & mask[i];
+		DMA_SIM->HIFCR = 0;
+		incap_irq(&ic);
+		CHECK(!(DMA_SIM->HISR & ~DMA_SIM->HIFCR), "stream %u flags not cleared", 5 + i);
+		all &= ~DMA_SIM->HIFCR;
+		irqs++;
+	}
+	DMA_SIM->HISR = all;
+	DMA_SIM->HIFCR = 0;
+	irq_pending = 0;
+}
+
+// a capture on the channel of stream n, moved to the ring
+static void dma_xfer(int n, uint32_t v)
+{
+	DMA_Stream_TypeDef *s = STREAM(n);
+	uint32_t *buf = (uint32_t *)(uintptr_t)s->M0AR;
+	uint32_t flags = 0;
+
+	if (!(s->CR & (1 << 0)))
+		return;
+
+	buf[RING_LEN - s->NDTR] = v;
+	if (--s->NDTR == RING_LEN / 2)
+		flags = DMA_HTIF;
+	if (s->NDTR == 0) {
+		s->NDTR = RING_LEN;
+		flags = DMA_TCIF;
+	}
+	if (flags) {
+		if (n < 4)
+			DMA_SIM->LISR |= flags << flag_shift[n];
+		else
+			DMA_SIM->HISR |= flags << flag_shift[n - 4];
+		if (!irq_pending)
+			irq_wait = 0;
+		irq_pending = 1;
+	}
+}
+
+// SR bits are cleared by writing 0, written 1s leave them
+static void poll(incap_batch_t *b)
+{
+	uint32_t sr = tim.SR;
+
+	incap_poll(&ic, b);
+	tim.SR = sr & tim.SR;
+}
+
+/*************************************************
+* scenarios
+*************************************************/
+static void run(const scenario_t *sc)
+{
+	double period = TICK_HZ / sc->hz;
+	double t_end = TICK_HZ * sc->ms / 1000.0;
+	double t_poll = TICK_HZ * sc->poll_us / 1000000.0;
+	double stall0 = TICK_HZ * sc->stall_at_ms / 1000.0;
+	double stall1 = stall0 + TICK_HZ * sc->stall_ms / 1000.0;
+	// first rising edge somewhere in the first period
+	double t_rise = period * 0.3;
+	double t_fall = t_rise + period * sc->duty;
+	double t_next_poll = t_poll;
+	uint32_t pmin = (uint32_t)floor(period), pmax = (uint32_t)ceil(period);
+	uint32_t nrise = 0, batches = 0, bad = 0, lost = 0, lossy = 0;
+	uint32_t min = 0xFFFFFFFF, max = 0;
+	uint64_t want_mhz = (uint64_t)llround(sc->hz * 1000);
+	uint64_t f, pns, want_ns;
+	uint32_t duty;
+	incap_batch_t b, tot = { 0 };
+
+	irqs = 0;
+	irq_pending = 0;
+	tim.SR = 0;
+	incap_init(&ic, &tim, STREAM(5), STREAM(6), 3, 0, (uint32_t)TICK_HZ);
+	CHECK(incap_start(&ic, rise, sc->rise_only ? 0 : fall, RING_LEN), "start refused");
+	CHECK(STREAM(5)->PAR == (uint32_t)(uintptr_t)&tim.CCR1, "rising edges not from CCR1");
+	CHECK(STREAM(5)->CR & (1 << 8), "ring not circular");
+	CHECK(((STREAM(5)->CR >> 25) & 7) == 3, "DMA channel %u", (unsigned)((STREAM(5)->CR >> 25) & 7));
+
+	while (t_rise < t_end || t_next_poll < t_end) {
+		double t = t_rise;
+		int what = 0;
+
+		if (!sc->rise_only && t_fall < t) {
+			t = t_fall;
+			what = 1;
+		}
+		if (t_next_poll <= t) {
+			t = t_next_poll;
+			what = 2;
+		}
+
+		if (what == 0) {
+			nrise++;
+			if (sc->drop_every && nrise % sc->drop_every == 0)
+				tim.SR |= (1u << 9);
+			else
+				dma_xfer(5, CNT_START + (uint32_t)floor(t_rise));
+			t_rise += period;
+		} else if (what == 1) {
+			dma_xfer(6, CNT_START + (uint32_t)floor(t_fall));
+			t_fall += period;
+		} else {
+			t_next_poll += t_poll;
+			if (sc->stall_ms && t >= stall0 && t < stall1)
+				continue;
+			poll(&b);
+			batches++;
+			if (b.lost) {
+				// a consumer throws these away
+				lost += b.lost;
+				lossy++;
+				continue;
+			}
+			if (b.periods == 0)
+				continue;
+			if (b.min < min)
+				min = b.min;
+			if (b.max > max)
+				max = b.max;
+			f = incap_freq_mhz(&ic, &b);
+			// a batch to 0.1 %
+			if (f < want_mhz - want_mhz / 1000 || f > want_mhz + want_mhz / 1000)
+				bad++;
+			tot.periods += b.periods;
+			tot.ticks += b.ticks;
+			tot.highs += b.highs;
+			tot.high += b.high;
+			tot.hticks += b.hticks;
+		}
+
+		if (irq_pending && irq_wait++ >= sc->irq_delay)
+			irq_take();
+	}
+	if (irq_pending)
+		irq_take();
+
+	f = incap_freq_mhz(&ic, &tot);
+	pns = incap_period_ns(&ic, &tot);
+	duty = incap_duty_x100(&tot);
+	want_ns = (uint64_t)llround(1e9 / sc->hz);
+
+	printf("  %-28s %8u %14.3f %11llu %7.2f %5u %5u %6u %6u\n", sc->name, tot.periods,
+	       (double)f / 1000, (unsigned long long)pns, (double)duty / 100,
+	       min, max, lost, irqs);
+
+	// over the whole run to 10 ppm, the period to 1 ns
+	CHECK(f + want_mhz / 100000 >= want_mhz && f <= want_mhz + want_mhz / 100000,
+	      "%s: %llu mHz, expected %llu", sc->name, (unsigned long long)f,
+	      (unsigned long long)want_mhz);
+	CHECK(pns + 1 >= want_ns && pns <= want_ns + 1, "%s: period %llu ns, expected %llu",
+	      sc->name, (unsigned long long)pns, (unsigned long long)want_ns);
+	CHECK(bad == 0, "%s: %u batches off by more than 0.1 %%", sc->name, bad);
+	CHECK(min >= pmin && max <= pmax, "%s: periods %u .. %u ticks, the signal has %u .. %u",
+	      sc->name, min, max, pmin, pmax);
+	if (sc->rise_only) {
+		CHECK(tot.highs == 0, "%s: high time without falling edges", sc->name);
+	} else {
+		int32_t d = (int32_t)duty - (int32_t)llround(sc->duty * 10000);
+		CHECK(d >= -5 && d <= 5, "%s: duty %u, expected %.0f", sc->name, duty, sc->duty * 10000);
+		CHECK(tot.highs == tot.periods, "%s: %u of %u periods with a high time",
+		      sc->name, tot.highs, tot.periods);
+	}
+	if (sc->expect_lost)
+		CHECK(lost > 0 && lossy < batches / 10, "%s: %u lost in %u of %u batches",
+		      sc->name, lost, lossy, batches);
+	else
+		CHECK(lost == 0, "%s: %u edges lost", sc->name, lost);
+	CHECK(ic.errors == 0, "%s: DMA errors", sc->name);
+
+	incap_stop(&ic);
+}
+
+static const scenario_t scenarios[] = {
+	{ "243 kHz, 1/3 high",        243000, 1.0 / 3, 1000, 200, 0,   0,   0, 0,     0, 0 },
+	{ "500 kHz, irq 100 late",    500000, 0.5,      500, 300, 0, 100,   0, 0,     0, 0 },
+	{ "1 MHz, rising only",      1000000, 0.25,     200, 150, 1,   0,   0, 0,     0, 0 },
+	{ "200 kHz, 5 ms stall",      200000, 0.4,      500, 200, 0,   0, 100, 5,     0, 1 },
+	{ "100 kHz, overcaptures",    100000, 0.6,     1000, 200, 0,   0,   0, 0, 10007, 1 },
+	{ "10 Hz, 1/4 high",              10, 0.25,    3000, 100000, 0, 0,  0, 0,     0, 0 },
+};
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	uint32_t i;
+
+	printf("input capture to DMA rings, %d timestamps each, %.0f MHz ticks\n",
+	       RING_LEN, TICK_HZ / 1e6);
+	printf("  %-28s %8s %14s %11s %7s %5s %5s %6s %6s\n", "signal", "periods",
+	       "Hz", "period ns", "duty %", "min", "max", "lost", "irqs");
+
+	for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+		run(&scenarios[i]);
+
+	printf("  (min/max: shortest and longest period in ticks, irqs: half and full ring)\n");
+
+	if (failures) {
+		printf("FAILED: %d checks\n", failures);
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -154,7 +154,7 @@ void Default_Handler(void)
 int main(void)
 {
 	uint32_t dac_value = 0xD00;
-	int32_t i = 0;
+	volatile int32_t i = 0;
 
 	/* set system clock to 168 Mhz */
 	set_sysclk_to_168();
@@ -0,0 +1,218 @@
+/*
+ * dds.hpp
+ *
+ * description:
+ *   direct digital synthesis with tables generated at compile time.
+ *
+ *   a 32-bit phase accumulator steps through one period of a table of
+ *   N = 2^k samples. the step is f * 2^32 / fs, so the frequency
+ *   resolution is fs / 2^32 (47 uHz at 200 ksps) and a frequency or
+ *   phase change takes effect on the next sample without a jump.
+ *   the top k bits of the phase pick the table entry, with linear
+ *   interpolation the next 15 bits weight it against the following one
+ *   (15 so the product of a 16-bit difference still fits in 32 bits).
+ *
+ *   tables are built by constexpr functions from a shape, the table
+ *   size and the bit depth. they end up as constants in flash, there
+ *   is no sin() call and no start up cost. the sine comes from a
+ *   Taylor series, any other shape is a struct with a
+ *   static constexpr double at(double p) for p in [0, 1) returning
+ *   -1.0 .. 1.0.
+ *
+ *   everything that runs per sample is integer only, so a host build
+ *   produces the same samples bit for bit as the board and the output
+ *   can be checked offline (FFT, spurs, THD).
+ *
+ * usage:
+ *   static constexpr auto sine = dds::make_table<dds::sine, 1024, 12>();
+ *   dds::engine<1024, 12> osc(sine, true);       // interpolated
+ *   osc.set_frequency(1000, 200000);             // 1 kHz at 200 ksps
+ *   osc.fill(half, n);                           // from the DMA refill
+ *   osc.fill_pair(iq, n, 1u << 30);              // or cos/sin pairs
+ *
+ *   engine objects have constexpr constructors so globals are set up
+ *   without static constructors (Reset_Handler does not call them)
+ */
+
+#ifndef __DDS_HPP
+#define __DDS_HPP
+
+#include <stdint.h>
+
+namespace dds {
+
+/*************************************************
+* compile time math
+*************************************************/
+constexpr double pi = 3.14159265358979323846;
+
+// sin(2 pi p), the argument is brought to -pi .. pi first
+constexpr double sin_cycles(double p)
+{
+	p = p - (double)(int64_t)p;
+	if (p < 0.0)
+		p += 1.0;
+	if (p > 0.5)
+		p -= 1.0;
+
+	double x = 2.0 * pi * p;
+	double term = x;
+	double sum = x;
+	// x^(2n+1) / (2n+1)!, 12 terms are well below 1e-16 at pi
+	for (int n = 1; n < 12; n++) {
+		term = -term * x * x / (double)((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+/*************************************************
+* shapes, at(p) for p in [0, 1) gives -1.0 .. 1.0
+*************************************************/
+struct sine {
+	static constexpr double at(double p) { return sin_cycles(p); }
+};
+
+// starts at 0 like the sine
+struct triangle {
+	static constexpr double at(double p)
+	{
+		return (p < 0.25) ? 4.0 * p :
+		       (p < 0.75) ? 2.0 - 4.0 * p : 4.0 * p - 4.0;
+	}
+};
+
+struct saw {
+	static constexpr double at(double p)
+	{
+		return (p < 0.5) ? 2.0 * p : 2.0 * p - 2.0;
+	}
+};
+
+/*************************************************
+* tables
+*************************************************/
+constexpr bool is_pow2(uint32_t n) { return n && !(n & (n - 1)); }
+
+constexpr unsigned log2u(uint32_t n) { return (n <= 1) ? 0 : 1 + log2u(n >> 1); }
+
+// one period, unsigned, mid scale 2^(Bits-1)
+template <uint32_t N, unsigned Bits>
+struct wave_table {
+	static_assert(is_pow2(N) && N >= 2, "table size must be a power of two");
+	static_assert(Bits >= 2 && Bits <= 16, "table bit depth must be 2 .. 16");
+
+	static constexpr uint32_t size = N;
+	static constexpr unsigned bits = Bits;
+
+	uint16_t v[N];
+
+	constexpr uint16_t operator[](uint32_t i) const { return v[i]; }
+};
+
+template <class Shape, uint32_t N, unsigned Bits>
+constexpr wave_table<N, Bits> make_table()
+{
+	wave_table<N, Bits> t{};
+	const double mid = (double)(1u << (Bits - 1));
+	const double amp = mid - 1.0;
+
+	for (uint32_t i = 0; i < N; i++) {
+		double s = mid + amp * Shape::at((double)i / (double)N);
+		// round to nearest, s is never negative
+		t.v[i] = (uint16_t)(s + 0.5);
+	}
+	return t;
+}
+
+/*************************************************
+* engine
+*************************************************/
+template <uint32_t N, unsigned Bits>
+class engine {
+public:
+	typedef wave_table<N, Bits> table_type;
+
+	constexpr engine(const table_type &t, bool interpolate = false)
+		: table_(&t), phase_(0), step_(0), offset_(0), interp_(interpolate) {}
+
+	// phase step for hz at a sample rate of fs
+	static constexpr uint32_t step_for(uint32_t hz, uint32_t fs)
+	{
+		return (uint32_t)(((uint64_t)hz << 32) / fs);
+	}
+
+	// the setters are single 32-bit stores, they can be called while the
+	//   DMA interrupt is filling
+	void set_frequency(uint32_t hz, uint32_t fs) { step_ = step_for(hz, fs); }
+	void set_step(uint32_t step) { step_ = step; }
+	void set_phase(uint32_t phase) { phase_ = phase; }
+	// added on output only, 2^32 is one period (2^30 = 90 degrees)
+	void set_phase_offset(uint32_t offset) { offset_ = offset; }
+	void set_table(const table_type &t) { table_ = &t; }
+	void set_interpolate(bool on) { interp_ = on; }
+
+	uint32_t step() const { return step_; }
+	uint32_t phase() const { return phase_; }
+
+	// sample at a phase, no state change
+	uint16_t at(uint32_t phase) const
+	{
+		uint32_t i = phase >> shift;
+		if (!interp_)
+			return table_->v[i];
+
+		int32_t a = table_->v[i];
+		int32_t b = table_->v[(i + 1) & (N - 1)];
+		int32_t frac = (int32_t)((phase >> (shift - 15)) & 0x7FFF);
+		return (uint16_t)(a + (((b - a) * frac + (1 << 14)) >> 15));
+	}
+
+	uint16_t next()
+	{
+		uint16_t s = at(phase_ + offset_);
+		phase_ += step_;
+		return s;
+	}
+
+	void fill(uint16_t *out, uint32_t n)
+	{
+		const uint32_t step = step_;
+		uint32_t phase = phase_;
+
+		for (uint32_t k = 0; k < n; k++) {
+			out[k] = at(phase + offset_);
+			phase += step;
+		}
+		phase_ = phase;
+	}
+
+	// two outputs from the one accumulator, the second one offset2
+	//   ahead (2^30 gives I/Q). packed with the first in the low
+	//   half-word, the DAC dual register layout
+	void fill_pair(uint32_t *out, uint32_t n, uint32_t offset2)
+	{
+		const uint32_t step = step_;
+		uint32_t phase = phase_ + offset_;
+
+		for (uint32_t k = 0; k < n; k++) {
+			out[k] = (uint32_t)at(phase) | ((uint32_t)at(phase + offset2) << 16);
+			phase += step;
+		}
+		phase_ = phase - offset_;
+	}
+
+private:
+	static constexpr unsigned shift = 32 - log2u(N);
+	static_assert(shift >= 15, "table too large for 15-bit interpolation");
+
+	const table_type *table_;
+	uint32_t phase_;
+	uint32_t step_;
+	uint32_t offset_;
+	bool interp_;
+};
+
+} // namespace dds
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * main.cpp
+ *
+ * description:
+ *   DDS I/Q pair on DAC channel 1 (PA4) and channel 2 (PA5) at
+ *   200 ksps, channel 2 runs 90 degrees ahead. the 1024 entry 12-bit
+ *   sine and triangle tables are generated at compile time (dds.hpp),
+ *   the engine fills a 256 sample SRAM buffer of packed pairs in
+ *   halves from the DMA transfer complete interrupt (dac_wave.c dual
+ *   streaming mode). both channels load on the same TIM6 trigger from
+ *   one DHR12RD write, so the pair stays phase locked on a scope in
+ *   XY mode (a circle for the sine).
+ *
+ *   the main loop sweeps the frequency from 100 Hz to 10 kHz and back,
+ *   every change lands on the next sample without a phase jump.
+ *   pressing the user button (PA0) switches between sine and triangle.
+ *
+ *   before the output starts the engine runs a fixed reference sequence
+ *   and compares its checksum with the one the host build prints. the
+ *   green LED (PD12) shows a match, the red LED (PD14) a mismatch or
+ *   a DMA underrun.
+ *
+ *   make run HOST=1 prints the checksum and the error against a double
+ *   precision sine, with a file name it also writes the reference
+ *   samples (one per line) for an offline FFT:
+ *     make run HOST=1 RUN_ARGS=dds.txt
+ *
+ * setup:
+ *   1. dac_wave_init at 200 ksps (TIM6 TRGO, DMA1 stream 5)
+ *   2. dac_wave_stream_dual with the buffer and the fill callback
+ *   3. the callback calls engine.fill_pair for the half that just played
+ */
+
+#include <stdint.h>
+#include "dds.hpp"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#include <math.h>
+#else
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "dac_wave.h"
+#endif
+
+/*************************************************
+* definitions
+*************************************************/
+#define TABLE_N       1024
+#define TABLE_BITS    12
+#define SAMPLE_RATE   200000
+#define BUF_LEN       256
+
+// reference sequence, the same on host and board
+#define REF_SAMPLES   8192
+#define REF_HZ        1234
+// FNV-1a over the reference samples, printed by the host build
+#define REF_CHECKSUM  0xD43DCB6FUL
+
+typedef dds::engine<TABLE_N, TABLE_BITS> osc_t;
+
+/*************************************************
+* variables
+*************************************************/
+// computed by the compiler, placed in flash
+static constexpr auto sine_table = dds::make_table<dds::sine, TABLE_N, TABLE_BITS>();
+static constexpr auto tri_table = dds::make_table<dds::triangle, TABLE_N, TABLE_BITS>();
+
+// constant initialized, no constructor has to run
+static osc_t osc(sine_table, true);
+
+/*************************************************
+* reference
+*************************************************/
+static uint32_t fnv1a(uint32_t h, uint16_t s)
+{
+	h = (h ^ (s & 0xFF)) * 16777619UL;
+	h = (h ^ (s >> 8)) * 16777619UL;
+	return h;
+}
+
+// interpolated sine, a frequency and phase change half way through
+static uint32_t reference(void (*out)(uint16_t))
+{
+	osc_t o(sine_table, true);
+	uint32_t h = 2166136261UL;
+
+	o.set_frequency(REF_HZ, SAMPLE_RATE);
+	for (uint32_t i = 0; i < REF_SAMPLES; i++) {
+		if (i == REF_SAMPLES / 2) {
+			o.set_step(o.step() * 3);
+			o.set_phase_offset(1UL << 30);
+		}
+		uint16_t s = o.next();
+		h = fnv1a(h, s);
+		if (out)
+			out(s);
+	}
+	return h;
+}
+
+#ifdef HOST_BUILD
+/*************************************************
+* host: checksum, accuracy and sample dump
+*************************************************/
+static FILE *dump;
+
+static void dump_sample(uint16_t s)
+{
+	fprintf(dump, "%u\n", s);
+}
+
+// worst error against a double sine, in LSB
+static double max_error(bool interp, uint32_t hz)
+{
+	osc_t o(sine_table, interp);
+	const double mid = 1 << (TABLE_BITS - 1);
+	double worst = 0;
+
+	o.set_frequency(hz, SAMPLE_RATE);
+	for (uint32_t i = 0; i < REF_SAMPLES; i++) {
+		double p = (double)o.phase() / 4294967296.0;
+		double e = fabs((double)o.next() - (mid + (mid - 1) * sin(2 * M_PI * p)));
+		if (e > worst)
+			worst = e;
+	}
+	return worst;
+}
+
+// the packed pairs hold the single output and the one 90 degrees ahead
+static int pair_ok(void)
+{
+	osc_t a(sine_table, true), b(sine_table, true), q(sine_table, true);
+	uint16_t one[BUF_LEN];
+	uint32_t pair[BUF_LEN];
+
+	a.set_frequency(REF_HZ, SAMPLE_RATE);
+	b.set_frequency(REF_HZ, SAMPLE_RATE);
+	q.set_frequency(REF_HZ, SAMPLE_RATE);
+	q.set_phase_offset(1UL << 30);
+	for (int k = 0; k < 4; k++) {
+		a.fill(one, BUF_LEN);
+		b.fill_pair(pair, BUF_LEN, 1UL << 30);
+		for (uint32_t i = 0; i < BUF_LEN; i++)
+			if ((pair[i] & 0xFFFF) != one[i] || (pair[i] >> 16) != q.next())
+				return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t h;
+	int ok = pair_ok();
+
+	printf("dds: %u entry %u-bit table, %u sps\n", TABLE_N, TABLE_BITS, SAMPLE_RATE);
+	printf("  max error, table only   : %.3f LSB\n", max_error(false, REF_HZ));
+	printf("  max error, interpolated : %.3f LSB\n", max_error(true, REF_HZ));
+
+	dump = (argc > 1) ? fopen(argv[1], "w") : 0;
+	if (argc > 1 && !dump) {
+		perror(argv[1]);
+		return 1;
+	}
+	h = reference(dump ? dump_sample : 0);
+	if (dump) {
+		fclose(dump);
+		printf("  %u samples written to %s\n", REF_SAMPLES, argv[1]);
+	}
+
+	printf("  I/Q pairs               : %s\n", ok ? "match" : "MISMATCH");
+	printf("  reference checksum      : 0x%08X%s\n", (unsigned)h,
+	       (h == REF_CHECKSUM) ? "" : " (REF_CHECKSUM differs)");
+	return !ok || h != REF_CHECKSUM;
+}
+
+#else
+/*************************************************
+* function declarations
+*************************************************/
+extern "C" {
+void DMA1_Stream5_IRQHandler(void);
+void TIM6_DAC_IRQHandler(void);
+}
+
+static void fill(uint32_t *half, uint16_t n);
+
+/*************************************************
+* variables
+*************************************************/
+// packed I/Q pairs, DMA reads it, has to be in SRAM (not CCM)
+static uint32_t dac_buf[BUF_LEN];
+
+/*
+ * half buffer played, refill it
+ */
+void DMA1_Stream5_IRQHandler(void)
+{
+	dac_wave_irq();
+}
+
+/*
+ * DAC DMA underrun, the refill was too late
+ */
+void TIM6_DAC_IRQHandler(void)
+{
+	dac_wave_underrun_irq();
+	GPIOD->ODR |= (1 << 14);
+}
+
+static void fill(uint32_t *half, uint16_t n)
+{
+	// channel 2 a quarter period ahead
+	osc.fill_pair(half, n, 1UL << 30);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	volatile uint32_t i;
+	uint32_t hz = 100;
+	int up = 1;
+	int tri = 0;
+	uint32_t button = 0;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	// setup LEDs
+	RCC->AHB1ENR |= (1 << 3);
+	GPIOD->MODER &= 0x00FFFFFF;
+	GPIOD->MODER |= 0x55000000;
+	GPIOD->ODR    = 0;
+
+	// enable GPIOA clock, bit 0 on AHB1ENR
+	// PA0 user button is an input by default
+	RCC->AHB1ENR |= (1 << 0);
+
+	// same sequence as the host build
+	if (reference(0) == REF_CHECKSUM)
+		GPIOD->ODR |= (1 << 12);
+	else
+		GPIOD->ODR |= (1 << 14);
+
+	/*****************************
+	 ******** DAC + DMA **********
+	 *****************************/
+	osc.set_frequency(hz, dac_wave_init(SAMPLE_RATE));
+	dac_wave_stream_dual(dac_buf, BUF_LEN, fill);
+
+	while(1)
+	{
+		// about 50 steps per second, 2 % each
+		for (i=0; i<400000; i++);
+
+		hz = up ? hz + hz / 50 : hz - hz / 50;
+		if (hz >= 10000)
+			up = 0;
+		else if (hz <= 100)
+			up = 1;
+		osc.set_frequency(hz, dac_wave.rate);
+
+		// user button, switch the table on release
+		if (GPIOA->IDR & (1 << 0)) {
+			button = 1;
+		} else if (button) {
+			button = 0;
+			tri = !tri;
+			osc.set_table(tri ? tri_table : sine_table);
+		}
+	}
+
+	return 0;
+}
+#endif
@@ -0,0 +1,122 @@
+/*
+ * dac_dma.c
+ *
+ * description:
+ *   DAC channel 1 (PA4) plays a waveform table at 1 Msps without
+ *   any per-sample CPU work. TIM6 TRGO triggers the conversions and
+ *   DMA1 stream 5 feeds DHR12R1 from the table (dac_wave.c).
+ *
+ *   a 64 sample sine from flash and a triangle built in RAM are
+ *   swapped every second, the swap happens on a period boundary so
+ *   the output never shows a torn period. 64 samples at 1 Msps give
+ *   a 15.625 kHz tone.
+ *
+ *   the only interrupts are the two half-table ends during a swap,
+ *   a steady waveform costs no CPU time at all.
+ *   the orange LED (PD13) is on while the triangle plays,
+ *   the red LED (PD14) lights up on a DMA underrun.
+ *
+ * setup:
+ *   1. set PA4 to analog mode
+ *   2. DAC channel 1 triggered by TIM6 TRGO, DMA requests on
+ *   3. TIM6 update at the sample rate, update as TRGO
+ *   4. DMA1 stream 5 channel 7, circular double buffer mode,
+ *      the two table halves are the two buffers
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "dac_wave.h"
+
+/*************************************************
+* function declarations
+*************************************************/
+void DMA1_Stream5_IRQHandler(void);
+void TIM6_DAC_IRQHandler(void);
+int main(void);
+
+/*************************************************
+* variables
+*************************************************/
+#define WAVE_LEN 64
+
+// one period, 12-bit, mid scale 2048
+static const uint16_t sine_table[WAVE_LEN] = {
+	2048, 2249, 2447, 2642, 2831, 3013, 3185, 3347,
+	3495, 3630, 3750, 3853, 3939, 4007, 4056, 4085,
+	4095, 4085, 4056, 4007, 3939, 3853, 3750, 3630,
+	3495, 3347, 3185, 3013, 2831, 2642, 2447, 2249,
+	2048, 1847, 1649, 1454, 1265, 1083,  911,  749,
+	 601,  466,  346,  243,  157,   89,   40,   11,
+	   1,   11,   40,   89,  157,  243,  346,  466,
+	 601,  749,  911, 1083, 1265, 1454, 1649, 1847,
+};
+
+// filled at start up, lives in SRAM
+static uint16_t triangle_table[WAVE_LEN];
+
+/*
+ * table half done, only enabled while a swap is in progress
+ */
+void DMA1_Stream5_IRQHandler(void)
+{
+	dac_wave_irq();
+}
+
+/*
+ * DAC DMA underrun
+ */
+void TIM6_DAC_IRQHandler(void)
+{
+	dac_wave_underrun_irq();
+	GPIOD->ODR |= (1 << 14);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	volatile uint32_t i;
+	int tri = 0;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	// setup LEDs
+	RCC->AHB1ENR |= (1 << 3);
+	GPIOD->MODER &= 0x00FFFFFF;
+	GPIOD->MODER |= 0x55000000;
+	GPIOD->ODR    = 0;
+
+	// triangle from 0 up to 4095 and back
+	for (i = 0; i < WAVE_LEN; i++) {
+		uint32_t up = (i < WAVE_LEN / 2) ? i : WAVE_LEN - i;
+		triangle_table[i] = (uint16_t)((up * 4095) / (WAVE_LEN / 2));
+	}
+
+	/*****************************
+	 ******** DAC + DMA **********
+	 *****************************/
+	dac_wave_init(1000000);
+	dac_wave_start(sine_table, WAVE_LEN);
+
+	while(1)
+	{
+		// wait about a second, the output runs on its own
+		for (i=0; i<20000000; i++);
+
+		tri = !tri;
+		dac_wave_swap(tri ? triangle_table : sine_table);
+		while (dac_wave_swap_pending());
+
+		if (tri)
+			GPIOD->ODR |= (1 << 13);
+		else
+			GPIOD->ODR &= (uint16_t)~(1 << 13);
+	}
+
+	return 0;
+}
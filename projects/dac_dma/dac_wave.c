@@ -0,0 +1,366 @@
+/*
+ * dac_wave.c
+ *
+ * description:
+ *   DMA driven DAC waveform generator, see dac_wave.h
+ *
+ * setup:
+ *   1. PA4 analog, DAC, TIM6 and DMA1 clocks on
+ *   2. TIM6 update as TRGO (MMS = 010), auto-reload preload on
+ *   3. DAC channel 1: trigger on, TIM6 TRGO (TSEL1 = 000),
+ *      DMA underrun interrupt on
+ *   4. DMA1 stream 5, channel 7: memory to peripheral, half-word to
+ *      DHR12R1, memory increment, circular + double buffer mode
+ *   5. enable the stream, then DMAEN1, then start TIM6
+ *
+ *   dual mode: PA5 analog, channel 2 on the same trigger (TSEL2 = 000)
+ *   without its own DMA requests, word transfers to DHR12RD
+ */
+
+#include "stm32f4xx.h"
+#include "dac_wave.h"
+
+/*************************************************
+* definitions
+*************************************************/
+// stream 5 event flags sit at bit 6 of HISR/HIFCR
+#define DMA_S5_FLAGS   ((uint32_t)0x3D << 6)
+
+// channel 7, high priority, memory increment, circular,
+// memory to peripheral, double buffer
+#define DMA_WAVE_CR    (((uint32_t)7 << 25) | (1 << 18) | (0x2 << 16) | \
+                        (1 << 10) | (1 << 8) | (0x1 << 6))
+// memory and peripheral size, 16-bit or 32-bit
+#define DMA_SIZE16     ((1 << 13) | (1 << 11))
+#define DMA_SIZE32     ((0x2 << 13) | (0x2 << 11))
+
+#define DMA_CR_TCIE    (1u << 4)
+#define DMA_CR_CT      (1u << 19)
+
+/*************************************************
+* variables
+*************************************************/
+dac_wave_t dac_wave;
+
+/*************************************************
+* api
+*************************************************/
+/*
+ * TIM6 period for the sample rate, returns the rate it really runs at.
+ * ARR is preloaded, a change takes effect on the next update.
+ */
+uint32_t dac_wave_set_rate(uint32_t rate_hz)
+{
+	uint32_t div, psc, arr;
+
+	if (rate_hz == 0)
+		rate_hz = 1;
+	div = DAC_WAVE_TIMCLK / rate_hz;
+	if (div < 2)
+		div = 2;
+
+	// smallest prescaler that lets ARR fit in 16 bits
+	psc = (div - 1) / 65536;
+	arr = div / (psc + 1) - 1;
+
+	TIM6->PSC = psc;
+	TIM6->ARR = arr;
+
+	dac_wave.rate = DAC_WAVE_TIMCLK / ((psc + 1) * (arr + 1));
+	return dac_wave.rate;
+}
+
+/*
+ * DAC channel 1, TIM6 and DMA1 stream 5 setup, output is not started
+ */
+uint32_t dac_wave_init(uint32_t rate_hz)
+{
+	uint32_t rate;
+
+	// enable GPIOA clock, bit 0 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 0);
+	// PA4 analog mode (0b11)
+	GPIOA->MODER |= (0x3 << 8);
+
+	// enable DMA1 clock, bit 21 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 21);
+	// enable DAC clock, bit 29 on APB1ENR
+	RCC->APB1ENR |= (1 << 29);
+	// enable TIM6 clock, bit 4 on APB1ENR
+	RCC->APB1ENR |= (1 << 4);
+
+	// TIM6: auto-reload preload (ARPE bit 7), update as TRGO (MMS 0b010)
+	TIM6->CR1 = (1 << 7);
+	TIM6->CR2 = (0x2 << 4);
+	rate = dac_wave_set_rate(rate_hz);
+	// load PSC and ARR before the DAC listens to TRGO
+	TIM6->EGR = (1 << 0);
+
+	// DAC channel 1: DMA underrun interrupt (bit 13), TSEL1 TIM6 (0b000),
+	//   trigger enable (bit 2), output buffer on, enable (bit 0)
+	//   DMAEN1 (bit 12) is set once the stream runs
+	DAC->CR = (1 << 13) | (0x0 << 3) | (1 << 2) | (1 << 0);
+
+	NVIC_SetPriority(DMA1_Stream5_IRQn, 2);
+	NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+
+	dac_wave.table = 0;
+	dac_wave.pending = 0;
+	dac_wave.stage = 0;
+	dac_wave.dual = 0;
+	dac_wave.buf = 0;
+	dac_wave.fill = 0;
+	dac_wave.fill_dual = 0;
+	dac_wave.swaps = 0;
+	dac_wave.underruns = 0;
+
+	return rate;
+}
+
+/*
+ * stop the timer, the DAC requests and the stream
+ */
+void dac_wave_stop(void)
+{
+	DMA_Stream_TypeDef *s = DMA1_Stream5;
+
+	TIM6->CR1 &= ~(1u << 0);
+	DAC->CR &= ~(1u << 12);
+	s->CR &= ~(1u << 0);
+	while (s->CR & (1 << 0));
+	DMA1->HIFCR = DMA_S5_FLAGS;
+
+	dac_wave.pending = 0;
+	dac_wave.stage = 0;
+}
+
+// address of the second half of a table
+static uint32_t wave_half(const void *table)
+{
+	return (uint32_t)table + (uint32_t)(dac_wave.len / 2) * (dac_wave.dual ? 4 : 2);
+}
+
+// channel 2 follows channel 1 in dual mode
+static void wave_mode(uint8_t dual)
+{
+	if (!dual) {
+		// channel 2 off again if dual mode turned it on
+		if (dac_wave.dual)
+			DAC->CR &= ~((1u << 18) | (1u << 16));
+		dac_wave.dual = 0;
+		return;
+	}
+	dac_wave.dual = 1;
+
+	// PA5 analog mode (0b11)
+	GPIOA->MODER |= (0x3 << 10);
+	// DAC channel 2: TSEL2 TIM6 (0b000), trigger enable (bit 18),
+	//   enable (bit 16), no DMA requests of its own
+	DAC->CR |= (0x0 << 19) | (1 << 18) | (1 << 16);
+}
+
+// each half of buf is one memory target, dac_wave.len and .dual are set
+static void wave_run(const void *buf, uint32_t cr)
+{
+	DMA_Stream_TypeDef *s = DMA1_Stream5;
+
+	if (dac_wave.dual) {
+		s->PAR = (uint32_t)&DAC->DHR12RD;
+		cr |= DMA_SIZE32;
+	} else {
+		s->PAR = (uint32_t)&DAC->DHR12R1;
+		cr |= DMA_SIZE16;
+	}
+	s->M0AR = (uint32_t)buf;
+	s->M1AR = wave_half(buf);
+	s->NDTR = dac_wave.len / 2;
+	s->CR = cr;
+	s->CR |= (1 << 0);
+
+	DAC->CR |= (1 << 12);    // DMAEN1
+	TIM6->CR1 |= (1 << 0);   // start conversions
+}
+
+/*
+ * play table over and over, len has to be even
+ * returns 0 if the length is not usable
+ */
+static int wave_start(const void *table, uint16_t len, uint8_t dual)
+{
+	if (len < 2 || (len & 1))
+		return 0;
+
+	dac_wave_stop();
+	wave_mode(dual);
+
+	dac_wave.table = table;
+	dac_wave.len = len;
+	dac_wave.fill = 0;
+	dac_wave.fill_dual = 0;
+
+	wave_run(table, DMA_WAVE_CR);
+	return 1;
+}
+
+int dac_wave_start(const uint16_t *table, uint16_t len)
+{
+	return wave_start(table, len, 0);
+}
+
+/*
+ * same as dac_wave_start on both channels, DAC_WAVE_PACK samples
+ */
+int dac_wave_start_dual(const uint32_t *table, uint16_t len)
+{
+	return wave_start(table, len, 1);
+}
+
+/*
+ * play buf (SRAM) and let fill refill each half once it has played,
+ * both halves are filled before the output starts.
+ * returns 0 if the length is not usable
+ */
+int dac_wave_stream(uint16_t *buf, uint16_t len, dac_wave_fill_t fill)
+{
+	if (len < 2 || (len & 1) || fill == 0)
+		return 0;
+
+	dac_wave_stop();
+	wave_mode(0);
+
+	dac_wave.table = buf;
+	dac_wave.len = len;
+	dac_wave.buf = buf;
+	dac_wave.fill = fill;
+	dac_wave.fill_dual = 0;
+
+	fill(buf, len / 2);
+	fill(buf + len / 2, len / 2);
+
+	wave_run(buf, DMA_WAVE_CR | DMA_CR_TCIE);
+	return 1;
+}
+
+/*
+ * same as dac_wave_stream on both channels, DAC_WAVE_PACK samples
+ */
+int dac_wave_stream_dual(uint32_t *buf, uint16_t len, dac_wave_fill_dual_t fill)
+{
+	if (len < 2 || (len & 1) || fill == 0)
+		return 0;
+
+	dac_wave_stop();
+	wave_mode(1);
+
+	dac_wave.table = buf;
+	dac_wave.len = len;
+	dac_wave.buf = buf;
+	dac_wave.fill = 0;
+	dac_wave.fill_dual = fill;
+
+	fill(buf, len / 2);
+	fill(buf + len / 2, len / 2);
+
+	wave_run(buf, DMA_WAVE_CR | DMA_CR_TCIE);
+	return 1;
+}
+
+/*
+ * replace the playing table with one of the same length at the next
+ * period boundary. returns 0 if an earlier swap is still in progress.
+ */
+int dac_wave_swap(const void *table)
+{
+	DMA_Stream_TypeDef *s = DMA1_Stream5;
+
+	if (dac_wave.pending || dac_wave.fill || dac_wave.fill_dual)
+		return 0;
+
+	dac_wave.stage = 0;
+	dac_wave.pending = table;
+
+	// interrupts only while swapping, stale flags do no harm as the
+	//   handler looks at CT and not at which half ended
+	DMA1->HIFCR = DMA_S5_FLAGS;
+	s->CR |= DMA_CR_TCIE;
+	return 1;
+}
+
+int dac_wave_swap_pending(void)
+{
+	return dac_wave.pending != 0;
+}
+
+/*
+ * half transfer done, call from DMA1_Stream5_IRQHandler
+ */
+void dac_wave_irq(void)
+{
+	DMA_Stream_TypeDef *s = DMA1_Stream5;
+
+	DMA1->HIFCR = DMA_S5_FLAGS;
+
+	if (dac_wave.fill || dac_wave.fill_dual) {
+		// refill the half that is not playing
+		uint16_t half = dac_wave.len / 2;
+		void *p = (s->CR & DMA_CR_CT) ? dac_wave.buf : (void *)wave_half(dac_wave.buf);
+
+		if (dac_wave.fill_dual)
+			dac_wave.fill_dual((uint32_t *)p, half);
+		else
+			dac_wave.fill((uint16_t *)p, half);
+		return;
+	}
+
+	if (dac_wave.pending == 0) {
+		s->CR &= ~DMA_CR_TCIE;
+		return;
+	}
+
+	if (s->CR & DMA_CR_CT) {
+		// M1 (old second half) plays, M0 is up next
+		if (dac_wave.stage == 0) {
+			s->M0AR = (uint32_t)dac_wave.pending;
+			dac_wave.stage = 1;
+		}
+	} else if (dac_wave.stage == 1) {
+		// new first half plays, M1 is up next
+		s->M1AR = wave_half(dac_wave.pending);
+		dac_wave.table = dac_wave.pending;
+		dac_wave.pending = 0;
+		dac_wave.stage = 0;
+		dac_wave.swaps++;
+		s->CR &= ~DMA_CR_TCIE;
+	}
+}
+
+/*
+ * DMA underrun, call from TIM6_DAC_IRQHandler.
+ * the DAC stops requesting after an underrun, start over.
+ */
+void dac_wave_underrun_irq(void)
+{
+	const void *t;
+
+	if (!(DAC->SR & (1 << 13)))
+		return;
+
+	// DMAUDR1, write 1 to clear
+	DAC->SR = (1 << 13);
+	dac_wave.underruns++;
+
+	if (dac_wave.fill) {
+		dac_wave_stream((uint16_t *)dac_wave.buf, dac_wave.len, dac_wave.fill);
+		return;
+	}
+	if (dac_wave.fill_dual) {
+		dac_wave_stream_dual((uint32_t *)dac_wave.buf, dac_wave.len, dac_wave.fill_dual);
+		return;
+	}
+
+	// a swap in progress ends up finished by the restart
+	t = dac_wave.pending ? dac_wave.pending : dac_wave.table;
+	if (t)
+		wave_start(t, dac_wave.len, dac_wave.dual);
+}
@@ -0,0 +1,104 @@
+/*
+ * dac_wave.h
+ *
+ * description:
+ *   DAC channel 1 (PA4) waveform generator. a sample table is streamed
+ *   to DHR12R1 by DMA1 stream 5 (channel 7), every TIM6 update (TRGO)
+ *   converts the next sample. the CPU does no per-sample work, there is
+ *   no interrupt while a waveform simply repeats.
+ *
+ *   the stream runs in double buffer mode, the two halves of the table
+ *   are its two memory targets (M0AR, M1AR) and NDTR is half the table.
+ *   while one half plays, the address of the other one may be changed,
+ *   so a new table takes over exactly at a period boundary:
+ *     - dac_wave_swap stores the new table and enables TC interrupts
+ *     - end of the first half (M1 now plays): M0AR = new first half
+ *     - end of the second half (new first half now plays):
+ *       M1AR = new second half, TC interrupts off again
+ *   the output goes old, old, ..., new, new without a torn period,
+ *   the swap is done within two periods. half a table has to take
+ *   longer than the worst interrupt latency (32 us for 64 samples
+ *   at 1 Msps).
+ *
+ *   streaming mode (dac_wave_stream) plays a RAM buffer instead and
+ *   calls a fill function from the transfer complete interrupt for the
+ *   half that just finished, while the other half plays. this is the
+ *   path for generated signals (DDS, filters).
+ *
+ *   dual mode (the _dual calls) drives channel 2 (PA5) as well. each
+ *   sample is a 32-bit word, channel 1 in bits 11:0 and channel 2 in
+ *   bits 27:16 (DAC_WAVE_PACK), written to DHR12RD by the same stream.
+ *   both channels are triggered by the same TIM6 update, so they
+ *   change on the same clock edge (I/Q, stereo) with one DMA transfer
+ *   and at most one interrupt per sample pair.
+ *
+ *   tables hold 12-bit right aligned values, an even number of samples.
+ *   they can be in flash or SRAM (not CCM, DMA can not reach it) and
+ *   must stay valid while they play. all tables swapped in have the
+ *   length and the mode of the one that was started.
+ *
+ * usage:
+ *   dac_wave_init(1000000);              // 1 Msps
+ *   dac_wave_start(sine, 64);
+ *   ...
+ *   dac_wave_swap(triangle);             // takes effect on a period boundary
+ *   or
+ *   dac_wave_stream(buf, 256, fill);     // fill(half, 128) refills buf
+ *   or
+ *   dac_wave_start_dual(iq, 64);         // iq[i] = DAC_WAVE_PACK(i, q)
+ *   call dac_wave_irq() from DMA1_Stream5_IRQHandler
+ *   call dac_wave_underrun_irq() from TIM6_DAC_IRQHandler
+ */
+
+#ifndef __DAC_WAVE_H
+#define __DAC_WAVE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* TIM6 input clock, APB1 at 42 MHz, timers run at twice that */
+#define DAC_WAVE_TIMCLK    84000000UL
+
+/* dual mode sample, channel 1 in the low half-word */
+#define DAC_WAVE_PACK(ch1, ch2)  ((uint32_t)(ch1) | ((uint32_t)(ch2) << 16))
+
+/* refill n samples at half, called from the DMA interrupt */
+typedef void (*dac_wave_fill_t)(uint16_t *half, uint16_t n);
+typedef void (*dac_wave_fill_dual_t)(uint32_t *half, uint16_t n);
+
+typedef struct {
+	const void *table;        /* playing table              */
+	const void * volatile pending;  /* table waiting for the swap, set in the irq */
+	uint16_t len;             /* samples per table          */
+	uint8_t stage;            /* swap progress              */
+	uint8_t dual;             /* 32-bit samples to DHR12RD  */
+	void *buf;                /* streaming buffer           */
+	dac_wave_fill_t fill;     /* streaming refill, 0 if off */
+	dac_wave_fill_dual_t fill_dual;
+	volatile uint32_t swaps;
+	volatile uint32_t underruns;
+	uint32_t rate;            /* actual sample rate (Hz)    */
+} dac_wave_t;
+
+extern dac_wave_t dac_wave;
+
+uint32_t dac_wave_init(uint32_t rate_hz);
+uint32_t dac_wave_set_rate(uint32_t rate_hz);
+int  dac_wave_start(const uint16_t *table, uint16_t len);
+int  dac_wave_stream(uint16_t *buf, uint16_t len, dac_wave_fill_t fill);
+int  dac_wave_start_dual(const uint32_t *table, uint16_t len);
+int  dac_wave_stream_dual(uint32_t *buf, uint16_t len, dac_wave_fill_dual_t fill);
+int  dac_wave_swap(const void *table);
+int  dac_wave_swap_pending(void);
+void dac_wave_stop(void);
+void dac_wave_irq(void);
+void dac_wave_underrun_irq(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -163,7 +163,7 @@ void exti_handler(void)
 		GPIOD->ODR = (uint16_t)(i << 12);
 
 		/* wait little bit */
-		for(uint32_t j=0; j<1000000; j++);
+		for(volatile uint32_t j=0; j<1000000; j++);
 
 		if (i == 0x08) {
 			i = 1;
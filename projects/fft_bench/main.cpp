@@ -0,0 +1,295 @@
+/*
+ * main.cpp
+ *
+ * description:
+ *   cycles per transform and accuracy of the in-place FFT in
+ *   include/fft.hpp for 64 .. 1024 points in float, Q31 and Q15.
+ *   the outputs are checked against a naive double precision DFT of
+ *   the same input, a tone pair with noise on re and a slower tone on
+ *   im. the input only has 16 significant bits so all three formats
+ *   see exactly the same numbers.
+ *
+ *   1024 point float and Q15 also run on a buffer in CCM to compare
+ *   with the SRAM one.
+ *
+ *   the same file builds for the board and for the host:
+ *     make          - target, DSP instructions, DWT cycle counter
+ *     make HOST=1   - host, portable arithmetic, TSC
+ *     make run HOST=1
+ *
+ *   on target the results are left in results[] for the debugger,
+ *   green LED (PD12) when every transform is within its error bound,
+ *   red LED (PD14) otherwise. the Q31 and Q15 checksums are the same
+ *   on both builds.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "fft.hpp"
+#include "cyccnt.h"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#else
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#endif
+
+/*************************************************
+* definitions
+*************************************************/
+#define MAX_N         1024
+#define NRESULTS      17
+
+#ifdef HOST_BUILD
+#define BENCH_REPEAT  200
+#else
+#define BENCH_REPEAT  4
+#endif
+
+// worst error against the DFT / N, in full scale units
+#define BOUND_F32     2.0e-7
+#define BOUND_Q31     1.0e-8
+#define BOUND_Q15     3.0e-4
+
+typedef struct {
+	const char *name;
+	uint32_t n;
+	uint32_t cycles;       // per transform, best of BENCH_REPEAT
+	float max_err;
+	float bound;
+	uint32_t checksum;     // FNV-1a over the output words, fixed point only
+	uint32_t ok;
+} bench_result_t;
+
+/*************************************************
+* variables
+*************************************************/
+// input, 16 significant bits
+static int16_t in_re[MAX_N], in_im[MAX_N];
+// naive DFT / N
+static double ref_re[MAX_N], ref_im[MAX_N];
+
+static fft::cf32 buf_f32[MAX_N] __attribute__ ((aligned(8)));
+static fft::cq31 buf_q31[MAX_N] __attribute__ ((aligned(8)));
+static fft::cq15 buf_q15[MAX_N] __attribute__ ((aligned(8)));
+
+#ifdef HOST_BUILD
+static fft::cf32 *const ccm_f32 = buf_f32;
+static fft::cq15 *const ccm_q15 = buf_q15;
+#else
+// .ccm_bss of the linker script, zeroed by the startup code
+static fft::cf32 ccm_f32[MAX_N] CCM_BSS __attribute__ ((aligned(8)));
+static fft::cq15 ccm_q15[MAX_N] CCM_BSS __attribute__ ((aligned(8)));
+#endif
+
+volatile bench_result_t results[NRESULTS];
+static uint32_t nresults;
+
+/*************************************************
+* input and reference
+*************************************************/
+static void make_input(uint32_t n)
+{
+	const double w = 8 * atan(1.0) / n;  // 2 pi / n, no float constants
+	uint32_t lcg = 12345;
+
+	for (uint32_t i = 0; i < n; i++) {
+		lcg = lcg * 1664525u + 1013904223u;
+		double noise = ((double)(lcg >> 22) - 512) / 16384;
+		double re = 0.4 * sin(w * 5 * i) + 0.2 * cos(w * (n / 4 + 3) * i) + noise;
+		double im = 0.3 * sin(w * 2 * i + 1);
+
+		in_re[i] = (int16_t)floor(re * 32768 + 0.5);
+		in_im[i] = (int16_t)floor(im * 32768 + 0.5);
+	}
+}
+
+static void dft(uint32_t n)
+{
+	const double w = 8 * atan(1.0) / n;
+
+	for (uint32_t k = 0; k < n; k++) {
+		double sr = 0, si = 0;
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t p = (uint32_t)(((uint64_t)k * i) % n);
+			double c = cos(w * p), s = sin(w * p);
+			sr += (in_re[i] * c + in_im[i] * s) / 32768;
+			si += (in_im[i] * c - in_re[i] * s) / 32768;
+		}
+		ref_re[k] = sr / n;
+		ref_im[k] = si / n;
+	}
+}
+
+static void load(fft::cf32 *x, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+		x[i] = fft::cf32{ in_re[i] / 32768.0f, in_im[i] / 32768.0f };
+}
+
+static void load(fft::cq31 *x, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+		x[i] = fft::cq31{ (int32_t)((uint32_t)(int32_t)in_re[i] << 16),
+		                  (int32_t)((uint32_t)(int32_t)in_im[i] << 16) };
+}
+
+static void load(fft::cq15 *x, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+		x[i] = fft::q15_pack(in_re[i], in_im[i]);
+}
+
+/*************************************************
+* errors
+*************************************************/
+static double worse(double e, double re, double im, uint32_t k)
+{
+	double dr = fabs(re - ref_re[k]);
+	double di = fabs(im - ref_im[k]);
+	if (dr > e)
+		e = dr;
+	return (di > e) ? di : e;
+}
+
+static double error(const fft::cf32 *x, uint32_t n, uint32_t *h)
+{
+	double e = 0;
+	for (uint32_t k = 0; k < n; k++)
+		e = worse(e, (double)x[k].re / n, (double)x[k].im / n, k);
+	*h = 0;
+	return e;
+}
+
+static double error(const fft::cq31 *x, uint32_t n, uint32_t *h)
+{
+	double e = 0;
+	*h = 2166136261u;
+	for (uint32_t k = 0; k < n; k++) {
+		e = worse(e, x[k].re / 2147483648.0, x[k].im / 2147483648.0, k);
+		*h = (*h ^ (uint32_t)x[k].re) * 16777619u;
+		*h = (*h ^ (uint32_t)x[k].im) * 16777619u;
+	}
+	return e;
+}
+
+static double error(const fft::cq15 *x, uint32_t n, uint32_t *h)
+{
+	double e = 0;
+	*h = 2166136261u;
+	for (uint32_t k = 0; k < n; k++) {
+		e = worse(e, fft::q15_re(x[k]) / 32768.0, fft::q15_im(x[k]) / 32768.0, k);
+		*h = (*h ^ x[k]) * 16777619u;
+	}
+	return e;
+}
+
+/*************************************************
+* benchmarks
+*************************************************/
+template <uint32_t N, class T>
+static void bench(const char *name, T *x, double bound)
+{
+	volatile bench_result_t *r = &results[nresults++];
+	uint32_t min = 0xFFFFFFFF;
+	uint32_t h;
+	double e;
+
+	for (uint32_t rep = 0; rep < BENCH_REPEAT; rep++) {
+		load(x, N);
+		uint32_t t0 = cyccnt_read();
+		fft::forward<N>(x);
+		uint32_t c = cyccnt_read() - t0;
+		if (c < min)
+			min = c;
+	}
+	e = error(x, N, &h);
+
+	r->name = name;
+	r->n = N;
+	r->cycles = min;
+	r->max_err = (float)e;
+	r->bound = (float)bound;
+	r->checksum = h;
+	r->ok = (e <= bound);
+}
+
+template <uint32_t N>
+static void bench_size(void)
+{
+	make_input(N);
+	dft(N);
+	bench<N>("float", buf_f32, BOUND_F32);
+	bench<N>("Q31", buf_q31, BOUND_Q31);
+	bench<N>("Q15", buf_q15, BOUND_Q15);
+}
+
+static void run(void)
+{
+	bench_size<64>();
+	bench_size<128>();
+	bench_size<256>();
+	bench_size<512>();
+	bench_size<1024>();
+	// input and reference of 1024 are still there
+	bench<1024>("float, CCM", ccm_f32, BOUND_F32);
+	bench<1024>("Q15, CCM", ccm_q15, BOUND_Q15);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+#ifdef HOST_BUILD
+int main(void)
+{
+	uint32_t i, fail = 0;
+
+	cyccnt_init();
+	run();
+
+	printf("%-12s %5s %12s  %-9s  %-10s\n", "fft", "N", CYCCNT_UNIT, "max error", "checksum");
+	for (i = 0; i < nresults; i++) {
+		printf("%-12s %5u %12u  %9.3g  ", results[i].name, results[i].n,
+		       results[i].cycles, (double)results[i].max_err);
+		if (results[i].checksum)
+			printf("0x%08x  ", results[i].checksum);
+		else
+			printf("%-10s  ", "-");
+		printf("%s\n", results[i].ok ? "ok" : "EXCEEDED");
+		fail |= !results[i].ok;
+	}
+	printf("(%s per transform, best of %u runs, error against DFT / N)\n",
+	       CYCCNT_UNIT, BENCH_REPEAT);
+	return fail ? 1 : 0;
+}
+#else
+int main(void)
+{
+	uint32_t i, ok = 1;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	// PD12 and PD14 as outputs
+	GPIOD->MODER &= 0xCCFFFFFF;
+	GPIOD->MODER |= 0x11000000;
+	GPIOD->ODR = 0;
+
+	cyccnt_init();
+	run();
+
+	for (i = 0; i < nresults; i++)
+		ok &= results[i].ok;
+
+	// green when within the error bounds, red otherwise
+	GPIOD->ODR = ok ? (1 << 12) : (1 << 14);
+
+	while(1);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,365 @@
+/*
+ * filter_bench.c
+ *
+ * description:
+ *   cycles per sample and exactness of the Q15 accelerometer filters
+ *   (projects/spi/q15_filter.c). a synthetic 3-axis stream of 256
+ *   samples is split into axis blocks the same way the spi example
+ *   does with its ring, every filter runs block by block and its
+ *   output is compared with a plain per-sample C reference.
+ *
+ *   the same file builds for the board and for the host:
+ *     make          - target, DSP instructions, DWT cycle counter
+ *     make HOST=1   - host, portable arithmetic, TSC
+ *     make run HOST=1
+ *
+ *   on target the results are left in results[] for the debugger,
+ *   green LED (PD12) when every filter matched its reference,
+ *   red LED (PD14) otherwise. the checksums are the same on both
+ *   builds when the two implementations are bit exact.
+ */
+
+#include <stdint.h>
+#include "q15_filter.h"
+#include "cyccnt.h"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#else
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#endif
+
+/*************************************************
+* definitions
+*************************************************/
+#define BENCH_SAMPLES 256
+#define FIR_M         4
+
+#ifdef HOST_BUILD
+#define BENCH_REPEAT  2000
+#else
+#define BENCH_REPEAT  4
+#endif
+
+typedef struct {
+	const char *name;
+	uint32_t cycles_x100;  // per sample and axis, times 100
+	uint32_t checksum;     // FNV-1a over all outputs
+	uint32_t exact;        // 1 if equal to the reference
+} bench_result_t;
+
+#ifndef HOST_BUILD
+int main(void);
+#endif
+
+/*************************************************
+* variables
+*************************************************/
+static sample_t input[BENCH_SAMPLES];
+static q15_t axis[3][BENCH_SAMPLES];
+static q15_t out[3][BENCH_SAMPLES];
+static q15_t ref[BENCH_SAMPLES];
+
+static const q15_t biquad_coef[5] = Q15_BIQUAD_LP_5HZ_400HZ;
+
+// 16 tap low pass, fc = 40 Hz at 400 Hz, Hamming window, sums to 1.0
+static const q15_t fir_taps[16] = {
+	-114, -159, -139, 291, 1450, 3284, 5246, 6525,
+	6525, 5246, 3284, 1450, 291, -139, -159, -114
+};
+
+volatile bench_result_t results[4];
+
+/*************************************************
+* input and checks
+*************************************************/
+// tilt ramp on x, steps on y, 1 g on z, all with some noise
+static void make_input(void)
+{
+	uint32_t lcg = 12345;
+	int32_t i;
+
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		int32_t noise;
+		lcg = lcg * 1664525u + 1013904223u;
+		noise = (int32_t)(lcg >> 29) - 4;
+
+		input[i].t = (uint32_t)i * 420000u;  // 400 Hz at 168 MHz
+		input[i].x = (int8_t)(((i % 128) - 64) + noise);
+		input[i].y = (int8_t)(((i / 32) & 1) ? 40 + noise : -40 + noise);
+		input[i].z = (int8_t)(56 + noise);
+		input[i].status = 0x0F;
+	}
+}
+
+static uint32_t fnv1a(uint32_t h, const q15_t *p, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		h = (h ^ (uint16_t)p[i]) * 16777619u;
+	}
+	return h;
+}
+
+static int same(const q15_t *a, const q15_t *b, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		if (a[i] != b[i])
+			return 0;
+	}
+	return 1;
+}
+
+static q15_t sat16(int64_t v)
+{
+	if (v > 32767)
+		return 32767;
+	if (v < -32768)
+		return -32768;
+	return (q15_t)v;
+}
+
+/*************************************************
+* references, one sample at a time
+*************************************************/
+static void ma_ref(const q15_t *in, q15_t *o, uint32_t n, uint8_t shift)
+{
+	int32_t len = 1 << shift;
+	int32_t i, k;
+
+	for (i = 0; i < (int32_t)n; i++) {
+		int32_t sum = 0;
+		for (k = 0; k < len; k++) {
+			if (i - k >= 0)
+				sum += in[i - k];
+		}
+		o[i] = (q15_t)((sum + (len >> 1)) >> shift);
+	}
+}
+
+static void biquad_ref(const q15_t *in, q15_t *o, uint32_t n, const q15_t *c)
+{
+	int64_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		int64_t acc = 8192 + c[0] * (int64_t)in[i] + c[1] * x1 + c[2] * x2 +
+		              c[3] * y1 + c[4] * y2;
+		q15_t y = sat16(acc >> 14);
+		x2 = x1;
+		x1 = in[i];
+		y2 = y1;
+		y1 = y;
+		o[i] = y;
+	}
+}
+
+static uint32_t fir_dec_ref(const q15_t *in, q15_t *o, uint32_t n,
+                            const q15_t *taps, int32_t ntaps, uint32_t m)
+{
+	uint32_t produced = 0;
+	int32_t i, k;
+
+	for (i = 0; i < (int32_t)n; i++) {
+		int64_t acc = 16384;
+		if ((uint32_t)(i + 1) % m)
+			continue;
+		// taps[0] goes with the oldest sample of the window
+		for (k = 0; k < ntaps; k++) {
+			int32_t j = i - (ntaps - 1) + k;
+			if (j >= 0)
+				acc += (int64_t)taps[k] * in[j];
+		}
+		o[produced++] = sat16(acc >> 15);
+	}
+	return produced;
+}
+
+/*************************************************
+* benchmarks
+*************************************************/
+// split the stream into axis blocks like the ring consumer does
+static uint32_t bench_split(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t b;
+
+	for (b = 0; b < BENCH_SAMPLES; b += Q15_BLOCK)
+		q15_from_samples(&input[b], Q15_BLOCK, &axis[0][b], &axis[1][b], &axis[2][b]);
+
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_ma(void)
+{
+	q15_ma_t f[3];
+	uint32_t t0, a, b;
+
+	for (a = 0; a < 3; a++)
+		q15_ma_init(&f[a], 4);
+
+	t0 = cyccnt_read();
+	for (b = 0; b < BENCH_SAMPLES; b += Q15_BLOCK) {
+		for (a = 0; a < 3; a++)
+			q15_ma_block(&f[a], &axis[a][b], &out[a][b], Q15_BLOCK);
+	}
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_biquad(void)
+{
+	q15_biquad_t f[3];
+	uint32_t t0, a, b;
+
+	for (a = 0; a < 3; a++)
+		q15_biquad_init(&f[a], biquad_coef);
+
+	t0 = cyccnt_read();
+	for (b = 0; b < BENCH_SAMPLES; b += Q15_BLOCK) {
+		for (a = 0; a < 3; a++)
+			q15_biquad_block(&f[a], &axis[a][b], &out[a][b], Q15_BLOCK);
+	}
+	return cyccnt_read() - t0;
+}
+
+static uint32_t fir_produced[3];
+
+static uint32_t bench_fir(void)
+{
+	static q15_fir_dec_t f[3];
+	uint32_t t0, a, b;
+
+	for (a = 0; a < 3; a++) {
+		q15_fir_dec_init(&f[a], fir_taps, 16, FIR_M);
+		fir_produced[a] = 0;
+	}
+
+	t0 = cyccnt_read();
+	for (b = 0; b < BENCH_SAMPLES; b += Q15_BLOCK) {
+		for (a = 0; a < 3; a++)
+			fir_produced[a] += q15_fir_dec_block(&f[a], &axis[a][b],
+			                                     &out[a][fir_produced[a]], Q15_BLOCK);
+	}
+	return cyccnt_read() - t0;
+}
+
+// best of BENCH_REPEAT runs, per sample and axis, times 100
+static uint32_t best(uint32_t (*fn)(void), uint32_t axes)
+{
+	uint32_t min = 0xFFFFFFFF;
+	uint32_t r;
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		uint32_t c = fn();
+		if (c < min)
+			min = c;
+	}
+	return (uint32_t)(((uint64_t)min * 100) / (BENCH_SAMPLES * axes));
+}
+
+static void run(void)
+{
+	uint32_t a, h, exact, n;
+
+	make_input();
+
+	results[0].name = "split";
+	results[0].cycles_x100 = best(bench_split, 1);
+	h = 2166136261u;
+	for (a = 0; a < 3; a++)
+		h = fnv1a(h, axis[a], BENCH_SAMPLES);
+	results[0].checksum = h;
+	results[0].exact = 1;
+
+	results[1].name = "moving average 16";
+	results[1].cycles_x100 = best(bench_ma, 3);
+	h = 2166136261u;
+	exact = 1;
+	for (a = 0; a < 3; a++) {
+		ma_ref(axis[a], ref, BENCH_SAMPLES, 4);
+		exact &= (uint32_t)same(out[a], ref, BENCH_SAMPLES);
+		h = fnv1a(h, out[a], BENCH_SAMPLES);
+	}
+	results[1].checksum = h;
+	results[1].exact = exact;
+
+	results[2].name = "biquad low pass";
+	results[2].cycles_x100 = best(bench_biquad, 3);
+	h = 2166136261u;
+	exact = 1;
+	for (a = 0; a < 3; a++) {
+		biquad_ref(axis[a], ref, BENCH_SAMPLES, biquad_coef);
+		exact &= (uint32_t)same(out[a], ref, BENCH_SAMPLES);
+		h = fnv1a(h, out[a], BENCH_SAMPLES);
+	}
+	results[2].checksum = h;
+	results[2].exact = exact;
+
+	results[3].name = "FIR 16 taps, decimate 4";
+	results[3].cycles_x100 = best(bench_fir, 3);
+	h = 2166136261u;
+	exact = 1;
+	for (a = 0; a < 3; a++) {
+		n = fir_dec_ref(axis[a], ref, BENCH_SAMPLES, fir_taps, 16, FIR_M);
+		exact &= (uint32_t)(n == fir_produced[a] && same(out[a], ref, n));
+		h = fnv1a(h, out[a], fir_produced[a]);
+	}
+	results[3].checksum = h;
+	results[3].exact = exact;
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+#ifdef HOST_BUILD
+int main(void)
+{
+	uint32_t i, fail = 0;
+
+	cyccnt_init();
+	run();
+
+	printf("%-26s %10s  %-10s  %s\n", "filter", CYCCNT_UNIT, "checksum", "reference");
+	for (i = 0; i < 4; i++) {
+		printf("%-26s %7u.%02u  0x%08x  %s\n", results[i].name,
+		       results[i].cycles_x100 / 100, results[i].cycles_x100 % 100,
+		       results[i].checksum, results[i].exact ? "exact" : "MISMATCH");
+		fail |= !results[i].exact;
+	}
+	printf("(%s per sample and axis, best of %u runs)\n", CYCCNT_UNIT, BENCH_REPEAT);
+	return fail ? 1 : 0;
+}
+#else
+int main(void)
+{
+	uint32_t i, ok = 1;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	// PD12 and PD14 as outputs
+	GPIOD->MODER &= 0xCCFFFFFF;
+	GPIOD->MODER |= 0x11000000;
+	GPIOD->ODR = 0;
+
+	cyccnt_init();
+	run();
+
+	for (i = 0; i < 4; i++)
+		ok &= results[i].exact;
+
+	// green when bit exact, red otherwise
+	GPIOD->ODR = ok ? (1 << 12) : (1 << 14);
+
+	while(1);
+
+	return 0;
+}
+#endif
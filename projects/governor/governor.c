@@ -0,0 +1,309 @@
+/*
+ * governor.c
+ *
+ * description:
+ *   the frequency governor of include/dvfs.c under a changing load.
+ *
+ *   a job with a fixed amount of work comes every 10 ms. it is light
+ *   at first, the user button (PA0) switches it between light and 10
+ *   times heavier. the main loop is include/idle.c, the core sleeps
+ *   in WFI between jobs. every 100 ms dvfs_govern looks at the time
+ *   asleep and picks the level:
+ *     light   about a quarter of the time busy at 16 MHz, DVFS_LOW
+ *     heavy   more than 16 MHz can do, DVFS_HIGH, then DVFS_MID when
+ *             half the speed is enough
+ *   the button interrupt calls dvfs_boost(), the heavy job starts at
+ *   full speed without waiting for the next window.
+ *
+ *   hooks re-time on every switch:
+ *     SysTick   LOAD for 1 ms from the new HCLK. the period that is
+ *               running ends with the old count, one tick off at most
+ *     TIM5      1 MHz free running counter, the clock of the idle
+ *               statistics, PSC for the new timer clock
+ *     USART2    BRR for 115200 baud from the new PCLK1. a character
+ *               on the line during a boost from the button comes out
+ *               garbled
+ *     LEDs      green DVFS_HIGH, orange DVFS_MID, blue DVFS_LOW
+ *
+ *   every second a line on USART2: level, HCLK, PCLK1 and PCLK2 read
+ *   back from RCC, busy percent of the last window, switches, boosts
+ *   and the worst switch time in core cycles, hooks included. the red
+ *   LED is on while the job is heavy.
+ *
+ * setup:
+ *    uses 4 on-board LEDs and the user button
+ *    USART2 TX on PA2 (AF7), 115200 8N1
+ *    clock at 168 Mhz, then 16, 84 or 168 Mhz as the governor picks
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "cyccnt.h"
+#include "dvfs.h"
+#include "idle.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define LED_GREEN     12
+#define LED_ORANGE    13
+#define LED_RED       14
+#define LED_BLUE      15
+
+#define BAUD          115200
+
+// governor thresholds, busy percent over 100 ms
+#define UP            80
+#define DOWN          30
+
+// job work, loop iterations every 10 ms
+#define LIGHT         10000
+#define HEAVY         100000
+
+/*************************************************
+* function declarations
+*************************************************/
+void SysTick_Handler(void);
+void EXTI0_IRQHandler(void);
+int main(void);
+
+/*************************************************
+* variables
+*************************************************/
+static volatile uint32_t ms;
+static volatile uint32_t job_due, window_due, report_due;
+static volatile uint32_t work = LIGHT;
+volatile uint32_t sink;
+
+void SysTick_Handler(void)
+{
+	ms++;
+	if (ms % 10 == 0)
+		job_due++;
+	if (ms % 100 == 0)
+		window_due = 1;
+	if (ms % 1000 == 0)
+		report_due = 1;
+}
+
+/*************************************************
+* button interrupt handler
+*************************************************/
+void EXTI0_IRQHandler(void)
+{
+	// clear pending bit 0 on PR, writing 1 clears it
+	EXTI->PR = (1 << 0);
+
+	work = (work == LIGHT) ? HEAVY : LIGHT;
+	if (work == HEAVY) {
+		GPIOD->BSRR = (1U << LED_RED);
+		dvfs_boost();
+	} else {
+		GPIOD->BSRR = (1U << (LED_RED + 16));
+	}
+}
+
+/*************************************************
+* usart
+*************************************************/
+static void uart_putc(char c)
+{
+	// wait for TXE, bit 7 on SR
+	while (!(USART2->SR & (1 << 7)));
+	USART2->DR = (uint8_t)c;
+}
+
+static void uart_puts(const char *s)
+{
+	while (*s)
+		uart_putc(*s++);
+}
+
+static void uart_putu(uint32_t v)
+{
+	char buf[11];
+	int n = 0;
+
+	do {
+		buf[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	while (n)
+		uart_putc(buf[--n]);
+}
+
+// percent times 100 as 12.34
+static void uart_putx100(uint32_t v)
+{
+	uart_putu(v / 100);
+	uart_putc('.');
+	uart_putc((char)('0' + (v / 10) % 10));
+	uart_putc((char)('0' + v % 10));
+}
+
+/*************************************************
+* re-timing hooks
+*************************************************/
+static void systick_retime(const dvfs_clocks_t *now, const dvfs_clocks_t *before)
+{
+	(void)before;
+	SysTick->LOAD = now->hclk / 1000 - 1;
+}
+
+static void tim5_retime(const dvfs_clocks_t *now, const dvfs_clocks_t *before)
+{
+	(void)before;
+	dvfs_tim_retime(TIM5, now->timclk1, 1000000);
+}
+
+static void uart_retime(const dvfs_clocks_t *now, const dvfs_clocks_t *before)
+{
+	(void)before;
+	USART2->BRR = dvfs_uart_brr(now->pclk1, BAUD);
+}
+
+static void led_retime(const dvfs_clocks_t *now, const dvfs_clocks_t *before)
+{
+	static const uint8_t led[DVFS_NLEVELS] = { LED_BLUE, LED_ORANGE, LED_GREEN };
+
+	(void)now;
+	(void)before;
+	GPIOD->ODR = (GPIOD->ODR & ~((1U << LED_GREEN) | (1U << LED_ORANGE) | (1U << LED_BLUE))) |
+	             (1U << led[dvfs_level()]);
+}
+
+/*************************************************
+* main loop work
+*************************************************/
+static uint32_t tim5_now(void)
+{
+	return TIM5->CNT;
+}
+
+// a fixed amount of work, it takes longer at a lower clock
+static uint32_t job_poll(void)
+{
+	uint32_t i, x = sink;
+
+	if (!job_due)
+		return 0;
+	__disable_irq();
+	job_due--;
+	__enable_irq();
+
+	for (i = 0; i < work; i++)
+		x = x * 1664525 + 1013904223;
+	sink = x;
+	return 1;
+}
+
+static int job_pending(void)
+{
+	return job_due != 0;
+}
+
+static void report(void)
+{
+	uart_puts("level ");
+	uart_putu(dvfs_level());
+	uart_puts(" hclk ");
+	uart_putu(get_hclk());
+	uart_puts(" pclk1 ");
+	uart_putu(get_pclk1());
+	uart_puts(" pclk2 ");
+	uart_putu(get_pclk2());
+	uart_puts(" busy ");
+	uart_putx100(dvfs_stats.busy_x100);
+	uart_puts("% switches ");
+	uart_putu(dvfs_stats.switches);
+	uart_puts(" boosts ");
+	uart_putu(dvfs_stats.boosts);
+	uart_puts(" worst ");
+	uart_putu(dvfs_stats.switch_max);
+	uart_puts(" cycles\r\n");
+}
+
+static uint32_t window_poll(void)
+{
+	uint32_t n = 0;
+
+	if (window_due) {
+		window_due = 0;
+		dvfs_govern();
+		n++;
+	}
+	if (report_due) {
+		report_due = 0;
+		report();
+		n++;
+	}
+	return n;
+}
+
+static int window_pending(void)
+{
+	return window_due || report_due;
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+	cyccnt_init();
+	dvfs_init(UP, DOWN);
+
+	// enable GPIOA and GPIOD clocks, bits 0 and 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 0) | (1 << 3);
+	// PD12-15 as output
+	GPIOD->MODER &= 0x00FFFFFF;
+	GPIOD->MODER |= 0x55000000;
+	GPIOD->ODR = (1 << LED_GREEN);
+
+	// PA0 input, the board has a pull-down on it. rising edge
+	//   interrupt on EXTI0 - SYSCFG clock bit 14 on APB2ENR
+	GPIOA->MODER &= ~(0x3U << 0);
+	RCC->APB2ENR |= (1 << 14);
+	SYSCFG->EXTICR[0] &= ~(0xFU << 0);
+	EXTI->IMR |= (1 << 0);
+	EXTI->RTSR |= (1 << 0);
+	NVIC_EnableIRQ(EXTI0_IRQn);
+
+	// USART2 TX on PA2, alternate function mode (0b10), AF7 - clock
+	//   bit 17 on APB1ENR
+	RCC->APB1ENR |= (1 << 17);
+	GPIOA->MODER &= ~(0x3U << 4);
+	GPIOA->MODER |= (0x2 << 4);
+	GPIOA->AFR[0] |= (0x7 << 8);
+	USART2->BRR = dvfs_uart_brr(get_pclk1(), BAUD);
+	// usart enable UE bit 13, tx enable TE bit 3
+	USART2->CR1 = (1 << 13) | (1 << 3);
+
+	// TIM5 free running at 1 MHz - clock bit 3 on APB1ENR
+	RCC->APB1ENR |= (1 << 3);
+	TIM5->ARR = 0xFFFFFFFF;
+	dvfs_tim_retime(TIM5, dvfs_clocks()->timclk1, 1000000);
+	TIM5->CR1 |= (1 << 0);
+
+	// 1 ms from the core clock - CLKSOURCE bit 2, TICKINT bit 1, ENABLE bit 0
+	SysTick->LOAD = get_hclk() / 1000 - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = (1 << 2) | (1 << 1) | (1 << 0);
+
+	dvfs_add_hook(systick_retime);
+	dvfs_add_hook(tim5_retime);
+	dvfs_add_hook(uart_retime);
+	dvfs_add_hook(led_retime);
+
+	idle_init(tim5_now, IDLE_WFI);
+	idle_add_poll(job_poll, job_pending);
+	idle_add_poll(window_poll, window_pending);
+
+	while(1)
+		idle_once();
+
+	return 0;
+}
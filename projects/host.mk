@@ -0,0 +1,71 @@
+# host build rules
+#   counterpart of armf4.mk for code that runs on the development
+#   machine (simulators, reference implementations, benchmarks).
+#   HOST_BUILD is defined so shared sources can pick portable paths.
+
+#OBJS = $(SRCS:.c=.o)
+#CPP_OBJS = $(CPP_SRCS:.cpp=.o)
+
+OBJS = $(addprefix ,$(notdir $(SRCS:.c=.o)))
+CPP_OBJS = $(addprefix ,$(notdir $(CPP_SRCS:.cpp=.o)))
+
+vpath %.c $(sort $(dir $(SRCS)))
+vpath %.cpp $(sort $(dir $(CPP_SRCS)))
+
+INCLUDES += -I.
+INCLUDES += -I../../include
+
+CFLAGS += $(CDEFS)
+CFLAGS += -DHOST_BUILD
+
+CFLAGS += -O2 # same level as the speed profile on target
+CFLAGS += -g
+
+CFLAGS += -fno-common
+CFLAGS += -Wall # turn on warnings
+CFLAGS += -Wsign-compare
+CFLAGS += -ffunction-sections -fdata-sections
+
+# C++ size optimizations, kept the same as on target
+CPPFLAGS += -fno-rtti -fno-exceptions
+
+LDFLAGS += -Wl,--gc-sections
+LDFLAGS += $(LIBS)
+
+CC = gcc
+CPP = g++
+
+# link with g++ only when there is C++ code
+ifeq ($(strip $(CPP_OBJS)),)
+LD = $(CC)
+else
+LD = $(CPP)
+endif
+
+all: clean build
+	@echo "Successfully finished..."
+
+build: $(TARGET)
+
+$(TARGET): $(OBJS) $(CPP_OBJS)
+	@echo "Linking" $@
+	@$(LD) $(OBJS) $(CPP_OBJS) $(LDFLAGS) -o $@
+
+%.o: %.c
+	@echo "Building" $@
+	@$(CC) $(CFLAGS) $(INCLUDES) -c $< -o $@
+
+%.o: %.cpp
+	@echo "Building" $@
+	@$(CPP) $(CFLAGS) $(CPPFLAGS) $(INCLUDES) -c $< -o $@
+
+run: build
+	@./$(TARGET) $(RUN_ARGS)
+
+clean:
+	@echo "Cleaning..."
+	@rm -f $(TARGET)
+	@rm -f *.o
+	@rm -f *.d
+
+.PHONY: all build run clean
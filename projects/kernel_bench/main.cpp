@@ -0,0 +1,202 @@
+/*
+ * main.cpp
+ *
+ * description:
+ *   context switch latency of the preemptive kernel in
+ *   bare_metal_cpp/kernel, in core cycles at 168 MHz.
+ *
+ *   two tasks: hi (prio 3) measures, lo (prio 2) is the task that gets
+ *   preempted. hi blocks, lo runs and wakes it, the time from the wake
+ *   up to hi running again is one sample:
+ *     flags          lo reads the cycle counter and calls flags_set,
+ *                    hi returns from flags_wait
+ *     flags, FPU     the same, both tasks use the FPU between samples:
+ *                    switching out saves s16-s31 and the lazily
+ *                    stacked s0-s15, switching in restores them
+ *     queue          lo puts its cycle count into a queue, hi returns
+ *                    from queue_get with it
+ *     tick timeout   hi sleeps for a tick, lo spins. the time since the
+ *                    SysTick reload (LOAD - VAL) when hi runs again:
+ *                    exception entry, the timeout scan and the switch
+ *     isr flags_set  the tick hook sets a flag hi waits for, same clock
+ *                    as above, one interrupt that wakes a task
+ *   the cost of reading the cycle counter is taken off.
+ *
+ *   results[] holds min, average and max of each for the debugger,
+ *   stack_free[] the untouched stack of both tasks afterwards.
+ *   orange LED (PD13) while it runs, then green (PD12) if every
+ *   worst case is below LIMIT cycles, red (PD14) if not.
+ *
+ * setup:
+ *   uses the C++ startup code and the kernel of projects/bare_metal_cpp
+ */
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "cyccnt.h"
+#include "kernel/kernel.hpp"
+
+/*************************************************
+* definitions
+*************************************************/
+#define RUNS          1000
+#define LIMIT         2000
+
+enum bench_test : uint32_t {
+    T_FLAGS, T_FLAGS_FPU, T_QUEUE, T_TICK, T_ISR, NTESTS
+};
+
+struct bench_result_t {
+    const char *name;
+    uint32_t runs;
+    uint32_t min;
+    uint32_t avg;
+    uint32_t max;
+};
+
+/*************************************************
+* variables
+*************************************************/
+volatile bench_result_t results[NTESTS];
+volatile uint32_t stack_free[2];
+
+static const char *const names[NTESTS] = {
+    "flags", "flags, FPU", "queue", "tick timeout", "isr flags_set"
+};
+
+static kernel::task t_hi, t_lo;
+alignas(8) static uint32_t s_hi[256];
+alignas(8) static uint32_t s_lo[256];
+
+static kernel::flags go;
+static kernel::flags from_isr;
+static kernel::queue q;
+static uint32_t q_buf[4];
+
+static volatile uint32_t test;
+static volatile uint32_t t0;
+static volatile uint32_t hook_armed;
+static volatile float fsink = 1.0f;
+static uint32_t overhead;
+
+/*************************************************
+* tasks
+*************************************************/
+static void tick_hook() {
+    if (hook_armed) {
+        kernel::flags_set(from_isr, 1);
+    }
+}
+
+// cycles since the last SysTick reload, the tick interrupt came then
+static uint32_t since_tick() {
+    return SysTick->LOAD - SysTick->VAL;
+}
+
+static void lo(void *) {
+    while (true) {
+        uint32_t t = test;
+        if (t == T_FLAGS_FPU) {
+            // an FPU context to save
+            fsink = fsink * 1.0001f;
+        }
+        if (t == T_FLAGS || t == T_FLAGS_FPU) {
+            t0 = cyccnt_read();
+            kernel::flags_set(go, 1);
+        } else if (t == T_QUEUE) {
+            uint32_t now = cyccnt_read();
+            kernel::queue_put(q, &now, kernel::forever);
+        } else if (t >= NTESTS) {
+            kernel::sleep(kernel::forever);
+        }
+        // tick tests: just be the running task
+    }
+}
+
+static void hi(void *) {
+    for (uint32_t t = 0; t < NTESTS; t++) {
+        uint32_t min = 0xFFFFFFFF, max = 0, dt = 0;
+        uint64_t sum = 0;
+
+        test = t;
+        hook_armed = (t == T_ISR);
+        for (uint32_t i = 0; i < RUNS; i++) {
+            switch (t) {
+            case T_FLAGS:
+            case T_FLAGS_FPU:
+                if (t == T_FLAGS_FPU) {
+                    fsink = fsink * 0.9999f;
+                }
+                kernel::flags_wait(go, 1, kernel::flags_any | kernel::flags_consume,
+                                   kernel::forever);
+                dt = cyccnt_read() - t0 - overhead;
+                break;
+            case T_QUEUE: {
+                uint32_t sent;
+                kernel::queue_get(q, &sent, kernel::forever);
+                dt = cyccnt_read() - sent - overhead;
+                break;
+            }
+            case T_TICK:
+                kernel::sleep(1);
+                dt = since_tick();
+                break;
+            case T_ISR:
+                kernel::flags_wait(from_isr, 1, kernel::flags_any | kernel::flags_consume,
+                                   kernel::forever);
+                dt = since_tick();
+                break;
+            }
+            if (dt < min) min = dt;
+            if (dt > max) max = dt;
+            sum += dt;
+        }
+
+        results[t].name = names[t];
+        results[t].runs = RUNS;
+        results[t].min = min;
+        results[t].avg = static_cast<uint32_t>(sum / RUNS);
+        results[t].max = max;
+    }
+    hook_armed = 0;
+    test = NTESTS;
+
+    stack_free[0] = kernel::stack_unused(t_hi);
+    stack_free[1] = kernel::stack_unused(t_lo);
+
+    bool ok = true;
+    for (uint32_t t = 0; t < NTESTS; t++) {
+        ok &= results[t].max < LIMIT;
+    }
+    GPIOD->ODR = ok ? (1 << 12) : (1 << 14);
+
+    kernel::sleep(kernel::forever);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+// application, called from RESET_handler
+void main_app() {
+    set_sysclk_to_168();
+    cyccnt_init();
+
+    // enable GPIOD clock, bit 3 on AHB1ENR
+    RCC->AHB1ENR |= (1 << 3);
+    // PD12-14 as output
+    GPIOD->MODER &= 0xC0FFFFFF;
+    GPIOD->MODER |= 0x15000000;
+    GPIOD->ODR = (1 << 13);
+
+    // two reads back to back, taken off every sample
+    uint32_t a = cyccnt_read();
+    overhead = cyccnt_read() - a;
+
+    kernel::queue_init(q, q_buf, sizeof(uint32_t), 4);
+    kernel::tick_hook = tick_hook;
+    kernel::create(t_hi, hi, nullptr, 3, s_hi, 256, "hi");
+    kernel::create(t_lo, lo, nullptr, 2, s_lo, 256, "lo");
+
+    kernel::start(168000000);
+}
@@ -5,7 +5,9 @@
  * description:
  *    implements a simple sine function to test math library operation
  *    processor clock is set to max (168 Mhz)
- *    math library needs to be linked. added to makefile
+ *    the sine comes from the single precision polynomial kernel in
+ *    include/fast_trig.c on the FPU, double precision sin() from libm
+ *    is soft-float on the M4 and takes thousands of cycles
  *
  * setup:
  *    uses 4 on-board LEDs
@@ -13,7 +15,7 @@
 
 #include "stm32f4xx.h"
 #include "system_stm32f4xx.h"
-#include <math.h>
+#include "fast_trig.h"
 
 /*************************************************
 * function declarations
@@ -110,7 +112,7 @@ int main(void)
 	set_sysclk_to_168();
 
 	uint32_t i;
-	double x;
+	float x;
 	// configure SysTick to interrupt every 21k ticks
 	// enable callback
 	init_systick(21000, 1);
@@ -125,7 +127,7 @@ int main(void)
 	{
 		for (i=0; i<1000; i++)
 		{
-			x = 4 * ( sin(2 * M_PI * (float)i / 1000) + 1);
+			x = 4 * ( trig_sin_poly(TRIG_2PI * (float)i / 1000) + 1);
 
 			if (x > 4)      GPIOD->ODR = (0xF << 12);
 			else if (x > 3) GPIOD->ODR = (0x7 << 12);
@@ -0,0 +1,285 @@
+/*
+ * noinit.c
+ *
+ * description:
+ *   RAM the startup code leaves alone, NOINIT and LAZY_BSS from
+ *   system_stm32f4xx.h.
+ *
+ *   a 64K sample buffer in .lazy_bss. in .bss the startup code would
+ *   zero it before main, here DMA zeroes it while main sets up the
+ *   clock and the peripherals. lazy_zero_wait() comes right before
+ *   the first use.
+ *
+ *   a crash log in .noinit that survives a warm reset. the user
+ *   button (PA0) runs an undefined instruction, its handler is
+ *   attached at run time (vectors_set, include/vectors.h). the hard
+ *   fault handler writes the stacked PC and LR and the fault status
+ *   registers into the log and resets the chip. after the reset the
+ *   log is still there. after power on the RAM is random, the reset
+ *   flags of RCC CSR, a magic number and a check word tell.
+ *
+ *   at every boot on USART2: the reset cause, boots since power on,
+ *   the last crash if there was one, the cycles from reset to main,
+ *   the cycles from main until the buffer was zero, and what zeroing
+ *   it in the startup code would have added.
+ *   green LED when the buffer read back as zero, red LED otherwise.
+ *
+ * setup:
+ *    uses the user button (PA0), green (PD12) and red (PD14) LEDs
+ *    USART2 TX on PA2 (AF7), 115200 8N1
+ *    clock at 168 Mhz
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define LED_GREEN     12
+#define LED_RED       14
+
+#define BAUD          115200
+
+#define NSAMPLES      16384
+#define LOG_MAGIC     0x4C4F4721
+
+typedef struct {
+	uint32_t magic;
+	uint32_t boots;              // since power on
+	uint32_t crashes;
+	uint32_t pc;                 // last crash, from the stacked frame
+	uint32_t lr;
+	uint32_t cfsr;
+	uint32_t hfsr;
+	uint32_t check;              // xor of the others, a half written log fails
+} crash_log_t;
+
+/*************************************************
+* function declarations
+*************************************************/
+void HardFault_Handler(void);
+void fault_record(uint32_t *frame);
+int main(void);
+
+/*************************************************
+* variables
+*************************************************/
+static crash_log_t crash_log NOINIT;
+static uint32_t samples[NSAMPLES] LAZY_BSS;
+
+/*************************************************
+* crash log
+*************************************************/
+static uint32_t log_check(void)
+{
+	return crash_log.magic ^ crash_log.boots ^ crash_log.crashes ^ crash_log.pc ^
+	       crash_log.lr ^ crash_log.cfsr ^ crash_log.hfsr;
+}
+
+// the reset cause from RCC CSR, a new log after power on or when the
+//   old one does not check
+static const char *log_open(void)
+{
+	uint32_t csr = RCC->CSR;
+	const char *cause;
+
+	// remove the reset flags, RMVF bit 24 on CSR
+	RCC->CSR |= (1 << 24);
+
+	// PORRSTF bit 27, BORRSTF 25, IWDGRSTF 29, WWDGRSTF 30, SFTRSTF 28,
+	//   LPWRRSTF 31, PINRSTF 26. power on sets the pin and BOR flags too
+	if (csr & (1U << 27))
+		cause = "power on";
+	else if (csr & (1U << 25))
+		cause = "brown out";
+	else if (csr & (1U << 29))
+		cause = "independent watchdog";
+	else if (csr & (1U << 30))
+		cause = "window watchdog";
+	else if (csr & (1U << 28))
+		cause = "software";
+	else if (csr & (1U << 31))
+		cause = "low power";
+	else
+		cause = "reset pin";
+
+	if ((csr & (1U << 27)) || crash_log.magic != LOG_MAGIC || crash_log.check != log_check()) {
+		crash_log.magic = LOG_MAGIC;
+		crash_log.boots = 0;
+		crash_log.crashes = 0;
+		crash_log.pc = 0;
+		crash_log.lr = 0;
+		crash_log.cfsr = 0;
+		crash_log.hfsr = 0;
+	}
+	crash_log.boots++;
+	crash_log.check = log_check();
+	return cause;
+}
+
+// r0 is the stack the exception frame went to, bit 2 of EXC_RETURN
+//   tells which one
+__attribute__ ((naked))
+void HardFault_Handler(void)
+{
+	__asm volatile (
+		"	tst	lr, #4\n"
+		"	ite	eq\n"
+		"	mrseq	r0, msp\n"
+		"	mrsne	r0, psp\n"
+		"	b	fault_record\n");
+}
+
+// stacked r0-r3, r12, lr, pc, xpsr
+void fault_record(uint32_t *frame)
+{
+	crash_log.crashes++;
+	crash_log.lr = frame[5];
+	crash_log.pc = frame[6];
+	crash_log.cfsr = SCB->CFSR;
+	crash_log.hfsr = SCB->HFSR;
+	crash_log.check = log_check();
+	// the log is in RAM, a system reset keeps it. SYSRESETREQ bit 2
+	//   on AIRCR with the key 0x05FA, PRIGROUP (bits 10:8) kept
+	__DSB();
+	SCB->AIRCR = (0x5FAUL << 16) | (SCB->AIRCR & (0x7UL << 8)) | (1UL << 2);
+	__DSB();
+	for (;;);
+}
+
+/*************************************************
+* button interrupt handler
+*************************************************/
+static void button_handler(void)
+{
+	// clear pending bit 0 on PR, writing 1 clears it
+	EXTI->PR = (1 << 0);
+	// undefined instruction, a usage fault that is not enabled
+	//   becomes a hard fault
+	__asm volatile ("udf #0");
+}
+
+/*************************************************
+* usart
+*************************************************/
+static void uart_putc(char c)
+{
+	// wait for TXE, bit 7 on SR
+	while (!(USART2->SR & (1 << 7)));
+	USART2->DR = (uint8_t)c;
+}
+
+static void uart_puts(const char *s)
+{
+	while (*s)
+		uart_putc(*s++);
+}
+
+static void uart_putu(uint32_t v)
+{
+	char buf[11];
+	int n = 0;
+
+	do {
+		buf[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	while (n)
+		uart_putc(buf[--n]);
+}
+
+static void uart_puthex(uint32_t v)
+{
+	int i;
+
+	uart_puts("0x");
+	for (i = 28; i >= 0; i -= 4)
+		uart_putc("0123456789ABCDEF"[(v >> i) & 0xF]);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	const char *cause;
+	uint32_t i, sum, lazy, eager, t0;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+	cause = log_open();
+
+	// enable GPIOA and GPIOD clocks, bits 0 and 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 0) | (1 << 3);
+	// PD12 and PD14 as output
+	GPIOD->MODER &= ~((0x3U << 24) | (0x3U << 28));
+	GPIOD->MODER |= (0x1U << 24) | (0x1U << 28);
+
+	// USART2 TX on PA2, alternate function mode (0b10), AF7 - clock
+	//   bit 17 on APB1ENR
+	RCC->APB1ENR |= (1 << 17);
+	GPIOA->MODER &= ~(0x3U << 4);
+	GPIOA->MODER |= (0x2 << 4);
+	GPIOA->AFR[0] |= (0x7 << 8);
+	USART2->BRR = (get_pclk1() + BAUD / 2) / BAUD;
+	// usart enable UE bit 13, tx enable TE bit 3
+	USART2->CR1 = (1 << 13) | (1 << 3);
+
+	// first use of the buffer. the cycle counter runs from reset,
+	//   boot_cycles is where main started
+	lazy_zero_wait();
+	lazy = DWT->CYCCNT - boot_cycles;
+	sum = 0;
+	for (i = 0; i < NSAMPLES; i++)
+		sum |= samples[i];
+	// what the startup code would have spent on it
+	t0 = DWT->CYCCNT;
+	boot_zero(samples, samples + NSAMPLES);
+	eager = DWT->CYCCNT - t0;
+
+	GPIOD->ODR = sum ? (1 << LED_RED) : (1 << LED_GREEN);
+
+	uart_puts("reset: ");
+	uart_puts(cause);
+	uart_puts(", boot ");
+	uart_putu(crash_log.boots);
+	uart_puts(" since power on\r\n");
+	if (crash_log.crashes) {
+		uart_puts("crashes: ");
+		uart_putu(crash_log.crashes);
+		uart_puts(", last at pc ");
+		uart_puthex(crash_log.pc);
+		uart_puts(" lr ");
+		uart_puthex(crash_log.lr);
+		uart_puts(" cfsr ");
+		uart_puthex(crash_log.cfsr);
+		uart_puts(" hfsr ");
+		uart_puthex(crash_log.hfsr);
+		uart_puts("\r\n");
+	}
+	uart_puts("reset to main ");
+	uart_putu(boot_cycles);
+	uart_puts(" cycles, main to a zero buffer ");
+	uart_putu(lazy);
+	uart_puts(", zeroing it at boot ");
+	uart_putu(eager);
+	uart_puts("\r\n");
+
+	// PA0 input, the board has a pull-down on it. rising edge
+	//   interrupt on EXTI0 - SYSCFG clock bit 14 on APB2ENR
+	GPIOA->MODER &= ~(0x3U << 0);
+	RCC->APB2ENR |= (1 << 14);
+	SYSCFG->EXTICR[0] &= ~(0xFU << 0);
+	EXTI->IMR |= (1 << 0);
+	EXTI->RTSR |= (1 << 0);
+	// into the vector table in SRAM, the hardware calls it from there
+	vectors_set(EXTI0_IRQn, button_handler);
+	NVIC_EnableIRQ(EXTI0_IRQn);
+
+	while(1)
+		__WFI();
+
+	return 0;
+}
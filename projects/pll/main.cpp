@@ -0,0 +1,195 @@
+/*
+ * main.cpp
+ *
+ * description:
+ *   the PLL solver of include/pll.hpp for the parts and crystals of
+ *   our boards.
+ *
+ *   the checks are static_asserts, the file does not build when one
+ *   fails:
+ *     - F401, F405, F407 and F429 reach their maximum SYSCLK from 8,
+ *       12 and 25 MHz crystals, with USB at 48 MHz where the VCO
+ *       allows it
+ *     - impossible combinations are refused with the right reason
+ *     - the PLL_ macros of system_stm32f4xx.h, which the C projects
+ *       use through set_sysclk_to_168, give the clocks and settings
+ *       the solver picks for the part and HSE_VALUE of this build
+ *
+ *   the same file builds for the board and for the host:
+ *     make          - target, the fastest clock from the solver. SysTick
+ *                     blinks the green LED (PD12) at 1 Hz whatever the
+ *                     clock is, SYSCLK / 5 is on MCO2 (PC9) to measure
+ *     make HOST=1   - host, prints the table of every part and crystal
+ *     make run HOST=1
+ *     make HSE=25000000 - a board with a 25 MHz crystal
+ */
+
+#include <stdint.h>
+#include "system_stm32f4xx.h"
+#include "pll.hpp"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#else
+#include "vectors.h"
+#endif
+
+using pll::chip;
+using pll::error;
+using pll::MHZ;
+
+/*************************************************
+* compile time checks
+*************************************************/
+// every part at its maximum from every crystal we ship
+template <chip C, uint32_t MAX, uint32_t MAX_USB>
+struct reaches {
+	static_assert(pll::fastest<C, 8 * MHZ, false>::value.sysclk == MAX, "8 MHz");
+	static_assert(pll::fastest<C, 12 * MHZ, false>::value.sysclk == MAX, "12 MHz");
+	static_assert(pll::fastest<C, 25 * MHZ, false>::value.sysclk == MAX, "25 MHz");
+	static_assert(pll::fastest<C, 8 * MHZ>::value.sysclk == MAX_USB, "8 MHz, USB");
+	static_assert(pll::fastest<C, 12 * MHZ>::value.sysclk == MAX_USB, "12 MHz, USB");
+	static_assert(pll::fastest<C, 25 * MHZ>::value.sysclk == MAX_USB, "25 MHz, USB");
+	static constexpr bool ok = true;
+};
+
+static_assert(reaches<chip::f401, 84 * MHZ, 84 * MHZ>::ok, "F401");
+static_assert(reaches<chip::f405, 168 * MHZ, 168 * MHZ>::ok, "F405");
+static_assert(reaches<chip::f407, 168 * MHZ, 168 * MHZ>::ok, "F407");
+static_assert(reaches<chip::f429, 180 * MHZ, 168 * MHZ>::ok, "F429");
+
+// the settings that go with the clock
+typedef pll::clock<chip::f407, 8 * MHZ, 168 * MHZ> f407_8;
+static_assert(f407_8::value.m == 4 && f407_8::value.n == 168 && f407_8::value.p == 2 &&
+              f407_8::value.q == 7, "F407 8 MHz dividers");
+static_assert(f407_8::value.vos == 1 && f407_8::value.latency == 5 &&
+              f407_8::value.pclk1 == 42 * MHZ && f407_8::value.pclk2 == 84 * MHZ,
+              "F407 168 MHz scale, wait states and buses");
+
+typedef pll::clock<chip::f407, 25 * MHZ, 168 * MHZ> f407_25;
+static_assert(f407_25::value.m == 25 && f407_25::value.n == 336, "F407 25 MHz dividers");
+
+typedef pll::clock<chip::f429, 8 * MHZ, 180 * MHZ, false> f429_180;
+static_assert(f429_180::value.overdrive && f429_180::value.vos == 1 &&
+              f429_180::value.pll48 <= 48 * MHZ && f429_180::value.pclk1 == 45 * MHZ,
+              "F429 180 MHz over-drive, PLL48CLK and APB1");
+static_assert(!pll::clock<chip::f429, 8 * MHZ, 168 * MHZ>::value.overdrive,
+              "F429 168 MHz without over-drive");
+
+typedef pll::clock<chip::f401, 12 * MHZ, 84 * MHZ> f401_12;
+static_assert(f401_12::value.p == 4 && f401_12::value.vos == 2 &&
+              f401_12::value.latency == 2 && f401_12::value.pclk2 == 84 * MHZ,
+              "F401 84 MHz: the VCO has to stay over 192 MHz");
+
+// what cannot be done, pll::clock<> would stop the build with these
+static_assert(pll::solve(chip::f429, 8 * MHZ, 180 * MHZ).err == error::usb,
+              "F429 180 MHz has no 48 MHz");
+static_assert(pll::solve(chip::f401, 8 * MHZ, 168 * MHZ).err == error::too_fast,
+              "F401 at 168 MHz");
+static_assert(pll::solve(chip::f407, 30 * MHZ, 168 * MHZ).err == error::hse_range,
+              "30 MHz crystal");
+static_assert(pll::solve(chip::f407, 25 * MHZ, 167500000).err == error::usb,
+              "167.5 MHz from 25 MHz has no 48 MHz");
+static_assert(pll::solve(chip::f407, 25 * MHZ, 167300000, false).err == error::sysclk,
+              "167.3 MHz from 25 MHz");
+
+// the C side agrees with the solver: same clocks, settings in range.
+//   its M is HSE / 1 or 2 MHz, the solver may take another one
+typedef pll::fastest<pll::this_chip, HSE_VALUE, (PLL_VCO % 48000000) == 0> board;
+static_assert(PLL_M >= 2 && PLL_M <= 63 && PLL_N >= 50 && PLL_N <= 432 &&
+              HSE_VALUE / PLL_M * PLL_N == PLL_VCO, "system_stm32f4xx.h dividers");
+static_assert(PLL_VCO / PLL_P == board::value.sysclk && PLL_VCO / PLL_Q == board::value.pll48,
+              "system_stm32f4xx.h clocks");
+static_assert(board::value.vos_bits == PLL_VOS && board::value.overdrive == PLL_OD &&
+              board::value.latency == PLL_LATENCY && board::value.ppre1 == PLL_PPRE1 &&
+              board::value.ppre2 == PLL_PPRE2,
+              "system_stm32f4xx.h scale, wait states and prescalers");
+
+#ifdef HOST_BUILD
+/*************************************************
+* table
+*************************************************/
+static const char *names[] = { "F401", "F405", "F407", "F429" };
+
+static void row(const pll::config &c)
+{
+	printf("%-5s %3u %3u %-3s  %2u %3u %u %2u  %5.1f  %u %-3s %u  %5.1f %5.1f\n",
+	       names[(int)c.part], c.hse / MHZ, c.sysclk / MHZ, c.pll48 == pll::usb_hz ? "yes" : "no",
+	       c.m, c.n, c.p, c.q, (double)c.pll48 / MHZ, c.vos, c.overdrive ? "yes" : "no",
+	       c.latency, (double)c.pclk1 / MHZ, (double)c.pclk2 / MHZ);
+}
+
+int main(void)
+{
+	static const chip chips[] = { chip::f401, chip::f405, chip::f407, chip::f429 };
+	static const uint32_t crystals[] = { 8 * MHZ, 12 * MHZ, 25 * MHZ };
+	uint32_t i, k;
+
+	printf("%-5s %3s %3s %-3s  %2s %3s %s %2s  %5s  %s %-3s %s  %5s %5s\n", "part", "hse",
+	       "sys", "usb", "M", "N", "P", "Q", "48clk", "V", "od", "W", "apb1", "apb2");
+	for (i = 0; i < 4; i++) {
+		for (k = 0; k < 3; k++) {
+			pll::config usb = pll::solve_max(chips[i], crystals[k], true);
+			pll::config any = pll::solve_max(chips[i], crystals[k], false);
+
+			row(usb);
+			// without USB only where it is faster
+			if (any.sysclk != usb.sysclk)
+				row(any);
+		}
+	}
+	printf("(MHz, V voltage scale, od over-drive, W flash wait states)\n");
+	printf("this build: %s, HSE %u MHz, set_sysclk_to_168 gives %u MHz\n",
+	       names[(int)pll::this_chip], HSE_VALUE / MHZ, board::value.sysclk / MHZ);
+	return 0;
+}
+#else
+/*************************************************
+* function declarations
+*************************************************/
+extern "C" void SysTick_Handler(void);
+
+void SysTick_Handler(void)
+{
+	static uint32_t ms;
+
+	if (++ms == 500) {
+		ms = 0;
+		GPIOD->ODR ^= (1 << 12);
+	}
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+// the fastest clock of the part from the crystal, USB kept at 48 MHz
+typedef pll::fastest<pll::this_chip, HSE_VALUE> sysclk;
+
+int main(void)
+{
+	pll::apply(sysclk::value);
+
+	// enable GPIOC and GPIOD clocks, bits 2 and 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 2) | (1 << 3);
+	// PD12 as output
+	GPIOD->MODER &= ~(0x3U << 24);
+	GPIOD->MODER |= (0x1U << 24);
+	// PC9 alternate function 0 (MCO2), very high speed
+	GPIOC->MODER &= ~(0x3U << 18);
+	GPIOC->MODER |= (0x2U << 18);
+	GPIOC->OSPEEDR |= (0x3U << 18);
+	GPIOC->AFR[1] &= ~(0xFU << 4);
+	// MCO2 from SYSCLK (CFGR: bits 31:30 = 0), divided by 5 (bits 29:27)
+	RCC->CFGR &= ~(0x3U << 30);
+	RCC->CFGR |= (0x7U << 27);
+
+	// 1 ms from the core clock - CLKSOURCE bit 2, TICKINT bit 1, ENABLE bit 0
+	SysTick->LOAD = sysclk::value.sysclk / 1000 - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = (1 << 2) | (1 << 1) | (1 << 0);
+
+	while(1);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,279 @@
+/*
+ * profile_bench.c
+ *
+ * description:
+ *   a fixed set of kernels to compare the build profiles of armf4.mk
+ *   (debug, speed, size) on the board:
+ *     - CRC-32, bit by bit           integer, branches
+ *     - Q15 biquad, 256 samples      DSP instructions (q15_filter.c)
+ *     - float sine x 256             calls with float arguments, the
+ *                                    soft/hard float ABI difference
+ *     - float 8x8 matrix product     FPU arithmetic
+ *     - memcpy 4 KB                  libc variant of the profile
+ *
+ *   make profiles builds all three and prints their size, flash each
+ *   profile_bench-<profile>.elf and read results[] with the debugger.
+ *   profile[] names the build that is running. the integer checksums
+ *   are the same in every profile, the float ones may differ in the
+ *   last bits when -O2 fuses multiply and add (VFMA).
+ *   green LED (PD12) when the integer checksums match the reference,
+ *   red LED (PD14) otherwise.
+ *
+ *   make run HOST=1 runs the same kernels on the development machine.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "q15_filter.h"
+#include "fast_trig.h"
+#include "cyccnt.h"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#else
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#endif
+
+/*************************************************
+* definitions
+*************************************************/
+#define NRESULTS      5
+#define CRC_BYTES     1024
+#define BIQUAD_N      256
+#define SINE_N        256
+#define MAT_N         8
+#define COPY_BYTES    4096
+
+#ifdef HOST_BUILD
+#define BENCH_REPEAT  1000
+#else
+#define BENCH_REPEAT  4
+#endif
+
+// integer results every profile has to reproduce
+#define CRC_REF       0xC35519DEu
+#define BIQUAD_REF    0xB31AA717u
+
+typedef struct {
+	const char *name;
+	uint32_t cycles;       // best of BENCH_REPEAT
+	uint32_t checksum;
+	uint32_t ok;           // 1 if checked and equal, or not checked
+} bench_result_t;
+
+#ifndef HOST_BUILD
+int main(void);
+#endif
+
+/*************************************************
+* variables
+*************************************************/
+#if !defined(__OPTIMIZE__)
+const char profile[] = "debug";
+#elif defined(__OPTIMIZE_SIZE__)
+const char profile[] = "size";
+#else
+const char profile[] = "speed";
+#endif
+
+static uint8_t bytes[COPY_BYTES];
+static uint8_t copy[COPY_BYTES];
+static q15_t q15_in[BIQUAD_N], q15_out[BIQUAD_N];
+static float angles[SINE_N];
+static volatile float sines[SINE_N];
+static float mat_a[MAT_N][MAT_N], mat_b[MAT_N][MAT_N], mat_c[MAT_N][MAT_N];
+
+static const q15_t biquad_coef[5] = Q15_BIQUAD_LP_5HZ_400HZ;
+
+volatile bench_result_t results[NRESULTS];
+
+/*************************************************
+* input
+*************************************************/
+static void make_input(void)
+{
+	uint32_t lcg = 12345;
+	uint32_t i, j;
+
+	for (i = 0; i < COPY_BYTES; i++) {
+		lcg = lcg * 1664525u + 1013904223u;
+		bytes[i] = (uint8_t)(lcg >> 24);
+	}
+	for (i = 0; i < BIQUAD_N; i++)
+		q15_in[i] = (q15_t)((int32_t)(bytes[i] << 8) - 32768);
+	for (i = 0; i < SINE_N; i++)
+		angles[i] = -TRIG_PI + TRIG_2PI * (float)i / SINE_N;
+	for (i = 0; i < MAT_N; i++) {
+		for (j = 0; j < MAT_N; j++) {
+			mat_a[i][j] = (float)bytes[i * MAT_N + j] / 256.0f;
+			mat_b[i][j] = (float)bytes[256 + i * MAT_N + j] / 256.0f;
+		}
+	}
+}
+
+static uint32_t fnv1a(uint32_t h, const void *p, uint32_t n)
+{
+	const uint8_t *b = (const uint8_t *)p;
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		h = (h ^ b[i]) * 16777619u;
+	return h;
+}
+
+/*************************************************
+* kernels
+*************************************************/
+static uint32_t crc;
+
+static uint32_t bench_crc(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t c = 0xFFFFFFFF;
+	uint32_t i, k;
+
+	for (i = 0; i < CRC_BYTES; i++) {
+		c ^= bytes[i];
+		for (k = 0; k < 8; k++)
+			c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+	}
+	crc = ~c;
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_biquad(void)
+{
+	q15_biquad_t f;
+	uint32_t t0;
+
+	q15_biquad_init(&f, biquad_coef);
+	t0 = cyccnt_read();
+	q15_biquad_block(&f, q15_in, q15_out, BIQUAD_N);
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_sine(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+
+	for (i = 0; i < SINE_N; i++)
+		sines[i] = trig_sin_poly(angles[i]);
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_matrix(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i, j, k;
+
+	for (i = 0; i < MAT_N; i++) {
+		for (j = 0; j < MAT_N; j++) {
+			float s = 0;
+			for (k = 0; k < MAT_N; k++)
+				s += mat_a[i][k] * mat_b[k][j];
+			mat_c[i][j] = s;
+		}
+	}
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_copy(void)
+{
+	uint32_t t0 = cyccnt_read();
+
+	memcpy(copy, bytes, COPY_BYTES);
+	return cyccnt_read() - t0;
+}
+
+// best of BENCH_REPEAT runs
+static void bench(uint32_t n, const char *name, uint32_t (*fn)(void))
+{
+	uint32_t min = 0xFFFFFFFF;
+	uint32_t r;
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		uint32_t c = fn();
+		if (c < min)
+			min = c;
+	}
+	results[n].name = name;
+	results[n].cycles = min;
+	results[n].ok = 1;
+}
+
+static void run(void)
+{
+	make_input();
+
+	bench(0, "crc32 1 KB", bench_crc);
+	results[0].checksum = crc;
+	results[0].ok = (crc == CRC_REF);
+
+	bench(1, "q15 biquad 256", bench_biquad);
+	results[1].checksum = fnv1a(2166136261u, q15_out, sizeof(q15_out));
+	results[1].ok = (results[1].checksum == BIQUAD_REF);
+
+	bench(2, "float sine 256", bench_sine);
+	results[2].checksum = fnv1a(2166136261u, (const void *)sines, sizeof(sines));
+
+	bench(3, "float matrix 8x8", bench_matrix);
+	results[3].checksum = fnv1a(2166136261u, mat_c, sizeof(mat_c));
+
+	bench(4, "memcpy 4 KB", bench_copy);
+	results[4].checksum = fnv1a(2166136261u, copy, sizeof(copy));
+	results[4].ok = (memcmp(copy, bytes, COPY_BYTES) == 0);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+#ifdef HOST_BUILD
+int main(void)
+{
+	uint32_t i, fail = 0;
+
+	cyccnt_init();
+	run();
+
+	printf("profile %s\n", profile);
+	printf("%-18s %10s  %-10s\n", "kernel", CYCCNT_UNIT, "checksum");
+	for (i = 0; i < NRESULTS; i++) {
+		printf("%-18s %10u  0x%08x  %s\n", results[i].name, results[i].cycles,
+		       results[i].checksum, results[i].ok ? "ok" : "MISMATCH");
+		fail |= !results[i].ok;
+	}
+	printf("(%s, best of %u runs)\n", CYCCNT_UNIT, BENCH_REPEAT);
+	return fail ? 1 : 0;
+}
+#else
+int main(void)
+{
+	uint32_t i, ok = 1;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	// PD12 and PD14 as outputs
+	GPIOD->MODER &= 0xCCFFFFFF;
+	GPIOD->MODER |= 0x11000000;
+	GPIOD->ODR = 0;
+
+	cyccnt_init();
+	run();
+
+	for (i = 0; i < NRESULTS; i++)
+		ok &= results[i].ok;
+
+	// green when the integer results match, red otherwise
+	GPIOD->ODR = ok ? (1 << 12) : (1 << 14);
+
+	while(1);
+
+	return 0;
+}
+#endif
@@ -3,24 +3,31 @@
  *
  * author: Furkan Cayci
  * description:
- *    fades one LED using pwm functionality on timer4
+ *    fades the four LEDs with pwm on timer4, the duty values of all
+ *    four channels are streamed by DMA burst on every update event
+ *    (pwm_burst.c), no per-period interrupt.
  *    the LEDs are connected to GPIOD 12-15
  *    which has timer4 capability.
- *    GPIOD 12 is connected to timer4 channel1
+ *    GPIOD 12-15 are connected to timer4 channel1-4
+ *
+ *    a sine fade goes around the LEDs in loop mode for four passes,
+ *    then a one-shot flash of all four fades out, and it starts over.
+ *    the pass callback is the only interrupt, once a second.
  *
  * setup:
- *    uses 1 on-board LED
+ *    uses 4 on-board LEDs
  */
 
 #include "stm32f4xx.h"
 #include "system_stm32f4xx.h"
+#include "pwm_burst.h"
 #include <math.h>
 
 /*************************************************
 * function declarations
 *************************************************/
 void Default_Handler(void);
-void tim4_handler(void);
+void DMA1_Stream6_IRQHandler(void);
 int main(void);
 
 /*************************************************
@@ -69,7 +76,7 @@ void (* const vector_table[])(void) = {
 	0,                                  /* 0x078 DMA1 Stream 3 global Interrupt                                    */
 	0,                                  /* 0x07C DMA1 Stream 4 global Interrupt                                    */
 	0,                                  /* 0x080 DMA1 Stream 5 global Interrupt                                    */
-	0,                                  /* 0x084 DMA1 Stream 6 global Interrupt                                    */
+	DMA1_Stream6_IRQHandler,            /* 0x084 DMA1 Stream 6 global Interrupt                                    */
 	0,                                  /* 0x088 ADC1, ADC2 and ADC3 global Interrupts                             */
 	0,                                  /* 0x08C CAN1 TX Interrupt                                                 */
 	0,                                  /* 0x090 CAN1 RX0 Interrupt                                                */
@@ -82,7 +89,7 @@ void (* const vector_table[])(void) = {
 	0,                                  /* 0x0AC TIM1 Capture Compare Interrupt                                    */
 	0,                                  /* 0x0B0 TIM2 global Interrupt                                             */
 	0,                                  /* 0x0B4 TIM3 global Interrupt                                             */
-	tim4_handler,                       /* 0x0B8 TIM4 global Interrupt                                             */
+	0,                                  /* 0x0B8 TIM4 global Interrupt                                             */
 	0,                                  /* 0x0BC I2C1 Event Interrupt                                              */
 	0,                                  /* 0x0C0 I2C1 Error Interrupt                                              */
 	0,                                  /* 0x0C4 I2C2 Event Interrupt                                              */
@@ -143,28 +150,60 @@ void Default_Handler(void)
 	for (;;);  // Wait forever
 }
 
-const uint32_t period = 5000;
+/*************************************************
+* definitions
+*************************************************/
+// timer4 at 84 MHz / 84 = 1 MHz, 1000 counts - 1 kHz pwm, 1 ms steps
+#define PWM_PSC        83
+#define PWM_ARR        999
+#define FADE_STEPS     1000
+#define FLASH_STEPS    200
+#define FADE_PASSES    4
+
+/*************************************************
+* variables
+*************************************************/
+pwm_burst_t pwm;
+
+// CCR1..CCR4 for each step
+static uint16_t fade[FADE_STEPS][4];
+static uint16_t flash[FLASH_STEPS][4];
+static volatile uint32_t passes;
 
 /*************************************************
-* timer 4 interrupt handler
+* DMA1 stream 6, TIM4 update requests
 *************************************************/
-void tim4_handler(void)
+void DMA1_Stream6_IRQHandler(void)
 {
-	double x;
-	static uint32_t t = 0;
-	const uint32_t f = 10*period;
-	// generate new value each time
-	x = f/2 * ( sin(2 * M_PI * (float)t / (float)f) + 1);
-	if (t == f)
-	{
-		t = 0;
-	} else
-	{
-		++t;
-	}
+	pwm_burst_irq(&pwm);
+}
+
+static void on_pass(void *arg)
+{
+	(void)arg;
+	passes++;
+}
 
-	// set new duty cycle
-	TIM4->CCR1 = (uint16_t)(x/10);
+// brightness 0..1 to a compare value, squared for the eye
+static uint16_t duty(float b)
+{
+	return (uint16_t)(b * b * (PWM_ARR + 1));
+}
+
+static void make_tables(void)
+{
+	uint32_t i, c;
+
+	// one sine period per pass, each LED a quarter behind the last
+	for (i = 0; i < FADE_STEPS; i++)
+		for (c = 0; c < 4; c++)
+			fade[i][c] = duty(0.5f * (1.0f + sinf(2 * (float)M_PI *
+			                  ((float)i / FADE_STEPS - 0.25f * c))));
+
+	// all on, fading out to off
+	for (i = 0; i < FLASH_STEPS; i++)
+		for (c = 0; c < 4; c++)
+			flash[i][c] = duty(1.0f - (float)i / (FLASH_STEPS - 1));
 }
 
 /*************************************************
@@ -175,52 +214,31 @@ int main(void)
 	/* set system clock to 168 Mhz */
 	set_sysclk_to_168();
 
-	uint32_t duty = period/2;
-
 	// enable GPIOD clock
 	RCC->AHB1ENR |= (1 << 3);
 	GPIOD->MODER &= 0x00FFFFFF;   // Reset bits 31-24 to clear old values
-	GPIOD->MODER |= 0x02000000;   // Set pin 12 to alternate func. mode (0b10)
-
-	// Choose Timer4 as Alternative Function for pin 12 led
-	GPIOD->AFR[1] |= (0x2 << 16);
-
-	// enable TIM4 clock (bit2)
-	RCC->APB1ENR |= (1 << 2);
-
-	// set prescaler to 167
-	//   it will increment counter every prescalar cycles
-	// fCK_PSC / (PSC[15:0] + 1)
-	// 168 Mhz / 167 + 1 = 1 Mhz timer clock speed
-	TIM4->PSC = 167;
-
-	// set period
-	TIM4->ARR = period;
-
-	// set duty cycle on channel 1
-	TIM4->CCR1 = duty;
-
-	// enable channel 1 in capture/compare register
-	// set oc1 mode as pwm (0b110 or 0x6 in bits 6-4)
-	TIM4->CCMR1 |= (0x6 << 4);
-	// enable oc1 preload bit 3
-	TIM4->CCMR1 |= (1 << 3);
-
-	// enable capture/compare ch1 output
-	TIM4->CCER |= (1 << 0);
+	GPIOD->MODER |= 0xAA000000;   // Set pins 12-15 to alternate func. mode (0b10)
 
-	// enable interrupt CC1IE (bit 1)
-	TIM4->DIER |= (1 << 1);
+	// Choose Timer4 as Alternative Function for pins 12-15
+	GPIOD->AFR[1] &= 0x0000FFFF;
+	GPIOD->AFR[1] |= 0x22220000;
 
-	// enable TIM4 IRQ from NVIC
-	NVIC_EnableIRQ(TIM4_IRQn);
+	make_tables();
 
-	// Enable Timer 4 module (CEN, bit0)
-	TIM4->CR1 |= (1 << 0);
+	// all four channels of timer4
+	pwm_burst_init(&pwm, TIM4, PWM_PSC, PWM_ARR, 4);
 
 	while(1)
 	{
-		// Do nothing. let timer handler do its magic
+		passes = 0;
+		pwm_burst_start(&pwm, &fade[0][0], FADE_STEPS, PWM_BURST_LOOP, on_pass, 0);
+		while (passes < FADE_PASSES)
+			__WFI();
+
+		// stops the loop, the flash ends with the LEDs off
+		pwm_burst_start(&pwm, &flash[0][0], FLASH_STEPS, PWM_BURST_ONESHOT, 0, 0);
+		while (pwm_burst_busy(&pwm))
+			__WFI();
 	}
 
 	return 0;
@@ -0,0 +1,279 @@
+/*
+ * pwm_burst.c
+ *
+ * description:
+ *   multi-channel PWM with DMA burst updates, see pwm_burst.h
+ *
+ * setup:
+ *   1. timer and DMA clocks on
+ *   2. timer: auto-reload preload, PWM mode 1 with output compare
+ *      preload on the channels in use, outputs enabled (and MOE on
+ *      TIM1/TIM8)
+ *   3. DCR: burst from CCR1 (DBA = 0x34 / 4 = 13), DBL = channels - 1
+ *   4. stream of the update request: memory to peripheral, half-word
+ *      to TIMx_DMAR, memory increment, circular in loop mode
+ *   5. prime: UDE on and an update by software (UG) lets the DMA write
+ *      step 0 to the preload registers, a second UG with UDE off moves
+ *      them to the active registers
+ *   6. UDE on, start the counter
+ */
+
+#include "pwm_burst.h"
+#include "dma_stream.h"
+
+/*************************************************
+* definitions
+*************************************************/
+// high priority, half-word memory and peripheral size, memory increment,
+// memory to peripheral, transfer error interrupt
+#define DMA_PWM_CR     ((0x2 << 16) | (1 << 13) | (1 << 11) | (1 << 10) | \
+                        (0x1 << 6) | (1 << 2))
+#define DMA_CR_CIRC    (1u << 8)
+#define DMA_CR_TCIE    (1u << 4)
+
+// CCR1 offset in words, start of the burst
+#define TIM_DBA_CCR1   (0x34 / 4)
+// update DMA request enable, UDE bit 8 on DIER
+#define TIM_UDE        (1u << 8)
+
+/*************************************************
+* helpers
+*************************************************/
+static void stream_off(pwm_burst_t *p)
+{
+	p->tim->DIER &= ~TIM_UDE;
+	p->stream->CR &= ~(1u << 0);
+	while (p->stream->CR & (1 << 0));
+	dma_stream_clear(p->dma, p->stream_n, DMA_STREAM_FLAGS);
+}
+
+/*************************************************
+* api
+*************************************************/
+/*
+ * timer runs at timer clock / (psc + 1) / (arr + 1), compare values
+ * go from 0 (off) to arr + 1 (always on). nch channels from channel 1
+ * on are used. returns 0 for a timer without a burst capable update
+ * request here, or a bad channel count
+ */
+int pwm_burst_init(pwm_burst_t *p, TIM_TypeDef *tim, uint16_t psc, uint16_t arr, uint8_t nch)
+{
+	uint32_t i, ccmr = 0;
+
+	if (nch < 1 || nch > 4)
+		return 0;
+
+	if (tim == TIM1) {
+		// enable TIM1 clock, bit 0 on APB2ENR
+		RCC->APB2ENR |= (1 << 0);
+		// enable DMA2 clock, bit 22 on AHB1ENR
+		RCC->AHB1ENR |= (1 << 22);
+		p->dma = DMA2;
+		p->stream = DMA2_Stream5;
+		p->stream_n = 5;
+		p->chsel = 6;
+		p->irq = DMA2_Stream5_IRQn;
+	} else if (tim == TIM8) {
+		// enable TIM8 clock, bit 1 on APB2ENR
+		RCC->APB2ENR |= (1 << 1);
+		RCC->AHB1ENR |= (1 << 22);
+		p->dma = DMA2;
+		p->stream = DMA2_Stream1;
+		p->stream_n = 1;
+		p->chsel = 7;
+		p->irq = DMA2_Stream1_IRQn;
+	} else if (tim == TIM3) {
+		// enable TIM3 clock, bit 1 on APB1ENR
+		RCC->APB1ENR |= (1 << 1);
+		// enable DMA1 clock, bit 21 on AHB1ENR
+		RCC->AHB1ENR |= (1 << 21);
+		p->dma = DMA1;
+		p->stream = DMA1_Stream2;
+		p->stream_n = 2;
+		p->chsel = 5;
+		p->irq = DMA1_Stream2_IRQn;
+	} else if (tim == TIM4) {
+		// enable TIM4 clock, bit 2 on APB1ENR
+		RCC->APB1ENR |= (1 << 2);
+		RCC->AHB1ENR |= (1 << 21);
+		p->dma = DMA1;
+		p->stream = DMA1_Stream6;
+		p->stream_n = 6;
+		p->chsel = 2;
+		p->irq = DMA1_Stream6_IRQn;
+	} else {
+		return 0;
+	}
+
+	p->tim = tim;
+	p->nch = nch;
+	p->running = 0;
+	p->seq = 0;
+	p->steps = 0;
+	p->done = 0;
+	p->passes = 0;
+	p->errors = 0;
+
+	stream_off(p);
+
+	// counter off, auto-reload preload (ARPE bit 7)
+	tim->CR1 = (1 << 7);
+	tim->PSC = psc;
+	tim->ARR = arr;
+
+	// PWM mode 1 (0b110) and output compare preload on each channel,
+	//   OCxM bits 6:4 and OCxPE bit 3, the second channel of a
+	//   register 8 bits up
+	for (i = 0; i < 2 && i < nch; i++)
+		ccmr |= ((0x6 << 4) | (1 << 3)) << (8 * i);
+	tim->CCMR1 = ccmr;
+	ccmr = 0;
+	for (i = 2; i < 4 && i < nch; i++)
+		ccmr |= ((0x6 << 4) | (1 << 3)) << (8 * (i - 2));
+	tim->CCMR2 = ccmr;
+
+	tim->CCR1 = 0;
+	tim->CCR2 = 0;
+	tim->CCR3 = 0;
+	tim->CCR4 = 0;
+
+	// CCxE, bit 0 of each 4 bit group on CCER
+	tim->CCER = 0;
+	for (i = 0; i < nch; i++)
+		tim->CCER |= (1 << (4 * i));
+
+	// advanced timers: main output enable, MOE bit 15 on BDTR
+	if (tim == TIM1 || tim == TIM8)
+		tim->BDTR |= (1 << 15);
+
+	// burst of nch transfers from CCR1 on, DBL bits 12:8, DBA bits 4:0
+	tim->DCR = ((uint32_t)(nch - 1) << 8) | TIM_DBA_CCR1;
+
+	// load PSC, ARR and the compare values, then run with all outputs low
+	tim->EGR = (1 << 0);
+	tim->SR = 0;
+	tim->CR1 |= (1 << 0);
+
+	NVIC_SetPriority(p->irq, 2);
+	NVIC_EnableIRQ(p->irq);
+
+	return 1;
+}
+
+/*
+ * compare values for all channels in use by software, they take effect
+ * on the next update. stops a playing sequence
+ */
+void pwm_burst_set(pwm_burst_t *p, const uint16_t *duty)
+{
+	volatile uint32_t *ccr = &p->tim->CCR1;
+	uint32_t i;
+
+	if (p->running)
+		pwm_burst_stop(p);
+	for (i = 0; i < p->nch; i++)
+		ccr[i] = duty[i];
+}
+
+/*
+ * play steps steps of seq, nch values each, in mode PWM_BURST_LOOP or
+ * PWM_BURST_ONESHOT. done(arg) is called from pwm_burst_irq at the end
+ * of each pass (loop) or of the sequence (one-shot), it may be 0.
+ * the counter starts over with step 0.
+ * returns 0 if the sequence is not usable
+ */
+int pwm_burst_start(pwm_burst_t *p, const uint16_t *seq, uint16_t steps,
+                    uint8_t mode, pwm_burst_done_t done, void *arg)
+{
+	DMA_Stream_TypeDef *s = p->stream;
+	TIM_TypeDef *tim = p->tim;
+	uint32_t total = (uint32_t)steps * p->nch;
+	uint32_t cr = (p->chsel << 25) | DMA_PWM_CR;
+
+	// one step is pwm_burst_set
+	if (steps < 2 || total > 0xFFFF)
+		return 0;
+
+	pwm_burst_stop(p);
+	tim->CR1 &= ~(1u << 0);
+
+	p->seq = seq;
+	p->steps = steps;
+	p->mode = mode;
+	p->done = done;
+	p->arg = arg;
+	p->passes = 0;
+
+	if (mode == PWM_BURST_LOOP)
+		cr |= DMA_CR_CIRC;
+	// one-shot always ends with the interrupt, a loop only for done
+	if (mode == PWM_BURST_ONESHOT || done)
+		cr |= DMA_CR_TCIE;
+
+	s->PAR = (uint32_t)&tim->DMAR;
+	s->M0AR = (uint32_t)seq;
+	s->NDTR = total;
+	s->CR = cr;
+	s->CR |= (1 << 0);
+
+	// step 0 into the preload registers, the burst takes a few cycles
+	tim->DIER |= TIM_UDE;
+	tim->EGR = (1 << 0);
+	while (s->NDTR > total - p->nch);
+
+	// and into the active ones, without a DMA request this time
+	tim->DIER &= ~TIM_UDE;
+	tim->EGR = (1 << 0);
+	tim->SR = 0;
+
+	// step 1 is written on the first update
+	p->running = 1;
+	tim->DIER |= TIM_UDE;
+	tim->CR1 |= (1 << 0);
+	return 1;
+}
+
+/*
+ * stop the sequence, the outputs keep running with the values of the
+ * step that played last
+ */
+void pwm_burst_stop(pwm_burst_t *p)
+{
+	stream_off(p);
+	p->running = 0;
+}
+
+int pwm_burst_busy(pwm_burst_t *p)
+{
+	return p->running;
+}
+
+/*
+ * end of a pass or transfer error, call from the stream interrupt
+ */
+void pwm_burst_irq(pwm_burst_t *p)
+{
+	uint32_t flags = dma_stream_flags(p->dma, p->stream_n);
+
+	dma_stream_clear(p->dma, p->stream_n, flags);
+
+	if (flags & DMA_STREAM_TEIF) {
+		// the stream disabled itself, the outputs hold the last values
+		p->errors++;
+		p->tim->DIER &= ~TIM_UDE;
+		p->running = 0;
+		return;
+	}
+
+	if (!(flags & DMA_STREAM_TCIF))
+		return;
+
+	p->passes++;
+	if (p->mode == PWM_BURST_ONESHOT) {
+		// the last step is in the preload registers, no more requests
+		p->tim->DIER &= ~TIM_UDE;
+		p->running = 0;
+	}
+	if (p->done)
+		p->done(p->arg);
+}
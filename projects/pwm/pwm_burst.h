@@ -0,0 +1,101 @@
+/*
+ * pwm_burst.h
+ *
+ * description:
+ *   multi-channel PWM on TIM1, TIM3, TIM4 or TIM8 with new duty values
+ *   for all channels on every update event, streamed by DMA through
+ *   the DMA burst feature of the timer. the CPU does no per-period
+ *   work: LED fading, commutation tables and waveform shaping run from
+ *   a sequence buffer on their own.
+ *
+ *   a sequence is an array of steps, each step holds one 16-bit
+ *   compare value per channel in use (CCR1, CCR2, ...). on an update
+ *   event the timer asks the DMA for DBL + 1 transfers, all of them
+ *   to TIMx_DMAR, and redirects each one to the next register from
+ *   DBA on (CCR1 .. CCR4). with output compare preload on, the values
+ *   go to the preload registers and take effect on the next update,
+ *   so the transfers have a whole period to finish and a step is
+ *   never applied half way.
+ *
+ *   the update DMA requests are fixed in hardware (RM0090 tables 42
+ *   and 43), the driver picks the stream from the timer:
+ *     TIM1_UP   DMA2 stream 5 channel 6
+ *     TIM8_UP   DMA2 stream 1 channel 7
+ *     TIM3_UP   DMA1 stream 2 channel 5
+ *     TIM4_UP   DMA1 stream 6 channel 2
+ *
+ *   modes:
+ *     PWM_BURST_LOOP      circular DMA, the sequence repeats forever.
+ *                         with a callback the transfer complete
+ *                         interrupt calls it once per pass, without
+ *                         one there are no interrupts at all
+ *     PWM_BURST_ONESHOT   the sequence plays once, the last step stays
+ *                         on the outputs. the callback runs when the
+ *                         last step was loaded, it plays from the next
+ *                         update on
+ *
+ *   step 0 is loaded into the compare registers before the counter
+ *   starts, so it plays in the first period and every step plays for
+ *   exactly one period. the sequence can be in flash or SRAM (not
+ *   CCM, DMA can not reach it) and must stay valid while it plays,
+ *   steps * channels must fit in 16 bits (NDTR).
+ *
+ *   the driver sets up the timer, the channels and the DMA stream,
+ *   the pins (alternate function) are up to the caller. TIM1 and TIM8
+ *   have their main output enable (MOE) set.
+ *
+ * usage:
+ *   pwm_burst_t pwm;
+ *   pwm_burst_init(&pwm, TIM4, 83, 999, 4);       // 84 MHz / 84 / 1000 = 1 kHz
+ *   pwm_burst_start(&pwm, fade, 1024, PWM_BURST_LOOP, 0, 0);
+ *   call pwm_burst_irq(&pwm) from the stream interrupt
+ *   (DMA1_Stream6_IRQHandler for TIM4)
+ */
+
+#ifndef __PWM_BURST_H
+#define __PWM_BURST_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWM_BURST_LOOP      0
+#define PWM_BURST_ONESHOT   1
+
+/* end of a pass (loop) or of the sequence (one-shot), DMA interrupt */
+typedef void (*pwm_burst_done_t)(void *arg);
+
+typedef struct {
+	TIM_TypeDef *tim;
+	DMA_TypeDef *dma;
+	DMA_Stream_TypeDef *stream;
+	IRQn_Type irq;            /* stream interrupt                   */
+	uint32_t chsel;           /* CHSEL bits of the update request   */
+	uint8_t stream_n;         /* stream number, for the flag bits   */
+	uint8_t nch;              /* channels per step, 1 .. 4          */
+	uint8_t mode;
+	volatile uint8_t running;
+	const uint16_t *seq;
+	uint16_t steps;
+	pwm_burst_done_t done;
+	void *arg;
+	volatile uint32_t passes; /* loops played, or 1 once one-shot ended */
+	volatile uint32_t errors; /* DMA transfer errors                */
+} pwm_burst_t;
+
+int  pwm_burst_init(pwm_burst_t *p, TIM_TypeDef *tim, uint16_t psc, uint16_t arr, uint8_t nch);
+void pwm_burst_set(pwm_burst_t *p, const uint16_t *duty);
+int  pwm_burst_start(pwm_burst_t *p, const uint16_t *seq, uint16_t steps,
+                     uint8_t mode, pwm_burst_done_t done, void *arg);
+void pwm_burst_stop(pwm_burst_t *p);
+int  pwm_burst_busy(pwm_burst_t *p);
+void pwm_burst_irq(pwm_burst_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
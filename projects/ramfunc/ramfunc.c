@@ -0,0 +1,255 @@
+/*
+ * ramfunc.c
+ *
+ * description:
+ *   interrupt latency of a handler in flash and of the same handler
+ *   in SRAM (RAMFUNC, system_stm32f4xx.h).
+ *
+ *   the interrupt is triggered from software (NVIC STIR) and the
+ *   handler reads the cycle counter first thing. latency here is the
+ *   cycles from the STIR write to that read, the read included.
+ *   each case runs 1000 times:
+ *     flash handler   TIM6 vector. at 168 MHz flash has 5 wait
+ *                     states, a hit in the ART accelerator hides them
+ *     SRAM handler    TIM7 vector, the same code copied to SRAM at
+ *                     boot
+ *     SRAM vectors    the SRAM handler with the vector table in SRAM
+ *                     (vectors_to_ram, include/vectors.h), the vector
+ *                     fetch does not go to flash either
+ *   each one warm, back to back, and with the ART instruction and data
+ *   caches flushed before every interrupt, the worst case when other
+ *   code ran in between. the flash handler spreads with the cache, the
+ *   SRAM handler with SRAM vectors does not.
+ *   CCM is not an option for code, the core only reads data from it.
+ *
+ *   every second the min, max and average cycles of each case on
+ *   USART2, also left in results[] for the debugger. the green LED
+ *   toggles with each report.
+ *
+ * setup:
+ *    uses the green on-board LED (PD12)
+ *    USART2 TX on PA2 (AF7), 115200 8N1
+ *    clock at 168 Mhz
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "cyccnt.h"
+#include "vectors.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define RUNS          1000
+#define NCASES        6
+
+#define BAUD          115200
+
+typedef struct {
+	const char *name;
+	uint32_t min;
+	uint32_t max;
+	uint32_t avg;
+} latency_t;
+
+/*************************************************
+* function declarations
+*************************************************/
+void TIM6_DAC_IRQHandler(void);
+RAMFUNC void TIM7_IRQHandler(void);
+int main(void);
+
+/*************************************************
+* variables
+*************************************************/
+static volatile uint32_t stamp, done;
+
+// the copy of vector_table in SRAM
+static uint32_t ram_vectors;
+
+static const struct {
+	const char *name;
+	IRQn_Type irq;
+	uint32_t sram_vectors;
+	uint32_t cold;
+} cases[NCASES] = {
+	{ "flash handler, warm              ", TIM6_DAC_IRQn, 0, 0 },
+	{ "flash handler, ART flushed       ", TIM6_DAC_IRQn, 0, 1 },
+	{ "SRAM handler, warm               ", TIM7_IRQn, 0, 0 },
+	{ "SRAM handler, ART flushed        ", TIM7_IRQn, 0, 1 },
+	{ "SRAM handler+vectors, warm       ", TIM7_IRQn, 1, 0 },
+	{ "SRAM handler+vectors, ART flushed", TIM7_IRQn, 1, 1 },
+};
+
+volatile latency_t results[NCASES];
+
+/*************************************************
+* the same handler in flash and in SRAM
+*************************************************/
+void TIM6_DAC_IRQHandler(void)
+{
+	stamp = DWT->CYCCNT;
+	done = 1;
+}
+
+RAMFUNC void TIM7_IRQHandler(void)
+{
+	stamp = DWT->CYCCNT;
+	done = 1;
+}
+
+/*************************************************
+* usart
+*************************************************/
+static void uart_putc(char c)
+{
+	// wait for TXE, bit 7 on SR
+	while (!(USART2->SR & (1 << 7)));
+	USART2->DR = (uint8_t)c;
+}
+
+static void uart_puts(const char *s)
+{
+	while (*s)
+		uart_putc(*s++);
+}
+
+static void uart_putu(uint32_t v)
+{
+	char buf[11];
+	int n = 0;
+
+	do {
+		buf[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	while (n)
+		uart_putc(buf[--n]);
+}
+
+/*************************************************
+* measurement
+*************************************************/
+// empty both ART caches, they only reset while disabled.
+//   ICEN bit 9, DCEN bit 10, ICRST bit 11, DCRST bit 12 on ACR
+static void art_flush(void)
+{
+	FLASH->ACR &= ~((1U << 9) | (1U << 10));
+	FLASH->ACR |= (1U << 11) | (1U << 12);
+	FLASH->ACR &= ~((1U << 11) | (1U << 12));
+	FLASH->ACR |= (1U << 9) | (1U << 10);
+}
+
+static uint32_t sample(IRQn_Type irq, uint32_t cold)
+{
+	uint32_t t0;
+
+	if (cold)
+		art_flush();
+	done = 0;
+	t0 = DWT->CYCCNT;
+	// software trigger, the interrupt number on STIR
+	NVIC->STIR = (uint32_t)irq;
+	while (!done);
+	return stamp - t0;
+}
+
+static void run(void)
+{
+	uint32_t c, i, t, sum;
+
+	for (c = 0; c < NCASES; c++) {
+		SCB->VTOR = cases[c].sram_vectors ? ram_vectors : (uint32_t)vector_table;
+		__DSB();
+
+		results[c].name = cases[c].name;
+		results[c].min = 0xFFFFFFFF;
+		results[c].max = 0;
+		sum = 0;
+		// the first one fills the caches
+		sample(cases[c].irq, 0);
+		for (i = 0; i < RUNS; i++) {
+			t = sample(cases[c].irq, cases[c].cold);
+			if (t < results[c].min)
+				results[c].min = t;
+			if (t > results[c].max)
+				results[c].max = t;
+			sum += t;
+		}
+		results[c].avg = sum / RUNS;
+	}
+	SCB->VTOR = (uint32_t)vector_table;
+	__DSB();
+}
+
+static void report(void)
+{
+	uint32_t c;
+
+	uart_puts("hclk ");
+	uart_putu(get_hclk());
+	uart_puts(", ");
+	uart_putu(FLASH->ACR & 0x7);
+	uart_puts(" wait states. cycles from STIR to the handler, min max avg\r\n");
+	for (c = 0; c < NCASES; c++) {
+		uart_puts("  ");
+		uart_puts(results[c].name);
+		uart_puts("  ");
+		uart_putu(results[c].min);
+		uart_putc(' ');
+		uart_putu(results[c].max);
+		uart_putc(' ');
+		uart_putu(results[c].avg);
+		uart_puts("\r\n");
+	}
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	uint32_t t0;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+	cyccnt_init();
+
+	// enable GPIOA and GPIOD clocks, bits 0 and 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 0) | (1 << 3);
+	// PD12 as output
+	GPIOD->MODER &= ~(0x3U << 24);
+	GPIOD->MODER |= (0x1U << 24);
+
+	// USART2 TX on PA2, alternate function mode (0b10), AF7 - clock
+	//   bit 17 on APB1ENR
+	RCC->APB1ENR |= (1 << 17);
+	GPIOA->MODER &= ~(0x3U << 4);
+	GPIOA->MODER |= (0x2 << 4);
+	GPIOA->AFR[0] |= (0x7 << 8);
+	USART2->BRR = (get_pclk1() + BAUD / 2) / BAUD;
+	// usart enable UE bit 13, tx enable TE bit 3
+	USART2->CR1 = (1 << 13) | (1 << 3);
+
+	// the vector table in SRAM, with the handlers it has in flash.
+	//   run() switches VTOR between the two
+	vectors_to_ram();
+	ram_vectors = SCB->VTOR;
+	SCB->VTOR = (uint32_t)vector_table;
+	__DSB();
+
+	// both timers stay off, only their interrupt lines are used
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+	NVIC_EnableIRQ(TIM7_IRQn);
+
+	while(1) {
+		run();
+		report();
+		GPIOD->ODR ^= (1 << 12);
+
+		t0 = cyccnt_read();
+		while (cyccnt_read() - t0 < get_hclk());
+	}
+
+	return 0;
+}
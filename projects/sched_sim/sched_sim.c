@@ -0,0 +1,368 @@
+/*
+ * sched_sim.c
+ *
+ * description:
+ *   runs the cooperative scheduler of include/sched.c on the host with
+ *   a simulated tick and checks its dispatch order and statistics.
+ *
+ *   time is virtual, in core cycles at 168 MHz. tasks take the time
+ *   they are given (burn), the SysTick comes every 168000 cycles and
+ *   runs sched_tick at once unless PRIMASK is set, right in the middle
+ *   of a task the way the interrupt would. the main loop is the one of
+ *   the board: sched_poll, and WFI up to the next tick when nothing is
+ *   ready. the scheduler clock starts half a second before it wraps.
+ *
+ *   scenarios:
+ *     1. three rate monotonic tasks at 1, 5 and 20 ms, 19 % load:
+ *        every release runs, nobody misses a deadline, lateness is
+ *        bounded by the longest lower priority task (cooperative
+ *        blocking) plus the higher ones
+ *     2. four tasks released on the same tick run by priority
+ *     3. overload: a 3 ms task every 2 ms and a 1 ms task above it.
+ *        the long one misses every deadline and drops releases, the
+ *        short one drops releases while it is blocked
+ *     4. two 4 ms tasks every 10 ms, on the same tick the lower one
+ *        waits 4 ms, with an offset of 5 ticks neither waits
+ *
+ *   at the end the dispatch cost of the host build is measured with
+ *   the TSC, for information only. exits with 1 if a check fails.
+ *
+ * usage:
+ *   make run
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+// the x86 intrinsics of the host cyccnt.h before the CMSIS qualifiers
+#include "cyccnt.h"
+#include "stm32f4xx.h"
+#include "sched.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define CORE_HZ        168000000U
+#define TICK           168000U               // cycles per 1 ms tick
+#define US             168U                  // cycles per us
+#define CLK_START      (0xFFFFFFFFU - CORE_HZ / 2)
+
+// exception entry and exit around sched_tick
+#define IRQ_CYCLES     40
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		failures++; \
+		printf("  FAIL: " __VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while (0)
+
+typedef struct {
+	const char *name;
+	uint8_t prio;
+	uint32_t period;
+	uint32_t offset;
+	uint32_t cost;                 // cycles per run
+} job_t;
+
+/*************************************************
+* variables
+*************************************************/
+static uint64_t now;               // virtual cycles
+static uint64_t next_tick;
+static uint32_t primask;
+static int tick_pending;
+static int failures;
+
+static uint8_t order[64];
+static uint32_t norder;
+
+/*************************************************
+* processor model
+*************************************************/
+static void take_irqs(void)
+{
+	if (tick_pending && !primask) {
+		tick_pending = 0;
+		now += IRQ_CYCLES / 2;
+		sched_tick();
+		now += IRQ_CYCLES / 2;
+	}
+}
+
+void sim_irq_enable(void)
+{
+	primask = 0;
+	take_irqs();
+}
+
+void sim_irq_disable(void)
+{
+	primask = 1;
+}
+
+uint32_t sim_get_primask(void)
+{
+	return primask;
+}
+
+void sim_set_primask(uint32_t v)
+{
+	primask = v;
+	if (!v)
+		take_irqs();
+}
+
+// sleep up to the next tick, it is taken once PRIMASK is clear
+void sim_wfi(void)
+{
+	now = next_tick;
+	next_tick += TICK;
+	tick_pending = 1;
+}
+
+static uint32_t sim_clock(void)
+{
+	return (uint32_t)(CLK_START + now);
+}
+
+// a task at work for cycles, the ticks on the way interrupt it
+static void burn(uint64_t cycles)
+{
+	uint64_t end = now + cycles;
+
+	while (next_tick <= end) {
+		now = next_tick;
+		next_tick += TICK;
+		tick_pending = 1;
+		take_irqs();
+		end += IRQ_CYCLES;
+	}
+	now = end;
+}
+
+static void job(void *arg)
+{
+	const job_t *j = (const job_t *)arg;
+
+	if (norder < sizeof(order))
+		order[norder++] = j->prio;
+	burn(j->cost);
+}
+
+// the main loop of the board for a number of ticks
+static void run_ticks(uint32_t ticks)
+{
+	uint32_t end = sched_stats.ticks + ticks;
+
+	while (sched_stats.ticks < end) {
+		if (sched_poll())
+			continue;
+		__disable_irq();
+		if (!sched_pending())
+			sim_wfi();
+		__enable_irq();
+	}
+}
+
+static void start(const job_t *jobs, uint32_t n)
+{
+	uint32_t i;
+
+	sched_init(sim_clock, TICK);
+	norder = 0;
+	for (i = 0; i < n; i++)
+		CHECK(sched_add(jobs[i].prio, jobs[i].period, jobs[i].offset, job,
+		                (void *)&jobs[i], jobs[i].name) != 0, "%s not added", jobs[i].name);
+	CHECK(sched_add(jobs[0].prio, 1, 0, job, 0, "twice") == 0, "priority taken twice");
+}
+
+static void report(const job_t *jobs, uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		sched_task_t *t = sched_task(jobs[i].prio);
+		printf("  %-10s %4u %6u %9.1f %9.1f %9.1f %9u %7u\n", t->name, t->prio,
+		       t->runs, (double)sched_exec_avg(t) / US, (double)t->exec_max / US,
+		       (double)t->late_max / US, t->overruns, t->misses);
+	}
+}
+
+/*************************************************
+* scenarios
+*************************************************/
+static void rate_monotonic(void)
+{
+	static const job_t jobs[] = {
+		{ "1 ms",  3,  1, 0, 100 * US },
+		{ "5 ms",  2,  5, 1, 300 * US },
+		{ "20 ms", 1, 20, 3, 600 * US },
+	};
+	uint32_t i;
+
+	printf("1. rate monotonic, 2000 ticks\n");
+	start(jobs, 3);
+	run_ticks(2000);
+	report(jobs, 3);
+
+	for (i = 0; i < 3; i++) {
+		sched_task_t *t = sched_task(jobs[i].prio);
+		uint32_t want = (2000 - jobs[i].offset - 1) / jobs[i].period + 1;
+		// a lower task in the way, the higher ones, the interrupts
+		uint32_t bound = IRQ_CYCLES * 4;
+		uint32_t k;
+
+		for (k = 0; k < 3; k++) {
+			if (jobs[k].prio > jobs[i].prio)
+				bound += jobs[k].cost;
+			else if (jobs[k].prio < jobs[i].prio && jobs[k].cost > bound)
+				bound += jobs[k].cost;
+		}
+		CHECK(t->runs + 1 >= want && t->runs <= want, "%s: %u runs, expected %u",
+		      t->name, t->runs, want);
+		CHECK(t->overruns == 0 && t->misses == 0, "%s: %u overruns, %u misses",
+		      t->name, t->overruns, t->misses);
+		CHECK(t->exec_max >= jobs[i].cost && t->exec_max <= jobs[i].cost + 2 * IRQ_CYCLES,
+		      "%s: execution %u cycles, costs %u", t->name, t->exec_max, jobs[i].cost);
+		CHECK(t->late_max <= bound, "%s: %u cycles late, bound %u", t->name,
+		      t->late_max, bound);
+	}
+}
+
+static void priority_order(void)
+{
+	static const job_t jobs[] = {
+		{ "a", 9, 10, 0, 10 * US },
+		{ "b", 4, 10, 0, 10 * US },
+		{ "c", 7, 10, 0, 10 * US },
+		{ "d", 2, 10, 0, 10 * US },
+	};
+	static const uint8_t want[4] = { 9, 7, 4, 2 };
+	uint32_t i, bad = 0;
+
+	printf("2. same tick, run by priority, 100 ticks\n");
+	start(jobs, 4);
+	run_ticks(100);
+	report(jobs, 4);
+
+	CHECK(norder == 40, "%u runs, expected 40", norder);
+	for (i = 0; i < norder; i++)
+		if (order[i] != want[i % 4])
+			bad++;
+	CHECK(bad == 0, "%u runs out of priority order", bad);
+}
+
+static void overload(void)
+{
+	static const job_t jobs[] = {
+		{ "short", 2, 1, 0,   50 * US },
+		{ "long",  1, 2, 0, 3000 * US },
+	};
+	sched_task_t *s, *l;
+
+	printf("3. overload, 1000 ticks\n");
+	start(jobs, 2);
+	run_ticks(1000);
+	report(jobs, 2);
+
+	s = sched_task(2);
+	l = sched_task(1);
+	// the last long run goes past the end, its ticks were all taken
+	CHECK(sched_stats.ticks >= 1000 && sched_stats.ticks <= 1003, "%u ticks",
+	      sched_stats.ticks);
+	CHECK(l->misses == l->runs && l->runs > 0, "long: %u misses in %u runs",
+	      l->misses, l->runs);
+	CHECK(l->runs + l->overruns >= 499, "long: %u runs and %u overruns for 500 releases",
+	      l->runs, l->overruns);
+	CHECK(s->overruns > 0 && s->runs + s->overruns >= 999,
+	      "short: %u runs and %u overruns for 1000 releases", s->runs, s->overruns);
+	// a long release during a long run is dropped, the short one
+	//   released a tick after the long start waits out the rest of it
+	CHECK(l->runs + l->overruns <= 501, "long: %u runs and %u overruns for 500 releases",
+	      l->runs, l->overruns);
+	CHECK(s->late_max >= 1900 * US && s->late_max <= 2100 * US,
+	      "short: %u cycles late, the long task takes 3 ms", s->late_max);
+}
+
+static void offsets(void)
+{
+	static const job_t same[] = {
+		{ "hi",  5, 10, 0, 4000 * US },
+		{ "lo",  4, 10, 0, 4000 * US },
+	};
+	static const job_t spread[] = {
+		{ "hi",  5, 10, 0, 4000 * US },
+		{ "lo",  4, 10, 5, 4000 * US },
+	};
+	sched_task_t *t;
+
+	printf("4a. two 4 ms tasks on the same tick, 200 ticks\n");
+	start(same, 2);
+	run_ticks(200);
+	report(same, 2);
+	t = sched_task(4);
+	CHECK(t->late_max >= 4000 * US, "same tick: lo only %u cycles late", t->late_max);
+
+	printf("4b. the same, lo 5 ticks later\n");
+	start(spread, 2);
+	run_ticks(200);
+	report(spread, 2);
+	CHECK(sched_task(5)->late_max <= IRQ_CYCLES && sched_task(4)->late_max <= IRQ_CYCLES,
+	      "offset: %u and %u cycles late", sched_task(5)->late_max,
+	      sched_task(4)->late_max);
+	CHECK(sched_task(5)->misses + sched_task(4)->misses == 0, "offset: deadline misses");
+}
+
+/*************************************************
+* host dispatch cost
+*************************************************/
+static void empty(void *arg)
+{
+	(void)arg;
+}
+
+static void dispatch_cost(void)
+{
+	uint32_t i, p, t0, total = 0, runs = 0;
+
+	cyccnt_init();
+	sched_init(cyccnt_read, TICK);
+	for (p = 0; p < 8; p++)
+		sched_add((uint8_t)p, 1, 0, empty, 0, "empty");
+	for (i = 0; i < 10000; i++) {
+		sched_tick();
+		t0 = cyccnt_read();
+		while (sched_poll())
+			runs++;
+		total += cyccnt_read() - t0;
+	}
+	printf("host dispatch: %.1f %s per task run, worst %u\n", (double)total / runs,
+	       CYCCNT_UNIT, sched_stats.overhead_max);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	next_tick = TICK;
+
+	printf("cooperative scheduler, %u cycle tick, times in us\n", TICK);
+	printf("  %-10s %4s %6s %9s %9s %9s %9s %7s\n", "task", "prio", "runs",
+	       "exec avg", "exec max", "late max", "overruns", "misses");
+
+	rate_monotonic();
+	priority_order();
+	overload();
+	offsets();
+	dispatch_cost();
+
+	if (failures) {
+		printf("FAILED: %d checks\n", failures);
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
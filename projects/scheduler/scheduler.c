@@ -0,0 +1,185 @@
+/*
+ * scheduler.c
+ *
+ * description:
+ *   periodic jobs with the cooperative scheduler (include/sched.c)
+ *   instead of a while(1) loop with delay counts.
+ *
+ *     control  prio 6, 1 ms     a filter over a fake input, some work
+ *                               every millisecond
+ *     button   prio 5, 10 ms    debounces the user button (PA0), each
+ *                               press toggles the blue LED (PD15)
+ *     blink    prio 2, 500 ms   green LED (PD12)
+ *     check    prio 0, 1000 ms  copies the statistics into stats[] for
+ *                               the debugger. orange LED (PD13) after
+ *                               an overrun, red (PD14) after a missed
+ *                               deadline
+ *
+ *   SysTick at 1 ms calls sched_tick, the main loop is include/idle.c
+ *   with the scheduler as its poller: it runs the ready jobs and
+ *   sleeps in WFI until the next tick. execution and lateness are in
+ *   DWT cycles. projects/sched_sim runs the scheduler on the host.
+ *
+ * setup:
+ *    uses 4 on-board LEDs and the user button
+ *    clock at 168 MHz, SysTick from the core clock
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "cyccnt.h"
+#include "sched.h"
+#include "idle.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define CORE_HZ       168000000
+#define TICK_CYCLES   (CORE_HZ / 1000)
+
+#define LED_GREEN     12
+#define LED_ORANGE    13
+#define LED_RED       14
+#define LED_BLUE      15
+
+#define NJOBS         4
+
+typedef struct {
+	const char *name;
+	uint32_t runs;
+	uint32_t exec_avg;           // cycles
+	uint32_t exec_max;
+	uint32_t late_max;
+	uint32_t overruns;
+	uint32_t misses;
+} job_stats_t;
+
+/*************************************************
+* function declarations
+*************************************************/
+void SysTick_Handler(void);
+int main(void);
+
+/*************************************************
+* variables
+*************************************************/
+volatile job_stats_t stats[NJOBS];
+volatile uint32_t dispatch_max;  // cycles
+volatile int32_t filtered;
+
+static const uint8_t prios[NJOBS] = { 6, 5, 2, 0 };
+
+void SysTick_Handler(void)
+{
+	sched_tick();
+}
+
+// the clock for the statistics, a function to hand to sched_init
+static uint32_t cycles(void)
+{
+	return cyccnt_read();
+}
+
+/*************************************************
+* jobs
+*************************************************/
+// first order low pass over a sawtooth, stands in for a control loop
+static void control(void *arg)
+{
+	static int32_t in, y;
+	uint32_t i;
+
+	(void)arg;
+	for (i = 0; i < 64; i++) {
+		in = (in + 37) & 0xFFF;
+		y += (in - y) >> 3;
+	}
+	filtered = y;
+}
+
+// the button reads the same 3 times in a row before it counts
+static void button(void *arg)
+{
+	static uint8_t history, pressed;
+
+	(void)arg;
+	history = (uint8_t)((history << 1) | (GPIOA->IDR & 1));
+	if ((history & 0x7) == 0x7 && !pressed) {
+		pressed = 1;
+		GPIOD->ODR ^= (1 << LED_BLUE);
+	} else if ((history & 0x7) == 0) {
+		pressed = 0;
+	}
+}
+
+static void blink(void *arg)
+{
+	(void)arg;
+	GPIOD->ODR ^= (1 << LED_GREEN);
+}
+
+static void check(void *arg)
+{
+	uint32_t i, overruns = 0, misses = 0;
+
+	(void)arg;
+	for (i = 0; i < NJOBS; i++) {
+		sched_task_t *t = sched_task(prios[i]);
+
+		stats[i].name = t->name;
+		stats[i].runs = t->runs;
+		stats[i].exec_avg = sched_exec_avg(t);
+		stats[i].exec_max = t->exec_max;
+		stats[i].late_max = t->late_max;
+		stats[i].overruns = t->overruns;
+		stats[i].misses = t->misses;
+		overruns += t->overruns;
+		misses += t->misses;
+	}
+	dispatch_max = sched_stats.overhead_max;
+
+	if (overruns)
+		GPIOD->ODR |= (1 << LED_ORANGE);
+	if (misses)
+		GPIOD->ODR |= (1 << LED_RED);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+	cyccnt_init();
+
+	// enable GPIOA and GPIOD clocks, bits 0 and 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 0) | (1 << 3);
+	// PA0 input, the board has a pull-down on it
+	GPIOA->MODER &= ~(0x3U << 0);
+	// PD12-15 as output
+	GPIOD->MODER &= 0x00FFFFFF;
+	GPIOD->MODER |= 0x55000000;
+	GPIOD->ODR = 0;
+
+	sched_init(cycles, TICK_CYCLES);
+	sched_add(prios[0], 1, 0, control, 0, "control");
+	sched_add(prios[1], 10, 3, button, 0, "button");
+	sched_add(prios[2], 500, 7, blink, 0, "blink");
+	sched_add(prios[3], 1000, 11, check, 0, "check");
+
+	// 1 ms from the core clock - CLKSOURCE bit 2, TICKINT bit 1, ENABLE bit 0
+	SysTick->LOAD = TICK_CYCLES - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = (1 << 2) | (1 << 1) | (1 << 0);
+
+	// ready jobs from the poller, WFI when there are none
+	idle_init(0, IDLE_WFI);
+	idle_add_poll(sched_poll, sched_pending);
+
+	while(1)
+		idle_once();
+
+	return 0;
+}
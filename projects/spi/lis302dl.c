@@ -0,0 +1,191 @@
+/*
+ * lis302dl.c
+ *
+ * description:
+ *   LIS302DL accelerometer driver on top of the queued SPI bus.
+ *   register access sleeps until the transaction is done,
+ *   sampling runs from the data ready interrupt (EXTI0 on PE0)
+ *   and fills accel_ring without main loop involvement.
+ *
+ *   only the register map in lis302dl.h, the bus and the
+ *   CMSIS device header are used, so the same file builds
+ *   for the board and for the host simulator in projects/spi_sim.
+ */
+
+#include "stm32f4xx.h"
+#include "spi_bus.h"
+#include "lis302dl.h"
+
+/*************************************************
+* variables
+*************************************************/
+static spi_bus_t *lis302_bus;
+
+// single register access frames
+static uint16_t reg_tx_frame;
+static uint16_t reg_rx_frame;
+
+// 16-bit frames for one STATUS..OUT_Z burst read,
+//   low byte of each received frame is STATUS, X, Y, Z
+static uint16_t spi_tx_frames[4];
+static volatile uint16_t spi_rx_frames[4];
+
+static spi_xfer_t drdy_xfer;
+static volatile uint32_t drdy_time;  // cycle count at the data ready edge
+volatile uint32_t drdy_overrun = 0;  // edges that came while still busy
+
+sample_ring_t accel_ring;
+
+/*
+ * lis302dl transaction settings: CS on PE3, mode 0,
+ * 16-bit frames, fPCLK/32
+ */
+static void lis302_xfer(spi_xfer_t *x)
+{
+	x->cs_port = GPIOE;
+	x->cs_pin = 3;
+	x->mode = SPI_BUS_MODE_0;
+	x->width = 16;
+	x->div = SPI_BUS_DIV_32;
+	x->tx = 0;
+	x->rx = 0;
+	x->len = 1;
+	x->done = 0;
+	x->ctx = 0;
+	x->state = SPI_XFER_IDLE;
+}
+
+/*
+ * write spi function customized for lis302dl
+ */
+void spi_write(uint8_t reg, uint8_t data)
+{
+	spi_xfer_t x;
+	lis302_xfer(&x);
+
+	// bit 15 is 0 for write for lis302dl
+	reg_tx_frame = (uint16_t)((reg << 8) | data);
+	x.tx = &reg_tx_frame;
+	spi_bus_transfer(lis302_bus, &x);
+}
+
+/*
+ * read spi function customized for lis302dl
+ */
+uint8_t spi_read(uint8_t reg)
+{
+	spi_xfer_t x;
+	lis302_xfer(&x);
+
+	// bit 15 is 1 for read for lis302dl
+	reg_tx_frame = (uint16_t)((1 << 15) | (reg << 8));
+	x.tx = &reg_tx_frame;
+	x.rx = &reg_rx_frame;
+	spi_bus_transfer(lis302_bus, &x);
+
+	return (uint8_t)reg_rx_frame;
+}
+
+/*
+ * data ready edge, queue the burst read
+ */
+void EXTI0_IRQHandler(void)
+{
+	uint32_t t = DWT->CYCCNT;
+
+	// Clear pending bit
+	EXTI->PR = (1 << 0);
+
+	if (drdy_xfer.state == SPI_XFER_QUEUED || drdy_xfer.state == SPI_XFER_ACTIVE) {
+		drdy_overrun++;
+		return;
+	}
+	drdy_time = t;
+	spi_bus_submit(lis302_bus, &drdy_xfer);
+}
+
+/*
+ * burst read finished, store the sample
+ *   runs from the DMA interrupt
+ */
+static void drdy_done(spi_xfer_t *x)
+{
+	sample_t s;
+	(void)x;
+
+	s.t = drdy_time;
+	s.status = (uint8_t)spi_rx_frames[0];
+	s.x = (int8_t)spi_rx_frames[1];
+	s.y = (int8_t)spi_rx_frames[2];
+	s.z = (int8_t)spi_rx_frames[3];
+	sample_ring_push(&accel_ring, &s);
+
+	// next sample got ready while reading, there will be no new edge
+	if (GPIOE->IDR & (1 << 0))
+		EXTI->SWIER = (1 << 0);
+}
+
+/*
+ * cycle counter and EXTI0 setup for data ready sampling
+ * the bus and the sensor have to be configured before calling this
+ */
+void drdy_init(void)
+{
+	// enable DWT cycle counter for the timestamps
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	// read STATUS with auto increment, X/Y/Z follow at odd addresses
+	spi_tx_frames[0] = (uint16_t)((LIS302_READ | LIS302_AUTO_INC |
+	                               LIS302_REG_STATUS_REG) << 8);
+	spi_tx_frames[1] = 0;
+	spi_tx_frames[2] = 0;
+	spi_tx_frames[3] = 0;
+
+	lis302_xfer(&drdy_xfer);
+	drdy_xfer.tx = spi_tx_frames;
+	drdy_xfer.rx = (void *)spi_rx_frames;
+	drdy_xfer.len = 4;
+	drdy_xfer.done = drdy_done;
+
+	// PE0 as input, GPIOE clock is already on
+	GPIOE->MODER &= 0xFFFFFFFC;
+
+	// enable SYSCFG clock (APB2ENR: bit 14)
+	RCC->APB2ENR |= (1 << 14);
+	// tie PE0 to EXTI0 (0b0100 is port E)
+	SYSCFG->EXTICR[0] &= 0xFFFFFFF0;
+	SYSCFG->EXTICR[0] |= 0x00000004;
+	EXTI->RTSR |= (1 << 0); // rising edge
+	EXTI->IMR |= (1 << 0);  // unmask
+
+	NVIC_SetPriority(EXTI0_IRQn, 1);
+	NVIC_EnableIRQ(EXTI0_IRQn);
+
+	// sensor may already be holding DRDY high
+	if (GPIOE->IDR & (1 << 0))
+		EXTI->SWIER = (1 << 0);
+}
+
+/*
+ * attach the driver to the bus the sensor sits on
+ */
+void lis302_init(spi_bus_t *bus)
+{
+	lis302_bus = bus;
+}
+
+/*
+ * reboot, active mode, 400 Hz, +/-2g, data ready on INT1
+ */
+void lis302_configure(void)
+{
+	// reboot memory
+	spi_write(LIS302_REG_CTRL_REG2, LIS302_CR2_BOOT);
+	// active mode, 400 Hz, +/-2g
+	spi_write(LIS302_REG_CTRL_REG1, LIS302_CR1_DR_400HZ | LIS302_CR1_PD |
+	          LIS302_CR1_ZEN | LIS302_CR1_YEN | LIS302_CR1_XEN);
+	// data ready on INT1
+	spi_write(LIS302_REG_CTRL_REG3, LIS302_CR3_I1_DRDY);
+}
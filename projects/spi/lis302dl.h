@@ -12,4 +12,45 @@
 #define LIS302_REG_OUT_Y           0x2B
 #define LIS302_REG_OUT_Z           0x2D
 
-#endif
\ No newline at end of file
+/* WHO_AM_I answer */
+#define LIS302_WHO_AM_I_VALUE      0x3B
+
+/* address byte, bit 7 is read, bit 6 is auto increment (MS) */
+#define LIS302_READ                0x80
+#define LIS302_AUTO_INC            0x40
+
+/* CTRL_REG1 bits */
+#define LIS302_CR1_DR_400HZ        0x80 /* 0 - 100 Hz, 1 - 400 Hz */
+#define LIS302_CR1_PD              0x40 /* 1 - active mode        */
+#define LIS302_CR1_FS              0x20 /* 0 - +/-2g, 1 - +/-8g   */
+#define LIS302_CR1_ZEN             0x04
+#define LIS302_CR1_YEN             0x02
+#define LIS302_CR1_XEN             0x01
+
+/* CTRL_REG2 bits */
+#define LIS302_CR2_BOOT            0x40 /* reboot memory content  */
+
+/* CTRL_REG3 bits, I1CFG[2:0] = 100 routes data ready to INT1 */
+#define LIS302_CR3_I1_DRDY         0x04
+
+/* STATUS_REG bits */
+#define LIS302_SR_ZYXOR            0x80 /* a sample was overwritten */
+#define LIS302_SR_ZYXDA            0x08 /* new sample available     */
+
+/* driver, lis302dl.c */
+#ifndef LIS302DL_REGS_ONLY
+#include "spi_bus.h"
+#include "sample_ring.h"
+
+extern sample_ring_t accel_ring;
+extern volatile uint32_t drdy_overrun;
+
+void lis302_init(spi_bus_t *bus);
+void lis302_configure(void);
+void spi_write(uint8_t reg, uint8_t data);
+uint8_t spi_read(uint8_t reg);
+void drdy_init(void);
+void EXTI0_IRQHandler(void);
+#endif
+
+#endif
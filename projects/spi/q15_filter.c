@@ -0,0 +1,231 @@
+/*
+ * q15_filter.c
+ *
+ * description:
+ *   Q15 block filters, see q15_filter.h
+ *
+ *   the arithmetic goes through four primitives. on target they are
+ *   the CMSIS intrinsics for the DSP extension, on the host they are
+ *   plain C with the same definition:
+ *     dsp_pack(lo, hi)        two Q15 values in one word (PKHBT)
+ *     dsp_smlald(a, b, acc)   acc + a.lo * b.lo + a.hi * b.hi, 64-bit (SMLALD)
+ *     dsp_ssat16(v)           saturate to -32768 .. 32767 (SSAT #16)
+ *     dsp_load2(p)            two adjacent Q15 values, any alignment (LDR)
+ */
+
+#include <stdint.h>
+#include "q15_filter.h"
+
+#if defined(HOST_BUILD) || !defined(__ARM_FEATURE_DSP)
+
+static inline uint32_t dsp_pack(q15_t lo, q15_t hi)
+{
+	return (uint32_t)(uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+static inline uint64_t dsp_smlald(uint32_t a, uint32_t b, uint64_t acc)
+{
+	int64_t lo = (int64_t)(int16_t)a * (int16_t)b;
+	int64_t hi = (int64_t)(int16_t)(a >> 16) * (int16_t)(b >> 16);
+	return acc + (uint64_t)(lo + hi);
+}
+
+static inline q15_t dsp_ssat16(int32_t v)
+{
+	if (v > 32767)
+		return 32767;
+	if (v < -32768)
+		return -32768;
+	return (q15_t)v;
+}
+
+#else
+
+#include "stm32f4xx.h"
+
+#define dsp_pack(lo, hi)       __PKHBT((uint32_t)(uint16_t)(lo), (uint32_t)(hi), 16)
+#define dsp_smlald(a, b, acc)  __SMLALD((a), (b), (acc))
+#define dsp_ssat16(v)          ((q15_t)__SSAT((v), 16))
+
+#endif
+
+static inline uint32_t dsp_load2(const q15_t *p)
+{
+	uint32_t v;
+	// a single LDR on Cortex-M4, unaligned access is allowed for it
+	__builtin_memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*************************************************
+* conversion
+*************************************************/
+/*
+ * split n ring samples into one Q15 block per axis
+ */
+void q15_from_samples(const sample_t *s, uint32_t n, q15_t *x, q15_t *y, q15_t *z)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		x[i] = Q15_FROM_DIGITS(s[i].x);
+		y[i] = Q15_FROM_DIGITS(s[i].y);
+		z[i] = Q15_FROM_DIGITS(s[i].z);
+	}
+}
+
+/*************************************************
+* moving average
+*************************************************/
+void q15_ma_init(q15_ma_t *f, uint8_t shift)
+{
+	uint32_t i;
+
+	if (shift > Q15_MA_MAX_SHIFT)
+		shift = Q15_MA_MAX_SHIFT;
+	for (i = 0; i < (1u << Q15_MA_MAX_SHIFT); i++)
+		f->hist[i] = 0;
+	f->sum = 0;
+	f->shift = shift;
+	f->pos = 0;
+}
+
+/*
+ * one add and one subtract per sample, whatever the length.
+ * the sum of up to 32 Q15 values fits in 32 bits.
+ */
+void q15_ma_block(q15_ma_t *f, const q15_t *in, q15_t *out, uint32_t n)
+{
+	uint32_t mask = (1u << f->shift) - 1;
+	int32_t round = f->shift ? (1 << (f->shift - 1)) : 0;
+	int32_t sum = f->sum;
+	uint32_t pos = f->pos;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		q15_t v = in[i];
+		sum += v - f->hist[pos];
+		f->hist[pos] = v;
+		pos = (pos + 1) & mask;
+		out[i] = (q15_t)((sum + round) >> f->shift);
+	}
+
+	f->sum = sum;
+	f->pos = (uint8_t)pos;
+}
+
+/*************************************************
+* biquad
+*************************************************/
+void q15_biquad_init(q15_biquad_t *f, const q15_t coef[5])
+{
+	f->c01 = dsp_pack(coef[0], coef[1]);
+	f->c23 = dsp_pack(coef[2], coef[3]);
+	f->c4 = dsp_pack(coef[4], 0);
+	f->x1 = 0;
+	f->x2 = 0;
+	f->y1 = 0;
+	f->y2 = 0;
+}
+
+/*
+ * three SMLALD per sample: (x0, x1).(b0, b1) + (x2, y1).(b2, a1) + (y2, 0).(a2, 0)
+ * Q15 x Q14 products, rounded back to Q15
+ */
+void q15_biquad_block(q15_biquad_t *f, const q15_t *in, q15_t *out, uint32_t n)
+{
+	q15_t x1 = f->x1, x2 = f->x2, y1 = f->y1, y2 = f->y2;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		q15_t x0 = in[i];
+		uint64_t acc = (uint64_t)1 << 13;
+		q15_t y0;
+
+		acc = dsp_smlald(dsp_pack(x0, x1), f->c01, acc);
+		acc = dsp_smlald(dsp_pack(x2, y1), f->c23, acc);
+		acc = dsp_smlald(dsp_pack(y2, 0), f->c4, acc);
+		y0 = dsp_ssat16((int32_t)((int64_t)acc >> 14));
+
+		x2 = x1;
+		x1 = x0;
+		y2 = y1;
+		y1 = y0;
+		out[i] = y0;
+	}
+
+	f->x1 = x1;
+	f->x2 = x2;
+	f->y1 = y1;
+	f->y2 = y2;
+}
+
+/*************************************************
+* decimating FIR
+*************************************************/
+/*
+ * returns 0 if the tap count is odd or too long, or m is 0
+ */
+int q15_fir_dec_init(q15_fir_dec_t *f, const q15_t *taps, uint16_t ntaps, uint8_t m)
+{
+	uint32_t i;
+
+	if ((ntaps & 1) || ntaps == 0 || ntaps > Q15_FIR_MAX_TAPS || m == 0)
+		return 0;
+
+	f->taps = taps;
+	f->ntaps = ntaps;
+	f->m = m;
+	f->phase = 0;
+	for (i = 0; i < sizeof(f->state) / sizeof(f->state[0]); i++)
+		f->state[i] = 0;
+	return 1;
+}
+
+// window w[0..ntaps-1], oldest first, two taps per SMLALD
+static q15_t fir_dot(const q15_t *w, const q15_t *taps, uint16_t ntaps)
+{
+	uint64_t acc = (uint64_t)1 << 14;
+	uint16_t k;
+
+	for (k = 0; k < ntaps; k += 2)
+		acc = dsp_smlald(dsp_load2(&w[k]), dsp_load2(&taps[k]), acc);
+
+	return dsp_ssat16((int32_t)((int64_t)acc >> 15));
+}
+
+/*
+ * filters n inputs, only every m-th output is computed.
+ * returns the number of outputs written, at most n / m + 1.
+ */
+uint32_t q15_fir_dec_block(q15_fir_dec_t *f, const q15_t *in, q15_t *out, uint32_t n)
+{
+	uint32_t hist = (uint32_t)f->ntaps - 1;
+	uint32_t produced = 0;
+	uint32_t i;
+
+	while (n) {
+		uint32_t chunk = (n > Q15_BLOCK) ? Q15_BLOCK : n;
+
+		// new samples go after the last ntaps-1 old ones
+		for (i = 0; i < chunk; i++)
+			f->state[hist + i] = in[i];
+
+		for (i = 0; i < chunk; i++) {
+			if (++f->phase == f->m) {
+				f->phase = 0;
+				// window ends with input i
+				out[produced++] = fir_dot(&f->state[i], f->taps, f->ntaps);
+			}
+		}
+
+		// keep the newest ntaps-1 samples for the next chunk
+		for (i = 0; i < hist; i++)
+			f->state[i] = f->state[chunk + i];
+
+		in += chunk;
+		n -= chunk;
+	}
+
+	return produced;
+}
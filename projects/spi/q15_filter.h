@@ -0,0 +1,89 @@
+/*
+ * q15_filter.h
+ *
+ * description:
+ *   Q15 fixed-point filters for 3-axis accelerometer streams.
+ *   every filter works on one axis and on whole blocks, so a batch
+ *   taken from the sample ring is split into axis blocks once
+ *   (q15_from_samples) and each axis runs through its own filter.
+ *
+ *   - moving average over 2^shift samples, running sum
+ *   - biquad, direct form 1, Q14 coefficients, 64-bit accumulator
+ *   - decimating FIR, even number of Q15 taps, keeps every m-th output
+ *
+ *   on Cortex-M4 the multiply-accumulate runs on the DSP instructions
+ *   (SMLALD on packed sample pairs, SSAT, PKHBT). host builds
+ *   (HOST_BUILD) use a portable version of the same operations, the
+ *   results are bit exact between the two.
+ *
+ * usage:
+ *   n = sample_ring_peek(&accel_ring, &s);
+ *   n = (n > Q15_BLOCK) ? Q15_BLOCK : n;
+ *   q15_from_samples(s, n, x, y, z);
+ *   q15_biquad_block(&lp_x, x, x, n);   // in place is fine
+ *   sample_ring_consume(&accel_ring, n);
+ */
+
+#ifndef __Q15_FILTER_H
+#define __Q15_FILTER_H
+
+#include <stdint.h>
+#include "sample_ring.h"
+
+typedef int16_t q15_t;
+
+/* samples handled per inner pass, also the FIR work buffer size */
+#define Q15_BLOCK          32
+
+/* longest moving average is 2^Q15_MA_MAX_SHIFT samples */
+#define Q15_MA_MAX_SHIFT   5
+
+/* longest decimating FIR */
+#define Q15_FIR_MAX_TAPS   32
+
+/* 2nd order Butterworth low pass, fc = 5 Hz at fs = 400 Hz, Q14, unity DC gain */
+#define Q15_BIQUAD_LP_5HZ_400HZ { 24, 48, 24, 30950, -14662 }
+
+/* one LIS302DL digit in Q15, int8 samples use the full range */
+#define Q15_FROM_DIGITS(d) ((q15_t)((d) * 256))
+
+typedef struct {
+	q15_t hist[1 << Q15_MA_MAX_SHIFT];
+	int32_t sum;
+	uint8_t shift;
+	uint8_t pos;
+} q15_ma_t;
+
+/*
+ * coefficients {b0, b1, b2, a1, a2} in Q14 (-2.0 .. 2.0),
+ * y = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+ * the feedback terms are added, so a1 and a2 have the opposite sign
+ * of the usual transfer function (same as CMSIS-DSP)
+ */
+typedef struct {
+	uint32_t c01;  // b0, b1 packed
+	uint32_t c23;  // b2, a1 packed
+	uint32_t c4;   // a2, 0 packed
+	q15_t x1, x2, y1, y2;
+} q15_biquad_t;
+
+typedef struct {
+	const q15_t *taps;   // taps[0] multiplies the oldest sample
+	uint16_t ntaps;      // even, <= Q15_FIR_MAX_TAPS
+	uint8_t m;           // decimation factor
+	uint8_t phase;       // inputs since the last output
+	q15_t state[Q15_FIR_MAX_TAPS - 1 + Q15_BLOCK];
+} q15_fir_dec_t;
+
+void q15_from_samples(const sample_t *s, uint32_t n, q15_t *x, q15_t *y, q15_t *z);
+
+void q15_ma_init(q15_ma_t *f, uint8_t shift);
+void q15_ma_block(q15_ma_t *f, const q15_t *in, q15_t *out, uint32_t n);
+
+void q15_biquad_init(q15_biquad_t *f, const q15_t coef[5]);
+void q15_biquad_block(q15_biquad_t *f, const q15_t *in, q15_t *out, uint32_t n);
+
+int q15_fir_dec_init(q15_fir_dec_t *f, const q15_t *taps, uint16_t ntaps, uint8_t m);
+uint32_t q15_fir_dec_block(q15_fir_dec_t *f, const q15_t *in, q15_t *out, uint32_t n);
+
+#endif
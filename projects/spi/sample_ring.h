@@ -0,0 +1,108 @@
+/*
+ * sample_ring.h
+ *
+ * description:
+ *   single producer / single consumer ring for timestamped
+ *   accelerometer samples. the producer is the data-ready
+ *   interrupt path, the consumer is the main loop.
+ *
+ *   head is only written by the producer and tail only by
+ *   the consumer, so no interrupt masking is needed.
+ *   both indices run freely and wrap at 2^32, the slot is
+ *   (index & (SAMPLE_RING_SIZE - 1)).
+ *
+ *   the consumer works in batches:
+ *     n = sample_ring_peek(&ring, &s);   // s[0..n-1] are valid
+ *     ... process s[0..n-1] ...
+ *     sample_ring_consume(&ring, n);
+ */
+
+#ifndef __SAMPLE_RING_H
+#define __SAMPLE_RING_H
+
+#include <stdint.h>
+
+/* number of slots, has to be a power of two
+ * 256 slots hold 640 ms of data at 400 Hz */
+#ifndef SAMPLE_RING_SIZE
+#define SAMPLE_RING_SIZE 256
+#endif
+
+#if (SAMPLE_RING_SIZE & (SAMPLE_RING_SIZE - 1)) != 0
+#error "SAMPLE_RING_SIZE must be a power of two"
+#endif
+
+typedef struct {
+	uint32_t t;      /* cycle counter value when the sample became ready */
+	int8_t x;
+	int8_t y;
+	int8_t z;
+	uint8_t status;  /* sensor status register read with the sample */
+} sample_t;
+
+typedef struct {
+	sample_t buf[SAMPLE_RING_SIZE];
+	volatile uint32_t head;    /* next slot to write (producer) */
+	volatile uint32_t tail;    /* next slot to read (consumer)  */
+	volatile uint32_t dropped; /* samples lost on a full ring   */
+} sample_ring_t;
+
+/*
+ * producer side, returns 0 if the ring was full and the sample was dropped
+ */
+static inline int sample_ring_push(sample_ring_t *r, const sample_t *s)
+{
+	uint32_t head = r->head;
+
+	if ((head - r->tail) >= SAMPLE_RING_SIZE) {
+		r->dropped++;
+		return 0;
+	}
+
+	r->buf[head & (SAMPLE_RING_SIZE - 1)] = *s;
+	// make the slot visible before publishing the new head
+	__sync_synchronize();
+	r->head = head + 1;
+	return 1;
+}
+
+/*
+ * consumer side, number of samples waiting
+ */
+static inline uint32_t sample_ring_count(const sample_ring_t *r)
+{
+	return r->head - r->tail;
+}
+
+/*
+ * consumer side, points *first at the oldest sample and returns how many
+ * samples can be read from there without wrapping around the buffer end.
+ * call again after consuming to get the part that wrapped.
+ */
+static inline uint32_t sample_ring_peek(sample_ring_t *r, const sample_t **first)
+{
+	uint32_t tail = r->tail;
+	uint32_t n = r->head - tail;
+	uint32_t idx = tail & (SAMPLE_RING_SIZE - 1);
+
+	// read the slots only after head was seen
+	__sync_synchronize();
+
+	if (n > SAMPLE_RING_SIZE - idx)
+		n = SAMPLE_RING_SIZE - idx;
+
+	*first = &r->buf[idx];
+	return n;
+}
+
+/*
+ * consumer side, releases n samples returned by sample_ring_peek
+ */
+static inline void sample_ring_consume(sample_ring_t *r, uint32_t n)
+{
+	// finish reading the slots before handing them back
+	__sync_synchronize();
+	r->tail = r->tail + n;
+}
+
+#endif
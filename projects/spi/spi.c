@@ -7,6 +7,16 @@
  *   is connected through the SPI port.
  *   lights up LEDs based on the tilt values
  *
+ *   the sensor runs at 400 Hz and raises data ready on INT1.
+ *   each rising edge on PE0 fires EXTI0, which timestamps the
+ *   sample and queues a 4 frame read (STATUS, X, Y, Z) on the
+ *   SPI1 bus (spi_bus.c, lis302dl.c). the bus runs it with DMA and the
+ *   completion callback pushes the sample into a lock-free ring
+ *   that the main loop drains in batches. other devices on SPI1
+ *   can queue their own transactions with their own chip select.
+ *   x and y go through a 5 Hz Q15 low pass (q15_filter.c) before
+ *   they drive the tilt LEDs.
+ *
  *   LIS302DL is present on the STM32F4 Discovery board
  *     rev. MB997B and
  *   LIS3DSH is present on the rev. MB997C
@@ -31,181 +41,53 @@
  *    7. do not choose TI mode
  *    8. choose master mode MSTR
  *    9. enable SPI
+ *
+ * data ready sampling:
+ *    1. route data ready to INT1 (CTRL_REG3) and tie PE0 to EXTI0
+ *    2. SPI1_RX is DMA2 stream 0 channel 3, SPI1_TX is
+ *       DMA2 stream 3 channel 3, both with 16-bit transfers
+ *    3. on EXTI0 queue the burst read on the bus
+ *    4. on completion store the sample
+ *    5. DRDY stays high until the data is read, so if it is already
+ *       high again when the read completes, EXTI0 is re-triggered
+ *       from software or the edge would be lost
  */
 
 #include "stm32f4xx.h"
 #include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "spi_bus.h"
 #include "lis302dl.h"
+#include "q15_filter.h"
 
 /*************************************************
 * function declarations
 *************************************************/
-void Default_Handler(void);
 int main(void);
-void spi_write(uint8_t reg, uint8_t data);
-uint8_t spi_read(uint8_t reg);
+void DMA2_Stream0_IRQHandler(void);
 
 /*************************************************
-* Vector Table
+* variables
 *************************************************/
-// get the stack pointer location from linker
-typedef void (* const intfunc)(void);
-extern unsigned long __stack;
+spi_bus_t spi1_bus;
 
-// attribute puts table in beginning of .vectors section
-//   which is the beginning of .text section in the linker script
-// Add other vectors -in order- here
-// Vector table can be found on page 372 in RM0090
-__attribute__ ((section(".vectors")))
-void (* const vector_table[])(void) = {
-	(intfunc)((unsigned long)&__stack), /* 0x000 Stack Pointer */
-	Reset_Handler,                      /* 0x004 Reset         */
-	Default_Handler,                    /* 0x008 NMI           */
-	Default_Handler,                    /* 0x00C HardFault     */
-	Default_Handler,                    /* 0x010 MemManage     */
-	Default_Handler,                    /* 0x014 BusFault      */
-	Default_Handler,                    /* 0x018 UsageFault    */
-	0,                                  /* 0x01C Reserved      */
-	0,                                  /* 0x020 Reserved      */
-	0,                                  /* 0x024 Reserved      */
-	0,                                  /* 0x028 Reserved      */
-	Default_Handler,                    /* 0x02C SVCall        */
-	Default_Handler,                    /* 0x030 Debug Monitor */
-	0,                                  /* 0x034 Reserved      */
-	Default_Handler,                    /* 0x038 PendSV        */
-	Default_Handler,                    /* 0x03C SysTick       */
-	0,                                  /* 0x040 Window WatchDog Interrupt                                         */
-	0,                                  /* 0x044 PVD through EXTI Line detection Interrupt                         */
-	0,                                  /* 0x048 Tamper and TimeStamp interrupts through the EXTI line             */
-	0,                                  /* 0x04C RTC Wakeup interrupt through the EXTI line                        */
-	0,                                  /* 0x050 FLASH global Interrupt                                            */
-	0,                                  /* 0x054 RCC global Interrupt                                              */
-	0,                                  /* 0x058 EXTI Line0 Interrupt                                              */
-	0,                                  /* 0x05C EXTI Line1 Interrupt                                              */
-	0,                                  /* 0x060 EXTI Line2 Interrupt                                              */
-	0,                                  /* 0x064 EXTI Line3 Interrupt                                              */
-	0,                                  /* 0x068 EXTI Line4 Interrupt                                              */
-	0,                                  /* 0x06C DMA1 Stream 0 global Interrupt                                    */
-	0,                                  /* 0x070 DMA1 Stream 1 global Interrupt                                    */
-	0,                                  /* 0x074 DMA1 Stream 2 global Interrupt                                    */
-	0,                                  /* 0x078 DMA1 Stream 3 global Interrupt                                    */
-	0,                                  /* 0x07C DMA1 Stream 4 global Interrupt                                    */
-	0,                                  /* 0x080 DMA1 Stream 5 global Interrupt                                    */
-	0,                                  /* 0x084 DMA1 Stream 6 global Interrupt                                    */
-	0,                                  /* 0x088 ADC1, ADC2 and ADC3 global Interrupts                             */
-	0,                                  /* 0x08C CAN1 TX Interrupt                                                 */
-	0,                                  /* 0x090 CAN1 RX0 Interrupt                                                */
-	0,                                  /* 0x094 CAN1 RX1 Interrupt                                                */
-	0,                                  /* 0x098 CAN1 SCE Interrupt                                                */
-	0,                                  /* 0x09C External Line[9:5] Interrupts                                     */
-	0,                                  /* 0x0A0 TIM1 Break interrupt and TIM9 global interrupt                    */
-	0,                                  /* 0x0A4 TIM1 Update Interrupt and TIM10 global interrupt                  */
-	0,                                  /* 0x0A8 TIM1 Trigger and Commutation Interrupt and TIM11 global interrupt */
-	0,                                  /* 0x0AC TIM1 Capture Compare Interrupt                                    */
-	0,                                  /* 0x0B0 TIM2 global Interrupt                                             */
-	0,                                  /* 0x0B4 TIM3 global Interrupt                                             */
-	0,                                  /* 0x0B8 TIM4 global Interrupt                                             */
-	0,                                  /* 0x0BC I2C1 Event Interrupt                                              */
-	0,                                  /* 0x0C0 I2C1 Error Interrupt                                              */
-	0,                                  /* 0x0C4 I2C2 Event Interrupt                                              */
-	0,                                  /* 0x0C8 I2C2 Error Interrupt                                              */
-	0,                                  /* 0x0CC SPI1 global Interrupt                                             */
-	0,                                  /* 0x0D0 SPI2 global Interrupt                                             */
-	0,                                  /* 0x0D4 USART1 global Interrupt                                           */
-	0,                                  /* 0x0D8 USART2 global Interrupt                                           */
-	0,                                  /* 0x0DC USART3 global Interrupt                                           */
-	0,                                  /* 0x0E0 External Line[15:10] Interrupts                                   */
-	0,                                  /* 0x0E4 RTC Alarm (A and B) through EXTI Line Interrupt                   */
-	0,                                  /* 0x0E8 USB OTG FS Wakeup through EXTI line interrupt                     */
-	0,                                  /* 0x0EC TIM8 Break Interrupt and TIM12 global interrupt                   */
-	0,                                  /* 0x0F0 TIM8 Update Interrupt and TIM13 global interrupt                  */
-	0,                                  /* 0x0F4 TIM8 Trigger and Commutation Interrupt and TIM14 global interrupt */
-	0,                                  /* 0x0F8 TIM8 Capture Compare global interrupt                             */
-	0,                                  /* 0x0FC DMA1 Stream7 Interrupt                                            */
-	0,                                  /* 0x100 FSMC global Interrupt                                             */
-	0,                                  /* 0x104 SDIO global Interrupt                                             */
-	0,                                  /* 0x108 TIM5 global Interrupt                                             */
-	0,                                  /* 0x10C SPI3 global Interrupt                                             */
-	0,                                  /* 0x110 UART4 global Interrupt                                            */
-	0,                                  /* 0x114 UART5 global Interrupt                                            */
-	0,                                  /* 0x118 TIM6 global and DAC1&2 underrun error  interrupts                 */
-	0,                                  /* 0x11C TIM7 global interrupt                                             */
-	0,                                  /* 0x120 DMA2 Stream 0 global Interrupt                                    */
-	0,                                  /* 0x124 DMA2 Stream 1 global Interrupt                                    */
-	0,                                  /* 0x128 DMA2 Stream 2 global Interrupt                                    */
-	0,                                  /* 0x12C DMA2 Stream 3 global Interrupt                                    */
-	0,                                  /* 0x130 DMA2 Stream 4 global Interrupt                                    */
-	0,                                  /* 0x134 Ethernet global Interrupt                                         */
-	0,                                  /* 0x138 Ethernet Wakeup through EXTI line Interrupt                       */
-	0,                                  /* 0x13C CAN2 TX Interrupt                                                 */
-	0,                                  /* 0x140 CAN2 RX0 Interrupt                                                */
-	0,                                  /* 0x144 CAN2 RX1 Interrupt                                                */
-	0,                                  /* 0x148 CAN2 SCE Interrupt                                                */
-	0,                                  /* 0x14C USB OTG FS global Interrupt                                       */
-	0,                                  /* 0x150 DMA2 Stream 5 global interrupt                                    */
-	0,                                  /* 0x154 DMA2 Stream 6 global interrupt                                    */
-	0,                                  /* 0x158 DMA2 Stream 7 global interrupt                                    */
-	0,                                  /* 0x15C USART6 global interrupt                                           */
-	0,                                  /* 0x160 I2C3 event interrupt                                              */
-	0,                                  /* 0x164 I2C3 error interrupt                                              */
-	0,                                  /* 0x168 USB OTG HS End Point 1 Out global interrupt                       */
-	0,                                  /* 0x16C USB OTG HS End Point 1 In global interrupt                        */
-	0,                                  /* 0x170 USB OTG HS Wakeup through EXTI interrupt                          */
-	0,                                  /* 0x174 USB OTG HS global interrupt                                       */
-	0,                                  /* 0x178 DCMI global interrupt                                             */
-	0,                                  /* 0x17C RNG global Interrupt                                              */
-	0                                   /* 0x180 FPU global interrupt                                              */
-};
-
-/*************************************************
-* default interrupt handler
-*************************************************/
-void Default_Handler(void)
-{
-	for (;;);  // Wait forever
-}
+volatile uint32_t sensor_overrun = 0; // samples overwritten in the sensor
 
+// tilt LEDs light up above 16 digits (~290 mg) of filtered x/y
+#define TILT_THRESHOLD Q15_FROM_DIGITS(16)
 
-/*
- * write spi function customized for lis302dl
- */
-void spi_write(uint8_t reg, uint8_t data)
-{
-	GPIOE->ODR &= (uint16_t)(~(1 << 3)); // enable
-	// bit 15 is 0 for write for lis302dl
-	uint16_t frame = 0;
-	frame |= (uint16_t)(reg << 8);
-	frame |= data;
-	// Send data
-	SPI1->DR = frame;
-	// wait until transmit is done (TXE flag)
-	while (!(SPI1->SR & (1 << 1)));
-	// wait until rx buf is not empty (RXNE flag)
-	while (!(SPI1->SR & (1 << 0)));
+static const q15_t tilt_coef[5] = Q15_BIQUAD_LP_5HZ_400HZ;
+static q15_biquad_t tilt_lp[2];
 
-	GPIOE->ODR |= (1 << 3); // disable
-	(void)SPI1->DR; // dummy read
-}
+// one ring batch split per axis
+static q15_t ax[Q15_BLOCK], ay[Q15_BLOCK], az[Q15_BLOCK];
 
 /*
- * read spi function customized for lis302dl
+ * SPI1 rx stream, drives the bus queue
  */
-uint8_t spi_read(uint8_t reg)
+void DMA2_Stream0_IRQHandler(void)
 {
-	GPIOE->ODR &= (uint16_t)(~(1 << 3)); // enable
-	// bit 15 is 1 for read for lis302dl
-	uint16_t frame = 0;
-	frame |= (1 << 15);
-	frame |= (uint16_t)(reg << 8);
-	// Send data
-	SPI1->DR = frame;
-	// wait until tx buf is empty (TXE flag)
-	while (!(SPI1->SR & (1 << 1)));
-	// wait until rx buf is not empty (RXNE flag)
-	while (!(SPI1->SR & (1 << 0)));
-
-	GPIOE->ODR |= (1 << 3); // disable
-	return (uint8_t)SPI1->DR;
+	spi_bus_irq(&spi1_bus);
 }
 
 /*************************************************
@@ -223,14 +105,6 @@ int main(void)
 	GPIOD->MODER |= 0x55000000;
 	GPIOD->ODR    = 0;
 
-	// SPI1 Chip-Select setup (PE3)
-
-	// enable GPIOE clock, bit 4 on AHB1ENR
-	RCC->AHB1ENR |= (1 << 4);
-	GPIOE->MODER &= 0xFFFFFF3F; // reset bits 6-7
-	GPIOE->MODER |= 0x00000040; // set bits 6-7 to 0b01 (output)
-	GPIOE->ODR |= (1 << 3);
-
 	// SPI1 data pins setup
 
 	// enable GPIOA clock, bit 0 on AHB1ENR
@@ -250,81 +124,84 @@ int main(void)
 	GPIOA->AFR[0] |= (0x5 << 24); // for pin 6
 	GPIOA->AFR[0] |= (0x5 << 28); // for pin 7
 
-	// Disable SPI1 and set the rest (no OR'ing)
-
-	// baud rate - BR[2:0] is bit 5:3
-	// fPCLK/2 is selected by default
-	SPI1->CR1 = (0x4 << 3); // set baud rate to fPCLK/32
-
-	// 8/16-bit mode - DFF is bit 11
-	SPI1->CR1 |= (1 << 11); // 1 - 16-bit mode
-
-	// motion sensor expects clk to be high and
-	//  transmission happens on the falling edge
-	// clock polarity - CPOL bit 1
-	SPI1->CR1 |= (0 << 1); // clk goes 1 when idle
-	// clock phase - CPHA bit 0
-	SPI1->CR1 |= (0 << 0); // first clock transaction
-
-	// frameformat - LSBFIRST bit 7, msb/lsb transmit first
-	// 0 - MSB transmitted first
-	//SPI1->CR1 |= (0 << 7); // 1 - LSB transmitted first
+	// enable DMA2 clock, bit 22 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 22);
 
-	// frame format - FRF bit 4 on CR2
-	// 0 - Motorola mode, 1 - TI mode
-	//   TI Mode autosets a lot of things
-	//   so do not enable it, unless that is what you want
-	//SPI1->CR2 |= (1 << 4); // 1 - SPI TI mode
+	// SPI1 bus: rx DMA2 stream 0, tx DMA2 stream 3, both channel 3
+	//   CR1 (baud rate, DFF, CPOL/CPHA, SSM/SSI, MSTR) is written
+	//   per transaction by the bus, see spi_bus.c
+	spi_bus_init(&spi1_bus, SPI1, DMA2_Stream0, DMA2_Stream3, 3);
+	NVIC_SetPriority(DMA2_Stream0_IRQn, 1);
+	NVIC_EnableIRQ(DMA2_Stream0_IRQn);
 
-	// software slave management - SSM bit 9
-	SPI1->CR1 |= (1 << 9); // 1- ssm enabled
-	// internal slave select - SSI bit 8
-	SPI1->CR1 |= (1 << 8); // set ssi to 1
-
-	// master config - MSTR bit 2
-	SPI1->CR1 |= (1 << 2); // 1 - master mode
+	// SPI1 Chip-Select setup (PE3)
 
-	// enable SPI - SPE bit 6
-	SPI1->CR1 |= (1 << 6);
+	// enable GPIOE clock, bit 4 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 4);
+	spi_bus_cs_setup(GPIOE, 3);
 
-	int16_t rbuf[3];
+	int16_t rbuf[3] = {0, 0, 0};
 
-	// reboot memory
-	spi_write(LIS302_REG_CTRL_REG2, 0x40);
-	// active mode, +/-2g
-	spi_write(LIS302_REG_CTRL_REG1, 0x47);
+	// sensor is on the SPI1 bus, CS on PE3
+	lis302_init(&spi1_bus);
+	// reboot, active mode, 400 Hz, +/-2g, data ready on INT1
+	lis302_configure();
 	// wait
-	for(int i=0; i<10000000; i++);
+	for(volatile int i=0; i<10000000; i++);
 	// read who am i
 	rbuf[0] = (int8_t)spi_read(LIS302_REG_WHO_AM_I);
 
+	// tilt filters, 5 Hz low pass at the 400 Hz sample rate
+	q15_biquad_init(&tilt_lp[0], tilt_coef);
+	q15_biquad_init(&tilt_lp[1], tilt_coef);
+
+	// from here on SPI1 belongs to the data ready path
+	drdy_init();
+
 	while(1)
 	{
-		rbuf[0] = (int8_t)spi_read(LIS302_REG_OUT_X);
-		rbuf[1] = (int8_t)spi_read(LIS302_REG_OUT_Y);
-		rbuf[2] = (int8_t)spi_read(LIS302_REG_OUT_Z);
+		const sample_t *s;
+		uint32_t n;
+
+		// drain everything collected since the last pass
+		while ((n = sample_ring_peek(&accel_ring, &s)) != 0) {
+			if (n > Q15_BLOCK)
+				n = Q15_BLOCK;
+			for (uint32_t i=0; i<n; i++) {
+				if (s[i].status & LIS302_SR_ZYXOR)
+					sensor_overrun++;
+			}
+			// low pass x and y so the LEDs do not flicker on noise
+			q15_from_samples(s, n, ax, ay, az);
+			q15_biquad_block(&tilt_lp[0], ax, ax, n);
+			q15_biquad_block(&tilt_lp[1], ay, ay, n);
+			rbuf[0] = ax[n-1];
+			rbuf[1] = ay[n-1];
+			rbuf[2] = az[n-1];
+			sample_ring_consume(&accel_ring, n);
+		}
 
-		if (rbuf[0] > 16) {
+		if (rbuf[0] > TILT_THRESHOLD) {
 			GPIOD->ODR &= (uint16_t)~0x2000;
 			GPIOD->ODR |= 0x8000;
-		} else if (rbuf[0] < -16 ) {
+		} else if (rbuf[0] < -TILT_THRESHOLD) {
 			GPIOD->ODR &= (uint16_t)~0x8000;
 			GPIOD->ODR |= 0x2000;
 		} else {
 			GPIOD->ODR &= (uint16_t)~0xA000;
 		}
 
-		if (rbuf[1] > 16) {
+		if (rbuf[1] > TILT_THRESHOLD) {
 			GPIOD->ODR &= (uint16_t)~0x1000;
 			GPIOD->ODR |= 0x4000;
-		} else if (rbuf[1] < -16 ) {
+		} else if (rbuf[1] < -TILT_THRESHOLD) {
 			GPIOD->ODR &= (uint16_t)~0x4000;
 			GPIOD->ODR |= 0x1000;
 		} else {
 			GPIOD->ODR &= (uint16_t)~0x5000;
 		}
 
-		for(int i=0; i<10000; i++);
+		// main loop is free for other work, sampling does not depend on it
 	}
 
 	return 0;
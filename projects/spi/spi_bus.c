@@ -0,0 +1,227 @@
+/*
+ * spi_bus.c
+ *
+ * description:
+ *   queued SPI master bus, see spi_bus.h
+ *
+ * transaction steps:
+ *   1. build CR1 from mode, frame width and clock divider, if it
+ *      differs from the last one disable SPI, write it and re-enable
+ *   2. pull the chip select low
+ *   3. program both DMA streams (memory increment only if there is
+ *      a buffer, otherwise a zero word is sent / a sink word is read)
+ *   4. set RXDMAEN, enable rx stream, enable tx stream, set TXDMAEN
+ *   5. on rx transfer complete wait for BSY to clear, release the chip
+ *      select, start the next queued transaction and then run the
+ *      callback of the finished one
+ */
+
+#include "stm32f4xx.h"
+#include "dma_stream.h"
+#include "spi_bus.h"
+
+/*************************************************
+* helpers
+*************************************************/
+static uint32_t xfer_cr1(const spi_xfer_t *x)
+{
+	uint32_t cr1 = 0;
+
+	// baud rate - BR[2:0] is bit 5:3, fPCLK / 2^(BR+1)
+	cr1 |= (uint32_t)(x->div & 0x7) << 3;
+	// 8/16-bit mode - DFF is bit 11
+	if (x->width == 16)
+		cr1 |= (1 << 11);
+	// clock polarity - CPOL bit 1, clock phase - CPHA bit 0
+	cr1 |= (uint32_t)(x->mode & 0x3);
+	// software slave management - SSM bit 9, internal slave select - SSI bit 8
+	cr1 |= (1 << 9) | (1 << 8);
+	// master config - MSTR bit 2
+	cr1 |= (1 << 2);
+
+	return cr1;
+}
+
+static void xfer_start(spi_bus_t *bus, spi_xfer_t *x)
+{
+	SPI_TypeDef *spi = bus->spi;
+	uint32_t cr1 = xfer_cr1(x);
+	uint32_t size = (x->width == 16) ? 0x1 : 0x0;
+	uint32_t cr;
+
+	x->state = SPI_XFER_ACTIVE;
+
+	// only touch CR1 when the device settings change
+	if (cr1 != bus->cr1) {
+		spi->CR1 &= (uint32_t)~(1 << 6); // disable SPI - SPE bit 6
+		spi->CR1 = cr1;
+		spi->CR1 |= (1 << 6);
+		bus->cr1 = cr1;
+		bus->reconfigs++;
+	}
+
+	// chip select low
+	x->cs_port->BSRR = (uint32_t)1 << (x->cs_pin + 16);
+
+	// common stream setup: channel, high priority, MSIZE/PSIZE
+	cr = ((uint32_t)bus->channel << 25) | (0x2 << 16) | (size << 13) | (size << 11);
+
+	dma_stream_clear(bus->dma, bus->rx_n, DMA_STREAM_FLAGS);
+	dma_stream_clear(bus->dma, bus->tx_n, DMA_STREAM_FLAGS);
+
+	// rx: peripheral-to-memory, transfer complete interrupt
+	bus->rx->CR = cr | (1 << 4) | (x->rx ? (1 << 10) : 0);
+	bus->rx->M0AR = x->rx ? (uint32_t)x->rx : (uint32_t)&bus->sink;
+	bus->rx->NDTR = x->len;
+
+	// tx: memory-to-peripheral
+	bus->tx->CR = cr | (0x1 << 6) | (x->tx ? (1 << 10) : 0);
+	bus->tx->M0AR = x->tx ? (uint32_t)x->tx : (uint32_t)&bus->zero;
+	bus->tx->NDTR = x->len;
+
+	spi->CR2 |= (1 << 0);        // RXDMAEN
+	bus->rx->CR |= (1 << 0);     // enable rx stream
+	bus->tx->CR |= (1 << 0);     // enable tx stream
+	spi->CR2 |= (1 << 1);        // TXDMAEN, starts clocking
+}
+
+/*************************************************
+* api
+*************************************************/
+
+/*
+ * attach the bus to an SPI port and its rx/tx DMA streams.
+ * SPI and DMA clocks and the SCK/MISO/MOSI pins are set up by the caller.
+ */
+void spi_bus_init(spi_bus_t *bus, SPI_TypeDef *spi, DMA_Stream_TypeDef *rx,
+                  DMA_Stream_TypeDef *tx, uint8_t channel)
+{
+	bus->spi = spi;
+	// rx and tx streams of an SPI port are on the same controller
+	bus->dma = dma_stream_dma(rx);
+	bus->rx = rx;
+	bus->tx = tx;
+	bus->rx_n = dma_stream_number(rx);
+	bus->tx_n = dma_stream_number(tx);
+	bus->channel = channel;
+	bus->head = 0;
+	bus->tail = 0;
+	bus->zero = 0;
+	bus->xfers = 0;
+	bus->reconfigs = 0;
+
+	// make sure both streams are off
+	rx->CR = 0;
+	while(rx->CR & (1 << 0));
+	tx->CR = 0;
+	while(tx->CR & (1 << 0));
+
+	rx->PAR = (uint32_t)&spi->DR;
+	tx->PAR = (uint32_t)&spi->DR;
+
+	// master with software slave management, the first transaction
+	// writes the rest of the configuration
+	spi->CR2 = 0;
+	spi->CR1 = (1 << 9) | (1 << 8) | (1 << 2);
+	bus->cr1 = spi->CR1;
+	spi->CR1 |= (1 << 6);
+}
+
+/*
+ * chip select pin as push-pull output, driven high (inactive)
+ * GPIO port clock has to be enabled by the caller
+ */
+void spi_bus_cs_setup(GPIO_TypeDef *port, uint8_t pin)
+{
+	port->BSRR = (uint32_t)1 << pin;
+	port->MODER &= ~((uint32_t)0x3 << (pin * 2));
+	port->MODER |= ((uint32_t)0x1 << (pin * 2));
+	port->OSPEEDR |= ((uint32_t)0x3 << (pin * 2));
+}
+
+/*
+ * queue a transaction, starts it right away if the bus is idle.
+ * safe from thread and interrupt context.
+ * returns 0 if the transaction is still queued or running from an
+ * earlier submit.
+ */
+int spi_bus_submit(spi_bus_t *bus, spi_xfer_t *x)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (x->state == SPI_XFER_QUEUED || x->state == SPI_XFER_ACTIVE) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+
+	x->next = 0;
+	x->state = SPI_XFER_QUEUED;
+
+	if (bus->head == 0) {
+		bus->head = x;
+		bus->tail = x;
+		xfer_start(bus, x);
+	} else {
+		bus->tail->next = x;
+		bus->tail = x;
+	}
+
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+/*
+ * queue a transaction and sleep until it is finished.
+ * not for interrupt context.
+ */
+void spi_bus_transfer(spi_bus_t *bus, spi_xfer_t *x)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	spi_bus_submit(bus, x);
+
+	// WFI wakes up on the pending interrupt even with PRIMASK set,
+	//   so the completion can not slip in between check and sleep
+	__disable_irq();
+	while (x->state != SPI_XFER_DONE) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__set_PRIMASK(primask);
+}
+
+int spi_bus_busy(const spi_bus_t *bus)
+{
+	return bus->head != 0;
+}
+
+/*
+ * rx stream transfer complete, call from the stream interrupt handler
+ */
+void spi_bus_irq(spi_bus_t *bus)
+{
+	spi_xfer_t *x = bus->head;
+
+	dma_stream_clear(bus->dma, bus->rx_n, DMA_STREAM_FLAGS);
+
+	if (x == 0)
+		return;
+
+	// last frame is in, wait for the shifter before releasing CS
+	while (bus->spi->SR & (1 << 7));
+	x->cs_port->BSRR = (uint32_t)1 << x->cs_pin;
+	bus->spi->CR2 &= (uint32_t)~((1 << 1) | (1 << 0));
+
+	bus->head = x->next;
+	if (bus->head == 0)
+		bus->tail = 0;
+	else
+		xfer_start(bus, bus->head);
+
+	bus->xfers++;
+	x->state = SPI_XFER_DONE;
+	if (x->done)
+		x->done(x);
+}
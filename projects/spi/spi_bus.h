@@ -0,0 +1,100 @@
+/*
+ * spi_bus.h
+ *
+ * description:
+ *   queued SPI master bus with one chip select per transaction.
+ *   several devices can share one SPI port, each transaction
+ *   carries its own chip select pin, mode, frame width and clock.
+ *
+ *   transactions are queued with spi_bus_submit and run back to back
+ *   from the RX DMA complete interrupt, so the caller never waits for
+ *   the bus. CR1 is only rewritten when a transaction needs a
+ *   different mode, width or clock than the one before it.
+ *
+ *   the spi_xfer_t belongs to the caller and must stay valid until
+ *   its callback runs (or state becomes SPI_XFER_DONE).
+ *   callbacks run in interrupt context.
+ *
+ *   DMA only reaches SRAM, so tx/rx buffers must not be on a stack
+ *   that may live in CCM. keep them static.
+ *
+ * usage:
+ *   // SPI1: rx on DMA2 stream 0, tx on DMA2 stream 3, channel 3
+ *   spi_bus_init(&bus, SPI1, DMA2_Stream0, DMA2_Stream3, 3);
+ *   spi_bus_cs_setup(GPIOE, 3);
+ *   NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+ *   ...
+ *   call spi_bus_irq(&bus) from the rx stream interrupt handler
+ */
+
+#ifndef __SPI_BUS_H
+#define __SPI_BUS_H
+
+#include "stm32f4xx.h"
+
+/* CPOL is bit 1, CPHA is bit 0 as in CR1 */
+#define SPI_BUS_MODE_0     0x0
+#define SPI_BUS_MODE_1     0x1
+#define SPI_BUS_MODE_2     0x2
+#define SPI_BUS_MODE_3     0x3
+
+/* clock is fPCLK / 2^(br + 1), BR[2:0] in CR1 */
+#define SPI_BUS_DIV_2      0x0
+#define SPI_BUS_DIV_4      0x1
+#define SPI_BUS_DIV_8      0x2
+#define SPI_BUS_DIV_16     0x3
+#define SPI_BUS_DIV_32     0x4
+#define SPI_BUS_DIV_64     0x5
+#define SPI_BUS_DIV_128    0x6
+#define SPI_BUS_DIV_256    0x7
+
+/* transaction state */
+#define SPI_XFER_IDLE      0
+#define SPI_XFER_QUEUED    1
+#define SPI_XFER_ACTIVE    2
+#define SPI_XFER_DONE      3
+
+typedef struct spi_xfer spi_xfer_t;
+typedef void (*spi_xfer_cb_t)(spi_xfer_t *x);
+
+struct spi_xfer {
+	GPIO_TypeDef *cs_port;   /* chip select port, active low      */
+	uint8_t cs_pin;          /* chip select pin 0-15              */
+	uint8_t mode;            /* SPI_BUS_MODE_x                    */
+	uint8_t width;           /* 8 or 16 bit frames                */
+	uint8_t div;             /* SPI_BUS_DIV_x                     */
+	const void *tx;          /* len frames, 0 sends zeros         */
+	void *rx;                /* len frames, 0 throws them away    */
+	uint16_t len;            /* number of frames                  */
+	spi_xfer_cb_t done;      /* optional completion callback      */
+	void *ctx;               /* free for the callback             */
+	volatile uint8_t state;  /* SPI_XFER_x                        */
+	spi_xfer_t *next;        /* queue link, owned by the bus      */
+};
+
+typedef struct {
+	SPI_TypeDef *spi;
+	DMA_TypeDef *dma;
+	DMA_Stream_TypeDef *rx;
+	DMA_Stream_TypeDef *tx;
+	uint8_t rx_n;            /* rx stream number 0-7              */
+	uint8_t tx_n;            /* tx stream number 0-7              */
+	uint8_t channel;         /* DMA channel of both streams       */
+	uint32_t cr1;            /* CR1 of the last transaction       */
+	spi_xfer_t *head;        /* running transaction               */
+	spi_xfer_t *tail;        /* last queued transaction           */
+	uint32_t zero;           /* tx filler without a tx buffer     */
+	uint32_t sink;           /* rx target without an rx buffer    */
+	uint32_t xfers;          /* finished transactions             */
+	uint32_t reconfigs;      /* CR1 rewrites                      */
+} spi_bus_t;
+
+void spi_bus_init(spi_bus_t *bus, SPI_TypeDef *spi, DMA_Stream_TypeDef *rx,
+                  DMA_Stream_TypeDef *tx, uint8_t channel);
+void spi_bus_cs_setup(GPIO_TypeDef *port, uint8_t pin);
+int  spi_bus_submit(spi_bus_t *bus, spi_xfer_t *x);
+void spi_bus_transfer(spi_bus_t *bus, spi_xfer_t *x);
+int  spi_bus_busy(const spi_bus_t *bus);
+void spi_bus_irq(spi_bus_t *bus);
+
+#endif
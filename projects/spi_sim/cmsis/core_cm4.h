@@ -0,0 +1,162 @@
+/*
+ * core_cm4.h (host simulator)
+ *
+ * description:
+ *   stands in for the CMSIS Cortex-M4 core header when target code is
+ *   built for the host simulator. core peripherals keep their real
+ *   addresses (the simulator maps them), the intrinsics that touch the
+ *   processor state are routed into the simulator instead.
+ *
+ *   only the parts used by the drivers in this tree are provided.
+ */
+
+#ifndef __CORE_CM4_H_GENERIC
+#define __CORE_CM4_H_GENERIC
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#ifdef __cplusplus
+  #define   __I     volatile
+#else
+  #define   __I     volatile const
+#endif
+#define     __O     volatile
+#define     __IO    volatile
+#define     __IM    volatile const
+#define     __OM    volatile
+#define     __IOM   volatile
+
+#define __STATIC_INLINE  static inline
+#define __ASM            __asm__
+#define __WEAK           __attribute__((weak))
+#define __ALIGNED(x)     __attribute__((aligned(x)))
+
+#ifndef __FPU_USED
+#define __FPU_USED       1U
+#endif
+
+/* core peripherals, same layout and addresses as CMSIS */
+typedef struct
+{
+  __IOM uint32_t ISER[8U];
+        uint32_t RESERVED0[24U];
+  __IOM uint32_t ICER[8U];
+        uint32_t RSERVED1[24U];
+  __IOM uint32_t ISPR[8U];
+        uint32_t RESERVED2[24U];
+  __IOM uint32_t ICPR[8U];
+        uint32_t RESERVED3[24U];
+  __IOM uint32_t IABR[8U];
+        uint32_t RESERVED4[56U];
+  __IOM uint8_t  IP[240U];
+        uint32_t RESERVED5[644U];
+  __OM  uint32_t STIR;
+} NVIC_Type;
+
+typedef struct
+{
+  __IM  uint32_t CPUID;
+  __IOM uint32_t ICSR;
+  __IOM uint32_t VTOR;
+  __IOM uint32_t AIRCR;
+  __IOM uint32_t SCR;
+  __IOM uint32_t CCR;
+  __IOM uint8_t  SHP[12U];
+  __IOM uint32_t SHCSR;
+  __IOM uint32_t CFSR;
+  __IOM uint32_t HFSR;
+  __IOM uint32_t DFSR;
+  __IOM uint32_t MMFAR;
+  __IOM uint32_t BFAR;
+  __IOM uint32_t AFSR;
+  __IM  uint32_t PFR[2U];
+  __IM  uint32_t DFR;
+  __IM  uint32_t ADR;
+  __IM  uint32_t MMFR[4U];
+  __IM  uint32_t ISAR[5U];
+        uint32_t RESERVED0[5U];
+  __IOM uint32_t CPACR;
+} SCB_Type;
+
+typedef struct
+{
+  __IOM uint32_t CTRL;
+  __IOM uint32_t LOAD;
+  __IOM uint32_t VAL;
+  __IM  uint32_t CALIB;
+} SysTick_Type;
+
+typedef struct
+{
+  __IOM uint32_t CTRL;
+  __IOM uint32_t CYCCNT;
+  __IOM uint32_t CPICNT;
+  __IOM uint32_t EXCCNT;
+  __IOM uint32_t SLEEPCNT;
+  __IOM uint32_t LSUCNT;
+  __IOM uint32_t FOLDCNT;
+  __IM  uint32_t PCSR;
+} DWT_Type;
+
+typedef struct
+{
+  __IOM uint32_t DHCSR;
+  __OM  uint32_t DCRSR;
+  __IOM uint32_t DCRDR;
+  __IOM uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define SCS_BASE            (0xE000E000UL)
+#define DWT_BASE            (0xE0001000UL)
+#define CoreDebug_BASE      (0xE000EDF0UL)
+#define SysTick_BASE        (SCS_BASE +  0x0010UL)
+#define NVIC_BASE           (SCS_BASE +  0x0100UL)
+#define SCB_BASE            (SCS_BASE +  0x0D00UL)
+
+#define SCB                 ((SCB_Type       *)     SCB_BASE      )
+#define SysTick             ((SysTick_Type   *)     SysTick_BASE  )
+#define NVIC                ((NVIC_Type      *)     NVIC_BASE     )
+#define DWT                 ((DWT_Type       *)     DWT_BASE      )
+#define CoreDebug           ((CoreDebug_Type *)     CoreDebug_BASE)
+
+#define DWT_CTRL_CYCCNTENA_Msk          (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1UL << 24U)
+
+/* processor state, implemented by the simulator */
+void     sim_irq_enable(void);
+void     sim_irq_disable(void);
+uint32_t sim_get_primask(void);
+void     sim_set_primask(uint32_t v);
+void     sim_wfi(void);
+void     sim_nvic_enable(int irqn);
+void     sim_nvic_disable(int irqn);
+void     sim_nvic_set_priority(int irqn, uint32_t prio);
+
+__STATIC_INLINE void __enable_irq(void)            { sim_irq_enable(); }
+__STATIC_INLINE void __disable_irq(void)           { sim_irq_disable(); }
+__STATIC_INLINE uint32_t __get_PRIMASK(void)       { return sim_get_primask(); }
+__STATIC_INLINE void __set_PRIMASK(uint32_t v)     { sim_set_primask(v); }
+__STATIC_INLINE void __WFI(void)                   { sim_wfi(); }
+__STATIC_INLINE void __WFE(void)                   { sim_wfi(); }
+__STATIC_INLINE void __NOP(void)                   { }
+__STATIC_INLINE void __DSB(void)                   { __sync_synchronize(); }
+__STATIC_INLINE void __ISB(void)                   { __sync_synchronize(); }
+__STATIC_INLINE void __DMB(void)                   { __sync_synchronize(); }
+__STATIC_INLINE uint32_t __CLZ(uint32_t v)         { return v ? (uint32_t)__builtin_clz(v) : 32U; }
+
+__STATIC_INLINE void NVIC_EnableIRQ(IRQn_Type IRQn)  { sim_nvic_enable((int)IRQn); }
+__STATIC_INLINE void NVIC_DisableIRQ(IRQn_Type IRQn) { sim_nvic_disable((int)IRQn); }
+__STATIC_INLINE void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority)
+{
+  sim_nvic_set_priority((int)IRQn, priority);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CORE_CM4_H_GENERIC */
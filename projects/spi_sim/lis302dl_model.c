@@ -0,0 +1,267 @@
+/*
+ * lis302dl_model.c
+ *
+ * description:
+ *   LIS302DL model, see lis302dl_model.h
+ *   register addresses and bits come from the driver header
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LIS302DL_REGS_ONLY
+#include "lis302dl.h"
+#include "lis302dl_model.h"
+
+/* STATUS_REG per axis bits next to ZYXDA / ZYXOR */
+#define SR_DA_ALL   0x0F
+#define SR_OR_ALL   0xF0
+
+/* I1CFG[2:0] in CTRL_REG3 */
+#define CR3_I1CFG   0x07
+
+/*************************************************
+* motion
+*************************************************/
+static int16_t lerp(int16_t a, int16_t b, uint64_t t, uint64_t t0, uint64_t t1)
+{
+	if (t1 <= t0)
+		return b;
+	return (int16_t)(a + ((int64_t)(b - a) * (int64_t)(t - t0)) / (int64_t)(t1 - t0));
+}
+
+static void motion_at(const lis302_model_t *m, uint64_t ns, int16_t mg[3])
+{
+	uint64_t t = (ns - m->t0) / 1000;  // us
+	int i;
+
+	if (m->nkeys == 0) {
+		mg[0] = 0;
+		mg[1] = 0;
+		mg[2] = 1000;
+		return;
+	}
+	// hold the last keyframe
+	mg[0] = m->keys[m->nkeys - 1].x;
+	mg[1] = m->keys[m->nkeys - 1].y;
+	mg[2] = m->keys[m->nkeys - 1].z;
+
+	for (i = 0; i < m->nkeys; i++) {
+		const lis302_key_t *k = &m->keys[i];
+		uint64_t tk = (uint64_t)k->t_ms * 1000;
+		if (t < tk) {
+			const lis302_key_t *p = (i > 0) ? &m->keys[i - 1] : k;
+			uint64_t tp = (uint64_t)p->t_ms * 1000;
+			mg[0] = lerp(p->x, k->x, t, tp, tk);
+			mg[1] = lerp(p->y, k->y, t, tp, tk);
+			mg[2] = lerp(p->z, k->z, t, tp, tk);
+			return;
+		}
+	}
+}
+
+// 18 mg/digit at +/-2g, 72 mg/digit at +/-8g
+static int8_t to_digits(int16_t mg, int fs8g)
+{
+	int sens = fs8g ? 72 : 18;
+	int v = (mg >= 0) ? (mg + sens / 2) / sens : -((-mg + sens / 2) / sens);
+
+	if (v > 127)
+		v = 127;
+	if (v < -128)
+		v = -128;
+	return (int8_t)v;
+}
+
+/*************************************************
+* sampling
+*************************************************/
+static uint64_t sample_period(const lis302_model_t *m)
+{
+	return (m->regs[LIS302_REG_CTRL_REG1] & LIS302_CR1_DR_400HZ) ? 2500000ULL : 10000000ULL;
+}
+
+static void update_int1(lis302_model_t *m)
+{
+	int level = ((m->regs[LIS302_REG_CTRL_REG3] & CR3_I1CFG) == LIS302_CR3_I1_DRDY) &&
+	            (m->regs[LIS302_REG_STATUS_REG] & LIS302_SR_ZYXDA);
+	sim_gpio_set_input(GPIOE, 0, level);
+}
+
+static void log_sample(lis302_model_t *m, uint8_t overrun)
+{
+	lis302_truth_t *e;
+
+	if (m->count == m->cap) {
+		m->cap = m->cap ? m->cap * 2 : 1024;
+		m->log = realloc(m->log, m->cap * sizeof(*m->log));
+		if (!m->log) {
+			perror("lis302dl model");
+			exit(2);
+		}
+	}
+	e = &m->log[m->count++];
+	e->cycles = sim_cyccnt();
+	e->x = (int8_t)m->regs[LIS302_REG_OUT_X];
+	e->y = (int8_t)m->regs[LIS302_REG_OUT_Y];
+	e->z = (int8_t)m->regs[LIS302_REG_OUT_Z];
+	e->overrun = overrun;
+}
+
+static void sample(void *ctx)
+{
+	lis302_model_t *m = ctx;
+	uint8_t cr1 = m->regs[LIS302_REG_CTRL_REG1];
+	int fs = (cr1 & LIS302_CR1_FS) != 0;
+	uint8_t *sr = &m->regs[LIS302_REG_STATUS_REG];
+	uint8_t overrun = 0;
+	int16_t mg[3];
+
+	motion_at(m, sim_now(), mg);
+	m->regs[LIS302_REG_OUT_X] = (cr1 & LIS302_CR1_XEN) ? (uint8_t)to_digits(mg[0], fs) : 0;
+	m->regs[LIS302_REG_OUT_Y] = (cr1 & LIS302_CR1_YEN) ? (uint8_t)to_digits(mg[1], fs) : 0;
+	m->regs[LIS302_REG_OUT_Z] = (cr1 & LIS302_CR1_ZEN) ? (uint8_t)to_digits(mg[2], fs) : 0;
+
+	if (*sr & LIS302_SR_ZYXDA) {
+		*sr |= SR_OR_ALL;
+		overrun = 1;
+	}
+	*sr |= SR_DA_ALL;
+
+	log_sample(m, overrun);
+	update_int1(m);
+	sim_schedule(sim_now() + sample_period(m), sample, m);
+}
+
+/*************************************************
+* registers
+*************************************************/
+static uint8_t reg_read(lis302_model_t *m, uint8_t a)
+{
+	uint8_t v = m->regs[a];
+
+	// reading the last output clears the data ready state
+	if (a == LIS302_REG_OUT_Z) {
+		m->regs[LIS302_REG_STATUS_REG] &= (uint8_t)~(SR_DA_ALL | SR_OR_ALL);
+		update_int1(m);
+	}
+	return v;
+}
+
+static void reg_write(lis302_model_t *m, uint8_t a, uint8_t v)
+{
+	uint8_t old = m->regs[a];
+
+	if (!((a >= LIS302_REG_CTRL_REG1 && a <= LIS302_REG_CTRL_REG3) || (a >= 0x30 && a <= 0x3F))) {
+		sim_error("lis302dl: write 0x%02x to read only register 0x%02x", v, a);
+		return;
+	}
+
+	if (a == LIS302_REG_CTRL_REG2 && (v & LIS302_CR2_BOOT)) {
+		// trimming reload, the bit clears itself
+		v &= (uint8_t)~LIS302_CR2_BOOT;
+	}
+	m->regs[a] = v;
+
+	if (a == LIS302_REG_CTRL_REG1 && ((old ^ v) & (LIS302_CR1_PD | LIS302_CR1_DR_400HZ))) {
+		sim_cancel(sample, m);
+		if (v & LIS302_CR1_PD) {
+			sim_schedule(sim_now() + sample_period(m), sample, m);
+		} else {
+			m->regs[LIS302_REG_STATUS_REG] = 0;
+			update_int1(m);
+		}
+	}
+	if (a == LIS302_REG_CTRL_REG3)
+		update_int1(m);
+}
+
+/*************************************************
+* SPI
+*************************************************/
+static void spi_select(void *dev, int active)
+{
+	lis302_model_t *m = dev;
+	m->selected = active;
+	m->nbyte = 0;
+}
+
+static uint8_t spi_xfer(void *dev, uint8_t mosi)
+{
+	lis302_model_t *m = dev;
+	uint8_t miso = 0;
+
+	if (m->nbyte++ == 0) {
+		m->read = (mosi & LIS302_READ) != 0;
+		m->inc = (mosi & LIS302_AUTO_INC) != 0;
+		m->addr = mosi & 0x3F;
+		return 0;
+	}
+
+	if (m->read)
+		miso = reg_read(m, m->addr);
+	else
+		reg_write(m, m->addr, mosi);
+
+	if (m->inc)
+		m->addr = (m->addr + 1) & 0x3F;
+	return miso;
+}
+
+void lis302_model_init(lis302_model_t *m, const lis302_key_t *keys, int nkeys)
+{
+	m->regs[LIS302_REG_WHO_AM_I] = LIS302_WHO_AM_I_VALUE;
+	m->regs[LIS302_REG_CTRL_REG1] = LIS302_CR1_ZEN | LIS302_CR1_YEN | LIS302_CR1_XEN;
+	m->keys = keys;
+	m->nkeys = nkeys;
+	m->t0 = sim_now();
+
+	m->spi.name = "lis302dl";
+	m->spi.cs_port = GPIOE;
+	m->spi.cs_pin = 3;
+	m->spi.modes = (1 << 0) | (1 << 3);
+	m->spi.max_hz = 10000000;
+	m->spi.select = spi_select;
+	m->spi.xfer = spi_xfer;
+	m->spi.dev = m;
+	sim_spi_attach(&m->spi);
+}
+
+/*
+ * motion script from a text file, one keyframe per line:
+ *   t_ms x_mg y_mg z_mg
+ * returns the number of keyframes, -1 if the file can not be read
+ */
+int lis302_model_load(const char *path, lis302_key_t **keys)
+{
+	FILE *f = fopen(path, "r");
+	lis302_key_t *k = 0;
+	int n = 0, cap = 0;
+	unsigned int t;
+	int x, y, z;
+	char line[128];
+
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || sscanf(line, "%u %d %d %d", &t, &x, &y, &z) != 4)
+			continue;
+		if (n == cap) {
+			cap = cap ? cap * 2 : 16;
+			k = realloc(k, (size_t)cap * sizeof(*k));
+			if (!k) {
+				fclose(f);
+				return -1;
+			}
+		}
+		k[n].t_ms = t;
+		k[n].x = (int16_t)x;
+		k[n].y = (int16_t)y;
+		k[n].z = (int16_t)z;
+		n++;
+	}
+	fclose(f);
+	*keys = k;
+	return n;
+}
@@ -0,0 +1,65 @@
+/*
+ * lis302dl_model.h
+ *
+ * description:
+ *   behavioural model of the LIS302DL accelerometer for the simulator.
+ *   SPI byte protocol (address byte with read and auto increment bits,
+ *   then data), WHO_AM_I, CTRL_REG1-3, STATUS_REG and OUT_X/Y/Z.
+ *
+ *   while CTRL_REG1 PD is set a sample is taken every 2.5 ms (400 Hz)
+ *   or 10 ms (100 Hz) from a scripted motion: keyframes in mg, linear
+ *   in between. every sample is kept in a truth log with the cycle
+ *   counter value of its data ready edge, so the harness can check
+ *   what the driver stored.
+ *
+ *   data ready goes to INT1 (PE0) when I1CFG in CTRL_REG3 is 100,
+ *   it stays high until OUT_Z is read. a sample that replaces one
+ *   that was never read sets ZYXOR.
+ */
+
+#ifndef __LIS302DL_MODEL_H
+#define __LIS302DL_MODEL_H
+
+#include <stdint.h>
+#include "sim.h"
+
+/* one point of the motion script, acceleration in mg */
+typedef struct {
+	uint32_t t_ms;
+	int16_t x;
+	int16_t y;
+	int16_t z;
+} lis302_key_t;
+
+/* one produced sample */
+typedef struct {
+	uint32_t cycles;    /* cycle counter at the data ready edge */
+	int8_t x;
+	int8_t y;
+	int8_t z;
+	uint8_t overrun;    /* it overwrote an unread sample        */
+} lis302_truth_t;
+
+typedef struct {
+	uint8_t regs[0x40];
+	/* SPI state */
+	int selected;
+	int nbyte;
+	uint8_t addr;
+	uint8_t read;
+	uint8_t inc;
+	/* motion script */
+	const lis302_key_t *keys;
+	int nkeys;
+	uint64_t t0;        /* script time zero (ns) */
+	/* truth log */
+	lis302_truth_t *log;
+	uint32_t count;
+	uint32_t cap;
+	sim_spi_dev_t spi;
+} lis302_model_t;
+
+void lis302_model_init(lis302_model_t *m, const lis302_key_t *keys, int nkeys);
+int  lis302_model_load(const char *path, lis302_key_t **keys);
+
+#endif
@@ -0,0 +1,968 @@
+/*
+ * sim.c
+ *
+ * description:
+ *   peripheral and interrupt simulation, see sim.h
+ *
+ * register access steps:
+ *   1. the driver touches a register on a protected page, SIGSEGV
+ *   2. reads: the model computes the register value first (SR, IDR,
+ *      CYCCNT, ...) and stores it through a writable alias mapping
+ *   3. the page is opened and the trap flag set, the instruction runs
+ *   4. SIGTRAP after the instruction: the page is closed again, writes
+ *      are handed to the model with the old and the new value
+ *   5. events that are due by now (transfer ends, sensor samples) run
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stm32f4xx.h"
+#include "sim.h"
+
+/*************************************************
+* memory
+*************************************************/
+#define PAGE_SIZE_SIM   0x1000UL
+
+typedef struct {
+	uintptr_t base;
+	size_t size;
+	uint8_t *alias;  // writable view of the same memory
+} region_t;
+
+static region_t regions[2] = {
+	{ 0x40000000UL, 0x00080000UL, 0 },  // APB1, APB2, AHB1
+	{ 0xE0000000UL, 0x00100000UL, 0 },  // private peripheral bus
+};
+
+// pages holding modelled registers
+static const uintptr_t trap_pages[] = {
+	0x40013000UL,  // SPI1, SYSCFG, EXTI
+	0x40020000UL,  // GPIOA-D
+	0x40021000UL,  // GPIOE-H
+	0x40026000UL,  // DMA1, DMA2
+	0xE0001000UL,  // DWT
+};
+
+// linker provided bounds of the executable image
+extern char __executable_start[];
+extern char _end[];
+
+static volatile uint32_t *alias32(uintptr_t addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+		if (addr >= regions[i].base && addr < regions[i].base + regions[i].size)
+			return (volatile uint32_t *)(regions[i].alias + (addr - regions[i].base));
+	}
+	fprintf(stderr, "sim: no region for 0x%08lx\n", (unsigned long)addr);
+	abort();
+}
+
+// model side access to a register, never traps
+#define REG(a) (*alias32((uintptr_t)(a)))
+
+static int is_trap_page(uintptr_t page)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(trap_pages) / sizeof(trap_pages[0]); i++) {
+		if (trap_pages[i] == page)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * target address of a DMA transfer back to a host pointer.
+ * only the static data of the image is accepted, a stack or heap
+ * buffer would not fit in 32 bits and is a bug on target as well.
+ */
+static void *dma_mem(uint32_t addr, uint32_t bytes)
+{
+	uintptr_t a = addr;
+
+	if (a < (uintptr_t)__executable_start || a + bytes > (uintptr_t)_end) {
+		sim_error("DMA memory address 0x%08x is not static data", addr);
+		return 0;
+	}
+	return (void *)a;
+}
+
+/*************************************************
+* time and events
+*************************************************/
+#define MAX_EVENTS 32
+
+typedef struct {
+	uint64_t t;
+	sim_event_fn fn;
+	void *ctx;
+	int used;
+} event_t;
+
+static uint64_t now_ns;
+static event_t events[MAX_EVENTS];
+
+sim_stats_t sim_stats;
+
+uint64_t sim_now(void)
+{
+	return now_ns;
+}
+
+uint32_t sim_ns_to_cycles(uint64_t ns)
+{
+	return (uint32_t)(ns * SIM_SYSCLK_HZ / 1000000000ULL);
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void sim_error(const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "sim: error at %llu ns: ", (unsigned long long)now_ns);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	sim_stats.errors++;
+}
+
+void sim_schedule(uint64_t t, sim_event_fn fn, void *ctx)
+{
+	int i;
+
+	for (i = 0; i < MAX_EVENTS; i++) {
+		if (!events[i].used) {
+			events[i].t = t;
+			events[i].fn = fn;
+			events[i].ctx = ctx;
+			events[i].used = 1;
+			return;
+		}
+	}
+	fprintf(stderr, "sim: event queue full\n");
+	abort();
+}
+
+void sim_cancel(sim_event_fn fn, void *ctx)
+{
+	int i;
+
+	for (i = 0; i < MAX_EVENTS; i++) {
+		if (events[i].used && events[i].fn == fn && events[i].ctx == ctx)
+			events[i].used = 0;
+	}
+}
+
+// earliest pending event, -1 if there is none
+static int next_event(void)
+{
+	int i, n = -1;
+
+	for (i = 0; i < MAX_EVENTS; i++) {
+		if (events[i].used && (n < 0 || events[i].t < events[n].t))
+			n = i;
+	}
+	return n;
+}
+
+// run everything that is due, events may schedule new ones
+static void process_events(void)
+{
+	int n;
+
+	while ((n = next_event()) >= 0 && events[n].t <= now_ns) {
+		events[n].used = 0;
+		events[n].fn(events[n].ctx);
+	}
+}
+
+/*************************************************
+* GPIO
+*************************************************/
+#define GPIO_PORTS 5
+
+static GPIO_TypeDef *const gpio_ports[GPIO_PORTS] = { GPIOA, GPIOB, GPIOC, GPIOD, GPIOE };
+static uint16_t gpio_in[GPIO_PORTS];  // externally driven levels
+
+#define MAX_SPI_DEVS 8
+static sim_spi_dev_t *spi_devs[MAX_SPI_DEVS];
+static int spi_dev_count;
+
+static void exti_edge(int port, int pin, int rising);
+
+static int gpio_index(const GPIO_TypeDef *port)
+{
+	int i;
+
+	for (i = 0; i < GPIO_PORTS; i++) {
+		if (gpio_ports[i] == port)
+			return i;
+	}
+	return -1;
+}
+
+// pins configured as outputs, MODER 01
+static uint16_t gpio_outputs(int p)
+{
+	uint32_t moder = REG(&gpio_ports[p]->MODER);
+	uint16_t out = 0;
+	int pin;
+
+	for (pin = 0; pin < 16; pin++) {
+		if (((moder >> (pin * 2)) & 0x3) == 0x1)
+			out |= (uint16_t)(1 << pin);
+	}
+	return out;
+}
+
+static uint16_t gpio_idr(int p)
+{
+	uint16_t out = gpio_outputs(p);
+	uint16_t odr = (uint16_t)REG(&gpio_ports[p]->ODR);
+	return (uint16_t)((odr & out) | (gpio_in[p] & ~out));
+}
+
+static void gpio_odr_changed(int p, uint16_t old, uint16_t odr)
+{
+	uint16_t changed = old ^ odr;
+	int i;
+
+	for (i = 0; i < spi_dev_count; i++) {
+		sim_spi_dev_t *d = spi_devs[i];
+		if (gpio_index(d->cs_port) == p && (changed & (1 << d->cs_pin)))
+			d->select(d->dev, !(odr & (1 << d->cs_pin)));
+	}
+}
+
+void sim_gpio_set_input(GPIO_TypeDef *port, uint8_t pin, int level)
+{
+	int p = gpio_index(port);
+	uint16_t bit = (uint16_t)(1 << pin);
+	uint16_t old = gpio_in[p];
+
+	if (level)
+		gpio_in[p] |= bit;
+	else
+		gpio_in[p] &= (uint16_t)~bit;
+
+	if ((old ^ gpio_in[p]) & bit & ~gpio_outputs(p))
+		exti_edge(p, pin, level);
+}
+
+static void gpio_read(int p, uintptr_t off)
+{
+	if (off == offsetof(GPIO_TypeDef, IDR))
+		REG(&gpio_ports[p]->IDR) = gpio_idr(p);
+}
+
+static void gpio_write(int p, uintptr_t off, uint32_t old, uint32_t val)
+{
+	GPIO_TypeDef *g = gpio_ports[p];
+
+	if (off == offsetof(GPIO_TypeDef, BSRR)) {
+		uint16_t odr = (uint16_t)REG(&g->ODR);
+		uint16_t prev = odr;
+		// set wins over reset
+		odr &= (uint16_t)~(val >> 16);
+		odr |= (uint16_t)val;
+		REG(&g->ODR) = odr;
+		REG(&g->BSRR) = 0;
+		gpio_odr_changed(p, prev, odr);
+	} else if (off == offsetof(GPIO_TypeDef, ODR)) {
+		gpio_odr_changed(p, (uint16_t)old, (uint16_t)val);
+	} else if (off == offsetof(GPIO_TypeDef, IDR)) {
+		REG(&g->IDR) = old;  // read only
+	}
+}
+
+/*************************************************
+* EXTI
+*************************************************/
+static void exti_edge(int port, int pin, int rising)
+{
+	uint32_t sel = (REG(&SYSCFG->EXTICR[pin / 4]) >> ((pin % 4) * 4)) & 0xF;
+	uint32_t bit = (uint32_t)1 << pin;
+
+	if ((int)sel != port)
+		return;
+	if (!((rising ? REG(&EXTI->RTSR) : REG(&EXTI->FTSR)) & bit))
+		return;
+	if (REG(&EXTI->IMR) & bit)
+		REG(&EXTI->PR) |= bit;
+}
+
+static void exti_write(uintptr_t off, uint32_t old, uint32_t val)
+{
+	if (off == offsetof(EXTI_TypeDef, PR)) {
+		REG(&EXTI->PR) = old & ~val;  // write one to clear
+	} else if (off == offsetof(EXTI_TypeDef, SWIER)) {
+		REG(&EXTI->PR) |= val & REG(&EXTI->IMR);
+		REG(&EXTI->SWIER) = 0;
+	}
+}
+
+/*************************************************
+* DMA
+*************************************************/
+static DMA_TypeDef *const dma_ctrl[2] = { DMA1, DMA2 };
+static const uint8_t dma_flag_shift[4] = {0, 6, 16, 22};
+
+#define DMA_TCIF  0x20
+#define DMA_HTIF  0x10
+#define DMA_TEIF  0x08
+
+static DMA_Stream_TypeDef *dma_stream(int d, int n)
+{
+	return (DMA_Stream_TypeDef *)((uintptr_t)dma_ctrl[d] + 0x10 + 0x18 * (uintptr_t)n);
+}
+
+static uint32_t dma_flags(int d, int n)
+{
+	uint32_t isr = (n < 4) ? REG(&dma_ctrl[d]->LISR) : REG(&dma_ctrl[d]->HISR);
+	return (isr >> dma_flag_shift[n & 3]) & 0x3D;
+}
+
+static void dma_set_flags(int d, int n, uint32_t flags)
+{
+	volatile uint32_t *isr = (n < 4) ? &REG(&dma_ctrl[d]->LISR) : &REG(&dma_ctrl[d]->HISR);
+	*isr |= flags << dma_flag_shift[n & 3];
+}
+
+static int dma_irq_requested(int d, int n)
+{
+	uint32_t cr = REG(&dma_stream(d, n)->CR);
+	uint32_t f = dma_flags(d, n);
+
+	return ((f & DMA_TCIF) && (cr & (1 << 4))) ||
+	       ((f & DMA_HTIF) && (cr & (1 << 3))) ||
+	       ((f & DMA_TEIF) && (cr & (1 << 2)));
+}
+
+static void dma_write(int d, uintptr_t off, uint32_t old, uint32_t val)
+{
+	DMA_TypeDef *dma = dma_ctrl[d];
+
+	if (off == offsetof(DMA_TypeDef, LIFCR) || off == offsetof(DMA_TypeDef, HIFCR)) {
+		volatile uint32_t *isr = (off == offsetof(DMA_TypeDef, LIFCR)) ?
+		                         &REG(&dma->LISR) : &REG(&dma->HISR);
+		*isr &= ~val;
+		REG((uintptr_t)dma + off) = 0;
+		return;
+	}
+	if (off == offsetof(DMA_TypeDef, LISR) || off == offsetof(DMA_TypeDef, HISR)) {
+		REG((uintptr_t)dma + off) = old;  // read only
+		return;
+	}
+
+	// stream registers
+	if (off >= 0x10 && off < 0x10 + 8 * 0x18) {
+		int n = (int)((off - 0x10) / 0x18);
+		if ((off - 0x10) % 0x18 == 0 && !(old & 1) && (val & 1) && dma_flags(d, n))
+			sim_error("DMA%d stream %d enabled with event flags still set", d + 1, n);
+		if ((off - 0x10) % 0x18 != 0 && (REG(&dma_stream(d, n)->CR) & 1) &&
+		    (off - 0x10) % 0x18 != offsetof(DMA_Stream_TypeDef, FCR))
+			sim_error("DMA%d stream %d reprogrammed while enabled", d + 1, n);
+	}
+}
+
+/*************************************************
+* SPI1
+*************************************************/
+static struct {
+	uint32_t rx;      // last received frame
+	int rxne;
+	int busy;         // DMA transfer is clocking
+	int rx_stream;    // DMA2 streams of the running transfer
+	int tx_stream;
+} spi1;
+
+static sim_spi_dev_t *spi_selected(void)
+{
+	sim_spi_dev_t *sel = 0;
+	int i;
+
+	for (i = 0; i < spi_dev_count; i++) {
+		sim_spi_dev_t *d = spi_devs[i];
+		int p = gpio_index(d->cs_port);
+		if ((gpio_outputs(p) & (1 << d->cs_pin)) &&
+		    !(REG(&d->cs_port->ODR) & (1 << d->cs_pin))) {
+			if (sel)
+				sim_error("SPI1 devices %s and %s selected at once", sel->name, d->name);
+			sel = d;
+		}
+	}
+	return sel;
+}
+
+static uint64_t spi_frame_ns(uint32_t cr1)
+{
+	uint64_t bits = (cr1 & (1 << 11)) ? 16 : 8;
+	uint64_t div = 2ULL << ((cr1 >> 3) & 0x7);
+	return bits * div * 1000000000ULL / SIM_PCLK2_HZ;
+}
+
+// one frame on the wire, returns MISO
+static uint32_t spi_frame(uint32_t mosi)
+{
+	uint32_t cr1 = REG(&SPI1->CR1);
+	sim_spi_dev_t *d = spi_selected();
+	uint32_t mode = cr1 & 0x3;
+	uint32_t hz = (uint32_t)(SIM_PCLK2_HZ >> (((cr1 >> 3) & 0x7) + 1));
+
+	sim_stats.spi_frames++;
+
+	if (!(cr1 & (1 << 6)))
+		sim_error("SPI1 frame with SPE clear");
+	if (!(cr1 & (1 << 2)))
+		sim_error("SPI1 frame without MSTR");
+	if (d == 0) {
+		sim_error("SPI1 frame 0x%04x with no device selected", mosi);
+		return 0xFFFF;
+	}
+	if (!(d->modes & (1 << mode)))
+		sim_error("%s: SPI mode %u not supported", d->name, mode);
+	if (hz > d->max_hz)
+		sim_error("%s: SCK %u Hz above %u Hz", d->name, hz, d->max_hz);
+	if (cr1 & (1 << 7))
+		sim_error("%s: LSB first not supported", d->name);
+
+	if (cr1 & (1 << 11)) {
+		uint32_t hi = d->xfer(d->dev, (uint8_t)(mosi >> 8));
+		uint32_t lo = d->xfer(d->dev, (uint8_t)mosi);
+		return (hi << 8) | lo;
+	}
+	return d->xfer(d->dev, (uint8_t)mosi);
+}
+
+static void spi_dma_done(void *ctx)
+{
+	DMA_Stream_TypeDef *rx = dma_stream(1, spi1.rx_stream);
+	DMA_Stream_TypeDef *tx = dma_stream(1, spi1.tx_stream);
+	(void)ctx;
+
+	REG(&rx->NDTR) = 0;
+	REG(&tx->NDTR) = 0;
+	REG(&rx->CR) &= ~1u;
+	REG(&tx->CR) &= ~1u;
+	dma_set_flags(1, spi1.rx_stream, DMA_TCIF | DMA_HTIF);
+	dma_set_flags(1, spi1.tx_stream, DMA_TCIF | DMA_HTIF);
+	spi1.busy = 0;
+}
+
+// find the enabled DMA2 stream that serves SPI1 in one direction
+static int spi_dma_stream(int dir)
+{
+	int n;
+
+	for (n = 0; n < 8; n++) {
+		DMA_Stream_TypeDef *s = dma_stream(1, n);
+		uint32_t cr = REG(&s->CR);
+		if ((cr & 1) && REG(&s->PAR) == (uint32_t)(uintptr_t)&SPI1->DR &&
+		    ((cr >> 6) & 0x3) == (uint32_t)dir)
+			return n;
+	}
+	return -1;
+}
+
+/*
+ * TXDMAEN was set with RXDMAEN on: the whole transfer is exchanged
+ * with the device right away, completion is scheduled for when the
+ * last frame would be clocked out.
+ */
+static void spi_dma_start(void)
+{
+	int rn = spi_dma_stream(0);
+	int tn = spi_dma_stream(1);
+	DMA_Stream_TypeDef *rx, *tx;
+	uint32_t rcr, tcr, len, size, cr1 = REG(&SPI1->CR1);
+	uint8_t *rmem, *tmem;
+	uint32_t i;
+
+	if (rn < 0 || tn < 0) {
+		sim_error("SPI1 DMA request without enabled rx and tx streams");
+		return;
+	}
+	if (spi1.busy) {
+		sim_error("SPI1 DMA started while the previous transfer runs");
+		return;
+	}
+	rx = dma_stream(1, rn);
+	tx = dma_stream(1, tn);
+	rcr = REG(&rx->CR);
+	tcr = REG(&tx->CR);
+
+	// SPI1_RX is stream 0 or 2, SPI1_TX stream 3 or 5, channel 3
+	if ((rn != 0 && rn != 2) || ((rcr >> 25) & 0x7) != 3)
+		sim_error("DMA2 stream %d channel %u does not serve SPI1_RX", rn, (rcr >> 25) & 0x7);
+	if ((tn != 3 && tn != 5) || ((tcr >> 25) & 0x7) != 3)
+		sim_error("DMA2 stream %d channel %u does not serve SPI1_TX", tn, (tcr >> 25) & 0x7);
+
+	len = REG(&tx->NDTR);
+	if (REG(&rx->NDTR) != len)
+		sim_error("SPI1 DMA rx/tx length %u/%u differ", REG(&rx->NDTR), len);
+
+	size = (cr1 & (1 << 11)) ? 1 : 0;
+	if (((rcr >> 11) & 3) != size || ((tcr >> 11) & 3) != size)
+		sim_error("SPI1 DMA PSIZE does not match DFF");
+	if (((rcr >> 13) & 3) != size || ((tcr >> 13) & 3) != size)
+		sim_error("SPI1 DMA MSIZE != PSIZE is not modelled");
+
+	rmem = dma_mem(REG(&rx->M0AR), (rcr & (1 << 10)) ? len << size : 1u << size);
+	tmem = dma_mem(REG(&tx->M0AR), (tcr & (1 << 10)) ? len << size : 1u << size);
+	if (!rmem || !tmem)
+		return;
+
+	for (i = 0; i < len; i++) {
+		uint32_t ti = (tcr & (1 << 10)) ? i : 0;
+		uint32_t ri = (rcr & (1 << 10)) ? i : 0;
+		uint32_t mosi = size ? ((uint16_t *)tmem)[ti] : tmem[ti];
+		uint32_t miso = spi_frame(mosi);
+		if (size)
+			((uint16_t *)rmem)[ri] = (uint16_t)miso;
+		else
+			rmem[ri] = (uint8_t)miso;
+	}
+
+	sim_stats.dma_xfers++;
+	spi1.busy = 1;
+	spi1.rx_stream = rn;
+	spi1.tx_stream = tn;
+	sim_schedule(now_ns + len * spi_frame_ns(cr1), spi_dma_done, 0);
+}
+
+static void spi1_read(uintptr_t off)
+{
+	if (off == offsetof(SPI_TypeDef, SR)) {
+		REG(&SPI1->SR) = (1 << 1) | (spi1.rxne ? (1 << 0) : 0) | (spi1.busy ? (1 << 7) : 0);
+	} else if (off == offsetof(SPI_TypeDef, DR)) {
+		REG(&SPI1->DR) = spi1.rx;
+		spi1.rxne = 0;
+	}
+}
+
+static void spi1_write(uintptr_t off, uint32_t old, uint32_t val)
+{
+	if (off == offsetof(SPI_TypeDef, CR1)) {
+		// everything but SPE must only change while SPE is clear
+		if ((old & (1 << 6)) && (val & (1 << 6)) && ((old ^ val) & ~(1u << 6)))
+			sim_error("SPI1 CR1 0x%04x -> 0x%04x changed while enabled", old, val);
+		if (old != val)
+			sim_stats.spi_cr1_writes++;
+	} else if (off == offsetof(SPI_TypeDef, CR2)) {
+		if ((val & 0x3) == 0x3 && !(old & (1 << 1)))
+			spi_dma_start();
+		else if ((val & (1 << 1)) && !(val & (1 << 0)) && !(old & (1 << 1)))
+			sim_error("SPI1 TXDMAEN without RXDMAEN is not modelled");
+	} else if (off == offsetof(SPI_TypeDef, DR)) {
+		uint32_t cr1 = REG(&SPI1->CR1);
+		uint32_t mask = (cr1 & (1 << 11)) ? 0xFFFF : 0xFF;
+		if (spi1.busy)
+			sim_error("SPI1 DR written during a DMA transfer");
+		spi1.rx = spi_frame(val & mask);
+		spi1.rxne = 1;
+		// polled transfers take the frame time
+		now_ns += spi_frame_ns(cr1);
+	} else if (off == offsetof(SPI_TypeDef, SR)) {
+		REG(&SPI1->SR) = old;
+	}
+}
+
+/*************************************************
+* DWT
+*************************************************/
+static uint32_t cyccnt_offset;
+
+// value the cycle counter has right now
+uint32_t sim_cyccnt(void)
+{
+	if (REG(&DWT->CTRL) & DWT_CTRL_CYCCNTENA_Msk)
+		REG(&DWT->CYCCNT) = sim_ns_to_cycles(now_ns) + cyccnt_offset;
+	return REG(&DWT->CYCCNT);
+}
+
+static void dwt_read(uintptr_t off)
+{
+	if (off == offsetof(DWT_Type, CYCCNT))
+		sim_cyccnt();
+}
+
+static void dwt_write(uintptr_t off, uint32_t old, uint32_t val)
+{
+	(void)old;
+	if (off == offsetof(DWT_Type, CYCCNT))
+		cyccnt_offset = val - sim_ns_to_cycles(now_ns);
+}
+
+/*************************************************
+* register dispatch
+*************************************************/
+static void periph_read(uintptr_t a)
+{
+	int p;
+
+	if (a >= SPI1_BASE && a < SPI1_BASE + 0x400)
+		spi1_read(a - SPI1_BASE);
+	else if (a >= DWT_BASE && a < DWT_BASE + 0x100)
+		dwt_read(a - DWT_BASE);
+	else {
+		for (p = 0; p < GPIO_PORTS; p++) {
+			uintptr_t b = (uintptr_t)gpio_ports[p];
+			if (a >= b && a < b + 0x400)
+				gpio_read(p, a - b);
+		}
+	}
+}
+
+static void periph_write(uintptr_t a, uint32_t old, uint32_t val)
+{
+	int p;
+
+	if (a >= SPI1_BASE && a < SPI1_BASE + 0x400)
+		spi1_write(a - SPI1_BASE, old, val);
+	else if (a >= EXTI_BASE && a < EXTI_BASE + 0x400)
+		exti_write(a - EXTI_BASE, old, val);
+	else if (a >= DMA1_BASE && a < DMA1_BASE + 0x400)
+		dma_write(0, a - DMA1_BASE, old, val);
+	else if (a >= DMA2_BASE && a < DMA2_BASE + 0x400)
+		dma_write(1, a - DMA2_BASE, old, val);
+	else if (a >= DWT_BASE && a < DWT_BASE + 0x100)
+		dwt_write(a - DWT_BASE, old, val);
+	else {
+		for (p = 0; p < GPIO_PORTS; p++) {
+			uintptr_t b = (uintptr_t)gpio_ports[p];
+			if (a >= b && a < b + 0x400)
+				gpio_write(p, a - b, old, val);
+		}
+	}
+}
+
+/*************************************************
+* NVIC and processor state
+*************************************************/
+#define NUM_IRQS 82
+
+typedef void (*isr_t)(void);
+
+// handlers are picked up from the image if it defines them
+void EXTI0_IRQHandler(void) __attribute__((weak));
+void EXTI1_IRQHandler(void) __attribute__((weak));
+void EXTI2_IRQHandler(void) __attribute__((weak));
+void EXTI3_IRQHandler(void) __attribute__((weak));
+void EXTI4_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream0_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream1_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream2_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream3_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream4_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream5_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream6_IRQHandler(void) __attribute__((weak));
+void DMA2_Stream7_IRQHandler(void) __attribute__((weak));
+
+static isr_t isr_table[NUM_IRQS];
+static uint8_t nvic_enabled[NUM_IRQS];
+static uint8_t nvic_prio[NUM_IRQS];
+static uint32_t primask;
+static int in_isr;
+
+static const IRQn_Type dma2_irqn[8] = {
+	DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+	DMA2_Stream4_IRQn, DMA2_Stream5_IRQn, DMA2_Stream6_IRQn, DMA2_Stream7_IRQn,
+};
+
+static void isr_table_init(void)
+{
+	isr_table[EXTI0_IRQn] = EXTI0_IRQHandler;
+	isr_table[EXTI1_IRQn] = EXTI1_IRQHandler;
+	isr_table[EXTI2_IRQn] = EXTI2_IRQHandler;
+	isr_table[EXTI3_IRQn] = EXTI3_IRQHandler;
+	isr_table[EXTI4_IRQn] = EXTI4_IRQHandler;
+	isr_table[DMA2_Stream0_IRQn] = DMA2_Stream0_IRQHandler;
+	isr_table[DMA2_Stream1_IRQn] = DMA2_Stream1_IRQHandler;
+	isr_table[DMA2_Stream2_IRQn] = DMA2_Stream2_IRQHandler;
+	isr_table[DMA2_Stream3_IRQn] = DMA2_Stream3_IRQHandler;
+	isr_table[DMA2_Stream4_IRQn] = DMA2_Stream4_IRQHandler;
+	isr_table[DMA2_Stream5_IRQn] = DMA2_Stream5_IRQHandler;
+	isr_table[DMA2_Stream6_IRQn] = DMA2_Stream6_IRQHandler;
+	isr_table[DMA2_Stream7_IRQn] = DMA2_Stream7_IRQHandler;
+}
+
+static int irq_requested(int irqn)
+{
+	int n;
+
+	if (irqn >= EXTI0_IRQn && irqn <= EXTI4_IRQn) {
+		uint32_t bit = (uint32_t)1 << (irqn - EXTI0_IRQn);
+		return (REG(&EXTI->PR) & REG(&EXTI->IMR) & bit) != 0;
+	}
+	for (n = 0; n < 8; n++) {
+		if (irqn == dma2_irqn[n])
+			return dma_irq_requested(1, n);
+	}
+	return 0;
+}
+
+// highest priority pending and enabled interrupt, -1 if none
+static int irq_pending(void)
+{
+	int i, n = -1;
+
+	for (i = 0; i < NUM_IRQS; i++) {
+		if (nvic_enabled[i] && irq_requested(i) && (n < 0 || nvic_prio[i] < nvic_prio[n]))
+			n = i;
+	}
+	return n;
+}
+
+static void irq_dispatch(void)
+{
+	int n;
+
+	if (primask || in_isr)
+		return;
+
+	while ((n = irq_pending()) >= 0) {
+		uint64_t t0;
+
+		if (!isr_table[n]) {
+			sim_error("IRQ %d enabled and pending without a handler", n);
+			nvic_enabled[n] = 0;
+			continue;
+		}
+		in_isr = 1;
+		sim_stats.irqs++;
+		t0 = host_ns();
+		isr_table[n]();
+		sim_stats.isr_host_ns += host_ns() - t0;
+		in_isr = 0;
+	}
+}
+
+void sim_irq_enable(void)
+{
+	primask = 0;
+	irq_dispatch();
+}
+
+void sim_irq_disable(void)
+{
+	primask = 1;
+}
+
+uint32_t sim_get_primask(void)
+{
+	return primask;
+}
+
+void sim_set_primask(uint32_t v)
+{
+	primask = v & 1;
+	irq_dispatch();
+}
+
+void sim_nvic_enable(int irqn)
+{
+	nvic_enabled[irqn] = 1;
+	irq_dispatch();
+}
+
+void sim_nvic_disable(int irqn)
+{
+	nvic_enabled[irqn] = 0;
+}
+
+void sim_nvic_set_priority(int irqn, uint32_t prio)
+{
+	nvic_prio[irqn] = (uint8_t)prio;
+}
+
+/*
+ * sleep until an enabled interrupt is pending, with PRIMASK set
+ * it wakes up without taking it, like the core does
+ */
+void sim_wfi(void)
+{
+	if (in_isr) {
+		sim_error("WFI inside an interrupt handler");
+		return;
+	}
+	while (irq_pending() < 0) {
+		int n = next_event();
+		if (n < 0) {
+			sim_error("WFI with nothing left that could wake it up");
+			exit(2);
+		}
+		if (events[n].t > now_ns) {
+			sim_stats.sleep_ns += events[n].t - now_ns;
+			now_ns = events[n].t;
+		}
+		process_events();
+	}
+	irq_dispatch();
+}
+
+void sim_run_until(uint64_t t)
+{
+	int n;
+
+	irq_dispatch();
+	while ((n = next_event()) >= 0 && events[n].t <= t) {
+		if (events[n].t > now_ns)
+			now_ns = events[n].t;
+		process_events();
+		irq_dispatch();
+	}
+	if (now_ns < t)
+		now_ns = t;
+	irq_dispatch();
+}
+
+void sim_run_for(uint64_t ns)
+{
+	sim_run_until(now_ns + ns);
+}
+
+void sim_spi_attach(sim_spi_dev_t *d)
+{
+	if (spi_dev_count == MAX_SPI_DEVS) {
+		fprintf(stderr, "sim: too many SPI devices\n");
+		abort();
+	}
+	spi_devs[spi_dev_count++] = d;
+}
+
+/*************************************************
+* fault handling
+*************************************************/
+static struct {
+	uintptr_t addr;
+	uintptr_t page;
+	uint32_t old;
+	int write;
+	int active;
+} pend;
+
+static void die(int sig)
+{
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static void on_segv(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = (ucontext_t *)ctx;
+	uintptr_t addr = (uintptr_t)si->si_addr;
+	uintptr_t page = addr & ~(PAGE_SIZE_SIM - 1);
+
+	if (pend.active || !is_trap_page(page)) {
+		// a real crash
+		die(sig);
+		return;
+	}
+
+	pend.addr = addr & ~(uintptr_t)3;
+	pend.page = page;
+	// page fault error code bit 1 is set for writes
+	pend.write = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+
+	now_ns += SIM_ACCESS_NS;
+	sim_stats.accesses++;
+	if (in_isr)
+		sim_stats.isr_accesses++;
+
+	if (!pend.write)
+		periph_read(pend.addr);
+	pend.old = REG(pend.addr);
+
+	mprotect((void *)page, PAGE_SIZE_SIM, PROT_READ | PROT_WRITE);
+	uc->uc_mcontext.gregs[REG_EFL] |= 0x100;  // single step, TF
+	pend.active = 1;
+}
+
+static void on_trap(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = (ucontext_t *)ctx;
+	(void)si;
+
+	if (!pend.active) {
+		die(sig);
+		return;
+	}
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+	mprotect((void *)pend.page, PAGE_SIZE_SIM, PROT_NONE);
+	pend.active = 0;
+
+	if (pend.write)
+		periph_write(pend.addr, pend.old, REG(pend.addr));
+
+	process_events();
+}
+
+/*************************************************
+* setup
+*************************************************/
+void sim_init(void)
+{
+	struct sigaction sa;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+		int fd = memfd_create("sim_periph", 0);
+		void *p;
+
+		if (fd < 0 || ftruncate(fd, (off_t)regions[i].size) < 0) {
+			perror("sim: memfd");
+			exit(2);
+		}
+		p = mmap((void *)regions[i].base, regions[i].size, PROT_READ | PROT_WRITE,
+		         MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+		if (p != (void *)regions[i].base) {
+			perror("sim: map peripheral range");
+			exit(2);
+		}
+		regions[i].alias = mmap(0, regions[i].size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (regions[i].alias == MAP_FAILED) {
+			perror("sim: map alias");
+			exit(2);
+		}
+		close(fd);
+	}
+
+	// reset values that differ from zero
+	REG(&GPIOA->MODER) = 0xA8000000;  // PA13-15 debug pins
+	REG(&GPIOB->MODER) = 0x00000280;  // PB3-4 debug pins
+	REG(&SPI1->SR) = (1 << 1);        // TXE
+
+	isr_table_init();
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_sigaction = on_segv;
+	sigaction(SIGSEGV, &sa, 0);
+	sa.sa_sigaction = on_trap;
+	sigaction(SIGTRAP, &sa, 0);
+
+	for (i = 0; i < sizeof(trap_pages) / sizeof(trap_pages[0]); i++)
+		mprotect((void *)trap_pages[i], PAGE_SIZE_SIM, PROT_NONE);
+}
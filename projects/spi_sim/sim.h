@@ -0,0 +1,78 @@
+/*
+ * sim.h
+ *
+ * description:
+ *   host side simulation of the STM32F407 peripherals used by the
+ *   SPI1 accelerometer driver: SPI1, DMA2, GPIOA-E, EXTI/SYSCFG,
+ *   NVIC and the DWT cycle counter.
+ *
+ *   the peripheral address ranges are mapped at their real addresses,
+ *   so driver code built against the normal device header runs as is.
+ *   pages with simulated registers are kept inaccessible, every access
+ *   faults into the simulator, which updates the register model around
+ *   the access and single-steps the instruction. other registers are
+ *   plain memory.
+ *
+ *   time is virtual (ns). it advances a little with every simulated
+ *   register access, jumps forward in WFI and in sim_run_until.
+ *   interrupts are taken at WFI, when PRIMASK is cleared and between
+ *   events while the harness runs time forward; there is no nesting.
+ *
+ *   x86-64 Linux only, link with -no-pie so static buffers have 32-bit
+ *   addresses that fit in the DMA address registers.
+ */
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+/* processor clock the cycle counter runs at */
+#define SIM_SYSCLK_HZ    168000000ULL
+/* SPI1 sits on APB2 */
+#define SIM_PCLK2_HZ      84000000ULL
+/* cost of one peripheral register access */
+#define SIM_ACCESS_NS    20
+
+/* an SPI slave on SPI1, selected by its chip select pin (active low) */
+typedef struct {
+	const char *name;
+	GPIO_TypeDef *cs_port;
+	uint8_t cs_pin;
+	uint8_t modes;                              /* bit n set: SPI mode n accepted */
+	uint32_t max_hz;                            /* fastest SCK it takes           */
+	void (*select)(void *dev, int active);
+	uint8_t (*xfer)(void *dev, uint8_t mosi);   /* one byte, MSB first            */
+	void *dev;
+} sim_spi_dev_t;
+
+typedef void (*sim_event_fn)(void *ctx);
+
+typedef struct {
+	uint64_t accesses;      /* simulated register accesses            */
+	uint64_t isr_accesses;  /* ... of those from interrupt handlers   */
+	uint64_t irqs;          /* interrupt handler entries              */
+	uint64_t isr_host_ns;   /* host time spent in interrupt handlers  */
+	uint64_t sleep_ns;      /* virtual time spent in WFI              */
+	uint64_t spi_frames;
+	uint64_t spi_cr1_writes;
+	uint64_t dma_xfers;
+	uint32_t errors;        /* protocol or register usage errors      */
+} sim_stats_t;
+
+extern sim_stats_t sim_stats;
+
+void     sim_init(void);
+uint64_t sim_now(void);
+void     sim_run_until(uint64_t t);
+void     sim_run_for(uint64_t ns);
+void     sim_schedule(uint64_t t, sim_event_fn fn, void *ctx);
+void     sim_cancel(sim_event_fn fn, void *ctx);
+void     sim_spi_attach(sim_spi_dev_t *d);
+void     sim_gpio_set_input(GPIO_TypeDef *port, uint8_t pin, int level);
+uint32_t sim_ns_to_cycles(uint64_t ns);
+uint32_t sim_cyccnt(void);
+void     sim_error(const char *fmt, ...);
+
+#endif
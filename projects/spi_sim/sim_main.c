@@ -0,0 +1,400 @@
+/*
+ * sim_main.c
+ *
+ * description:
+ *   runs the SPI1 bus and LIS302DL driver from projects/spi on the
+ *   host against the peripheral simulator and the sensor model.
+ *
+ *   scenarios:
+ *     1. WHO_AM_I and control register read back
+ *     2. 8-bit auto increment burst read through the bus
+ *     3. data ready sampling with DMA, every stored sample is checked
+ *        against the sensor truth log, edge to timestamp latency
+ *     4. slow consumer, the ring is drained every 500 ms
+ *     5. consumer too slow for the ring, drops have to be counted
+ *     6. second device on the bus (PB12, mode 3, 8-bit) with its own
+ *        transactions in between the sensor reads
+ *
+ *   prints register accesses, interrupts and host time per sample,
+ *   exits with 1 if anything did not match.
+ *
+ * usage:
+ *   make run
+ *   make run RUN_ARGS=motion.txt   (lines of: t_ms x_mg y_mg z_mg)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stm32f4xx.h"
+#include "spi_bus.h"
+#include "lis302dl.h"
+#include "sim.h"
+#include "lis302dl_model.h"
+
+/*************************************************
+* function declarations
+*************************************************/
+void DMA2_Stream0_IRQHandler(void);
+
+/*************************************************
+* variables
+*************************************************/
+spi_bus_t spi1_bus;
+
+static lis302_model_t accel;
+static int failures;
+
+// level, tilt in x, in y, both, then beyond the +/-2g range
+static const lis302_key_t default_motion[] = {
+	{    0,     0,     0,  1000 },
+	{  400,     0,     0,  1000 },
+	{  900,   700,     0,   700 },
+	{ 1400,   700,  -600,   400 },
+	{ 2000,  -900,   300,   300 },
+	{ 2600,     0,     0,  1000 },
+	{ 3200,  2600, -2600,     0 },
+	{ 4000,     0,     0, -1000 },
+	{ 6000,   300,   300,  1000 },
+};
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		failures++; \
+		printf("  FAIL: " __VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while (0)
+
+#define MS 1000000ULL
+
+/*
+ * SPI1 rx stream, drives the bus queue
+ */
+void DMA2_Stream0_IRQHandler(void)
+{
+	spi_bus_irq(&spi1_bus);
+}
+
+/*************************************************
+* second device, echoes the previous byte
+*************************************************/
+typedef struct {
+	uint8_t last;
+	sim_spi_dev_t spi;
+} echo_dev_t;
+
+static echo_dev_t echo;
+
+static void echo_select(void *dev, int active)
+{
+	echo_dev_t *e = dev;
+	if (active)
+		e->last = 0xA5;
+}
+
+static uint8_t echo_xfer(void *dev, uint8_t mosi)
+{
+	echo_dev_t *e = dev;
+	uint8_t r = e->last;
+	e->last = mosi;
+	return r;
+}
+
+static uint8_t echo_tx[8];
+static uint8_t echo_rx[8];
+static spi_xfer_t echo_x;
+static uint32_t echo_done;
+
+static void echo_submit(void)
+{
+	unsigned int i;
+
+	if (echo_x.state == SPI_XFER_QUEUED || echo_x.state == SPI_XFER_ACTIVE)
+		return;
+
+	if (echo_x.state == SPI_XFER_DONE) {
+		CHECK(echo_rx[0] == 0xA5, "echo first byte 0x%02x", echo_rx[0]);
+		for (i = 1; i < sizeof(echo_rx); i++)
+			CHECK(echo_rx[i] == echo_tx[i - 1], "echo byte %u", i);
+		echo_done++;
+	}
+
+	for (i = 0; i < sizeof(echo_tx); i++)
+		echo_tx[i] = (uint8_t)(echo_done * 8 + i);
+
+	echo_x.cs_port = GPIOB;
+	echo_x.cs_pin = 12;
+	echo_x.mode = SPI_BUS_MODE_3;
+	echo_x.width = 8;
+	echo_x.div = SPI_BUS_DIV_8;
+	echo_x.tx = echo_tx;
+	echo_x.rx = echo_rx;
+	echo_x.len = sizeof(echo_tx);
+	echo_x.done = 0;
+	spi_bus_submit(&spi1_bus, &echo_x);
+}
+
+/*************************************************
+* board
+*************************************************/
+static void board_init(void)
+{
+	// same steps as projects/spi main()
+	RCC->AHB1ENR |= (1 << 0);
+	RCC->APB2ENR |= (1 << 12);
+	GPIOA->MODER &= 0xFFFF03FF;
+	GPIOA->MODER |= 0x0000A800;
+	GPIOA->OSPEEDR |= 0x0000FC00;
+	GPIOA->AFR[0] |= (0x5 << 20);
+	GPIOA->AFR[0] |= (0x5 << 24);
+	GPIOA->AFR[0] |= (0x5 << 28);
+
+	RCC->AHB1ENR |= (1 << 22);
+	spi_bus_init(&spi1_bus, SPI1, DMA2_Stream0, DMA2_Stream3, 3);
+	NVIC_SetPriority(DMA2_Stream0_IRQn, 1);
+	NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+	RCC->AHB1ENR |= (1 << 4);
+	spi_bus_cs_setup(GPIOE, 3);
+
+	// echo device chip select
+	RCC->AHB1ENR |= (1 << 1);
+	spi_bus_cs_setup(GPIOB, 12);
+
+	lis302_init(&spi1_bus);
+}
+
+/*************************************************
+* scenarios
+*************************************************/
+static void test_registers(void)
+{
+	uint8_t v;
+
+	printf("registers\n");
+	lis302_configure();
+
+	v = spi_read(LIS302_REG_WHO_AM_I);
+	CHECK(v == LIS302_WHO_AM_I_VALUE, "WHO_AM_I 0x%02x", v);
+	v = spi_read(LIS302_REG_CTRL_REG1);
+	CHECK(v == (LIS302_CR1_DR_400HZ | LIS302_CR1_PD | LIS302_CR1_ZEN |
+	            LIS302_CR1_YEN | LIS302_CR1_XEN), "CTRL_REG1 0x%02x", v);
+	v = spi_read(LIS302_REG_CTRL_REG2);
+	CHECK(v == 0, "CTRL_REG2 0x%02x, BOOT should clear", v);
+	v = spi_read(LIS302_REG_CTRL_REG3);
+	CHECK(v == LIS302_CR3_I1_DRDY, "CTRL_REG3 0x%02x", v);
+}
+
+static void test_burst8(void)
+{
+	static uint8_t tx[4] = { LIS302_READ | LIS302_AUTO_INC | LIS302_REG_CTRL_REG1, 0, 0, 0 };
+	static uint8_t rx[4];
+	static spi_xfer_t x;
+	uint32_t reconfigs = spi1_bus.reconfigs;
+
+	printf("8-bit burst read\n");
+
+	x.cs_port = GPIOE;
+	x.cs_pin = 3;
+	x.mode = SPI_BUS_MODE_3;
+	x.width = 8;
+	x.div = SPI_BUS_DIV_16;
+	x.tx = tx;
+	x.rx = rx;
+	x.len = 4;
+	x.done = 0;
+	x.state = SPI_XFER_IDLE;
+	spi_bus_transfer(&spi1_bus, &x);
+
+	CHECK(rx[1] == accel.regs[LIS302_REG_CTRL_REG1], "burst CTRL_REG1 0x%02x", rx[1]);
+	CHECK(rx[2] == accel.regs[LIS302_REG_CTRL_REG2], "burst CTRL_REG2 0x%02x", rx[2]);
+	CHECK(rx[3] == accel.regs[LIS302_REG_CTRL_REG3], "burst CTRL_REG3 0x%02x", rx[3]);
+	CHECK(spi1_bus.reconfigs == reconfigs + 1, "burst should reconfigure once");
+
+	// back to the driver settings
+	CHECK(spi_read(LIS302_REG_WHO_AM_I) == LIS302_WHO_AM_I_VALUE, "WHO_AM_I after burst");
+	CHECK(spi1_bus.reconfigs == reconfigs + 2, "driver read should reconfigure once");
+}
+
+typedef struct {
+	uint32_t next;         // next truth log entry expected
+	uint32_t received;
+	uint32_t skipped;      // truth entries that never reached the ring
+	uint32_t mismatched;
+	uint32_t max_latency;  // cycles from edge to timestamp
+} checker_t;
+
+// match ring samples to the truth log by timestamp
+static void drain(checker_t *c)
+{
+	const sample_t *s;
+	uint32_t n, i;
+
+	while ((n = sample_ring_peek(&accel_ring, &s)) != 0) {
+		for (i = 0; i < n; i++) {
+			uint32_t k = c->next;
+			uint32_t lat;
+
+			// latest sample whose edge is not after the timestamp
+			while (k + 1 < accel.count && (int32_t)(s[i].t - accel.log[k + 1].cycles) >= 0)
+				k++;
+			if (k >= accel.count || (int32_t)(s[i].t - accel.log[k].cycles) < 0) {
+				c->mismatched++;
+				continue;
+			}
+			c->skipped += k - c->next;
+			c->next = k + 1;
+			c->received++;
+
+			lat = s[i].t - accel.log[k].cycles;
+			if (lat > c->max_latency)
+				c->max_latency = lat;
+
+			if (s[i].x != accel.log[k].x || s[i].y != accel.log[k].y ||
+			    s[i].z != accel.log[k].z || !(s[i].status & LIS302_SR_ZYXDA)) {
+				c->mismatched++;
+				printf("  sample %u: got %d %d %d st 0x%02x, sensor had %d %d %d\n",
+				       k, s[i].x, s[i].y, s[i].z, s[i].status,
+				       accel.log[k].x, accel.log[k].y, accel.log[k].z);
+			}
+		}
+		sample_ring_consume(&accel_ring, n);
+	}
+}
+
+static void report(uint32_t produced, const checker_t *c, uint32_t dropped,
+                   uint32_t reconfigs, const sim_stats_t *a, const sim_stats_t *b,
+                   uint64_t host_ns)
+{
+	double n = produced ? (double)produced : 1.0;
+
+	printf("  produced %u, stored %u, lost %u (ring dropped %u, sensor overrun %u)\n",
+	       produced, c->received, c->skipped, dropped, drdy_overrun);
+	printf("  edge to timestamp latency max %u cycles (%.2f us)\n",
+	       c->max_latency, c->max_latency * 1e6 / (double)SIM_SYSCLK_HZ);
+	printf("  per sample: %.1f interrupts, %.1f register accesses in handlers, "
+	       "%.1f us host time in handlers\n",
+	       (double)(b->irqs - a->irqs) / n,
+	       (double)(b->isr_accesses - a->isr_accesses) / n,
+	       (double)(b->isr_host_ns - a->isr_host_ns) / n / 1000.0);
+	printf("  bus reconfigurations %u, CR1 writes %llu, wall time %.1f ms\n",
+	       reconfigs, (unsigned long long)(b->spi_cr1_writes - a->spi_cr1_writes),
+	       (double)host_ns / 1e6);
+}
+
+/*
+ * run for duration, drain the ring every drain_ms,
+ * optionally keep the second device busy every millisecond
+ */
+static void test_sampling(const char *name, uint32_t duration_ms, uint32_t drain_ms,
+                          int expect_drops, int with_echo)
+{
+	checker_t c = { 0, 0, 0, 0, 0 };
+	sim_stats_t a = sim_stats;
+	uint32_t first;
+	uint32_t dropped = accel_ring.dropped;
+	uint32_t reconfigs = spi1_bus.reconfigs;
+	uint32_t produced, ms;
+	uint64_t t0;
+	struct timespec h0, h1;
+
+	printf("%s\n", name);
+
+	// start matching from the first sample not yet seen
+	drain(&c);
+	c = (checker_t){ accel.count, 0, 0, 0, 0 };
+	first = accel.count;
+
+	clock_gettime(CLOCK_MONOTONIC, &h0);
+	t0 = sim_now();
+	for (ms = 1; ms <= duration_ms; ms++) {
+		sim_run_until(t0 + ms * MS);
+		if (with_echo)
+			echo_submit();
+		if (ms % drain_ms == 0)
+			drain(&c);
+	}
+	// let the last read finish
+	sim_run_for(MS / 10);
+	drain(&c);
+	clock_gettime(CLOCK_MONOTONIC, &h1);
+
+	// samples after the last stored one were dropped as well
+	c.skipped += accel.count - c.next;
+	produced = accel.count - first;
+	report(produced, &c, accel_ring.dropped - dropped, spi1_bus.reconfigs - reconfigs,
+	       &a, &sim_stats,
+	       (uint64_t)(h1.tv_sec - h0.tv_sec) * 1000000000ULL + (uint64_t)(h1.tv_nsec - h0.tv_nsec));
+
+	CHECK(c.mismatched == 0, "%u samples do not match the sensor", c.mismatched);
+	CHECK(c.received + c.skipped == produced, "%u stored + %u lost != %u produced",
+	      c.received, c.skipped, produced);
+	CHECK(c.max_latency < 10 * SIM_SYSCLK_HZ / 1000000, "latency above 10 us");
+	if (expect_drops) {
+		CHECK(c.skipped > 0, "expected drops with a slow consumer");
+		CHECK(accel_ring.dropped - dropped == c.skipped, "ring counted %u drops, %u lost",
+		      accel_ring.dropped - dropped, c.skipped);
+	} else {
+		CHECK(c.skipped == 0, "%u samples lost", c.skipped);
+		CHECK(accel_ring.dropped == dropped, "ring dropped samples");
+	}
+	CHECK(drdy_overrun == 0, "%u data ready edges while busy", drdy_overrun);
+	if (with_echo)
+		CHECK(echo_done > duration_ms / 2, "only %u echo transfers", echo_done);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(int argc, char **argv)
+{
+	const lis302_key_t *keys = default_motion;
+	int nkeys = (int)(sizeof(default_motion) / sizeof(default_motion[0]));
+
+	if (argc > 1) {
+		lis302_key_t *k;
+		nkeys = lis302_model_load(argv[1], &k);
+		if (nkeys < 0) {
+			perror(argv[1]);
+			return 2;
+		}
+		keys = k;
+	}
+
+	sim_init();
+	lis302_model_init(&accel, keys, nkeys);
+
+	echo.spi.name = "echo";
+	echo.spi.cs_port = GPIOB;
+	echo.spi.cs_pin = 12;
+	echo.spi.modes = (1 << 3);
+	echo.spi.max_hz = 20000000;
+	echo.spi.select = echo_select;
+	echo.spi.xfer = echo_xfer;
+	echo.spi.dev = &echo;
+	sim_spi_attach(&echo.spi);
+
+	board_init();
+
+	test_registers();
+	test_burst8();
+
+	drdy_init();
+	test_sampling("data ready sampling, 2 s, drained every 10 ms", 2000, 10, 0, 0);
+	test_sampling("slow consumer, drained every 500 ms", 2000, 500, 0, 0);
+	test_sampling("consumer slower than the ring, drained every 1 s", 2000, 1000, 1, 0);
+	test_sampling("shared bus, second device every 1 ms", 2000, 10, 0, 1);
+
+	printf("simulated %.3f s, %llu register accesses, %llu interrupts, %llu SPI frames\n",
+	       (double)sim_now() / 1e9, (unsigned long long)sim_stats.accesses,
+	       (unsigned long long)sim_stats.irqs, (unsigned long long)sim_stats.spi_frames);
+
+	if (failures || sim_stats.errors) {
+		printf("FAILED: %d checks, %u simulator errors\n", failures, sim_stats.errors);
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -5,6 +5,9 @@
  * description:
  *    blinks LEDs using systick timer
  *      at roughly 1 second
+ *    delay_ms sleeps in WFI between the 1 ms SysTick interrupts
+ *      (include/idle.c) instead of spinning on tDelay, idle_stats
+ *      counts the sleeps and what woke the core
  *
  * setup:
  *    uses 4 on-board LEDs
@@ -12,6 +15,7 @@
 
 #include "stm32f4xx.h"
 #include "system_stm32f4xx.h"
+#include "idle.h"
 
 /*************************************************
 * function declarations
@@ -114,6 +118,9 @@ int main(void)
 	// enable callback
 	init_systick(21000, 1);
 
+	// no other work, the main loop only sleeps
+	idle_init(0, IDLE_WFI);
+
 	// Each module is powered separately. In order to turn on a module
 	// we need to enable the relevant clock.
 	// Set Bit 3 to enable GPIOD clock in AHB1ENR
@@ -155,13 +162,20 @@ int main(void)
 	return 0;
 }
 
+static int delay_done(void *arg)
+{
+	(void)arg;
+	return tDelay == 0;
+}
+
 /*
  * Millisecond delay function.
- *   volatile keyword is used so that compiler does not optimize it away
- * Polling method (If interrupt is not enabled)
+ *   tDelay is volatile, the SysTick handler counts it down
+ * Sleeps until the next SysTick between checks, so it needs the
+ *   SysTick interrupt enabled
  */
 void delay_ms(volatile uint32_t s)
 {
 	tDelay = s;
-	while(tDelay != 0);
+	idle_wait(delay_done, 0);
 }
\ No newline at end of file
@@ -0,0 +1,373 @@
+/*
+ * swtimer.c
+ *
+ * description:
+ *   tickless software timers, see swtimer.h
+ *
+ *   the counter runs free over the full 32 bits (ARR = 0xFFFFFFFF),
+ *   channel 1 is an output compare without a pin (frozen mode). the
+ *   heap top goes to CCR1 and CC1IE is on only while something is
+ *   armed.
+ *
+ *   a deadline can pass while CCR1 is written (a callback ran long,
+ *   or a very short delay). the counter is read back after every
+ *   write and if it is already there the compare event is raised in
+ *   software through EGR, so no expiry waits for the counter to come
+ *   around again.
+ */
+
+#include "swtimer.h"
+
+/*************************************************
+* variables
+*************************************************/
+swtimer_stats_t swtimer_stats;
+
+static TIM_TypeDef *tim;
+static swtimer_t *heap[SWTIMER_MAX];
+static uint32_t armed;
+static uint8_t in_irq;
+
+// deferred callbacks in expiry order
+static swtimer_t *ready_head;
+static swtimer_t *ready_tail;
+
+/*************************************************
+* heap
+*************************************************/
+// a is before b, valid while both are within 2^31 of each other
+static inline int before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static inline void put(uint32_t i, swtimer_t *t)
+{
+	heap[i] = t;
+	t->slot = (uint8_t)i;
+}
+
+static void sift_up(uint32_t i)
+{
+	swtimer_t *t = heap[i];
+
+	while (i > 0) {
+		uint32_t p = (i - 1) / 2;
+		if (!before(t->deadline, heap[p]->deadline))
+			break;
+		put(i, heap[p]);
+		i = p;
+	}
+	put(i, t);
+}
+
+static void sift_down(uint32_t i)
+{
+	swtimer_t *t = heap[i];
+
+	for (;;) {
+		uint32_t c = 2 * i + 1;
+		if (c >= armed)
+			break;
+		if (c + 1 < armed && before(heap[c + 1]->deadline, heap[c]->deadline))
+			c++;
+		if (!before(heap[c]->deadline, t->deadline))
+			break;
+		put(i, heap[c]);
+		i = c;
+	}
+	put(i, t);
+}
+
+static void heap_remove(swtimer_t *t)
+{
+	uint32_t i = t->slot;
+	swtimer_t *last = heap[--armed];
+
+	t->slot = SWTIMER_IDLE;
+	if (last == t)
+		return;
+
+	// the last one takes the hole, then moves whichever way it needs
+	put(i, last);
+	if (i > 0 && before(last->deadline, heap[(i - 1) / 2]->deadline))
+		sift_up(i);
+	else
+		sift_down(i);
+}
+
+static void heap_insert(swtimer_t *t)
+{
+	heap[armed] = t;
+	sift_up(armed++);
+	if (armed > swtimer_stats.max_armed)
+		swtimer_stats.max_armed = (uint8_t)armed;
+}
+
+/*************************************************
+* deferred queue
+*************************************************/
+static void ready_push(swtimer_t *t)
+{
+	t->queued = 1;
+	t->next = 0;
+	if (ready_tail)
+		ready_tail->next = t;
+	else
+		ready_head = t;
+	ready_tail = t;
+}
+
+static void ready_remove(swtimer_t *t)
+{
+	swtimer_t **p = &ready_head;
+	swtimer_t *prev = 0;
+
+	while (*p && *p != t) {
+		prev = *p;
+		p = &(*p)->next;
+	}
+	if (*p == 0)
+		return;
+	*p = t->next;
+	if (ready_tail == t)
+		ready_tail = prev;
+	t->queued = 0;
+}
+
+/*************************************************
+* compare channel
+*************************************************/
+// CCR1 to the heap top, or compare interrupt off when nothing is armed
+static void program(void)
+{
+	uint32_t deadline;
+
+	if (armed == 0) {
+		// CC1IE bit 1 on DIER
+		tim->DIER &= ~(1U << 1);
+		return;
+	}
+
+	deadline = heap[0]->deadline;
+	tim->CCR1 = deadline;
+	// clear a match of the old value, CC1IF bit 1 on SR (rc_w0)
+	tim->SR = ~(1U << 1);
+	tim->DIER |= (1U << 1);
+	swtimer_stats.compares++;
+
+	// already there, raise the compare event by hand - CC1G bit 1 on EGR
+	if (!before(tim->CNT, deadline)) {
+		tim->EGR = (1U << 1);
+		swtimer_stats.forced++;
+	}
+}
+
+/*************************************************
+* api
+*************************************************/
+
+/*
+ * free running counter and compare channel 1 on a 32-bit timer.
+ * the timer clock and its NVIC line are enabled by the caller.
+ * counter rate is the timer clock / (psc + 1)
+ */
+void swtimer_init(TIM_TypeDef *t, uint16_t psc)
+{
+	tim = t;
+	armed = 0;
+	in_irq = 0;
+	ready_head = 0;
+	ready_tail = 0;
+
+	tim->CR1 = 0;
+	tim->DIER = 0;
+	tim->PSC = psc;
+	tim->ARR = 0xFFFFFFFF;
+	// channel 1 output compare, frozen, no preload - CCMR1 bits 6:0
+	tim->CCMR1 &= ~0x7FU;
+	tim->CCER &= ~(1U << 0);
+	tim->CNT = 0;
+	// load the prescaler - UG bit 0 on EGR
+	tim->EGR = (1U << 0);
+	tim->SR = 0;
+	// counter enable - CEN bit 0 on CR1
+	tim->CR1 |= (1U << 0);
+}
+
+uint32_t swtimer_now(void)
+{
+	return tim->CNT;
+}
+
+void swtimer_setup(swtimer_t *t, swtimer_fn_t fn, void *arg, uint8_t flags)
+{
+	t->fn = fn;
+	t->arg = arg;
+	t->flags = flags;
+	t->slot = SWTIMER_IDLE;
+	t->queued = 0;
+	t->missed = 0;
+	t->next = 0;
+}
+
+/*
+ * arm t to expire at a counter value, then every period steps
+ * (0 for one shot). an armed timer is moved to the new deadline.
+ * returns 0 when SWTIMER_MAX timers are armed already.
+ * safe from thread, interrupt and callback context.
+ */
+int swtimer_start_at(swtimer_t *t, uint32_t deadline, uint32_t period)
+{
+	uint32_t primask = __get_PRIMASK();
+	swtimer_t *top;
+
+	__disable_irq();
+
+	top = armed ? heap[0] : 0;
+	if (t->slot != SWTIMER_IDLE) {
+		heap_remove(t);
+	} else if (armed == SWTIMER_MAX) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+
+	t->deadline = deadline;
+	t->period = period;
+	heap_insert(t);
+
+	// the interrupt handler programs the compare when it is done
+	if (!in_irq && (heap[0] != top || top == t))
+		program();
+
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+int swtimer_start(swtimer_t *t, uint32_t delay, uint32_t period)
+{
+	return swtimer_start_at(t, tim->CNT + delay, period);
+}
+
+/*
+ * disarm t and drop a deferred run that has not happened yet
+ */
+void swtimer_stop(swtimer_t *t)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (t->slot != SWTIMER_IDLE) {
+		int was_top = (heap[0] == t);
+		heap_remove(t);
+		if (!in_irq && was_top)
+			program();
+	}
+	if (t->queued)
+		ready_remove(t);
+
+	__set_PRIMASK(primask);
+}
+
+int swtimer_armed(const swtimer_t *t)
+{
+	return t->slot != SWTIMER_IDLE;
+}
+
+/*
+ * deferred callbacks are waiting. check with interrupts disabled
+ * before going to sleep, the same as spi_bus_transfer does
+ */
+int swtimer_pending(void)
+{
+	return ready_head != 0;
+}
+
+/*
+ * run the queued deferred callbacks, call from the main loop.
+ * returns the number of callbacks run
+ */
+uint32_t swtimer_poll(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t n = 0;
+
+	for (;;) {
+		swtimer_t *t;
+
+		__disable_irq();
+		t = ready_head;
+		if (t) {
+			ready_head = t->next;
+			if (ready_head == 0)
+				ready_tail = 0;
+			t->queued = 0;
+		}
+		__set_PRIMASK(primask);
+
+		if (t == 0)
+			break;
+		t->fn(t);
+		n++;
+	}
+	swtimer_stats.deferred += n;
+	return n;
+}
+
+/*
+ * compare interrupt, call from the TIMx interrupt handler
+ */
+void swtimer_irq(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t now;
+
+	// CC1IF bit 1 on SR
+	tim->SR = ~(1U << 1);
+	swtimer_stats.irqs++;
+
+	// a higher priority interrupt may start or stop timers, the heap
+	//   and the ready list only change with interrupts masked. the
+	//   lock is dropped for the callbacks run from here
+	__disable_irq();
+	in_irq = 1;
+
+	now = tim->CNT;
+	while (armed && !before(now, heap[0]->deadline)) {
+		swtimer_t *t = heap[0];
+
+		t->expired = t->deadline;
+		swtimer_stats.expiries++;
+
+		if (t->period) {
+			// stay on the period grid, skip the runs that are gone
+			t->deadline += t->period;
+			if (!before(now, t->deadline)) {
+				uint32_t lost = (now - t->deadline) / t->period + 1;
+				t->deadline += lost * t->period;
+				t->missed += lost;
+			}
+			sift_down(0);
+		} else {
+			heap_remove(t);
+		}
+
+		if (t->flags & SWTIMER_DEFERRED) {
+			if (t->queued)
+				t->missed++;
+			else
+				ready_push(t);
+		} else {
+			__set_PRIMASK(primask);
+			t->fn(t);
+			__disable_irq();
+		}
+
+		// callbacks take time
+		now = tim->CNT;
+	}
+
+	in_irq = 0;
+	program();
+	__set_PRIMASK(primask);
+}
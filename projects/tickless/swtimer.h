@@ -0,0 +1,95 @@
+/*
+ * swtimer.h
+ *
+ * description:
+ *   tickless software timers on one 32-bit general purpose timer
+ *   (TIM2 or TIM5). the counter runs free at the prescaled rate,
+ *   1 MHz with the usage below, and wraps at 2^32 (71 min).
+ *
+ *   armed timers are kept in a binary min-heap ordered by deadline.
+ *   only the earliest deadline is written to CCR1, so there is one
+ *   interrupt per expiry and none in between: no periodic tick, and
+ *   the resolution is one counter step instead of a tick period.
+ *
+ *   deadlines compare with wrap around, a delay has to be less than
+ *   2^31 counter steps (35 min at 1 MHz). periodic timers advance
+ *   their deadline by the period, so they do not drift with the
+ *   interrupt latency. when a period is missed completely the
+ *   deadline skips ahead and missed counts the lost runs.
+ *
+ *   callbacks run either in the timer interrupt (SWTIMER_IRQ) or are
+ *   queued and run from the main loop by swtimer_poll
+ *   (SWTIMER_DEFERRED). t->expired holds the deadline the callback
+ *   runs for. callbacks may start and stop any timer, themselves too.
+ *   so may any interrupt, at any priority: the timer interrupt keeps
+ *   the heap and the queue under PRIMASK and only unmasks for the
+ *   SWTIMER_IRQ callbacks.
+ *
+ *   the swtimer_t belongs to the caller and must stay valid while it
+ *   is armed or queued. at most SWTIMER_MAX timers are armed at once.
+ *
+ * usage:
+ *   // TIM5 on APB1, 84 MHz timer clock / (83 + 1) = 1 MHz
+ *   RCC->APB1ENR |= (1 << 3);
+ *   swtimer_init(TIM5, 83);
+ *   NVIC_EnableIRQ(TIM5_IRQn);
+ *   swtimer_setup(&led, led_toggle, 0, SWTIMER_IRQ);
+ *   swtimer_start(&led, 500000, 500000);
+ *   ...
+ *   call swtimer_irq() from the timer interrupt handler
+ *   call swtimer_poll() from the main loop for deferred callbacks
+ */
+
+#ifndef __SWTIMER_H
+#define __SWTIMER_H
+
+#include "stm32f4xx.h"
+
+#define SWTIMER_MAX        16
+
+/* where the callback runs */
+#define SWTIMER_IRQ        0
+#define SWTIMER_DEFERRED   1
+
+/* slot of a timer that is not armed */
+#define SWTIMER_IDLE       0xFF
+
+typedef struct swtimer swtimer_t;
+typedef void (*swtimer_fn_t)(swtimer_t *t);
+
+struct swtimer {
+	swtimer_fn_t fn;         /* callback                              */
+	void *arg;               /* free for the callback                 */
+	uint32_t deadline;       /* next expiry, counter value            */
+	uint32_t period;         /* counter steps, 0 for one-shot         */
+	uint32_t expired;        /* deadline of the running callback      */
+	uint32_t missed;         /* periods or deferred runs lost         */
+	uint8_t flags;           /* SWTIMER_IRQ or SWTIMER_DEFERRED       */
+	uint8_t slot;            /* heap index, owned by the service      */
+	uint8_t queued;          /* waiting for swtimer_poll              */
+	swtimer_t *next;         /* deferred queue link                   */
+};
+
+typedef struct {
+	uint32_t irqs;           /* timer interrupts                      */
+	uint32_t expiries;       /* deadlines reached                     */
+	uint32_t compares;       /* CCR1 writes                           */
+	uint32_t forced;         /* deadline passed while CCR1 was set    */
+	uint32_t deferred;       /* callbacks run by swtimer_poll         */
+	uint8_t max_armed;       /* heap high water mark                  */
+} swtimer_stats_t;
+
+extern swtimer_stats_t swtimer_stats;
+
+void     swtimer_init(TIM_TypeDef *tim, uint16_t psc);
+uint32_t swtimer_now(void);
+void     swtimer_setup(swtimer_t *t, swtimer_fn_t fn, void *arg, uint8_t flags);
+int      swtimer_start(swtimer_t *t, uint32_t delay, uint32_t period);
+int      swtimer_start_at(swtimer_t *t, uint32_t deadline, uint32_t period);
+void     swtimer_stop(swtimer_t *t);
+int      swtimer_armed(const swtimer_t *t);
+int      swtimer_pending(void);
+uint32_t swtimer_poll(void);
+void     swtimer_irq(void);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * tickless.c
+ *
+ * description:
+ *   software timers without a periodic tick (swtimer.c). TIM5 counts
+ *   free at 1 MHz, the compare interrupt only fires at the next
+ *   deadline, SysTick stays off and the core sleeps in WFI in
+ *   between.
+ *
+ *     green  PD12 - 500 ms periodic, in the interrupt
+ *     orange PD13 - 333.333 ms periodic, in the interrupt
+ *     blue   PD15 - 1 s periodic, deferred to the main loop
+ *     red    PD14 - 5 ms pulse from a one-shot, started by the blue
+ *                   callback and turned off by its own expiry
+ *
+ *   each callback records how late it ran against its deadline in
+ *   late_max[] (microseconds), read it with the debugger along with
+ *   swtimer_stats. projects/tickless_sim runs the same timer service
+ *   on the host and prints a jitter report.
+ *
+ *   the main loop is include/idle.c: deferred callbacks run from its
+ *   poller, then the core sleeps. the TIM5 counter keeps running in
+ *   sleep and measures the time asleep, asleep_x100 is updated every
+ *   10 s (percent times 100), idle_stats.wakes[66] counts the TIM5
+ *   wakeups (TIM5_IRQn + 16).
+ *
+ * setup:
+ *    uses 4 on-board LEDs
+ *    TIM5 on APB1, 84 MHz timer clock, PSC 83 for 1 MHz
+ */
+
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#include "swtimer.h"
+#include "idle.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define LED_GREEN     12
+#define LED_ORANGE    13
+#define LED_RED       14
+#define LED_BLUE      15
+
+/*************************************************
+* function declarations
+*************************************************/
+void TIM5_IRQHandler(void);
+int main(void);
+
+/*************************************************
+* variables
+*************************************************/
+static swtimer_t green, orange, blue, pulse, report;
+
+// worst lateness per LED, microseconds
+volatile uint32_t late_max[4];
+// time asleep over the last 10 s, percent times 100
+volatile uint32_t asleep_x100;
+
+/*************************************************
+* timer 5 interrupt handler
+*************************************************/
+void TIM5_IRQHandler(void)
+{
+	swtimer_irq();
+}
+
+/*************************************************
+* timer callbacks
+*************************************************/
+static void record(swtimer_t *t)
+{
+	uint32_t n = (uint32_t)t->arg - LED_GREEN;
+	uint32_t late = swtimer_now() - t->expired;
+
+	if (late > late_max[n])
+		late_max[n] = late;
+}
+
+static void toggle(swtimer_t *t)
+{
+	record(t);
+	GPIOD->ODR ^= (1U << (uint32_t)t->arg);
+}
+
+static void pulse_off(swtimer_t *t)
+{
+	record(t);
+	// reset the pin through the upper half of BSRR
+	GPIOD->BSRR = (1U << (LED_RED + 16));
+}
+
+static void heartbeat(swtimer_t *t)
+{
+	toggle(t);
+	GPIOD->BSRR = (1U << LED_RED);
+	swtimer_start(&pulse, 5000, 0);
+}
+
+static void sleep_report(swtimer_t *t)
+{
+	(void)t;
+	asleep_x100 = idle_asleep_x100();
+	idle_stats_reset();
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	GPIOD->MODER &= 0x00FFFFFF;   // Reset bits 31-24 to clear old values
+	GPIOD->MODER |= 0x55000000;   // Set LEDs as output
+	GPIOD->ODR = 0x0;
+
+	// enable TIM5 clock, bit 3 on APB1ENR
+	RCC->APB1ENR |= (1 << 3);
+
+	// 84 Mhz / (83 + 1) = 1 Mhz counter
+	swtimer_init(TIM5, 83);
+	NVIC_EnableIRQ(TIM5_IRQn);
+
+	swtimer_setup(&green, toggle, (void *)LED_GREEN, SWTIMER_IRQ);
+	swtimer_setup(&orange, toggle, (void *)LED_ORANGE, SWTIMER_IRQ);
+	swtimer_setup(&blue, heartbeat, (void *)LED_BLUE, SWTIMER_DEFERRED);
+	swtimer_setup(&pulse, pulse_off, (void *)LED_RED, SWTIMER_IRQ);
+	swtimer_setup(&report, sleep_report, 0, SWTIMER_DEFERRED);
+
+	swtimer_start(&green, 500000, 500000);
+	swtimer_start(&orange, 333333, 333333);
+	swtimer_start(&blue, 1000000, 1000000);
+	swtimer_start(&report, 10000000, 10000000);
+
+	// deferred callbacks, then sleep until the next interrupt
+	idle_init(swtimer_now, IDLE_WFI);
+	idle_add_poll(swtimer_poll, swtimer_pending);
+
+	while(1)
+	{
+		idle_once();
+	}
+
+	return 0;
+}
@@ -0,0 +1,565 @@
+/*
+ * tickless_sim.c
+ *
+ * description:
+ *   runs the tickless timer service from projects/tickless on the
+ *   host against a model of a 32-bit timer and prints a jitter report.
+ *
+ *   the timer registers are a TIM_TypeDef in plain memory, the model
+ *   keeps CNT at virtual time / 1 us, sets CC1IF when the counter
+ *   reaches CCR1 or when CC1G is written to EGR, and enters the
+ *   interrupt handler when CC1IE is set and PRIMASK is clear.
+ *   callbacks and main loop work take virtual time, so expiries
+ *   collide, queue behind each other and wait for the main loop the
+ *   way they would on the board. the counter starts 3 s before it
+ *   wraps.
+ *
+ *   scenarios:
+ *     1. heap order: SWTIMER_MAX one-shots with random deadlines, some
+ *        stopped and some moved, have to fire in deadline order
+ *     2. mixed load for 10 s: periodic and one-shot timers in the
+ *        interrupt and deferred, random main loop work that arms and
+ *        stops a timeout it never reaches
+ *
+ *   for every timer the report gives the runs, how late the callback
+ *   ran against its deadline (min, mean, max) and for periodic ones
+ *   the worst deviation of the interval from the period. exits with 1
+ *   if a callback ran early, a periodic timer lost runs, the stopped
+ *   timeout fired or a lateness bound was exceeded.
+ *
+ * usage:
+ *   make run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stm32f4xx.h"
+#include "swtimer.h"
+
+/*************************************************
+* definitions
+*************************************************/
+#define US             1000ULL
+#define MS             1000000ULL
+
+// counter value at virtual time 0
+#define CNT_START      (0xFFFFFFFFU - 3000000U)
+
+// exception entry and swtimer_irq bookkeeping, exit
+#define IRQ_ENTRY_NS   200
+#define IRQ_EXIT_NS    100
+
+#define LOAD_NS        (10000 * MS)
+
+// worst lateness allowed, microseconds
+#define BOUND_IRQ_US       100
+#define BOUND_DEFERRED_US  1200
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		failures++; \
+		printf("  FAIL: " __VA_ARGS__); \
+		printf("\n"); \
+	} \
+} while (0)
+
+typedef struct {
+	const char *name;
+	uint32_t period_us;      // 0 for one-shot
+	uint32_t cost_ns;        // time the callback takes
+	uint8_t flags;
+	uint32_t runs;
+	uint32_t early;          // ran before the deadline
+	int64_t late_min;
+	int64_t late_max;
+	int64_t late_sum;
+	uint64_t last_ns;
+	int64_t jitter_max;      // worst |interval - period|
+	uint32_t hist[5];        // < 1 us, < 10 us, < 100 us, < 1 ms, more
+	swtimer_t t;
+} sim_timer_t;
+
+/*************************************************
+* function declarations
+*************************************************/
+void TIM5_IRQHandler(void);
+
+// processor state, called through the host core_cm4.h
+void     sim_irq_enable(void);
+void     sim_irq_disable(void);
+uint32_t sim_get_primask(void);
+void     sim_set_primask(uint32_t v);
+void     sim_wfi(void);
+void     sim_nvic_enable(int irqn);
+void     sim_nvic_disable(int irqn);
+void     sim_nvic_set_priority(int irqn, uint32_t prio);
+
+/*************************************************
+* variables
+*************************************************/
+static TIM_TypeDef tim;
+static uint64_t now_ns;
+static uint32_t cnt_base;
+static uint32_t primask;
+static int nvic_on;
+static int in_handler;
+static uint64_t wake_ns;       // next main loop event, WFI returns there
+static uint64_t sleep_ns;
+static uint64_t handler_ns;
+static uint32_t wraps;
+static int failures;
+static uint32_t lcg = 12345;
+
+/*************************************************
+* timer and processor model
+*************************************************/
+static uint32_t rnd(uint32_t lo, uint32_t hi)
+{
+	lcg = lcg * 1664525u + 1013904223u;
+	return lo + (uint32_t)(((uint64_t)(lcg >> 8) * (hi - lo + 1)) >> 24);
+}
+
+static void set_time(uint64_t t)
+{
+	uint32_t cnt = cnt_base + (uint32_t)(t / US);
+
+	if (cnt < tim.CNT)
+		wraps++;
+	now_ns = t;
+	tim.CNT = cnt;
+}
+
+// virtual time of the next counter step that equals CCR1
+static uint64_t next_match(void)
+{
+	uint32_t delta = tim.CCR1 - tim.CNT;
+	uint64_t step = (uint64_t)(delta ? delta : 0x100000000ULL);
+
+	return (now_ns / US + step) * US;
+}
+
+// EGR is write only, SR only has CC1IF in this model
+static void sync_regs(void)
+{
+	if (tim.EGR & (1U << 1))
+		tim.SR |= (1U << 1);
+	tim.EGR = 0;
+	tim.SR &= (1U << 1);
+}
+
+static void advance(uint64_t t);
+
+static void take_irqs(void)
+{
+	sync_regs();
+	while (!in_handler && !primask && nvic_on &&
+	       (tim.DIER & (1U << 1)) && (tim.SR & (1U << 1))) {
+		uint64_t t0 = now_ns;
+
+		in_handler = 1;
+		advance(now_ns + IRQ_ENTRY_NS);
+		TIM5_IRQHandler();
+		advance(now_ns + IRQ_EXIT_NS);
+		in_handler = 0;
+		handler_ns += now_ns - t0;
+		sync_regs();
+	}
+}
+
+// run virtual time forward, compare matches set CC1IF on the way and
+// are taken right away unless masked or already in the handler
+static void advance(uint64_t t)
+{
+	while (now_ns < t) {
+		uint64_t m = next_match();
+
+		if (m > t) {
+			set_time(t);
+			break;
+		}
+		set_time(m);
+		tim.SR |= (1U << 1);
+		take_irqs();
+	}
+	take_irqs();
+}
+
+static void spend(uint32_t ns)
+{
+	advance(now_ns + ns);
+}
+
+void sim_irq_enable(void)
+{
+	primask = 0;
+	take_irqs();
+}
+
+void sim_irq_disable(void)
+{
+	primask = 1;
+}
+
+uint32_t sim_get_primask(void)
+{
+	return primask;
+}
+
+void sim_set_primask(uint32_t v)
+{
+	primask = v;
+	if (!v)
+		take_irqs();
+}
+
+// sleep until the compare interrupt or the next main loop event
+void sim_wfi(void)
+{
+	uint64_t t = wake_ns;
+	uint64_t t0 = now_ns;
+
+	sync_regs();
+	if (in_handler) {
+		printf("  FAIL: WFI inside the interrupt handler\n");
+		failures++;
+		return;
+	}
+	if (nvic_on && (tim.DIER & (1U << 1))) {
+		if (tim.SR & (1U << 1))
+			return;
+		if (next_match() < t)
+			t = next_match();
+	}
+	// with PRIMASK set the match only sets the flag, taken on enable
+	advance(t);
+	sleep_ns += now_ns - t0;
+}
+
+void sim_nvic_enable(int irqn)
+{
+	if (irqn == TIM5_IRQn)
+		nvic_on = 1;
+}
+
+void sim_nvic_disable(int irqn)
+{
+	if (irqn == TIM5_IRQn)
+		nvic_on = 0;
+}
+
+void sim_nvic_set_priority(int irqn, uint32_t prio)
+{
+	(void)irqn;
+	(void)prio;
+}
+
+void TIM5_IRQHandler(void)
+{
+	swtimer_irq();
+}
+
+static void board_init(void)
+{
+	now_ns = 0;
+	swtimer_init(&tim, 83);
+	// the counter was cleared by init, move it close to the wrap
+	cnt_base = CNT_START;
+	tim.CNT = CNT_START;
+	sim_nvic_enable(TIM5_IRQn);
+}
+
+/*************************************************
+* lateness
+*************************************************/
+// virtual time of a counter value, within the 71 min after time 0
+static uint64_t counter_ns(uint32_t cnt)
+{
+	return (uint64_t)(cnt - cnt_base) * US;
+}
+
+static void record(sim_timer_t *s)
+{
+	int64_t late = (int64_t)(now_ns - counter_ns(s->t.expired));
+	int b;
+
+	if (late < 0)
+		s->early++;
+	if (s->runs == 0 || late < s->late_min)
+		s->late_min = late;
+	if (s->runs == 0 || late > s->late_max)
+		s->late_max = late;
+	s->late_sum += late;
+
+	if (s->period_us && s->runs > 0) {
+		int64_t d = (int64_t)(now_ns - s->last_ns) - (int64_t)s->period_us * (int64_t)US;
+		if (d < 0)
+			d = -d;
+		if (d > s->jitter_max)
+			s->jitter_max = d;
+	}
+	s->last_ns = now_ns;
+	s->runs++;
+
+	b = (late < 1000) ? 0 : (late < 10000) ? 1 : (late < 100000) ? 2 : (late < 1000000) ? 3 : 4;
+	s->hist[b]++;
+}
+
+static void sim_timer_setup(sim_timer_t *s, const char *name, uint32_t period_us,
+                            uint32_t cost_ns, uint8_t flags, swtimer_fn_t fn)
+{
+	s->name = name;
+	s->period_us = period_us;
+	s->cost_ns = cost_ns;
+	s->flags = flags;
+	swtimer_setup(&s->t, fn, s, flags);
+}
+
+/*************************************************
+* scenario 1: heap order
+*************************************************/
+static sim_timer_t order[SWTIMER_MAX + 1];
+static uint32_t order_last;
+static uint32_t order_runs;
+
+static void order_cb(swtimer_t *t)
+{
+	sim_timer_t *s = t->arg;
+
+	record(s);
+	CHECK(order_runs == 0 || !((int32_t)(t->expired - order_last) < 0),
+	      "%s ran after a later deadline", s->name);
+	order_last = t->expired;
+	order_runs++;
+	spend(s->cost_ns);
+}
+
+static void test_order(void)
+{
+	static const char *names[SWTIMER_MAX + 1] = {
+		"o0", "o1", "o2", "o3", "o4", "o5", "o6", "o7", "o8",
+		"o9", "o10", "o11", "o12", "o13", "o14", "o15", "o16"
+	};
+	uint32_t i, stopped = 0;
+
+	printf("heap order, %d one-shots\n", SWTIMER_MAX);
+
+	for (i = 0; i <= SWTIMER_MAX; i++) {
+		sim_timer_setup(&order[i], names[i], 0, 3000, SWTIMER_IRQ, order_cb);
+		// some share a deadline, some are only a few us apart
+		if (i < SWTIMER_MAX)
+			CHECK(swtimer_start(&order[i].t, rnd(1, 40) * 1000 + rnd(0, 3), 0),
+			      "start %u refused", i);
+	}
+	CHECK(!swtimer_start(&order[SWTIMER_MAX].t, 1000, 0), "start with a full heap accepted");
+	CHECK(swtimer_stats.max_armed == SWTIMER_MAX, "high water %u", swtimer_stats.max_armed);
+
+	// stop every fourth, move every third to a new deadline
+	for (i = 0; i < SWTIMER_MAX; i++) {
+		if (i % 4 == 1) {
+			swtimer_stop(&order[i].t);
+			stopped++;
+		} else if (i % 3 == 0) {
+			swtimer_start(&order[i].t, rnd(0, 45000), 0);
+		}
+	}
+
+	wake_ns = now_ns + 50 * MS;
+	while (now_ns < wake_ns) {
+		__disable_irq();
+		sim_wfi();
+		__enable_irq();
+	}
+
+	CHECK(order_runs == SWTIMER_MAX - stopped, "%u runs, expected %u",
+	      order_runs, SWTIMER_MAX - stopped);
+	for (i = 0; i < SWTIMER_MAX; i++) {
+		CHECK(order[i].runs == ((i % 4 == 1) ? 0U : 1U), "%s ran %u times",
+		      order[i].name, order[i].runs);
+		CHECK(order[i].early == 0, "%s ran early", order[i].name);
+		CHECK(!swtimer_armed(&order[i].t), "%s still armed", order[i].name);
+	}
+}
+
+/*************************************************
+* scenario 2: mixed load
+*************************************************/
+enum { T_1MS, T_3MS3, T_20MS, T_RANDOM, T_10MS_DEF, T_7MS_DEF, T_KICK, T_TIMEOUT, NLOAD };
+
+static sim_timer_t load[NLOAD];
+static uint32_t jobs;
+
+static void periodic_cb(swtimer_t *t)
+{
+	sim_timer_t *s = t->arg;
+
+	record(s);
+	spend(s->cost_ns);
+}
+
+// restarts itself with 0 .. 5 ms, short delays go through the forced
+//   compare event
+static void random_cb(swtimer_t *t)
+{
+	sim_timer_t *s = t->arg;
+
+	record(s);
+	spend(s->cost_ns);
+	swtimer_start(t, (rnd(0, 7) == 0) ? rnd(0, 2) : rnd(20, 5000), 0);
+}
+
+static void again_cb(swtimer_t *t)
+{
+	sim_timer_t *s = t->arg;
+
+	record(s);
+	spend(s->cost_ns);
+	swtimer_start(t, 7000, 0);
+}
+
+static void kick_cb(swtimer_t *t)
+{
+	sim_timer_t *s = t->arg;
+
+	record(s);
+	spend(s->cost_ns);
+}
+
+static void timeout_cb(swtimer_t *t)
+{
+	record(t->arg);
+}
+
+// main loop work, hands something to the interrupt right away and
+//   runs with a timeout it always beats
+static void run_job(void)
+{
+	// the deadline is the counter value now, the compare event has to
+	//   be raised by hand
+	swtimer_start(&load[T_KICK].t, 0, 0);
+	swtimer_start(&load[T_TIMEOUT].t, 2000, 0);
+	spend(rnd(20, 900) * (uint32_t)US);
+	swtimer_stop(&load[T_TIMEOUT].t);
+	jobs++;
+	wake_ns = now_ns + rnd(100, 3000) * US;
+}
+
+static void print_report(void)
+{
+	uint32_t i;
+
+	printf("  %-22s %6s %8s %8s %8s %9s %7s  %s\n", "timer", "runs",
+	       "late min", "mean", "max", "period", "missed", "late <1us <10us <100us <1ms more");
+	for (i = 0; i < NLOAD; i++) {
+		sim_timer_t *s = &load[i];
+		double mean = s->runs ? (double)s->late_sum / s->runs / 1000 : 0;
+
+		printf("  %-22s %6u %8.3f %8.3f %8.3f ", s->name, s->runs,
+		       (double)s->late_min / 1000, mean, (double)s->late_max / 1000);
+		if (s->period_us)
+			printf("%9.3f ", (double)s->jitter_max / 1000);
+		else
+			printf("%9s ", "-");
+		printf("%7u  %9u %5u %6u %5u %4u\n", s->t.missed, s->hist[0], s->hist[1],
+		       s->hist[2], s->hist[3], s->hist[4]);
+	}
+	printf("  (microseconds, period column is the worst |interval - period|)\n");
+}
+
+static void test_load(void)
+{
+	uint64_t t0 = now_ns;
+	uint32_t irqs0 = swtimer_stats.irqs;
+	uint64_t sleep0 = sleep_ns, handler0 = handler_ns;
+	uint32_t i, irqs;
+
+	printf("mixed load, %llu s\n", (unsigned long long)(LOAD_NS / (1000 * MS)));
+
+	sim_timer_setup(&load[T_1MS], "1 ms, irq", 1000, 3000, SWTIMER_IRQ, periodic_cb);
+	sim_timer_setup(&load[T_3MS3], "3.3 ms, irq", 3300, 15000, SWTIMER_IRQ, periodic_cb);
+	sim_timer_setup(&load[T_20MS], "20 ms, irq", 20000, 40000, SWTIMER_IRQ, periodic_cb);
+	sim_timer_setup(&load[T_RANDOM], "random one-shot, irq", 0, 2000, SWTIMER_IRQ, random_cb);
+	sim_timer_setup(&load[T_10MS_DEF], "10 ms, deferred", 10000, 200000, SWTIMER_DEFERRED, periodic_cb);
+	sim_timer_setup(&load[T_7MS_DEF], "7 ms one-shot, deferred", 0, 30000, SWTIMER_DEFERRED, again_cb);
+	sim_timer_setup(&load[T_KICK], "0 us one-shot, irq", 0, 1000, SWTIMER_IRQ, kick_cb);
+	sim_timer_setup(&load[T_TIMEOUT], "job timeout 2 ms", 0, 0, SWTIMER_IRQ, timeout_cb);
+
+	swtimer_start(&load[T_1MS].t, 1000, 1000);
+	swtimer_start(&load[T_3MS3].t, 3300, 3300);
+	swtimer_start(&load[T_20MS].t, 20000, 20000);
+	swtimer_start(&load[T_RANDOM].t, 500, 0);
+	swtimer_start(&load[T_10MS_DEF].t, 10000, 10000);
+	swtimer_start(&load[T_7MS_DEF].t, 7000, 0);
+	wake_ns = now_ns + 1 * MS;
+
+	// what idle_once() does in projects/tickless: deferred work, then sleep
+	while (now_ns - t0 < LOAD_NS) {
+		swtimer_poll();
+
+		if (now_ns >= wake_ns) {
+			run_job();
+			continue;
+		}
+
+		__disable_irq();
+		if (!swtimer_pending())
+			__WFI();
+		__enable_irq();
+	}
+
+	// deferred runs of the last deadline
+	swtimer_poll();
+	for (i = 0; i < NLOAD; i++)
+		swtimer_stop(&load[i].t);
+
+	print_report();
+
+	irqs = swtimer_stats.irqs - irqs0;
+	printf("  %u timer interrupts, %u main loop jobs, sleeping %.1f %%, in the handler %.2f %%\n",
+	       irqs, jobs, 100.0 * (double)(sleep_ns - sleep0) / LOAD_NS,
+	       100.0 * (double)(handler_ns - handler0) / LOAD_NS);
+	printf("  a 1 ms tick takes %llu interrupts for 1 ms resolution, a 1 us tick %llu\n",
+	       (unsigned long long)(LOAD_NS / MS), (unsigned long long)(LOAD_NS / US));
+
+	for (i = 0; i < NLOAD; i++) {
+		sim_timer_t *s = &load[i];
+		int64_t bound = (int64_t)((s->flags & SWTIMER_DEFERRED) ? BOUND_DEFERRED_US : BOUND_IRQ_US) * 1000;
+
+		CHECK(s->early == 0, "%s ran early %u times", s->name, s->early);
+		CHECK(s->late_max <= bound, "%s %.3f us late, bound %.0f us", s->name,
+		      (double)s->late_max / 1000, (double)bound / 1000);
+		if (s->period_us) {
+			uint32_t expected = (uint32_t)(LOAD_NS / (s->period_us * US));
+			CHECK(s->runs == expected, "%s ran %u times, expected %u", s->name, s->runs, expected);
+			CHECK(s->t.missed == 0, "%s missed %u", s->name, s->t.missed);
+		}
+	}
+	CHECK(load[T_TIMEOUT].runs == 0, "stopped timeout fired %u times", load[T_TIMEOUT].runs);
+	CHECK(load[T_RANDOM].runs > 1000, "random one-shot only ran %u times", load[T_RANDOM].runs);
+	CHECK(load[T_KICK].runs == jobs, "0 us one-shot ran %u times for %u jobs", load[T_KICK].runs, jobs);
+	CHECK(swtimer_stats.forced > 0, "deadline already passed was never hit");
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+int main(void)
+{
+	board_init();
+
+	test_order();
+	test_load();
+
+	printf("simulated %.3f s, counter wrapped %u times, %u interrupts, %u CCR1 writes, %u forced, %u deferred\n",
+	       (double)now_ns / 1e9, wraps, swtimer_stats.irqs, swtimer_stats.compares,
+	       swtimer_stats.forced, swtimer_stats.deferred);
+
+	CHECK(wraps > 0, "counter never wrapped");
+
+	if (failures) {
+		printf("FAILED: %d checks\n", failures);
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
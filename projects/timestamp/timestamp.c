@@ -0,0 +1,333 @@
+/*
+ * timestamp.c
+ *
+ * description:
+ *   checks and measures the 64-bit clock and delays of
+ *   include/timebase.c:
+ *     - now_us() against a plain 64-bit division, edge values and
+ *       random ones over the whole range
+ *     - now_cycles() never goes back while an interrupt reads the
+ *       clock at 10 kHz in parallel, over more than a full wrap of
+ *       the 32-bit counter (30 s on the board, 5 s on the host)
+ *     - cost of now_cycles() and now_us()
+ *     - delay_us() for 1 us .. 10 ms, shortest and longest of a few
+ *       runs against the requested time
+ *
+ *   the same file builds for the board and for the host:
+ *     make          - target, DWT cycle counter, SysTick as the reader
+ *                     in interrupt context
+ *     make HOST=1   - host, CLOCK_MONOTONIC, a SIGALRM handler as the
+ *                     interrupt
+ *     make run HOST=1 RUN_ARGS=10   (seconds for the wrap test)
+ *
+ *   on target the results are left in results[] for the debugger,
+ *   blue LED (PD15) blinks with delay_ms while the wrap test runs,
+ *   then green LED (PD12) when all checks pass, red LED (PD14)
+ *   otherwise.
+ */
+
+#include <stdint.h>
+#include "timebase.h"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/time.h>
+#else
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#endif
+
+/*************************************************
+* definitions
+*************************************************/
+#define CORE_HZ        168000000
+#define NRESULTS       12
+#define CONV_POINTS    100000
+#define CALLS          1000
+#define DELAY_REPEAT   8
+
+#ifdef HOST_BUILD
+#define WRAP_SECONDS   5
+// scheduling and frequency changes on the host, delays are only shown
+#define BOUND_DELAY    0
+#else
+#define WRAP_SECONDS   30
+// cycles the best run of a delay may be off
+#define BOUND_DELAY    8
+#endif
+
+typedef struct {
+	const char *name;
+	uint32_t value;        // cycles, or errors for the checks
+	uint32_t worst;        // longest run for delays, reads for the irq
+	uint32_t bound;        // 0 if not checked
+	uint32_t ok;
+} bench_result_t;
+
+#ifndef HOST_BUILD
+void SysTick_Handler(void);
+int main(void);
+#endif
+
+/*************************************************
+* variables
+*************************************************/
+volatile bench_result_t results[NRESULTS];
+static uint32_t nresults;
+
+// reads from interrupt context
+static volatile uint64_t isr_last;
+static volatile uint32_t isr_reads;
+static volatile uint32_t isr_back;
+
+/*************************************************
+* interrupt side reader
+*************************************************/
+static void isr_read(void)
+{
+	uint64_t t = now_cycles();
+
+	if (t < isr_last)
+		isr_back++;
+	isr_last = t;
+	isr_reads++;
+}
+
+#ifdef HOST_BUILD
+static void on_alarm(int sig)
+{
+	(void)sig;
+	isr_read();
+}
+
+static void reader_start(void)
+{
+	struct itimerval it = { { 0, 100 }, { 0, 100 } };
+
+	signal(SIGALRM, on_alarm);
+	setitimer(ITIMER_REAL, &it, 0);
+}
+
+static void reader_stop(void)
+{
+	struct itimerval it = { { 0, 0 }, { 0, 0 } };
+
+	setitimer(ITIMER_REAL, &it, 0);
+}
+#else
+void SysTick_Handler(void)
+{
+	isr_read();
+}
+
+// 10 kHz on the core clock
+static void reader_start(void)
+{
+	SysTick->CTRL = 0;
+	SysTick->LOAD = CORE_HZ / 10000 - 1;
+	SysTick->VAL = 0;
+	// processor clock (bit 2), interrupt (bit 1), enable (bit 0)
+	SysTick->CTRL = (1 << 2) | (1 << 1) | (1 << 0);
+}
+
+static void reader_stop(void)
+{
+	SysTick->CTRL = 0;
+}
+#endif
+
+/*************************************************
+* checks
+*************************************************/
+static void result(const char *name, uint32_t value, uint32_t worst, uint32_t bound, uint32_t ok)
+{
+	volatile bench_result_t *r = &results[nresults++];
+
+	r->name = name;
+	r->value = value;
+	r->worst = worst;
+	r->bound = bound;
+	r->ok = ok;
+}
+
+// reciprocal conversion against the libgcc division
+static void check_convert(void)
+{
+	static const uint64_t edges[] = {
+		0, 1, 167, 168, 169, 999, 1000, 1001, 0x7FFFFFFF, 0x80000000,
+		0xFFFFFFFF, 0x100000000ULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFF00ULL
+	};
+	uint32_t per_us = timebase_cycles_per_us();
+	uint64_t x = 0x123456789ABCDEFULL;
+	uint32_t i, bad = 0;
+
+	for (i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+		bad += (timebase_cycles_to_us(edges[i]) != edges[i] / per_us);
+		bad += (timebase_cycles_to_us(edges[i] * per_us) != edges[i] * per_us / per_us);
+	}
+	for (i = 0; i < CONV_POINTS; i++) {
+		// xorshift, every bit length shows up
+		uint64_t v;
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		v = x >> (i % 64);
+		bad += (timebase_cycles_to_us(v) != v / per_us);
+	}
+	result("now_us conversion errors", bad, 0, 0, bad == 0);
+}
+
+// main loop and interrupt read the clock until the counter wrapped
+static void check_wrap(uint32_t seconds)
+{
+	uint64_t start = now_cycles();
+	uint64_t end = start + (uint64_t)seconds * 1000000 * timebase_cycles_per_us();
+	uint64_t last = start, t;
+	uint32_t back = 0, us_back = 0;
+	uint64_t last_us = now_us();
+
+	reader_start();
+	do {
+		uint64_t u = now_us();
+		t = now_cycles();
+		if (t < last)
+			back++;
+		if (u < last_us)
+			us_back++;
+		last = t;
+		last_us = u;
+#ifndef HOST_BUILD
+		// something to look at while it runs
+		GPIOD->ODR ^= (1 << 15);
+		delay_ms(250);
+#endif
+	} while (t < end);
+	reader_stop();
+
+	result("now_cycles went back", back, 0, 0, back == 0);
+	result("now_us went back", us_back, 0, 0, us_back == 0);
+	result("now_cycles went back, irq", isr_back, isr_reads, 0,
+	       isr_back == 0 && isr_reads > 0);
+	// 2^32 cycles passed, the extension had to carry
+	result("wrapped, half periods", (uint32_t)((t >> 31) - (start >> 31)), 0, 0,
+	       (t - start) > 0xFFFFFFFFULL);
+}
+
+static void check_cost(void)
+{
+	volatile uint64_t sink;
+	uint64_t t0, t1;
+	uint32_t i;
+
+	t0 = now_cycles();
+	for (i = 0; i < CALLS; i++)
+		sink = now_cycles();
+	t1 = now_cycles();
+	result("now_cycles, cycles per call", (uint32_t)((t1 - t0) / CALLS), 0, 0, 1);
+
+	t0 = now_cycles();
+	for (i = 0; i < CALLS; i++)
+		sink = now_us();
+	t1 = now_cycles();
+	result("now_us, cycles per call", (uint32_t)((t1 - t0) / CALLS), 0, 0, 1);
+	(void)sink;
+}
+
+// error of the best run, the longest run, both in cycles over the request
+static void check_delays(void)
+{
+	static const uint32_t us[] = { 1, 10, 100, 1000, 10000 };
+	static const char *names[] = {
+		"delay_us(1)", "delay_us(10)", "delay_us(100)", "delay_us(1000)", "delay_us(10000)"
+	};
+	uint32_t per_us = timebase_cycles_per_us();
+	uint32_t i, r;
+
+	for (i = 0; i < sizeof(us) / sizeof(us[0]); i++) {
+		uint32_t want = us[i] * per_us;
+		uint32_t best = 0xFFFFFFFF, worst = 0;
+		int32_t err;
+
+		for (r = 0; r < DELAY_REPEAT; r++) {
+			uint64_t t0 = now_cycles();
+			delay_us(us[i]);
+			uint32_t took = (uint32_t)(now_cycles() - t0);
+			if (took < best)
+				best = took;
+			if (took > worst)
+				worst = took;
+		}
+		// signed error as the value, bits of a negative one are kept
+		err = (int32_t)(best - want);
+		result(names[i], best - want, worst - want, BOUND_DELAY,
+		       BOUND_DELAY == 0 || (err >= -BOUND_DELAY && err <= BOUND_DELAY));
+	}
+}
+
+static void run(uint32_t seconds)
+{
+	timebase_init(CORE_HZ);
+
+	check_convert();
+	check_cost();
+	check_delays();
+	check_wrap(seconds);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+#ifdef HOST_BUILD
+int main(int argc, char **argv)
+{
+	uint32_t seconds = (argc > 1) ? (uint32_t)atoi(argv[1]) : WRAP_SECONDS;
+	uint32_t i, fail = 0;
+
+	printf("timebase, wrap test for %u s\n", seconds);
+	run(seconds);
+
+	printf("%-30s %10s %10s %6s\n", "check", "value", "worst", "bound");
+	for (i = 0; i < nresults; i++) {
+		printf("%-30s %10d %10d ", results[i].name, (int32_t)results[i].value, (int32_t)results[i].worst);
+		if (results[i].bound)
+			printf("%6u ", results[i].bound);
+		else
+			printf("%6s ", "-");
+		printf("%s\n", results[i].ok ? "ok" : "FAILED");
+		fail |= !results[i].ok;
+	}
+	printf("(ns on the host, delays: over the request in the best and the longest run)\n");
+	printf("delay overhead taken off: %u\n", timebase_overhead());
+	return fail ? 1 : 0;
+}
+#else
+int main(void)
+{
+	uint32_t i, ok = 1;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	// PD12, PD14 and PD15 as outputs
+	GPIOD->MODER &= 0x0CFFFFFF;
+	GPIOD->MODER |= 0x51000000;
+	GPIOD->ODR = 0;
+
+	run(WRAP_SECONDS);
+
+	for (i = 0; i < nresults; i++)
+		ok &= results[i].ok;
+
+	// green when everything passed, red otherwise
+	GPIOD->ODR = ok ? (1 << 12) : (1 << 14);
+
+	while(1);
+
+	return 0;
+}
+#endif
@@ -0,0 +1,308 @@
+/*
+ * trig_bench.c
+ *
+ * description:
+ *   cycles per call and worst error of the sine/cosine kernels in
+ *   include/fast_trig.c next to newlib sin() and sinf(). the error is
+ *   taken against double precision sin() and cos() over -8 pi .. 8 pi
+ *   for the float kernels and over the whole Q31 range for the cordic.
+ *
+ *   the same file builds for the board and for the host:
+ *     make          - target, FPU, DWT cycle counter
+ *     make HOST=1   - host, TSC
+ *     make run HOST=1
+ *
+ *   on target the results are left in results[] for the debugger,
+ *   green LED (PD12) when every kernel is within the error documented
+ *   in fast_trig.h, red LED (PD14) otherwise.
+ *   a 10 kHz control loop at 168 MHz has 16800 cycles per step.
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "fast_trig.h"
+#include "cyccnt.h"
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#else
+#include "stm32f4xx.h"
+#include "system_stm32f4xx.h"
+#include "vectors.h"
+#endif
+
+/*************************************************
+* definitions
+*************************************************/
+#define BENCH_CALLS   256
+#define NRESULTS      6
+
+#ifdef HOST_BUILD
+#define BENCH_REPEAT  2000
+#define ERR_POINTS    200000
+#else
+#define BENCH_REPEAT  4
+#define ERR_POINTS    4096
+#endif
+
+// error bounds documented in fast_trig.h
+#define BOUND_LUT     7.6e-5
+#define BOUND_POLY    1.2e-7
+#define BOUND_Q31     2.0e-8
+
+typedef struct {
+	const char *name;
+	uint32_t cycles_x100;  // per call, times 100
+	float max_err;         // against double sin/cos
+	float bound;           // documented, 0 if not checked
+	uint32_t ok;
+} bench_result_t;
+
+#ifndef HOST_BUILD
+int main(void);
+#endif
+
+/*************************************************
+* variables
+*************************************************/
+static float angle[BENCH_CALLS];
+static q31_t angle_q31[BENCH_CALLS];
+static volatile float out[BENCH_CALLS];
+static volatile q31_t out_q31[BENCH_CALLS];
+
+volatile bench_result_t results[NRESULTS];
+
+/*************************************************
+* benchmarks
+*************************************************/
+// angles spread over -2 pi .. 2 pi, same ones for every kernel
+static void make_input(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < BENCH_CALLS; i++) {
+		angle[i] = -TRIG_2PI + (2.0f * TRIG_2PI * (float)i) / BENCH_CALLS;
+		angle_q31[i] = (q31_t)(i * (0xFFFFFFFFu / BENCH_CALLS));
+	}
+}
+
+static uint32_t bench_libm_sin(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+
+	for (i = 0; i < BENCH_CALLS; i++)
+		out[i] = (float)sin((double)angle[i]);
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_libm_sinf(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+
+	for (i = 0; i < BENCH_CALLS; i++)
+		out[i] = sinf(angle[i]);
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_lut(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+
+	for (i = 0; i < BENCH_CALLS; i++)
+		out[i] = trig_sin_lut(angle[i]);
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_poly(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+
+	for (i = 0; i < BENCH_CALLS; i++)
+		out[i] = trig_sin_poly(angle[i]);
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_sincos_poly(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+	float s, c;
+
+	for (i = 0; i < BENCH_CALLS; i++) {
+		trig_sincos_poly(angle[i], &s, &c);
+		out[i] = s + c;
+	}
+	return cyccnt_read() - t0;
+}
+
+static uint32_t bench_q31(void)
+{
+	uint32_t t0 = cyccnt_read();
+	uint32_t i;
+	q31_t s, c;
+
+	for (i = 0; i < BENCH_CALLS; i++) {
+		trig_sincos_q31(angle_q31[i], &s, &c);
+		out_q31[i] = s ^ c;
+	}
+	return cyccnt_read() - t0;
+}
+
+// best of BENCH_REPEAT runs, per call, times 100
+static uint32_t best(uint32_t (*fn)(void))
+{
+	uint32_t min = 0xFFFFFFFF;
+	uint32_t r;
+
+	for (r = 0; r < BENCH_REPEAT; r++) {
+		uint32_t c = fn();
+		if (c < min)
+			min = c;
+	}
+	return (uint32_t)(((uint64_t)min * 100) / BENCH_CALLS);
+}
+
+/*************************************************
+* errors against double precision
+*************************************************/
+// the target build has -fsingle-precision-constant, a double M_PI
+//   would turn into a float one
+static double pi_d(void)
+{
+	return 4 * atan(1.0);
+}
+
+static double worse(double e, double v, double ref)
+{
+	double d = fabs(v - ref);
+	return (d > e) ? d : e;
+}
+
+// kind: 0 libm sinf, 1 table, 2 polynomial, both sin and cos
+static double err_float(int kind)
+{
+	double e = 0;
+	double pi = pi_d();
+	int32_t i;
+
+	for (i = 0; i < ERR_POINTS; i++) {
+		float x = (float)(-8 * pi + (16 * pi * (double)i) / ERR_POINTS);
+		float s, c;
+
+		if (kind == 0) {
+			s = sinf(x);
+			c = cosf(x);
+		} else if (kind == 1) {
+			s = trig_sin_lut(x);
+			c = trig_cos_lut(x);
+		} else {
+			trig_sincos_poly(x, &s, &c);
+			e = worse(e, trig_sin_poly(x), sin((double)x));
+			e = worse(e, trig_cos_poly(x), cos((double)x));
+		}
+		e = worse(e, s, sin((double)x));
+		e = worse(e, c, cos((double)x));
+	}
+	return e;
+}
+
+static double err_q31(void)
+{
+	double e = 0;
+	double pi = pi_d();
+	int32_t i;
+
+	for (i = 0; i < ERR_POINTS; i++) {
+		q31_t a = (q31_t)((uint32_t)i * (0xFFFFFFFFu / ERR_POINTS) + 12345u);
+		double x = (double)a * (pi / 2147483648.0);
+		q31_t s, c;
+
+		trig_sincos_q31(a, &s, &c);
+		e = worse(e, (double)s / 2147483648.0, sin(x));
+		e = worse(e, (double)c / 2147483648.0, cos(x));
+	}
+	return e;
+}
+
+static void result(uint32_t n, const char *name, uint32_t (*fn)(void), double err, double bound)
+{
+	results[n].name = name;
+	results[n].cycles_x100 = best(fn);
+	results[n].max_err = (float)err;
+	results[n].bound = (float)bound;
+	results[n].ok = (bound == 0 || err <= bound);
+}
+
+static void run(void)
+{
+	double e;
+
+	make_input();
+
+	result(0, "libm sin (double)", bench_libm_sin, 0, 0);
+	result(1, "libm sinf", bench_libm_sinf, err_float(0), 0);
+	result(2, "table + interpolation", bench_lut, err_float(1), BOUND_LUT);
+	e = err_float(2);
+	result(3, "polynomial sin", bench_poly, e, BOUND_POLY);
+	result(4, "polynomial sincos", bench_sincos_poly, e, BOUND_POLY);
+	result(5, "cordic q31 sincos", bench_q31, err_q31(), BOUND_Q31);
+}
+
+/*************************************************
+* main code starts from here
+*************************************************/
+#ifdef HOST_BUILD
+int main(void)
+{
+	uint32_t i, fail = 0;
+
+	cyccnt_init();
+	run();
+
+	printf("%-24s %10s  %-9s  %s\n", "kernel", CYCCNT_UNIT, "max error", "bound");
+	for (i = 0; i < NRESULTS; i++) {
+		printf("%-24s %7u.%02u  %9.3g  ", results[i].name,
+		       results[i].cycles_x100 / 100, results[i].cycles_x100 % 100,
+		       (double)results[i].max_err);
+		if (results[i].bound == 0)
+			printf("-\n");
+		else
+			printf("%.3g %s\n", (double)results[i].bound, results[i].ok ? "ok" : "EXCEEDED");
+		fail |= !results[i].ok;
+	}
+	printf("(%s per call, best of %u runs)\n", CYCCNT_UNIT, BENCH_REPEAT);
+	return fail ? 1 : 0;
+}
+#else
+int main(void)
+{
+	uint32_t i, ok = 1;
+
+	/* set system clock to 168 Mhz */
+	set_sysclk_to_168();
+
+	// enable GPIOD clock, bit 3 on AHB1ENR
+	RCC->AHB1ENR |= (1 << 3);
+	// PD12 and PD14 as outputs
+	GPIOD->MODER &= 0xCCFFFFFF;
+	GPIOD->MODER |= 0x11000000;
+	GPIOD->ODR = 0;
+
+	cyccnt_init();
+	run();
+
+	for (i = 0; i < NRESULTS; i++)
+		ok &= results[i].ok;
+
+	// green when within the documented errors, red otherwise
+	GPIOD->ODR = ok ? (1 << 12) : (1 << 14);
+
+	while(1);
+
+	return 0;
+}
+#endif
@@ -202,7 +202,7 @@ int main(void)
 
 	const uint8_t brand[] = "AB1AW> furkan.space\n\r";
 	uint32_t i1;
-	int i2;
+	volatile int i2;
 	while(1)
 	{
 		for (i1=0; i1<sizeof(brand); i1++){